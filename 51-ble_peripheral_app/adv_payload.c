@@ -0,0 +1,203 @@
+#include <string.h>
+
+#include "app_timer.h"
+
+#include "adv_payload.h"
+
+/* RAM copies of the payloads. The SoftDevice reads the advertising data from these buffers
+ * for as long as the advertising set is configured with them, so they must stay valid.
+ * Updates while advertising must be given in a different buffer than the one in use,
+ * so there are two of each and they alternate.
+ */
+static uint8_t m_adv_data[2][ADV_PAYLOAD_MAX_SIZE];
+static uint8_t m_sr_data[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+static uint8_t m_buf_idx = 0;
+
+static uint16_t m_adv_len = 0;
+static uint16_t m_sr_len = 0;
+
+static ble_advertising_t *mp_advertising = NULL;
+static bool m_suspended = false;
+
+/* Beacon field, live updated at most once per update interval */
+APP_TIMER_DEF(m_beacon_timer);
+
+static uint8_t  m_beacon_pending[ADV_PAYLOAD_MAX_SIZE];
+static uint16_t m_beacon_offset = 0;
+static uint16_t m_beacon_len = 0;
+static uint32_t m_beacon_interval = 0;
+static uint32_t m_beacon_last_commit = 0;
+static bool     m_beacon_timer_running = false;
+static bool     m_beacon_timer_created = false;
+
+static void adv_data_set(uint8_t idx)
+{
+  mp_advertising->adv_data.adv_data.p_data = m_adv_data[idx];
+  mp_advertising->adv_data.adv_data.len = m_adv_len;
+
+  if(m_sr_len > 0)
+  {
+    mp_advertising->adv_data.scan_rsp_data.p_data = m_sr_data[idx];
+    mp_advertising->adv_data.scan_rsp_data.len = m_sr_len;
+  }
+  else
+  {
+    mp_advertising->adv_data.scan_rsp_data.p_data = NULL;
+    mp_advertising->adv_data.scan_rsp_data.len = 0;
+  }
+}
+
+/* Copy the current payloads into the other buffers, apply the beacon field and hand them over */
+static ret_code_t beacon_commit(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  uint8_t next = m_buf_idx ^ 1;
+
+  memcpy(m_adv_data[next], m_adv_data[m_buf_idx], m_adv_len);
+  memcpy(&m_adv_data[next][m_beacon_offset], m_beacon_pending, m_beacon_len);
+  memcpy(m_sr_data[next], m_sr_data[m_buf_idx], m_sr_len);
+
+  adv_data_set(next);
+  m_buf_idx = next;
+  m_beacon_last_commit = app_timer_cnt_get();
+
+  if(m_suspended)
+  {
+    /* Picked up by the next ble_advertising_start() or by the switch to fast advertising,
+     * both configure the set from adv_data. Also used through directed advertising, which
+     * carries no payload: the SoftDevice rejects a data update for it.
+     */
+    return NRF_SUCCESS;
+  }
+
+  /* Data only update, valid both while advertising and while stopped */
+  err_code = sd_ble_gap_adv_set_configure(&mp_advertising->adv_handle, &mp_advertising->adv_data, NULL);
+
+  return err_code;
+}
+
+static void beacon_timeout_handler(void *p_context)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  m_beacon_timer_running = false;
+
+  err_code = beacon_commit();
+  APP_ERROR_CHECK(err_code);
+}
+
+ret_code_t adv_payload_init(ble_advertising_t *p_advertising,
+                            uint8_t const *p_adv_data, uint16_t adv_len,
+                            uint8_t const *p_sr_data, uint16_t sr_len)
+{
+  if((p_advertising == NULL) || (p_adv_data == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((adv_len > sizeof(m_adv_data[0])) || (sr_len > sizeof(m_sr_data[0])))
+  {
+    return NRF_ERROR_DATA_SIZE;
+  }
+
+  mp_advertising = p_advertising;
+  m_buf_idx = 0;
+
+  memcpy(m_adv_data[m_buf_idx], p_adv_data, adv_len);
+  m_adv_len = adv_len;
+
+  m_sr_len = 0;
+  if((p_sr_data != NULL) && (sr_len > 0))
+  {
+    memcpy(m_sr_data[m_buf_idx], p_sr_data, sr_len);
+    m_sr_len = sr_len;
+  }
+
+  /* ble_advertising_start() configures the set from adv_data, so pointing it at our
+   * buffers replaces the payload ble_advdata_encode() would otherwise build at runtime.
+   */
+  adv_data_set(m_buf_idx);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t adv_payload_patch(uint16_t offset, uint8_t const *p_data, uint16_t len)
+{
+  if(p_data == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((offset + len) > m_adv_len)
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  memcpy(&m_adv_data[m_buf_idx][offset], p_data, len);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t adv_payload_beacon_init(uint16_t offset, uint16_t len, uint32_t update_interval)
+{
+  if((offset + len) > m_adv_len)
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  m_beacon_offset = offset;
+  m_beacon_len = len;
+  m_beacon_interval = MAX(update_interval, APP_TIMER_MIN_TIMEOUT_TICKS);
+  m_beacon_last_commit = app_timer_cnt_get();
+
+  memcpy(m_beacon_pending, &m_adv_data[m_buf_idx][offset], len);
+
+  /* Called again when the payload layout is switched at runtime */
+  if(m_beacon_timer_created)
+  {
+    return NRF_SUCCESS;
+  }
+
+  m_beacon_timer_created = true;
+
+  return app_timer_create(&m_beacon_timer, APP_TIMER_MODE_SINGLE_SHOT, beacon_timeout_handler);
+}
+
+ret_code_t adv_payload_beacon_set(uint8_t const *p_data)
+{
+  uint32_t elapsed = 0;
+
+  if(p_data == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(m_beacon_len == 0)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  memcpy(m_beacon_pending, p_data, m_beacon_len);
+
+  if(m_beacon_timer_running)
+  {
+    /* A commit is already scheduled and will carry the latest value */
+    return NRF_SUCCESS;
+  }
+
+  elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_beacon_last_commit);
+  if(elapsed >= m_beacon_interval)
+  {
+    return beacon_commit();
+  }
+
+  m_beacon_timer_running = true;
+
+  return app_timer_start(m_beacon_timer, MAX(m_beacon_interval - elapsed, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
+}
+
+void adv_payload_suspend(bool suspend)
+{
+  m_suspended = suspend;
+}
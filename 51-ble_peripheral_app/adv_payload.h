@@ -0,0 +1,84 @@
+#ifndef _ADV_PAYLOAD_H
+#define _ADV_PAYLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "app_util.h"
+#include "ble_advertising.h"
+
+/* Compile-time advertising payloads.
+ *
+ * A payload is described as a struct made only of AD structures. Every member is a
+ * byte array so the struct has no padding and its image is the encoded payload:
+ *
+ *   typedef struct
+ *   {
+ *     ADV_AD_STRUCT(flags, 1);
+ *     ADV_AD_STRUCT(name, sizeof(DEVICE_NAME) - 1);
+ *   } my_adv_data_t;
+ *   ADV_PAYLOAD_CHECK(my_adv_data_t, BLE_GAP_ADV_SET_DATA_SIZE_MAX);
+ *
+ *   static const my_adv_data_t m_adv = {
+ *     .flags = ADV_AD(my_adv_data_t, flags, BLE_GAP_AD_TYPE_FLAGS, { BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE }),
+ *     .name  = ADV_AD(my_adv_data_t, name, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, DEVICE_NAME),
+ *   };
+ *
+ * The const payload lives in flash. adv_payload_init() copies it once into RAM buffers
+ * handed to the SoftDevice and adv_payload_patch() rewrites the dynamic fields, located
+ * with offsetof() on the same struct.
+ */
+
+/* Largest payload: extended connectable advertising (no scan response in that mode) */
+#define ADV_PAYLOAD_MAX_SIZE            BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_CONNECTABLE_MAX_SUPPORTED
+
+/* One AD structure with 'data_size' bytes of data */
+#define ADV_AD_STRUCT(name, data_size)  struct { uint8_t len; uint8_t type; uint8_t data[(data_size)]; } name
+
+/* Length byte of an AD structure: type + data */
+#define ADV_AD_LEN(payload_type, field) (sizeof(((payload_type *)0)->field.data) + 1)
+
+/* Initializer of an AD structure declared with ADV_AD_STRUCT. The data is a brace list or a string literal */
+#define ADV_AD(payload_type, field, ad_type, ...) { ADV_AD_LEN(payload_type, field), (ad_type), __VA_ARGS__ }
+
+/* Offset of the data bytes of an AD structure inside the payload */
+#define ADV_AD_DATA_OFFSET(payload_type, field) offsetof(payload_type, field.data)
+
+/* Reject payloads that do not fit the advertising PDU at compile time */
+#define ADV_PAYLOAD_CHECK(payload_type, max_size) \
+  STATIC_ASSERT(sizeof(payload_type) <= (max_size), #payload_type " does not fit in the advertising PDU")
+
+/* Install the encoded advertising and scan response payloads into the advertising module.
+ * Must be called after ble_advertising_init() while not advertising. Can be called again
+ * to switch payloads, followed by adv_payload_beacon_init() for the new layout.
+ * p_sr_data can be NULL for no scan response.
+ */
+ret_code_t adv_payload_init(ble_advertising_t *p_advertising,
+                            uint8_t const *p_adv_data, uint16_t adv_len,
+                            uint8_t const *p_sr_data, uint16_t sr_len);
+
+/* Overwrite 'len' bytes of the advertising data at 'offset'. Only while not advertising */
+ret_code_t adv_payload_patch(uint16_t offset, uint8_t const *p_data, uint16_t len);
+
+/* Live updated beacon field.
+ *
+ * adv_payload_beacon_set() rewrites 'len' bytes at 'offset' of the advertising data while
+ * advertising keeps running: the new payload is built in the idle buffer and handed to the
+ * SoftDevice with a data only sd_ble_gap_adv_set_configure(). Commits are rate limited to one
+ * per 'update_interval' app_timer ticks (the advertising interval, faster updates would never
+ * be on air). Values set in between are coalesced and the latest one is committed.
+ *
+ * Call from the same context as the app_timer handlers.
+ */
+ret_code_t adv_payload_beacon_init(uint16_t offset, uint16_t len, uint32_t update_interval);
+
+ret_code_t adv_payload_beacon_set(uint8_t const *p_data);
+
+/* While suspended the advertising set is used by someone else (e.g. telemetry broadcast)
+ * or advertises without payload (directed advertising). Beacon updates only go to the
+ * buffers and are used by the next ble_advertising_start() or fast advertising stage.
+ */
+void adv_payload_suspend(bool suspend);
+
+#endif /* _ADV_PAYLOAD_H */
@@ -0,0 +1,412 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "adv_sched.h"
+
+/* Accounting runs at least this often so the 24 bit RTC counter never wraps twice in between */
+#define ADV_SCHED_ACCOUNT_INTERVAL    APP_TIMER_TICKS(60000)
+
+/* High duty directed advertising sends every 3.75 ms or less */
+#define ADV_SCHED_HIGH_DUTY_INTERVAL  6
+
+typedef struct
+{
+  uint64_t time_ms;
+  uint64_t events_milli;  /* Advertising events x 1000, keeps the fractions of short stages */
+  uint64_t charge_nc;
+  uint32_t entries;
+} stage_acc_t;
+
+APP_TIMER_DEF(m_account_timer);
+
+static ble_advertising_t       *mp_advertising = NULL;
+static ble_adv_modes_config_t  m_base_config;
+static adv_sched_stage_t       m_stages[ADV_SCHED_STAGES_MAX];
+static uint8_t                 m_stage_count = 0;
+static uint32_t                m_event_charge_nc = 0;
+static uint32_t                m_report_interval = 0;
+static uint32_t                m_directed_interval = 0;
+static uint32_t                m_directed_duration = 0;
+
+/* Stages, then the time spent not advertising, then directed advertising */
+static stage_acc_t m_acc[ADV_SCHED_STAGES_MAX + 2];
+static uint8_t     m_current = 0;
+static uint32_t    m_interval = 0;   /* Of the current bucket, 0 while not advertising */
+static bool        m_running = false;
+
+/* Directed advertising target, given to ble_advertising on request */
+static ble_gap_addr_t m_peer_addr;
+static bool           m_peer_addr_valid = false;
+static uint32_t    m_last_ticks = 0;
+static uint32_t    m_report_ticks = 0;
+
+static void account(void)
+{
+  uint32_t now = app_timer_cnt_get();
+  uint32_t ticks = app_timer_cnt_diff_compute(now, m_last_ticks);
+  uint64_t delta_ms = ((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ;
+
+  stage_acc_t *p_acc = &m_acc[m_current];
+
+  m_last_ticks = now;
+  p_acc->time_ms += delta_ms;
+
+  if(m_interval > 0)
+  {
+    /* One event per interval, interval is in 0.625 ms (5/8 ms) units */
+    uint64_t events_milli = (delta_ms * 8000) / ((uint64_t)m_interval * 5);
+
+    p_acc->events_milli += events_milli;
+    p_acc->charge_nc += (events_milli * m_event_charge_nc) / 1000;
+  }
+
+  if(m_report_interval > 0)
+  {
+    m_report_ticks += ticks;
+    if(m_report_ticks >= m_report_interval)
+    {
+      m_report_ticks = 0;
+      adv_sched_stats_log();
+    }
+  }
+}
+
+static void account_timeout_handler(void *p_context)
+{
+  account();
+}
+
+/* Account the time so far to the current bucket and switch to another one */
+static void bucket_switch(uint8_t bucket, uint32_t interval)
+{
+  account();
+  m_current = bucket;
+  m_interval = interval;
+}
+
+static void stopped_enter(void)
+{
+  bucket_switch(ADV_SCHED_STATS_IDLE(m_stage_count), 0);
+  m_running = false;
+  m_peer_addr_valid = false;
+}
+
+static void stage_config_get(uint8_t stage, ble_adv_modes_config_t *p_config)
+{
+  adv_sched_stage_t const *p_stage = &m_stages[stage];
+
+  *p_config = m_base_config;
+
+  p_config->ble_adv_fast_enabled = true;
+  p_config->ble_adv_fast_interval = p_stage->interval;
+  p_config->ble_adv_fast_timeout = p_stage->duration;
+  p_config->ble_adv_slow_enabled = false;   /* Stage changes are done here, not by ble_advertising */
+  p_config->ble_adv_whitelist_enabled = p_stage->allowlist;
+  p_config->ble_adv_directed_high_duty_enabled = false;
+  p_config->ble_adv_directed_enabled = false;
+}
+
+/* ble_advertising rewrites the flags in the payload to non-discoverable when it advertises
+ * with the allowlist and never puts them back. Restored before every start, it sets them
+ * again itself when the stage filters on the allowlist.
+ */
+static void flags_restore(void)
+{
+  uint8_t *p_flags = ble_advdata_parse(mp_advertising->adv_data.adv_data.p_data,
+                                       mp_advertising->adv_data.adv_data.len,
+                                       BLE_GAP_AD_TYPE_FLAGS);
+
+  if(p_flags != NULL)
+  {
+    *p_flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+  }
+}
+
+static ret_code_t adv_start(ble_adv_modes_config_t const *p_config, ble_adv_mode_t mode)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_advertising_modes_config_set(mp_advertising, p_config);
+  flags_restore();
+
+  m_running = true;
+  err_code = ble_advertising_start(mp_advertising, mode);
+  if(err_code != NRF_SUCCESS)
+  {
+    stopped_enter();
+  }
+
+  return err_code;
+}
+
+static ret_code_t stage_enter(uint8_t stage)
+{
+  ble_adv_modes_config_t config;
+
+  stage_config_get(stage, &config);
+
+  bucket_switch(stage, m_stages[stage].interval);
+  m_acc[stage].entries++;
+  m_peer_addr_valid = false;
+
+  return adv_start(&config, BLE_ADV_MODE_FAST);
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  if(mp_advertising == NULL)
+  {
+    return;
+  }
+
+  /* The SoftDevice stops advertising when a central connects */
+  if((p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) &&
+     (p_ble_evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH) &&
+     m_running)
+  {
+    stopped_enter();
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_adv_sched_observer, ADV_SCHED_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t adv_sched_init(adv_sched_init_t const *p_init)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if((p_init == NULL) || (p_init->p_advertising == NULL) ||
+     (p_init->p_base_config == NULL) || (p_init->p_stages == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((p_init->stage_count == 0) || (p_init->stage_count > ADV_SCHED_STAGES_MAX))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  for(uint8_t i = 0; i < p_init->stage_count; i++)
+  {
+    if(p_init->p_stages[i].interval == 0)
+    {
+      return NRF_ERROR_INVALID_PARAM;
+    }
+  }
+
+  mp_advertising = p_init->p_advertising;
+  m_base_config = *p_init->p_base_config;
+  memcpy(m_stages, p_init->p_stages, p_init->stage_count * sizeof(adv_sched_stage_t));
+  m_stage_count = p_init->stage_count;
+  m_event_charge_nc = p_init->event_charge_nc;
+  m_report_interval = p_init->report_interval;
+  m_directed_interval = p_init->directed_interval;
+  m_directed_duration = p_init->directed_duration;
+
+  memset(m_acc, 0, sizeof(m_acc));
+  m_current = ADV_SCHED_STATS_IDLE(m_stage_count);
+  m_interval = 0;
+  m_running = false;
+  m_last_ticks = app_timer_cnt_get();
+
+  err_code = app_timer_create(&m_account_timer, APP_TIMER_MODE_REPEATED, account_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  return app_timer_start(m_account_timer, ADV_SCHED_ACCOUNT_INTERVAL, NULL);
+}
+
+ret_code_t adv_sched_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(mp_advertising == NULL)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  err_code = adv_sched_stop();
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  return stage_enter(0);
+}
+
+ret_code_t adv_sched_stop(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  err_code = sd_ble_gap_adv_stop(mp_advertising->adv_handle);
+  if((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE))
+  {
+    return err_code;
+  }
+
+  stopped_enter();
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t adv_sched_kick(void)
+{
+  if(m_running && ((m_current == 0) || (m_current == ADV_SCHED_STATS_DIRECTED(m_stage_count))))
+  {
+    /* Already in the fastest stage, or reconnecting to a peer */
+    return NRF_SUCCESS;
+  }
+
+  return adv_sched_start();
+}
+
+ret_code_t adv_sched_reconnect(ble_gap_addr_t const *p_peer_addr)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_adv_modes_config_t config;
+
+  if(p_peer_addr == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(mp_advertising == NULL)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  err_code = adv_sched_stop();
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  /* ble_advertising goes high duty directed -> low duty directed -> fast (first stage) */
+  stage_config_get(0, &config);
+  config.ble_adv_directed_high_duty_enabled = true;
+  config.ble_adv_directed_enabled = (m_directed_duration > 0);
+  config.ble_adv_directed_interval = m_directed_interval;
+  config.ble_adv_directed_timeout = m_directed_duration;
+
+  m_peer_addr = *p_peer_addr;
+  m_peer_addr_valid = true;
+
+  bucket_switch(ADV_SCHED_STATS_DIRECTED(m_stage_count), ADV_SCHED_HIGH_DUTY_INTERVAL);
+  m_acc[m_current].entries++;
+
+  return adv_start(&config, BLE_ADV_MODE_DIRECTED_HIGH_DUTY);
+}
+
+void adv_sched_base_config_set(ble_adv_modes_config_t const *p_config, uint32_t event_charge_nc)
+{
+  m_base_config = *p_config;
+  m_event_charge_nc = event_charge_nc;
+}
+
+bool adv_sched_is_running(void)
+{
+  return m_running;
+}
+
+void adv_sched_on_adv_evt(ble_adv_evt_t ble_adv_evt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!m_running)
+  {
+    return;
+  }
+
+  switch(ble_adv_evt)
+  {
+    case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+      /* Asked at the start of each directed mode */
+      if(m_peer_addr_valid)
+      {
+        err_code = ble_advertising_peer_addr_reply(mp_advertising, &m_peer_addr);
+        APP_ERROR_CHECK(err_code);
+      }
+      break;
+    case BLE_ADV_EVT_DIRECTED:
+      /* High duty burst over, low duty directed */
+      bucket_switch(ADV_SCHED_STATS_DIRECTED(m_stage_count), m_directed_interval);
+      break;
+    case BLE_ADV_EVT_FAST:
+    case BLE_ADV_EVT_FAST_WHITELIST:
+      if(m_current == ADV_SCHED_STATS_DIRECTED(m_stage_count))
+      {
+        /* Directed advertising over, ble_advertising moved on to the first stage */
+        bucket_switch(0, m_stages[0].interval);
+        m_acc[0].entries++;
+        m_peer_addr_valid = false;
+      }
+      break;
+    case BLE_ADV_EVT_IDLE:
+      /* Current stage timed out */
+      if((m_current + 1) < m_stage_count)
+      {
+        err_code = stage_enter(m_current + 1);
+        APP_ERROR_CHECK(err_code);
+      }
+      else
+      {
+        stopped_enter();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void stats_fill(uint8_t stage, adv_sched_stats_t *p_stats)
+{
+  stage_acc_t const *p_acc = &m_acc[stage];
+
+  p_stats->time_s = (uint32_t)(p_acc->time_ms / 1000);
+  p_stats->entries = p_acc->entries;
+  p_stats->adv_events = (uint32_t)(p_acc->events_milli / 1000);
+  p_stats->charge_uc = (uint32_t)(p_acc->charge_nc / 1000);
+}
+
+void adv_sched_stats_get(uint8_t stage, adv_sched_stats_t *p_stats)
+{
+  memset(p_stats, 0, sizeof(*p_stats));
+
+  if(stage > ADV_SCHED_STATS_DIRECTED(m_stage_count))
+  {
+    return;
+  }
+
+  account();
+  stats_fill(stage, p_stats);
+}
+
+/* Uses the last accounted values, it is also called from account() */
+void adv_sched_stats_log(void)
+{
+  adv_sched_stats_t stats;
+
+  for(uint8_t i = 0; i < m_stage_count; i++)
+  {
+    stats_fill(i, &stats);
+    NRF_LOG_INFO("Adv stage %d: %u s, %u entries, ~%u events, ~%u uC",
+                 i, stats.time_s, stats.entries, stats.adv_events, stats.charge_uc);
+  }
+
+  stats_fill(ADV_SCHED_STATS_DIRECTED(m_stage_count), &stats);
+  NRF_LOG_INFO("Adv directed: %u s, %u entries, ~%u events, ~%u uC",
+               stats.time_s, stats.entries, stats.adv_events, stats.charge_uc);
+
+  stats_fill(ADV_SCHED_STATS_IDLE(m_stage_count), &stats);
+  NRF_LOG_INFO("Not advertising: %u s", stats.time_s);
+}
@@ -0,0 +1,83 @@
+#ifndef _ADV_SCHED_H
+#define _ADV_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_advertising.h"
+
+/* Multi-stage advertising schedule on top of ble_advertising.
+ *
+ * Each stage runs ble_advertising fast mode with its own interval, duration and allowlist
+ * setting. When a stage times out the next one is started. After the last stage the device
+ * stops advertising until adv_sched_kick() (button press, pending data) or adv_sched_start().
+ *
+ * adv_sched_reconnect() puts a directed prelude in front of the first stage for a peer that
+ * just dropped off: high duty directed advertising (1.28 s), then low duty directed, then
+ * the normal stages.
+ *
+ * Time spent per stage is accounted, and the advertising events and radio charge are
+ * estimated from it so discovery latency can be traded against battery.
+ */
+
+#define ADV_SCHED_STAGES_MAX          4
+#define ADV_SCHED_BLE_OBSERVER_PRIO   1   /* Before the application observer, so the state is current there */
+
+/* Stats indexes after the stages */
+#define ADV_SCHED_STATS_IDLE(stage_count)      (stage_count)         /* Not advertising */
+#define ADV_SCHED_STATS_DIRECTED(stage_count)  ((stage_count) + 1)   /* Directed reconnection advertising */
+
+typedef struct
+{
+  uint32_t interval;    /* Advertising interval in 0.625 ms units */
+  uint32_t duration;    /* Stage duration in 10 ms units. 0: until connected or kicked */
+  bool     allowlist;   /* Bonded peers only. Advertises openly while nothing is bonded */
+} adv_sched_stage_t;
+
+typedef struct
+{
+  uint32_t time_s;      /* Time spent in the stage */
+  uint32_t entries;     /* Times the stage was entered */
+  uint32_t adv_events;  /* Estimated from time and interval */
+  uint32_t charge_uc;   /* Estimated radio charge in uC */
+} adv_sched_stats_t;
+
+typedef struct
+{
+  ble_advertising_t            *p_advertising;
+  ble_adv_modes_config_t const *p_base_config;   /* PHYs, extended advertising... Fast mode fields are set per stage */
+  adv_sched_stage_t const      *p_stages;
+  uint8_t                      stage_count;
+  uint32_t                     event_charge_nc;  /* Radio charge of one advertising event in nC */
+  uint32_t                     report_interval;  /* Stats log interval in app_timer ticks. 0: off */
+  uint32_t                     directed_interval;  /* Low duty directed interval in 0.625 ms units */
+  uint32_t                     directed_duration;  /* Low duty directed duration in 10 ms units. 0: skip it */
+} adv_sched_init_t;
+
+ret_code_t adv_sched_init(adv_sched_init_t const *p_init);
+
+/* Start (or restart) at the first stage */
+ret_code_t adv_sched_start(void);
+
+ret_code_t adv_sched_stop(void);
+
+/* Resume fast advertising: button press or data pending for a central */
+ret_code_t adv_sched_kick(void);
+
+/* Directed advertising at a bonded peer's identity address, then the normal stages */
+ret_code_t adv_sched_reconnect(ble_gap_addr_t const *p_peer_addr);
+
+/* Change the base advertising config (e.g. PHY). Only while stopped */
+void adv_sched_base_config_set(ble_adv_modes_config_t const *p_config, uint32_t event_charge_nc);
+
+bool adv_sched_is_running(void);
+
+/* Forward the ble_advertising events from the application event handler */
+void adv_sched_on_adv_evt(ble_adv_evt_t ble_adv_evt);
+
+/* Stats of a stage, or of ADV_SCHED_STATS_IDLE() / ADV_SCHED_STATS_DIRECTED() */
+void adv_sched_stats_get(uint8_t stage, adv_sched_stats_t *p_stats);
+
+void adv_sched_stats_log(void);
+
+#endif /* _ADV_SCHED_H */
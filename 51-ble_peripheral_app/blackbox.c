@@ -0,0 +1,587 @@
+#include <string.h>
+
+#include "sdk_config.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+#include "nrf_log.h"
+#include "nrf_log_backend_interface.h"
+#include "nrf_log_internal.h"
+#include "nrf_mbr.h"
+#include "nrf_memobj.h"
+#include "nrf_soc.h"
+
+#include "blackbox.h"
+#include "radio_sched.h"
+
+#define RAM_MAGIC           0xB1AC0B0Du
+#define RING_WORDS          (BLACKBOX_RAM_SIZE / sizeof(uint32_t))
+#define PAGE_HEADER_SIZE    8
+#define RECORD_HEADER_WORDS 2
+#define RECORD_WORDS_MAX    (RECORD_HEADER_WORDS + 2 + BYTES_TO_WORDS(BLACKBOX_HEXDUMP_MAX))
+
+/* FDS sits right below the bootloader (or the end of flash), the black box right below FDS */
+#define FDS_PAGES           ((FDS_VIRTUAL_PAGES * FDS_VIRTUAL_PAGE_SIZE * sizeof(uint32_t)) / BLACKBOX_PAGE_SIZE)
+
+#if defined(__SES_ARM)
+#define BLACKBOX_NOINIT     __attribute__((section(".non_init")))
+#else
+#define BLACKBOX_NOINIT     __attribute__((section(".noinit")))
+#endif
+
+STATIC_ASSERT((BLACKBOX_RAM_SIZE % sizeof(uint32_t)) == 0);
+STATIC_ASSERT(BLACKBOX_FLUSH_THRESHOLD < BLACKBOX_RAM_SIZE);
+
+/* Survives resets. check guards the indexes against the random content after power on */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t head;        /* Next word written */
+  uint32_t tail;        /* Next word flushed */
+  uint32_t boot_count;
+  uint32_t check;
+  uint32_t data[RING_WORDS];
+} ram_ring_t;
+
+typedef enum
+{
+  FLASH_IDLE,
+  FLASH_ERASE,
+  FLASH_WRITE_HEADER,
+  FLASH_WRITE_DATA,
+} flash_state_t;
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_fs) =
+{
+  .evt_handler = fstorage_evt_handler,
+};
+
+APP_TIMER_DEF(m_flush_timer);
+
+static ram_ring_t m_ring BLACKBOX_NOINIT;
+
+static bool          m_initialized = false;
+static uint8_t       m_log_severity = 0;
+static uint16_t      m_seq = 0;
+static uint32_t      m_last_ticks = 0;
+static uint64_t      m_uptime_ticks = 0;
+
+static flash_state_t m_state = FLASH_IDLE;
+static uint8_t       m_page = 0;          /* Page being filled */
+static uint32_t      m_page_seq = 0;
+static uint32_t      m_page_off = 0;      /* Next byte written in the page */
+static uint32_t      m_page_hdr[2];       /* Source of the header write */
+static uint32_t      m_write_words = 0;
+static bool          m_flush_queued = false;
+static bool          m_hold = false;      /* Download in progress */
+
+static uint8_t       m_read_order[BLACKBOX_PAGES];
+static uint8_t       m_read_pages = 0;
+
+static blackbox_stats_t m_stats;
+
+static uint32_t ring_check(void)
+{
+  return m_ring.magic ^ m_ring.head ^ m_ring.tail ^ m_ring.boot_count;
+}
+
+static uint32_t ring_used(void)
+{
+  return (m_ring.head + RING_WORDS - m_ring.tail) % RING_WORDS;
+}
+
+static uint32_t page_addr(uint8_t page)
+{
+  return m_fs.start_addr + (page * BLACKBOX_PAGE_SIZE);
+}
+
+static uint32_t const *page_ptr(uint8_t page)
+{
+  return (uint32_t const *)page_addr(page);
+}
+
+/* Bootloader start as the MBR knows it (the dongle's USB bootloader), else the end of flash */
+static uint32_t flash_end_get(void)
+{
+  uint32_t bootloader = *(uint32_t const *)MBR_BOOTLOADER_ADDR;
+
+  if(bootloader == 0xFFFFFFFF)
+  {
+    bootloader = NRF_UICR->NRFFW[0];
+  }
+
+  return (bootloader != 0xFFFFFFFF) ? bootloader : (NRF_FICR->CODESIZE * NRF_FICR->CODEPAGESIZE);
+}
+
+static uint32_t uptime_ms(void)
+{
+  uint32_t now = app_timer_cnt_get();
+
+  m_uptime_ticks += app_timer_cnt_diff_compute(now, m_last_ticks);
+  m_last_ticks = now;
+
+  return (uint32_t)((m_uptime_ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static void flush_job(void *p_context);
+
+static void flush_queue(void)
+{
+  if(m_flush_queued || !m_initialized)
+  {
+    return;
+  }
+
+  if(radio_sched_job_put(flush_job, NULL) == NRF_SUCCESS)
+  {
+    m_flush_queued = true;
+  }
+}
+
+/* Append a record: header, then the payload words */
+static bool record_put(uint8_t type, uint32_t const *p_words, uint8_t word_count)
+{
+  bool     stored = false;
+  uint32_t total = RECORD_HEADER_WORDS + word_count;
+  uint32_t used = 0;
+
+  CRITICAL_REGION_ENTER();
+  if((RING_WORDS - 1 - ring_used()) >= total)
+  {
+    uint32_t header[RECORD_HEADER_WORDS];
+
+    header[0] = total | ((uint32_t)type << 8) | ((uint32_t)m_seq++ << 16);
+    header[1] = uptime_ms();
+
+    for(uint32_t i = 0; i < total; i++)
+    {
+      m_ring.data[m_ring.head] = (i < RECORD_HEADER_WORDS) ? header[i] : p_words[i - RECORD_HEADER_WORDS];
+      m_ring.head = (m_ring.head + 1) % RING_WORDS;
+    }
+    m_ring.check = ring_check();
+
+    m_stats.records++;
+    stored = true;
+  }
+  else
+  {
+    m_stats.dropped++;
+  }
+  used = ring_used();
+  CRITICAL_REGION_EXIT();
+
+  if(stored && ((used * sizeof(uint32_t)) >= BLACKBOX_FLUSH_THRESHOLD))
+  {
+    flush_queue();
+  }
+
+  return stored;
+}
+
+/* Start the next flash operation of the flush. Runs until the RAM ring is empty */
+static void flush_step(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint32_t   pending = ring_used();
+  uint32_t   fit = 0;
+  uint32_t   idx = m_ring.tail;
+
+  if(m_hold || (pending == 0))
+  {
+    m_state = FLASH_IDLE;
+    return;
+  }
+
+  /* Whole records that still fit in the page */
+  while(fit < pending)
+  {
+    uint32_t words = m_ring.data[idx] & 0xFF;
+
+    if((words < RECORD_HEADER_WORDS) || ((fit + words) > pending))
+    {
+      /* Ring content is not a record chain (torn by a reset while writing), drop it */
+      CRITICAL_REGION_ENTER();
+      m_ring.tail = m_ring.head;
+      m_ring.check = ring_check();
+      CRITICAL_REGION_EXIT();
+      m_state = FLASH_IDLE;
+      return;
+    }
+
+    if((m_page_off + ((fit + words) * sizeof(uint32_t))) > BLACKBOX_PAGE_SIZE)
+    {
+      break;
+    }
+
+    fit += words;
+    idx = (idx + words) % RING_WORDS;
+  }
+
+  if(fit == 0)
+  {
+    /* Page full, continue in the next one (the oldest) */
+    m_page = (m_page + 1) % BLACKBOX_PAGES;
+    m_state = FLASH_ERASE;
+    err_code = nrf_fstorage_erase(&m_fs, page_addr(m_page), 1, NULL);
+  }
+  else
+  {
+    /* Records wrapping around the end of the ring take two writes */
+    m_write_words = MIN(fit, RING_WORDS - m_ring.tail);
+    m_state = FLASH_WRITE_DATA;
+    err_code = nrf_fstorage_write(&m_fs, page_addr(m_page) + m_page_off, &m_ring.data[m_ring.tail],
+                                  m_write_words * sizeof(uint32_t), NULL);
+  }
+
+  if(err_code != NRF_SUCCESS)
+  {
+    /* fstorage queue full, the next flush tries again */
+    m_state = FLASH_IDLE;
+  }
+}
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(p_evt->result != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Black box flash operation failed, result 0x%X", p_evt->result);
+    m_state = FLASH_IDLE;
+    return;
+  }
+
+  switch(m_state)
+  {
+    case FLASH_ERASE:
+      m_stats.pages_erased++;
+      m_page_seq++;
+      m_page_hdr[0] = BLACKBOX_PAGE_MAGIC;
+      m_page_hdr[1] = m_page_seq;
+      m_state = FLASH_WRITE_HEADER;
+      err_code = nrf_fstorage_write(&m_fs, page_addr(m_page), m_page_hdr, sizeof(m_page_hdr), NULL);
+      if(err_code != NRF_SUCCESS)
+      {
+        /* Page stays without a header, it is erased again on the next flush */
+        m_page = (m_page + BLACKBOX_PAGES - 1) % BLACKBOX_PAGES;
+        m_page_off = BLACKBOX_PAGE_SIZE;
+        m_state = FLASH_IDLE;
+      }
+      return;
+
+    case FLASH_WRITE_HEADER:
+      m_page_off = PAGE_HEADER_SIZE;
+      break;
+
+    case FLASH_WRITE_DATA:
+      CRITICAL_REGION_ENTER();
+      m_ring.tail = (m_ring.tail + m_write_words) % RING_WORDS;
+      m_ring.check = ring_check();
+      CRITICAL_REGION_EXIT();
+      m_page_off += m_write_words * sizeof(uint32_t);
+      m_stats.words_written += m_write_words;
+      break;
+
+    default:
+      return;
+  }
+
+  flush_step();
+}
+
+static void flush_job(void *p_context)
+{
+  m_flush_queued = false;
+
+  if(m_state == FLASH_IDLE)
+  {
+    flush_step();
+  }
+}
+
+static void flush_timeout_handler(void *p_context)
+{
+  /* Also keeps the uptime counting across RTC wraps */
+  CRITICAL_REGION_ENTER();
+  (void)uptime_ms();
+  CRITICAL_REGION_EXIT();
+
+  flush_queue();
+}
+
+/* Newest page and the write position in it */
+static void flash_scan(void)
+{
+  bool found = false;
+
+  for(uint8_t page = 0; page < BLACKBOX_PAGES; page++)
+  {
+    uint32_t const *p_page = page_ptr(page);
+
+    if((p_page[0] == BLACKBOX_PAGE_MAGIC) && (!found || (p_page[1] > m_page_seq)))
+    {
+      m_page = page;
+      m_page_seq = p_page[1];
+      found = true;
+    }
+  }
+
+  if(!found)
+  {
+    /* Start with page 0 on the first flush */
+    m_page = BLACKBOX_PAGES - 1;
+    m_page_seq = 0;
+    m_page_off = BLACKBOX_PAGE_SIZE;
+    return;
+  }
+
+  m_page_off = PAGE_HEADER_SIZE;
+  while(m_page_off < BLACKBOX_PAGE_SIZE)
+  {
+    uint32_t words = page_ptr(m_page)[m_page_off / sizeof(uint32_t)] & 0xFF;
+
+    if(words == 0xFF)
+    {
+      break;
+    }
+
+    if((words < RECORD_HEADER_WORDS) || ((m_page_off + (words * sizeof(uint32_t))) > BLACKBOX_PAGE_SIZE))
+    {
+      /* Write torn by a reset, the rest of this page is not used */
+      m_page_off = BLACKBOX_PAGE_SIZE;
+      break;
+    }
+
+    m_page_off += words * sizeof(uint32_t);
+  }
+}
+
+/* NRF_LOG backend: stores the raw message, formatting is left to the host */
+static void log_backend_put(nrf_log_backend_t const *p_backend, nrf_log_entry_t *p_msg)
+{
+  nrf_log_header_t header;
+  uint32_t         payload[RECORD_WORDS_MAX];
+  uint32_t         offset = HEADER_SIZE * sizeof(uint32_t);
+
+  nrf_memobj_get(p_msg);
+  nrf_memobj_read(p_msg, &header, HEADER_SIZE * sizeof(uint32_t), 0);
+
+  if(header.base.generic.type == HEADER_TYPE_STD)
+  {
+    uint8_t nargs = header.base.std.nargs;
+
+    if(header.base.std.severity <= m_log_severity)
+    {
+      payload[0] = header.base.std.addr;
+      payload[1] = ((uint32_t)header.module_id << 16) | (header.base.std.severity << 8) | nargs;
+      nrf_memobj_read(p_msg, &payload[2], nargs * sizeof(uint32_t), offset);
+      (void)record_put(BLACKBOX_REC_LOG, payload, 2 + nargs);
+    }
+  }
+  else if(header.base.generic.type == HEADER_TYPE_HEXDUMP)
+  {
+    uint32_t len = MIN(header.base.hexdump.len, BLACKBOX_HEXDUMP_MAX);
+
+    if(header.base.hexdump.severity <= m_log_severity)
+    {
+      memset(payload, 0, sizeof(payload));
+      payload[0] = ((uint32_t)header.module_id << 16) | (header.base.hexdump.severity << 8);
+      payload[1] = len;
+      nrf_memobj_read(p_msg, &payload[2], len, offset);
+      (void)record_put(BLACKBOX_REC_HEXDUMP, payload, 2 + BYTES_TO_WORDS(len));
+    }
+  }
+
+  nrf_memobj_put(p_msg);
+}
+
+static void log_backend_panic_set(nrf_log_backend_t const *p_backend)
+{
+  /* Only RAM is touched, nothing to change */
+}
+
+static void log_backend_flush(nrf_log_backend_t const *p_backend)
+{
+}
+
+static const nrf_log_backend_api_t m_log_backend_api =
+{
+  .put       = log_backend_put,
+  .panic_set = log_backend_panic_set,
+  .flush     = log_backend_flush,
+};
+
+NRF_LOG_BACKEND_DEF(m_log_backend, m_log_backend_api, NULL);
+
+ret_code_t blackbox_init(uint8_t log_severity, uint32_t flush_interval)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint32_t   boot[3];
+  uint32_t   recovered = 0;
+  uint32_t   reset_reason = 0;
+
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_last_ticks = app_timer_cnt_get();
+
+  /* Records from before the reset are kept and flushed first */
+  if((m_ring.magic == RAM_MAGIC) && (m_ring.check == ring_check()) &&
+     (m_ring.head < RING_WORDS) && (m_ring.tail < RING_WORDS))
+  {
+    m_ring.boot_count++;
+    recovered = ring_used();
+  }
+  else
+  {
+    m_ring.magic = RAM_MAGIC;
+    m_ring.head = 0;
+    m_ring.tail = 0;
+    m_ring.boot_count = 0;
+  }
+  m_ring.check = ring_check();
+
+  m_fs.end_addr = flash_end_get() - (FDS_PAGES * BLACKBOX_PAGE_SIZE);
+  m_fs.start_addr = m_fs.end_addr - (BLACKBOX_PAGES * BLACKBOX_PAGE_SIZE);
+
+  err_code = nrf_fstorage_init(&m_fs, &nrf_fstorage_sd, NULL);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  flash_scan();
+
+  err_code = app_timer_create(&m_flush_timer, APP_TIMER_MODE_REPEATED, flush_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = app_timer_start(m_flush_timer, flush_interval, NULL);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  m_initialized = true;
+
+  (void)sd_power_reset_reason_get(&reset_reason);
+  (void)sd_power_reset_reason_clr(reset_reason);
+
+  boot[0] = reset_reason;
+  boot[1] = m_ring.boot_count;
+  boot[2] = recovered;
+  (void)record_put(BLACKBOX_REC_BOOT, boot, ARRAY_SIZE(boot));
+
+  NRF_LOG_INFO("Black box at 0x%X, page %d (seq %u), %u words recovered from RAM, boot %u",
+               m_fs.start_addr, m_page, m_page_seq, recovered, m_ring.boot_count);
+
+  if(log_severity > 0)
+  {
+    m_log_severity = log_severity;
+    if(nrf_log_backend_add(&m_log_backend, (nrf_log_severity_t)log_severity) < 0)
+    {
+      return NRF_ERROR_NO_MEM;
+    }
+    nrf_log_backend_enable(&m_log_backend);
+  }
+
+  flush_queue();
+
+  return NRF_SUCCESS;
+}
+
+bool blackbox_record(uint8_t type, void const *p_data, uint8_t len)
+{
+  uint32_t payload[BYTES_TO_WORDS(UINT8_MAX)];
+
+  if((type < BLACKBOX_REC_APP) || ((p_data == NULL) && (len > 0)))
+  {
+    return false;
+  }
+
+  memset(payload, 0, BYTES_TO_WORDS(len) * sizeof(uint32_t));
+  memcpy(payload, p_data, len);
+
+  return record_put(type, payload, BYTES_TO_WORDS(len));
+}
+
+void blackbox_fault_record(uint32_t id, uint32_t pc, uint32_t info)
+{
+  uint32_t fault[3] = { id, pc, info };
+
+  if(m_ring.magic != RAM_MAGIC)
+  {
+    return;
+  }
+
+  (void)record_put(BLACKBOX_REC_FAULT, fault, ARRAY_SIZE(fault));
+}
+
+void blackbox_flush(void)
+{
+  flush_queue();
+}
+
+uint32_t blackbox_download_begin(void)
+{
+  m_hold = true;
+  m_read_pages = 0;
+
+  /* Oldest first: the pages after the current one, then the current one */
+  for(uint8_t i = 1; i <= BLACKBOX_PAGES; i++)
+  {
+    uint8_t page = (m_page + i) % BLACKBOX_PAGES;
+
+    if(page_ptr(page)[0] == BLACKBOX_PAGE_MAGIC)
+    {
+      m_read_order[m_read_pages++] = page;
+    }
+  }
+
+  return m_read_pages * BLACKBOX_PAGE_SIZE;
+}
+
+uint32_t blackbox_download_read(uint32_t offset, uint8_t *p_buf, uint32_t len)
+{
+  uint32_t read = 0;
+
+  while((read < len) && (offset < (m_read_pages * BLACKBOX_PAGE_SIZE)))
+  {
+    uint32_t page_off = offset % BLACKBOX_PAGE_SIZE;
+    uint32_t chunk = MIN(len - read, BLACKBOX_PAGE_SIZE - page_off);
+
+    memcpy(&p_buf[read], (uint8_t const *)page_addr(m_read_order[offset / BLACKBOX_PAGE_SIZE]) + page_off, chunk);
+    read += chunk;
+    offset += chunk;
+  }
+
+  return read;
+}
+
+void blackbox_download_end(void)
+{
+  m_hold = false;
+  m_read_pages = 0;
+  flush_queue();
+}
+
+uint32_t blackbox_flash_start_get(void)
+{
+  return m_fs.start_addr;
+}
+
+void blackbox_stats_get(blackbox_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void blackbox_stats_log(void)
+{
+  NRF_LOG_INFO("Black box: %u records (%u dropped), %u words written, %u pages erased, %u pending",
+               m_stats.records, m_stats.dropped, m_stats.words_written, m_stats.pages_erased,
+               ring_used() * sizeof(uint32_t));
+}
@@ -0,0 +1,81 @@
+#ifndef _BLACKBOX_H
+#define _BLACKBOX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Crash-surviving binary log ("black box").
+ *
+ * Records (NRF_LOG messages through a log backend, boot and fault records, application
+ * records) are appended to a RAM ring in a section that is not cleared at startup, so they
+ * survive resets, including the reset after a fault. The ring is flushed to a ring of flash
+ * pages through nrf_fstorage_sd, in writes of whole records up to the rest of the page,
+ * right after a radio event (radio_sched).
+ *
+ * NRF_LOG messages are stored unformatted: the format string address, module id, severity and
+ * the arguments. The host parser (tools/blackbox_parse.py) formats them with the firmware ELF.
+ *
+ * Flash layout: BLACKBOX_PAGES pages right below the FDS pages. Each page starts with
+ * { magic, page sequence number } and is filled with records up to the first erased word.
+ * Record: { words (including this header), type, sequence (16 bit) } { uptime ms } payload.
+ */
+
+#define BLACKBOX_PAGES              8
+#define BLACKBOX_PAGE_SIZE          4096
+#define BLACKBOX_RAM_SIZE           2048    /* RAM ring, bytes */
+#define BLACKBOX_FLUSH_THRESHOLD    1024    /* Pending bytes that start a flush */
+#define BLACKBOX_HEXDUMP_MAX        64      /* Longer hexdumps are cut */
+
+#define BLACKBOX_PAGE_MAGIC         0x31584242  /* "BBX1" */
+
+/* Record types */
+#define BLACKBOX_REC_LOG            0x01    /* fmt address, module id << 16 | severity << 8 | nargs, args */
+#define BLACKBOX_REC_HEXDUMP        0x02    /* module id << 16 | severity << 8, length, data */
+#define BLACKBOX_REC_BOOT           0x03    /* RESETREAS, boot count, words recovered from RAM */
+#define BLACKBOX_REC_FAULT          0x04    /* id, pc, info (app_error_fault_handler / HardFault) */
+#define BLACKBOX_REC_APP            0x10    /* First application record type */
+
+#define BLACKBOX_FAULT_ID_HARDFAULT 0x40FF  /* Fault record id of a HardFault, after the SDK fault ids */
+
+typedef struct
+{
+  uint32_t records;
+  uint32_t dropped;         /* RAM ring full */
+  uint32_t words_written;
+  uint32_t pages_erased;
+} blackbox_stats_t;
+
+/* Call with the SoftDevice enabled. log_severity: lowest NRF_LOG severity recorded
+ * (nrf_log_severity_t), 0 to record no NRF_LOG messages.
+ */
+ret_code_t blackbox_init(uint8_t log_severity, uint32_t flush_interval);
+
+/* Application record, payload padded to words. Can be called from interrupts */
+bool blackbox_record(uint8_t type, void const *p_data, uint8_t len);
+
+/* From the fault handler, before the reset. Only touches RAM */
+void blackbox_fault_record(uint32_t id, uint32_t pc, uint32_t info);
+
+/* Write the pending records to flash (radio aligned) */
+void blackbox_flush(void);
+
+/* Download: stops flushing and freezes the page order, oldest page first.
+ * Returns the number of bytes to read.
+ */
+uint32_t blackbox_download_begin(void);
+
+/* Read from the frozen pages, returns the number of bytes read */
+uint32_t blackbox_download_read(uint32_t offset, uint8_t *p_buf, uint32_t len);
+
+void blackbox_download_end(void);
+
+/* Start of the black box pages. The flash below is free for other stores */
+uint32_t blackbox_flash_start_get(void);
+
+void blackbox_stats_get(blackbox_stats_t *p_stats);
+
+void blackbox_stats_log(void);
+
+#endif /* _BLACKBOX_H */
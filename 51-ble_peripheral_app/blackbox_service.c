@@ -0,0 +1,286 @@
+#include <string.h>
+
+#include "app_util.h"
+#include "ble_srv_common.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "blackbox.h"
+#include "blackbox_service.h"
+#include "diag_service.h"
+#include "lz_pack.h"
+
+#define CTRL_NOTIFY_SIZE  5
+
+static nrf_ble_gatt_t const     *mp_gatt = NULL;
+static uint16_t                 m_service_handle = BLE_GATT_HANDLE_INVALID;
+static ble_gatts_char_handles_t m_ctrl_handles;
+static ble_gatts_char_handles_t m_data_handles;
+static uint8_t                  m_uuid_type = BLE_UUID_TYPE_UNKNOWN;
+
+static uint16_t                 m_conn_handle = BLE_CONN_HANDLE_INVALID;   /* Link downloading */
+static uint32_t                 m_total = 0;
+static uint32_t                 m_offset = 0;
+static bool                     m_end_pending = false;
+static bool                     m_compressed = false;
+static uint32_t                 m_sent = 0;           /* Data notification bytes */
+
+/* Notification built but not queued yet, sent again on TX complete */
+static uint8_t                  m_chunk[NRF_SDH_BLE_GATT_MAX_MTU_SIZE];
+static uint16_t                 m_chunk_len = 0;
+
+static lz_pack_t                m_lz;
+static uint8_t                  m_lz_read[BLACKBOX_SERVICE_LZ_READ];
+
+static ret_code_t ctrl_notify(uint8_t op)
+{
+  uint8_t  data[CTRL_NOTIFY_SIZE];
+  uint16_t len = sizeof(data);
+
+  ble_gatts_hvx_params_t hvx = {0};
+
+  data[0] = op;
+  (void)uint32_encode(m_total, &data[1]);
+
+  hvx.handle = m_ctrl_handles.value_handle;
+  hvx.type = BLE_GATT_HVX_NOTIFICATION;
+  hvx.p_len = &len;
+  hvx.p_data = data;
+
+  return sd_ble_gatts_hvx(m_conn_handle, &hvx);
+}
+
+static void download_end(void)
+{
+  if(m_conn_handle == BLE_CONN_HANDLE_INVALID)
+  {
+    return;
+  }
+
+  blackbox_download_end();
+  m_conn_handle = BLE_CONN_HANDLE_INVALID;
+  m_end_pending = false;
+  m_chunk_len = 0;
+}
+
+/* Next data notification from m_offset on: page bytes, or a length and an lz_pack block or stored block */
+static uint16_t chunk_build(uint16_t chunk_max)
+{
+  uint32_t len = 0;
+  size_t   consumed = 0;
+
+  if(!m_compressed)
+  {
+    len = blackbox_download_read(m_offset, m_chunk, chunk_max);
+    m_offset += len;
+    return (uint16_t)len;
+  }
+
+  len = blackbox_download_read(m_offset, m_lz_read, sizeof(m_lz_read));
+  len = lz_pack(&m_lz, m_lz_read, len, &consumed, &m_chunk[2], chunk_max - 2);
+  if(len >= consumed)
+  {
+    /* Did not shrink: the same bytes stored, the window holds them either way */
+    memcpy(&m_chunk[2], m_lz_read, consumed);
+    len = consumed;
+    (void)uint16_encode((uint16_t)(len | LZ_PACK_FRAME_STORED), m_chunk);
+  }
+  else
+  {
+    (void)uint16_encode((uint16_t)len, m_chunk);
+  }
+  m_offset += consumed;
+
+  return (uint16_t)(len + 2);
+}
+
+/* Queue notifications until the SoftDevice runs out of buffers, continued on TX complete */
+static void download_pump(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint16_t   chunk_max = nrf_ble_gatt_eff_mtu_get(mp_gatt, m_conn_handle) - 3;
+
+  ble_gatts_hvx_params_t hvx = {0};
+
+  hvx.handle = m_data_handles.value_handle;
+  hvx.type = BLE_GATT_HVX_NOTIFICATION;
+  hvx.p_data = m_chunk;
+
+  while((m_offset < m_total) || (m_chunk_len != 0))
+  {
+    uint16_t len;
+
+    if(m_chunk_len == 0)
+    {
+      m_chunk_len = chunk_build(MIN(chunk_max, sizeof(m_chunk)));
+    }
+
+    len = m_chunk_len;
+    hvx.p_len = &len;
+    err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx);
+    if(err_code == NRF_ERROR_RESOURCES)
+    {
+      return;
+    }
+    if(err_code != NRF_SUCCESS)
+    {
+      /* Notifications not enabled, or the link is going down */
+      NRF_LOG_WARNING("Black box download stopped at %u of %u, error 0x%X", m_offset, m_total, err_code);
+      download_end();
+      return;
+    }
+
+    m_sent += len;
+    m_chunk_len = 0;
+    m_end_pending = (m_offset == m_total);
+  }
+
+  if(m_end_pending)
+  {
+    err_code = ctrl_notify(BLACKBOX_CTRL_END);
+    if(err_code == NRF_ERROR_RESOURCES)
+    {
+      return;
+    }
+
+    NRF_LOG_INFO("Black box download of %u bytes done, %u bytes sent", m_total, m_sent);
+    download_end();
+  }
+}
+
+static void on_ctrl_write(uint16_t conn_handle, ble_gatts_evt_write_t const *p_write)
+{
+  if((p_write->handle != m_ctrl_handles.value_handle) || (p_write->len < 1))
+  {
+    return;
+  }
+
+  switch(p_write->data[0])
+  {
+    case BLACKBOX_CTRL_START:
+    case BLACKBOX_CTRL_START_LZ:
+      if(m_conn_handle != BLE_CONN_HANDLE_INVALID)
+      {
+        /* Another link is downloading */
+        return;
+      }
+
+      m_conn_handle = conn_handle;
+      m_total = blackbox_download_begin();
+      m_offset = 0;
+      m_end_pending = (m_total == 0);
+      m_compressed = (p_write->data[0] == BLACKBOX_CTRL_START_LZ);
+      m_sent = 0;
+      m_chunk_len = 0;
+      lz_pack_reset(&m_lz);
+
+      if(ctrl_notify(p_write->data[0]) != NRF_SUCCESS)
+      {
+        download_end();
+        return;
+      }
+
+      NRF_LOG_INFO("Link 0x%04X: black box download of %u bytes%s", conn_handle, m_total,
+                   m_compressed ? " compressed" : "");
+      download_pump();
+      break;
+
+    case BLACKBOX_CTRL_ABORT:
+      if(m_conn_handle == conn_handle)
+      {
+        download_end();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  if(m_service_handle == BLE_GATT_HANDLE_INVALID)
+  {
+    return;
+  }
+
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GATTS_EVT_WRITE:
+      on_ctrl_write(p_ble_evt->evt.gatts_evt.conn_handle, &p_ble_evt->evt.gatts_evt.params.write);
+      break;
+
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+      if(p_ble_evt->evt.gatts_evt.conn_handle == m_conn_handle)
+      {
+        download_pump();
+      }
+      break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      if(p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+      {
+        download_end();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_blackbox_service_observer, BLACKBOX_SERVICE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t blackbox_service_init(nrf_ble_gatt_t const *p_gatt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_uuid128_t         base_uuid = { DIAG_SERVICE_UUID_BASE };
+  ble_uuid_t            service_uuid = {0};
+  ble_add_char_params_t char_params = {0};
+
+  mp_gatt = p_gatt;
+
+  /* Same base as the diagnostics service, the SoftDevice returns its type */
+  err_code = sd_ble_uuid_vs_add(&base_uuid, &m_uuid_type);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  service_uuid.type = m_uuid_type;
+  service_uuid.uuid = BLACKBOX_SERVICE_UUID;
+
+  err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &m_service_handle);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  char_params.uuid = BLACKBOX_CTRL_CHAR_UUID;
+  char_params.uuid_type = m_uuid_type;
+  char_params.max_len = CTRL_NOTIFY_SIZE;
+  char_params.init_len = 0;
+  char_params.is_var_len = true;
+  char_params.char_props.write = 1;
+  char_params.char_props.notify = 1;
+  char_params.write_access = SEC_JUST_WORKS;
+  char_params.cccd_write_access = SEC_JUST_WORKS;
+
+  err_code = characteristic_add(m_service_handle, &char_params, &m_ctrl_handles);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid = BLACKBOX_DATA_CHAR_UUID;
+  char_params.uuid_type = m_uuid_type;
+  char_params.max_len = NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3;
+  char_params.init_len = 0;
+  char_params.is_var_len = true;
+  char_params.char_props.notify = 1;
+  char_params.cccd_write_access = SEC_JUST_WORKS;
+
+  return characteristic_add(m_service_handle, &char_params, &m_data_handles);
+}
@@ -0,0 +1,41 @@
+#ifndef _BLACKBOX_SERVICE_H
+#define _BLACKBOX_SERVICE_H
+
+#include <stdint.h>
+
+#include "nrf_ble_gatt.h"
+#include "sdk_errors.h"
+
+/* Black box download service, on the diagnostics UUID base.
+ *
+ * Control characteristic (write, notify): write BLACKBOX_CTRL_START to download the flash
+ * pages, BLACKBOX_CTRL_ABORT to stop. Notifies { the start op, total bytes (u32 LE) }
+ * when the download starts and { BLACKBOX_CTRL_END, total bytes } after the last data packet.
+ *
+ * Data characteristic (notify): the page bytes in order, ATT MTU - 3 bytes per notification,
+ * as many per connection event as the SoftDevice queue takes. One download at a time, needs
+ * an encrypted link.
+ *
+ * BLACKBOX_CTRL_START_LZ starts a compressed download: each notification is a u16 LE length
+ * and one lz_pack block, the window carried over from the previous notification. A block
+ * that would not shrink goes out stored, with LZ_PACK_FRAME_STORED set in the length. Erased
+ * space and repeated log records shrink a lot, tools/lz_unpack.py restores the bytes. The
+ * totals in the control notifications stay uncompressed.
+ */
+
+#define BLACKBOX_SERVICE_UUID           0x0010
+#define BLACKBOX_CTRL_CHAR_UUID         0x0011
+#define BLACKBOX_DATA_CHAR_UUID         0x0012
+
+#define BLACKBOX_CTRL_START             0x01
+#define BLACKBOX_CTRL_ABORT             0x02
+#define BLACKBOX_CTRL_START_LZ          0x03
+#define BLACKBOX_CTRL_END               0x04
+
+#define BLACKBOX_SERVICE_BLE_OBSERVER_PRIO  2
+
+#define BLACKBOX_SERVICE_LZ_READ        512   /* Page bytes read per compressed notification */
+
+ret_code_t blackbox_service_init(nrf_ble_gatt_t const *p_gatt);
+
+#endif /* _BLACKBOX_SERVICE_H */
@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "bloom.h"
+
+#define FNV_OFFSET_BASIS  2166136261u
+#define FNV_PRIME         16777619u
+
+static uint32_t fnv1a(uint8_t const *p_data, uint16_t len)
+{
+  uint32_t hash = FNV_OFFSET_BASIS;
+
+  for(uint16_t i = 0; i < len; i++)
+  {
+    hash ^= p_data[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/* Second hash for the probe step. Odd, so the probes cover the whole (power of two) table */
+static uint32_t step_hash(uint32_t hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x7FEB352Du;
+  hash ^= hash >> 15;
+
+  return hash | 1;
+}
+
+static uint32_t popcount(uint32_t word)
+{
+  word = word - ((word >> 1) & 0x55555555u);
+  word = (word & 0x33333333u) + ((word >> 2) & 0x33333333u);
+
+  return (((word + (word >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+bool bloom_init(bloom_t *p_bloom, uint32_t *p_bits, uint32_t bit_count, uint8_t hash_count)
+{
+  if((p_bloom == NULL) || (p_bits == NULL) || (hash_count == 0) ||
+     (bit_count < 32) || ((bit_count & (bit_count - 1)) != 0))
+  {
+    return false;
+  }
+
+  p_bloom->p_bits = p_bits;
+  p_bloom->bit_count = bit_count;
+  p_bloom->hash_count = hash_count;
+  bloom_clear(p_bloom);
+
+  return true;
+}
+
+void bloom_clear(bloom_t *p_bloom)
+{
+  memset(p_bloom->p_bits, 0, p_bloom->bit_count / 8);
+  p_bloom->key_count = 0;
+}
+
+void bloom_add(bloom_t *p_bloom, uint8_t const *p_key, uint16_t len)
+{
+  uint32_t mask = p_bloom->bit_count - 1;
+  uint32_t pos = fnv1a(p_key, len);
+  uint32_t step = step_hash(pos);
+
+  for(uint8_t i = 0; i < p_bloom->hash_count; i++)
+  {
+    p_bloom->p_bits[(pos & mask) >> 5] |= (1u << (pos & 31));
+    pos += step;
+  }
+
+  p_bloom->key_count++;
+}
+
+bool bloom_check(bloom_t const *p_bloom, uint8_t const *p_key, uint16_t len)
+{
+  uint32_t mask = p_bloom->bit_count - 1;
+  uint32_t pos = fnv1a(p_key, len);
+  uint32_t step = step_hash(pos);
+
+  for(uint8_t i = 0; i < p_bloom->hash_count; i++)
+  {
+    if(!(p_bloom->p_bits[(pos & mask) >> 5] & (1u << (pos & 31))))
+    {
+      return false;
+    }
+    pos += step;
+  }
+
+  return true;
+}
+
+uint32_t bloom_fp_ppm(bloom_t const *p_bloom)
+{
+  uint32_t set = 0;
+  uint64_t fp = 1000000;
+
+  for(uint32_t i = 0; i < (p_bloom->bit_count / 32); i++)
+  {
+    set += popcount(p_bloom->p_bits[i]);
+  }
+
+  /* A false positive finds all k probed bits set: fill ^ k */
+  for(uint8_t i = 0; i < p_bloom->hash_count; i++)
+  {
+    fp = (fp * set) / p_bloom->bit_count;
+  }
+
+  return (uint32_t)fp;
+}
@@ -0,0 +1,37 @@
+#ifndef _BLOOM_H
+#define _BLOOM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Bloom filter over byte string keys.
+ *
+ * The k probe positions come from one FNV-1a hash by double hashing (h1 + i * h2), so a lookup
+ * costs one pass over the key and k bit tests. No false negatives; the false positive rate
+ * grows with the fill, see bloom_fp_ppm().
+ *
+ * No SDK dependencies, the filter can be built and exercised on a host.
+ */
+
+typedef struct
+{
+  uint32_t *p_bits;
+  uint32_t bit_count;     /* Power of two */
+  uint8_t  hash_count;
+  uint32_t key_count;     /* Keys added, 0: the filter is empty */
+} bloom_t;
+
+/* p_bits holds bit_count / 32 words. bit_count must be a power of two, at least 32 */
+bool bloom_init(bloom_t *p_bloom, uint32_t *p_bits, uint32_t bit_count, uint8_t hash_count);
+
+void bloom_clear(bloom_t *p_bloom);
+
+void bloom_add(bloom_t *p_bloom, uint8_t const *p_key, uint16_t len);
+
+/* True if the key may have been added, false if it was not */
+bool bloom_check(bloom_t const *p_bloom, uint8_t const *p_key, uint16_t len);
+
+/* Estimated false positive rate from the fraction of bits set, in parts per million */
+uint32_t bloom_fp_ppm(bloom_t const *p_bloom);
+
+#endif /* _BLOOM_H */
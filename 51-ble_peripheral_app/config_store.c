@@ -0,0 +1,448 @@
+#include <string.h>
+
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "fds.h"
+#include "nrf_log.h"
+
+#include "config_store.h"
+#include "fds_gc_sched.h"
+#include "radio_sched.h"
+
+/* nRF52840 NVMC: 41 us per word written, 85 ms per page erased. The CPU stalls while it runs */
+#define CONFIG_STORE_WORD_WRITE_US  41
+#define CONFIG_STORE_PAGE_ERASE_US  85000
+
+#define CONFIG_STORE_VALUE_WORDS    BYTES_TO_WORDS(CONFIG_STORE_STR_MAX + 1)
+
+typedef struct
+{
+  uint32_t value[CONFIG_STORE_VALUE_WORDS];   /* int32_t or NUL terminated string */
+  bool     dirty;
+} cache_entry_t;
+
+APP_TIMER_DEF(m_flush_timer);
+
+static config_item_t const     *mp_items = NULL;
+static uint8_t                 m_item_count = 0;
+static cache_entry_t           m_cache[CONFIG_STORE_ITEMS_MAX];
+static config_store_evt_handler_t m_evt_handler = NULL;
+static uint32_t                m_flush_delay = 0;
+
+/* One write at a time. FDS reads the data until the write completes, so it is a snapshot */
+static uint32_t m_write_buf[CONFIG_STORE_VALUE_WORDS];
+static bool     m_writing = false;
+static uint8_t  m_write_idx = 0;        /* Item of the running write */
+static bool     m_gc_pending = false;
+static bool     m_flush_queued = false;
+static uint32_t m_write_ticks = 0;
+
+static config_store_stats_t m_stats;
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static int item_index(uint16_t key)
+{
+  for(uint8_t i = 0; i < m_item_count; i++)
+  {
+    if(mp_items[i].key == key)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static uint16_t item_words(config_item_t const *p_item)
+{
+  return (p_item->type == CONFIG_TYPE_STR) ? CONFIG_STORE_VALUE_WORDS : 1;
+}
+
+static bool int_fits(config_type_t type, int32_t value)
+{
+  switch(type)
+  {
+    case CONFIG_TYPE_I8:
+      return (value >= INT8_MIN) && (value <= INT8_MAX);
+    case CONFIG_TYPE_U8:
+      return (value >= 0) && (value <= UINT8_MAX);
+    case CONFIG_TYPE_U16:
+      return (value >= 0) && (value <= UINT16_MAX);
+    case CONFIG_TYPE_U32:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void defaults_load(void)
+{
+  for(uint8_t i = 0; i < m_item_count; i++)
+  {
+    memset(m_cache[i].value, 0, sizeof(m_cache[i].value));
+    m_cache[i].dirty = false;
+
+    if(mp_items[i].type == CONFIG_TYPE_STR)
+    {
+      if(mp_items[i].p_def_str != NULL)
+      {
+        strncpy((char *)m_cache[i].value, mp_items[i].p_def_str, CONFIG_STORE_STR_MAX);
+      }
+    }
+    else
+    {
+      m_cache[i].value[0] = (uint32_t)mp_items[i].def_int;
+    }
+  }
+}
+
+static void stored_load(void)
+{
+  uint8_t loaded = 0;
+
+  for(uint8_t i = 0; i < m_item_count; i++)
+  {
+    fds_record_desc_t  desc = {0};
+    fds_find_token_t   token = {0};
+    fds_flash_record_t flash_record = {0};
+
+    if(fds_record_find(CONFIG_STORE_FDS_FILE_ID, mp_items[i].key, &desc, &token) != NRF_SUCCESS)
+    {
+      continue;
+    }
+
+    if(fds_record_open(&desc, &flash_record) != NRF_SUCCESS)
+    {
+      continue;
+    }
+
+    /* A record of another size is from an older item layout, keep the default */
+    if(flash_record.p_header->length_words == item_words(&mp_items[i]))
+    {
+      memcpy(m_cache[i].value, flash_record.p_data, item_words(&mp_items[i]) * sizeof(uint32_t));
+      if(mp_items[i].type == CONFIG_TYPE_STR)
+      {
+        ((char *)m_cache[i].value)[CONFIG_STORE_STR_MAX] = '\0';
+      }
+      loaded++;
+    }
+
+    (void)fds_record_close(&desc);
+  }
+
+  NRF_LOG_INFO("Config: %d of %d items loaded from flash", loaded, m_item_count);
+}
+
+/* Start writing the next dirty item. Returns false when there is none left */
+static bool write_next(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  fds_record_desc_t desc = {0};
+  fds_find_token_t  token = {0};
+  fds_record_t      record = {0};
+
+  for(uint8_t i = 0; i < m_item_count; i++)
+  {
+    if(!m_cache[i].dirty)
+    {
+      continue;
+    }
+
+    memcpy(m_write_buf, m_cache[i].value, sizeof(m_write_buf));
+
+    record.file_id = CONFIG_STORE_FDS_FILE_ID;
+    record.key = mp_items[i].key;
+    record.data.p_data = m_write_buf;
+    record.data.length_words = item_words(&mp_items[i]);
+
+    if(fds_record_find(CONFIG_STORE_FDS_FILE_ID, mp_items[i].key, &desc, &token) == NRF_SUCCESS)
+    {
+      err_code = fds_record_update(&desc, &record);
+    }
+    else
+    {
+      err_code = fds_record_write(NULL, &record);
+    }
+
+    if(err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+      /* Stays dirty, the batch continues after the garbage collection */
+      if(fds_gc_sched_space_needed() == NRF_SUCCESS)
+      {
+        m_gc_pending = true;
+        m_stats.gc_runs++;
+        m_stats.block_us += CONFIG_STORE_PAGE_ERASE_US;   /* At least one page */
+        return true;
+      }
+    }
+    if((err_code == FDS_ERR_NO_SPACE_IN_FLASH) || (err_code == FDS_ERR_NO_SPACE_IN_QUEUES))
+    {
+      /* FDS busy with other users or the collection not started, retried after the flush delay */
+      (void)app_timer_start(m_flush_timer, m_flush_delay, NULL);
+      return true;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    m_cache[i].dirty = false;
+    m_writing = true;
+    m_write_idx = i;
+    m_write_ticks = app_timer_cnt_get();
+    m_stats.records++;
+    m_stats.words += record.data.length_words;
+    m_stats.block_us += record.data.length_words * CONFIG_STORE_WORD_WRITE_US;
+
+    return true;
+  }
+
+  return false;
+}
+
+static void flush_job(void *p_context)
+{
+  m_flush_queued = false;
+
+  if(m_writing || m_gc_pending)
+  {
+    /* The running batch picks up the new dirty items */
+    return;
+  }
+
+  (void)write_next();
+}
+
+static void flush_queue(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(m_flush_queued)
+  {
+    return;
+  }
+
+  err_code = radio_sched_job_put(flush_job, NULL);
+  if(err_code == NRF_SUCCESS)
+  {
+    m_flush_queued = true;
+  }
+  else
+  {
+    (void)app_timer_start(m_flush_timer, m_flush_delay, NULL);
+  }
+}
+
+static void flush_timeout_handler(void *p_context)
+{
+  flush_queue();
+}
+
+static void batch_continue(void)
+{
+  if(!write_next() && (m_evt_handler != NULL))
+  {
+    m_evt_handler(CONFIG_STORE_EVT_FLUSHED);
+  }
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+  switch(p_evt->id)
+  {
+    case FDS_EVT_INIT:
+      if(p_evt->result == NRF_SUCCESS)
+      {
+        stored_load();
+      }
+      if(m_evt_handler != NULL)
+      {
+        m_evt_handler(CONFIG_STORE_EVT_LOADED);
+      }
+      break;
+
+    case FDS_EVT_WRITE:
+    case FDS_EVT_UPDATE:
+      if(p_evt->write.file_id != CONFIG_STORE_FDS_FILE_ID)
+      {
+        break;
+      }
+
+      m_writing = false;
+      m_stats.max_op_ms = MAX(m_stats.max_op_ms,
+                              ticks_to_ms(app_timer_cnt_diff_compute(app_timer_cnt_get(), m_write_ticks)));
+
+      if(p_evt->result != NRF_SUCCESS)
+      {
+        /* Written again after the flush delay, the batch resumes from there */
+        NRF_LOG_WARNING("Config record 0x%04X not written, result %d", p_evt->write.record_key, p_evt->result);
+        m_cache[m_write_idx].dirty = true;
+        (void)app_timer_start(m_flush_timer, m_flush_delay, NULL);
+        break;
+      }
+      batch_continue();
+      break;
+
+    case FDS_EVT_GC:
+      if(m_gc_pending)
+      {
+        m_gc_pending = false;
+        batch_continue();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+ret_code_t config_store_init(config_item_t const *p_items, uint8_t item_count,
+                             uint32_t flush_delay, config_store_evt_handler_t evt_handler)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(p_items == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((item_count == 0) || (item_count > CONFIG_STORE_ITEMS_MAX))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  mp_items = p_items;
+  m_item_count = item_count;
+  m_flush_delay = flush_delay;
+  m_evt_handler = evt_handler;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  defaults_load();
+
+  err_code = app_timer_create(&m_flush_timer, APP_TIMER_MODE_SINGLE_SHOT, flush_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  return fds_register(fds_evt_handler);
+}
+
+int32_t config_store_int_get(uint16_t key)
+{
+  int idx = item_index(key);
+
+  if((idx < 0) || (mp_items[idx].type == CONFIG_TYPE_STR))
+  {
+    return 0;
+  }
+
+  return (int32_t)m_cache[idx].value[0];
+}
+
+static void dirty_mark(int idx)
+{
+  m_cache[idx].dirty = true;
+
+  /* Every change pushes the flush back, a burst of changes is written once */
+  (void)app_timer_stop(m_flush_timer);
+  (void)app_timer_start(m_flush_timer, m_flush_delay, NULL);
+}
+
+ret_code_t config_store_int_set(uint16_t key, int32_t value)
+{
+  int idx = item_index(key);
+
+  if(idx < 0)
+  {
+    return NRF_ERROR_NOT_FOUND;
+  }
+
+  if(!int_fits(mp_items[idx].type, value))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if((int32_t)m_cache[idx].value[0] != value)
+  {
+    m_cache[idx].value[0] = (uint32_t)value;
+    dirty_mark(idx);
+  }
+
+  return NRF_SUCCESS;
+}
+
+char const *config_store_str_get(uint16_t key)
+{
+  int idx = item_index(key);
+
+  if((idx < 0) || (mp_items[idx].type != CONFIG_TYPE_STR))
+  {
+    return "";
+  }
+
+  return (char const *)m_cache[idx].value;
+}
+
+ret_code_t config_store_str_set(uint16_t key, char const *p_str)
+{
+  int idx = item_index(key);
+
+  if(idx < 0)
+  {
+    return NRF_ERROR_NOT_FOUND;
+  }
+
+  if((mp_items[idx].type != CONFIG_TYPE_STR) || (p_str == NULL) || (strlen(p_str) > CONFIG_STORE_STR_MAX))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if(strcmp((char const *)m_cache[idx].value, p_str) != 0)
+  {
+    memset(m_cache[idx].value, 0, sizeof(m_cache[idx].value));
+    strcpy((char *)m_cache[idx].value, p_str);
+    dirty_mark(idx);
+  }
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t config_store_flush(void)
+{
+  (void)app_timer_stop(m_flush_timer);
+
+  if(config_store_is_dirty())
+  {
+    flush_queue();
+  }
+
+  return NRF_SUCCESS;
+}
+
+bool config_store_is_dirty(void)
+{
+  for(uint8_t i = 0; i < m_item_count; i++)
+  {
+    if(m_cache[i].dirty)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void config_store_stats_get(config_store_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void config_store_stats_log(void)
+{
+  NRF_LOG_INFO("Config store: %u records, %u words (~%u us CPU stall), %u GC, slowest write %u ms",
+               m_stats.records, m_stats.words, m_stats.block_us, m_stats.gc_runs, m_stats.max_op_ms);
+}
@@ -0,0 +1,83 @@
+#ifndef _CONFIG_STORE_H
+#define _CONFIG_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Typed key-value configuration in FDS, served from a RAM cache.
+ *
+ * The application describes its items (key, type, default) in a table. At FDS initialization
+ * the stored values replace the defaults in the cache, and reads never touch flash. A set only
+ * changes the cache and marks the item dirty. Once no item has changed for flush_delay, the
+ * dirty items are written in one batch, one record per item, started right after a radio
+ * event (radio_sched). Tuning a value many times in the field costs one write.
+ *
+ * Records written, words written, garbage collections and the estimated time flash writes
+ * stall the CPU are counted.
+ */
+
+#define CONFIG_STORE_FDS_FILE_ID    0x2000
+#define CONFIG_STORE_ITEMS_MAX      16
+#define CONFIG_STORE_STR_MAX        31    /* String length without the terminator */
+
+typedef enum
+{
+  CONFIG_TYPE_I8,
+  CONFIG_TYPE_U8,
+  CONFIG_TYPE_U16,
+  CONFIG_TYPE_U32,
+  CONFIG_TYPE_STR,
+} config_type_t;
+
+typedef struct
+{
+  uint16_t      key;          /* FDS record key, 0x0001 - 0xBFFF */
+  config_type_t type;
+  int32_t       def_int;      /* Default of the integer types */
+  char const    *p_def_str;   /* Default of CONFIG_TYPE_STR */
+} config_item_t;
+
+typedef enum
+{
+  CONFIG_STORE_EVT_LOADED,    /* Stored values are in the cache */
+  CONFIG_STORE_EVT_FLUSHED,   /* All dirty items written */
+} config_store_evt_t;
+
+typedef void (*config_store_evt_handler_t)(config_store_evt_t evt);
+
+typedef struct
+{
+  uint32_t records;           /* Records written */
+  uint32_t words;             /* Words written */
+  uint32_t gc_runs;
+  uint32_t block_us;          /* Estimated CPU stall of the writes */
+  uint32_t max_op_ms;         /* Longest write, request to completion */
+} config_store_stats_t;
+
+/* Call before pm_init(), values are loaded when FDS is initialized.
+ * flush_delay: quiet time before dirty items are written, app_timer ticks
+ */
+ret_code_t config_store_init(config_item_t const *p_items, uint8_t item_count,
+                             uint32_t flush_delay, config_store_evt_handler_t evt_handler);
+
+int32_t config_store_int_get(uint16_t key);
+
+/* NRF_ERROR_INVALID_PARAM if the value does not fit the item type */
+ret_code_t config_store_int_set(uint16_t key, int32_t value);
+
+char const *config_store_str_get(uint16_t key);
+
+ret_code_t config_store_str_set(uint16_t key, char const *p_str);
+
+/* Write the dirty items now (radio aligned), without waiting for flush_delay */
+ret_code_t config_store_flush(void);
+
+bool config_store_is_dirty(void);
+
+void config_store_stats_get(config_store_stats_t *p_stats);
+
+void config_store_stats_log(void);
+
+#endif /* _CONFIG_STORE_H */
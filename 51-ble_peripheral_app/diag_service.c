@@ -0,0 +1,219 @@
+#include <string.h>
+
+#include "app_util.h"
+#include "ble_srv_common.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "diag_service.h"
+#include "fstorage_instr.h"
+#include "link_stats.h"
+
+static uint16_t                 m_service_handle = BLE_GATT_HANDLE_INVALID;
+static ble_gatts_char_handles_t m_link_stats_handles;
+static ble_gatts_char_handles_t m_flash_stats_handles;
+static ble_gatts_char_handles_t m_scan_filter_handles;
+static ble_gatts_char_handles_t m_settings_handles;
+static uint8_t                  m_uuid_type = BLE_UUID_TYPE_UNKNOWN;
+
+static diag_service_write_handler_t m_scan_filter_handler = NULL;
+static diag_service_write_handler_t m_settings_handler = NULL;
+
+static void on_read_authorize(uint16_t conn_handle, ble_gatts_evt_read_t const *p_read)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint8_t    record[MAX(LINK_STATS_RECORD_SIZE, FSTORAGE_INSTR_RECORD_SIZE)];
+  uint16_t   len = 0;
+
+  ble_gatts_rw_authorize_reply_params_t reply = {0};
+
+  if(p_read->handle == m_link_stats_handles.value_handle)
+  {
+    len = link_stats_encode(conn_handle, record, sizeof(record));
+  }
+  else if(p_read->handle == m_flash_stats_handles.value_handle)
+  {
+    len = fstorage_instr_encode(record, sizeof(record));
+  }
+  else
+  {
+    return;
+  }
+
+  reply.type = BLE_GATTS_AUTHORIZE_TYPE_READ;
+
+  if(len == 0)
+  {
+    reply.params.read.gatt_status = BLE_GATT_STATUS_ATTERR_UNLIKELY_ERROR;
+  }
+  else
+  {
+    /* Store this link's record, the SoftDevice serves the read (and long read offsets) from it */
+    reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+    reply.params.read.update = 1;
+    reply.params.read.offset = 0;
+    reply.params.read.len = len;
+    reply.params.read.p_data = record;
+  }
+
+  err_code = sd_ble_gatts_rw_authorize_reply(conn_handle, &reply);
+  if(err_code != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Link 0x%04X: diagnostics read not served, error 0x%X", conn_handle, err_code);
+  }
+}
+
+static void on_write_authorize(uint16_t conn_handle, ble_gatts_evt_write_t const *p_write)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  diag_service_write_handler_t handler = NULL;
+
+  ble_gatts_rw_authorize_reply_params_t reply = {0};
+
+  if((m_scan_filter_handler != NULL) && (p_write->handle == m_scan_filter_handles.value_handle))
+  {
+    handler = m_scan_filter_handler;
+  }
+  else if((m_settings_handler != NULL) && (p_write->handle == m_settings_handles.value_handle))
+  {
+    handler = m_settings_handler;
+  }
+  else
+  {
+    return;
+  }
+
+  reply.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+
+  if((p_write->op != BLE_GATTS_OP_WRITE_REQ) || (p_write->offset != 0))
+  {
+    reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+  }
+  else if(handler(p_write->data, p_write->len))
+  {
+    /* The write is applied, there is no value to keep */
+    reply.params.write.gatt_status = BLE_GATT_STATUS_SUCCESS;
+  }
+  else
+  {
+    reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED;
+  }
+
+  err_code = sd_ble_gatts_rw_authorize_reply(conn_handle, &reply);
+  if(err_code != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Link 0x%04X: diagnostics write not answered, error 0x%X", conn_handle, err_code);
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  ble_gatts_evt_rw_authorize_request_t const *p_auth = NULL;
+
+  if(m_service_handle == BLE_GATT_HANDLE_INVALID)
+  {
+    return;
+  }
+
+  if(p_ble_evt->header.evt_id == BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST)
+  {
+    p_auth = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+    if(p_auth->type == BLE_GATTS_AUTHORIZE_TYPE_READ)
+    {
+      on_read_authorize(p_ble_evt->evt.gatts_evt.conn_handle, &p_auth->request.read);
+    }
+    else if(p_auth->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+    {
+      on_write_authorize(p_ble_evt->evt.gatts_evt.conn_handle, &p_auth->request.write);
+    }
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_diag_service_observer, DIAG_SERVICE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t diag_service_init(diag_service_init_t const *p_init)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_uuid128_t         base_uuid = { DIAG_SERVICE_UUID_BASE };
+  ble_uuid_t            service_uuid = {0};
+  ble_add_char_params_t char_params = {0};
+
+  if(p_init == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  m_scan_filter_handler = p_init->scan_filter_handler;
+  m_settings_handler = p_init->settings_handler;
+
+  err_code = sd_ble_uuid_vs_add(&base_uuid, &m_uuid_type);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  service_uuid.type = m_uuid_type;
+  service_uuid.uuid = DIAG_SERVICE_UUID;
+
+  err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &m_service_handle);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  char_params.uuid = DIAG_LINK_STATS_CHAR_UUID;
+  char_params.uuid_type = m_uuid_type;
+  char_params.max_len = LINK_STATS_RECORD_SIZE;
+  char_params.init_len = 0;
+  char_params.is_var_len = true;
+  char_params.is_defered_read = true;
+  char_params.char_props.read = 1;
+  char_params.read_access = SEC_JUST_WORKS;
+
+  err_code = characteristic_add(m_service_handle, &char_params, &m_link_stats_handles);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  char_params.uuid = DIAG_FLASH_STATS_CHAR_UUID;
+  char_params.max_len = FSTORAGE_INSTR_RECORD_SIZE;
+
+  err_code = characteristic_add(m_service_handle, &char_params, &m_flash_stats_handles);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid_type = m_uuid_type;
+  char_params.init_len = 0;
+  char_params.is_var_len = true;
+  char_params.is_defered_write = true;
+  char_params.char_props.write = 1;
+  char_params.write_access = SEC_JUST_WORKS;
+
+  if(m_scan_filter_handler != NULL)
+  {
+    char_params.uuid = DIAG_SCAN_FILTER_CHAR_UUID;
+    char_params.max_len = DIAG_SCAN_FILTER_MAX_LEN;
+
+    err_code = characteristic_add(m_service_handle, &char_params, &m_scan_filter_handles);
+    if(err_code != NRF_SUCCESS)
+    {
+      return err_code;
+    }
+  }
+
+  if(m_settings_handler != NULL)
+  {
+    char_params.uuid = DIAG_SETTINGS_CHAR_UUID;
+    char_params.max_len = DIAG_SETTINGS_MAX_LEN;
+
+    err_code = characteristic_add(m_service_handle, &char_params, &m_settings_handles);
+  }
+
+  return err_code;
+}
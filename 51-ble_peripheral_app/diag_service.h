@@ -0,0 +1,46 @@
+#ifndef _DIAG_SERVICE_H
+#define _DIAG_SERVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Diagnostics GATT service.
+ *
+ * Link stats characteristic (read): the link_stats_encode() record of the connection reading
+ * it, built at read time.
+ * Flash stats characteristic (read): the fstorage_instr_encode() record.
+ * Scan filter characteristic (write): records for the scan gateway's filter, see
+ * scanner_filter_load(). Only there with a scan filter handler.
+ * Settings characteristic (write): { key (u16), value } of a persistent setting, decoded by the
+ * settings handler. Only there with one.
+ * Reading and writing need an encrypted link.
+ */
+
+/* 8e7f0000-3c1b-4e5a-9d2f-6b4a1c0e7d35, little endian */
+#define DIAG_SERVICE_UUID_BASE  { 0x35, 0x7D, 0x0E, 0x1C, 0x4A, 0x6B, 0x2F, 0x9D, \
+                                  0x5A, 0x4E, 0x1B, 0x3C, 0x00, 0x00, 0x7F, 0x8E }
+#define DIAG_SERVICE_UUID               0x0001
+#define DIAG_LINK_STATS_CHAR_UUID       0x0002
+#define DIAG_FLASH_STATS_CHAR_UUID      0x0003
+#define DIAG_SCAN_FILTER_CHAR_UUID      0x0004
+#define DIAG_SETTINGS_CHAR_UUID         0x0005
+
+#define DIAG_SCAN_FILTER_MAX_LEN        238   /* 34 addresses, fits one write at ATT MTU 247 */
+#define DIAG_SETTINGS_MAX_LEN           33    /* Key and a 31 character string */
+
+#define DIAG_SERVICE_BLE_OBSERVER_PRIO  2
+
+/* Applies a write, false rejects it */
+typedef bool (*diag_service_write_handler_t)(uint8_t const *p_data, uint16_t len);
+
+typedef struct
+{
+  diag_service_write_handler_t scan_filter_handler;   /* NULL: no scan filter characteristic */
+  diag_service_write_handler_t settings_handler;      /* NULL: no settings characteristic */
+} diag_service_init_t;
+
+ret_code_t diag_service_init(diag_service_init_t const *p_init);
+
+#endif /* _DIAG_SERVICE_H */
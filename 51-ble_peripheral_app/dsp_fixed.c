@@ -0,0 +1,392 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "dsp_fixed.h"
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "cmsis_compiler.h"
+#define DSP_FIXED_SIMD  1
+#else
+#define DSP_FIXED_SIMD  0
+#endif
+
+#define DSP_BIQUAD_POST_SHIFT_MAX   3   /* 5 products >> (15 - 3) still fit in 32 bits for SSAT */
+
+/* Two Q15 samples as one word, p[0] in the low half. Unaligned is fine on the Cortex-M4 */
+static inline int32_t q15x2_read(int16_t const *p)
+{
+  int32_t pair;
+
+  memcpy(&pair, p, sizeof(pair));
+
+  return pair;
+}
+
+/* {lo, hi} packed */
+static inline int32_t q15x2_pack(int16_t lo, int32_t hi)
+{
+#if DSP_FIXED_SIMD
+  return (int32_t)__PKHBT(lo, hi, 16);
+#else
+  return (int32_t)(((uint32_t)(uint16_t)lo) | ((uint32_t)hi << 16));
+#endif
+}
+
+/* acc + lo(x) * lo(y) + hi(x) * hi(y) */
+static inline int64_t smlald(int32_t x, int32_t y, int64_t acc)
+{
+#if DSP_FIXED_SIMD
+  return (int64_t)__SMLALD((uint32_t)x, (uint32_t)y, (uint64_t)acc);
+#else
+  return acc + ((int32_t)(int16_t)x * (int16_t)y) + (int64_t)((x >> 16) * (y >> 16));
+#endif
+}
+
+/* lo(x) * lo(y) - hi(x) * hi(y) */
+static inline int32_t smusd(int32_t x, int32_t y)
+{
+#if DSP_FIXED_SIMD
+  return (int32_t)__SMUSD((uint32_t)x, (uint32_t)y);
+#else
+  return ((int32_t)(int16_t)x * (int16_t)y) - ((x >> 16) * (y >> 16));
+#endif
+}
+
+static inline int16_t ssat16(int32_t value)
+{
+#if DSP_FIXED_SIMD
+  return (int16_t)__SSAT(value, 16);
+#else
+  if(value > INT16_MAX)
+  {
+    return INT16_MAX;
+  }
+  if(value < INT16_MIN)
+  {
+    return INT16_MIN;
+  }
+  return (int16_t)value;
+#endif
+}
+
+static inline int32_t sat32(int64_t value)
+{
+  if(value > INT32_MAX)
+  {
+    return INT32_MAX;
+  }
+  if(value < INT32_MIN)
+  {
+    return INT32_MIN;
+  }
+
+  return (int32_t)value;
+}
+
+/* Sum of p_x[i] * p_h[i], two pairs per step */
+static int64_t dot_q15(int16_t const *p_x, int16_t const *p_h, uint16_t count)
+{
+  int64_t  acc = 0;
+  uint16_t quads = count >> 2;
+
+  while(quads-- > 0)
+  {
+    acc = smlald(q15x2_read(p_x), q15x2_read(p_h), acc);
+    acc = smlald(q15x2_read(p_x + 2), q15x2_read(p_h + 2), acc);
+    p_x += 4;
+    p_h += 4;
+  }
+
+  for(count &= 3; count > 0; count--)
+  {
+    acc += (int32_t)*p_x++ * *p_h++;
+  }
+
+  return acc;
+}
+
+static uint32_t isqrt(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+
+  while(bit > value)
+  {
+    bit >>= 2;
+  }
+
+  while(bit != 0)
+  {
+    if(value >= (root + bit))
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+bool dsp_fir_q15_init(dsp_fir_q15_t *p_fir, int16_t const *p_coeffs, int16_t *p_state, uint16_t num_taps)
+{
+  if((p_coeffs == NULL) || (p_state == NULL) || (num_taps == 0))
+  {
+    return false;
+  }
+
+  p_fir->p_coeffs = p_coeffs;
+  p_fir->p_state = p_state;
+  p_fir->num_taps = num_taps;
+  memset(p_state, 0, (num_taps - 1) * sizeof(int16_t));
+
+  return true;
+}
+
+void dsp_fir_q15(dsp_fir_q15_t *p_fir, int16_t const *p_in, int16_t *p_out, uint16_t block)
+{
+  int16_t  *p_state = p_fir->p_state;
+  uint16_t history = p_fir->num_taps - 1;
+
+  /* State: the last num_taps - 1 inputs, then the new block */
+  memcpy(&p_state[history], p_in, block * sizeof(int16_t));
+
+  for(uint16_t i = 0; i < block; i++)
+  {
+    /* At most 65535 * 2^30 before the shift, fits in 32 bits after it */
+    p_out[i] = ssat16((int32_t)(dot_q15(&p_state[i], p_fir->p_coeffs, p_fir->num_taps) >> 15));
+  }
+
+  memmove(p_state, &p_state[block], history * sizeof(int16_t));
+}
+
+bool dsp_fir_q31_init(dsp_fir_q31_t *p_fir, int32_t const *p_coeffs, int32_t *p_state, uint16_t num_taps)
+{
+  if((p_coeffs == NULL) || (p_state == NULL) || (num_taps == 0))
+  {
+    return false;
+  }
+
+  p_fir->p_coeffs = p_coeffs;
+  p_fir->p_state = p_state;
+  p_fir->num_taps = num_taps;
+  memset(p_state, 0, (num_taps - 1) * sizeof(int32_t));
+
+  return true;
+}
+
+void dsp_fir_q31(dsp_fir_q31_t *p_fir, int32_t const *p_in, int32_t *p_out, uint16_t block)
+{
+  int32_t  *p_state = p_fir->p_state;
+  uint16_t history = p_fir->num_taps - 1;
+
+  memcpy(&p_state[history], p_in, block * sizeof(int32_t));
+
+  for(uint16_t i = 0; i < block; i++)
+  {
+    int32_t const *p_x = &p_state[i];
+    int64_t       acc = 0;
+
+    /* SMLAL, one cycle per tap */
+    for(uint16_t k = 0; k < p_fir->num_taps; k++)
+    {
+      acc += (int64_t)p_x[k] * p_fir->p_coeffs[k];
+    }
+
+    p_out[i] = sat32(acc >> 31);
+  }
+
+  memmove(p_state, &p_state[block], history * sizeof(int32_t));
+}
+
+bool dsp_biquad_q15_init(dsp_biquad_q15_t *p_iir, int16_t const *p_coeffs, int32_t *p_state,
+                         uint8_t num_stages, uint8_t post_shift)
+{
+  if((p_coeffs == NULL) || (p_state == NULL) || (num_stages == 0) ||
+     (post_shift > DSP_BIQUAD_POST_SHIFT_MAX))
+  {
+    return false;
+  }
+
+  p_iir->p_coeffs = p_coeffs;
+  p_iir->p_state = p_state;
+  p_iir->num_stages = num_stages;
+  p_iir->post_shift = post_shift;
+  memset(p_state, 0, num_stages * 2 * sizeof(int32_t));
+
+  return true;
+}
+
+void dsp_biquad_q15(dsp_biquad_q15_t *p_iir, int16_t const *p_in, int16_t *p_out, uint16_t block)
+{
+  uint8_t shift = 15 - p_iir->post_shift;
+
+  for(uint8_t stage = 0; stage < p_iir->num_stages; stage++)
+  {
+    int16_t const *p_c = &p_iir->p_coeffs[stage * 5];
+    int32_t       b0 = p_c[0];
+    int32_t       b12 = q15x2_read(&p_c[1]);
+    int32_t       a12 = q15x2_read(&p_c[3]);
+    int32_t       x12 = p_iir->p_state[stage * 2];
+    int32_t       y12 = p_iir->p_state[(stage * 2) + 1];
+
+    /* The first stage reads the input, the others filter the output in place */
+    int16_t const *p_x = (stage == 0) ? p_in : p_out;
+
+    for(uint16_t i = 0; i < block; i++)
+    {
+      int16_t x0 = p_x[i];
+      int64_t acc = (int64_t)b0 * x0;
+      int16_t y0;
+
+      acc = smlald(b12, x12, acc);
+      acc = smlald(a12, y12, acc);
+      y0 = ssat16((int32_t)(acc >> shift));
+
+      /* Shift the delay lines: the new sample in the low half, the old low half up */
+      x12 = q15x2_pack(x0, x12);
+      y12 = q15x2_pack(y0, y12);
+      p_out[i] = y0;
+    }
+
+    p_iir->p_state[stage * 2] = x12;
+    p_iir->p_state[(stage * 2) + 1] = y12;
+  }
+}
+
+bool dsp_biquad_q31_init(dsp_biquad_q31_t *p_iir, int32_t const *p_coeffs, int32_t *p_state,
+                         uint8_t num_stages, uint8_t post_shift)
+{
+  if((p_coeffs == NULL) || (p_state == NULL) || (num_stages == 0) ||
+     (post_shift > DSP_BIQUAD_POST_SHIFT_MAX))
+  {
+    return false;
+  }
+
+  p_iir->p_coeffs = p_coeffs;
+  p_iir->p_state = p_state;
+  p_iir->num_stages = num_stages;
+  p_iir->post_shift = post_shift;
+  memset(p_state, 0, num_stages * 4 * sizeof(int32_t));
+
+  return true;
+}
+
+void dsp_biquad_q31(dsp_biquad_q31_t *p_iir, int32_t const *p_in, int32_t *p_out, uint16_t block)
+{
+  uint8_t shift = 31 - p_iir->post_shift;
+
+  for(uint8_t stage = 0; stage < p_iir->num_stages; stage++)
+  {
+    int32_t const *p_c = &p_iir->p_coeffs[stage * 5];
+    int32_t       *p_s = &p_iir->p_state[stage * 4];
+    int32_t       x1 = p_s[0], x2 = p_s[1], y1 = p_s[2], y2 = p_s[3];
+    int32_t const *p_x = (stage == 0) ? p_in : p_out;
+
+    for(uint16_t i = 0; i < block; i++)
+    {
+      int32_t x0 = p_x[i];
+      int64_t acc = ((int64_t)p_c[0] * x0) + ((int64_t)p_c[1] * x1) + ((int64_t)p_c[2] * x2) +
+                    ((int64_t)p_c[3] * y1) + ((int64_t)p_c[4] * y2);
+      int32_t y0 = sat32(acc >> shift);
+
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = y0;
+      p_out[i] = y0;
+    }
+
+    p_s[0] = x1;
+    p_s[1] = x2;
+    p_s[2] = y1;
+    p_s[3] = y2;
+  }
+}
+
+bool dsp_decim_q15_init(dsp_decim_q15_t *p_decim, int16_t const *p_coeffs, int16_t *p_state,
+                        uint16_t num_taps, uint8_t factor)
+{
+  if(factor == 0)
+  {
+    return false;
+  }
+
+  p_decim->factor = factor;
+
+  return dsp_fir_q15_init(&p_decim->fir, p_coeffs, p_state, num_taps);
+}
+
+uint16_t dsp_decim_q15(dsp_decim_q15_t *p_decim, int16_t const *p_in, int16_t *p_out, uint16_t block)
+{
+  dsp_fir_q15_t *p_fir = &p_decim->fir;
+  int16_t       *p_state = p_fir->p_state;
+  uint16_t      history = p_fir->num_taps - 1;
+  uint16_t      outputs = block / p_decim->factor;
+
+  memcpy(&p_state[history], p_in, block * sizeof(int16_t));
+
+  /* Output i is the filter at input (i + 1) * factor - 1, the last of each group */
+  for(uint16_t i = 0; i < outputs; i++)
+  {
+    int16_t const *p_x = &p_state[(i * p_decim->factor) + p_decim->factor - 1];
+
+    p_out[i] = ssat16((int32_t)(dot_q15(p_x, p_fir->p_coeffs, p_fir->num_taps) >> 15));
+  }
+
+  memmove(p_state, &p_state[block], history * sizeof(int16_t));
+
+  return outputs;
+}
+
+bool dsp_rms_q15_init(dsp_rms_q15_t *p_rms, int16_t *p_history, uint16_t window)
+{
+  if((p_history == NULL) || (window == 0) || ((window & (window - 1)) != 0))
+  {
+    return false;
+  }
+
+  p_rms->p_history = p_history;
+  p_rms->window = window;
+  p_rms->pos = 0;
+  p_rms->sum_sq = 0;
+  p_rms->window_log2 = 0;
+  while((1u << p_rms->window_log2) < window)
+  {
+    p_rms->window_log2++;
+  }
+  memset(p_history, 0, window * sizeof(int16_t));
+
+  return true;
+}
+
+void dsp_rms_q15(dsp_rms_q15_t *p_rms, int16_t const *p_in, int16_t *p_out, uint16_t block)
+{
+  for(uint16_t i = 0; i < block; i++)
+  {
+    int16_t new_sample = p_in[i];
+    int32_t pair = q15x2_pack(new_sample, p_rms->p_history[p_rms->pos]);
+
+    /* new^2 - old^2 in one instruction */
+    p_rms->sum_sq += (int64_t)smusd(pair, pair);
+    p_rms->p_history[p_rms->pos] = new_sample;
+    p_rms->pos = (p_rms->pos + 1) & (p_rms->window - 1);
+
+    if(p_out != NULL)
+    {
+      p_out[i] = dsp_rms_q15_get(p_rms);
+    }
+  }
+}
+
+int16_t dsp_rms_q15_get(dsp_rms_q15_t const *p_rms)
+{
+  /* Mean square is Q30 and at most 2^30, its root Q15 */
+  uint32_t root = isqrt((uint32_t)(p_rms->sum_sq >> p_rms->window_log2));
+
+  return (root > INT16_MAX) ? INT16_MAX : (int16_t)root;
+}
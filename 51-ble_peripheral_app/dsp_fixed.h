@@ -0,0 +1,103 @@
+#ifndef _DSP_FIXED_H
+#define _DSP_FIXED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Fixed point filter kernels for sample streams: FIR, biquad IIR cascade, decimating FIR and
+ * moving RMS in Q15, FIR and biquad in Q31.
+ *
+ * On a core with the DSP extension (__ARM_FEATURE_DSP, the Cortex-M4) the Q15 kernels work on
+ * pairs of samples with SMLALD / SMUSD and saturate with SSAT. Elsewhere the same operations are
+ * plain C with the same integer semantics, so both builds give bit identical output and the
+ * kernels can be checked on a host.
+ *
+ * Block processing: state carries over between blocks, a stream can be cut anywhere. Nothing
+ * is allocated, the caller provides the coefficient and state arrays.
+ */
+
+/* FIR. Coefficients in time reversed order, h[N-1] first, as in CMSIS-DSP.
+ * Q15: accumulated in 64 bits, no overflow inside the sum.
+ * Q31: accumulated in 64 bits as 2.62, scale the input down by log2(num_taps) bits if the
+ * sum can exceed 2.
+ */
+typedef struct
+{
+  int16_t const *p_coeffs;
+  int16_t       *p_state;     /* num_taps - 1 + block_max samples */
+  uint16_t      num_taps;
+} dsp_fir_q15_t;
+
+typedef struct
+{
+  int32_t const *p_coeffs;
+  int32_t       *p_state;     /* num_taps - 1 + block_max samples */
+  uint16_t      num_taps;
+} dsp_fir_q31_t;
+
+/* Biquad cascade, direct form I. Per stage {b0, b1, b2, a1, a2}, with
+ * y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+ * (the a coefficients negated compared to MATLAB), in Q(15 - post_shift) or Q(31 - post_shift)
+ * so that coefficients up to 2^post_shift fit.
+ */
+typedef struct
+{
+  int16_t const *p_coeffs;    /* 5 per stage */
+  int32_t       *p_state;     /* 2 per stage: {x[n-1], x[n-2]} and {y[n-1], y[n-2]} packed */
+  uint8_t       num_stages;
+  uint8_t       post_shift;
+} dsp_biquad_q15_t;
+
+typedef struct
+{
+  int32_t const *p_coeffs;    /* 5 per stage */
+  int32_t       *p_state;     /* 4 per stage: x[n-1], x[n-2], y[n-1], y[n-2] */
+  uint8_t       num_stages;
+  uint8_t       post_shift;
+} dsp_biquad_q31_t;
+
+/* FIR evaluated at every factor-th input only: low pass and downsample in one pass */
+typedef struct
+{
+  dsp_fir_q15_t fir;
+  uint8_t       factor;
+} dsp_decim_q15_t;
+
+/* RMS over the last window samples. window is a power of two */
+typedef struct
+{
+  int16_t  *p_history;        /* window samples */
+  uint64_t sum_sq;
+  uint16_t window;
+  uint16_t pos;
+  uint8_t  window_log2;
+} dsp_rms_q15_t;
+
+/* The init functions clear the state. They return false on a bad configuration */
+bool dsp_fir_q15_init(dsp_fir_q15_t *p_fir, int16_t const *p_coeffs, int16_t *p_state, uint16_t num_taps);
+void dsp_fir_q15(dsp_fir_q15_t *p_fir, int16_t const *p_in, int16_t *p_out, uint16_t block);
+
+bool dsp_fir_q31_init(dsp_fir_q31_t *p_fir, int32_t const *p_coeffs, int32_t *p_state, uint16_t num_taps);
+void dsp_fir_q31(dsp_fir_q31_t *p_fir, int32_t const *p_in, int32_t *p_out, uint16_t block);
+
+bool dsp_biquad_q15_init(dsp_biquad_q15_t *p_iir, int16_t const *p_coeffs, int32_t *p_state,
+                         uint8_t num_stages, uint8_t post_shift);
+void dsp_biquad_q15(dsp_biquad_q15_t *p_iir, int16_t const *p_in, int16_t *p_out, uint16_t block);
+
+bool dsp_biquad_q31_init(dsp_biquad_q31_t *p_iir, int32_t const *p_coeffs, int32_t *p_state,
+                         uint8_t num_stages, uint8_t post_shift);
+void dsp_biquad_q31(dsp_biquad_q31_t *p_iir, int32_t const *p_in, int32_t *p_out, uint16_t block);
+
+/* block is a multiple of factor, p_state holds num_taps - 1 + block_max samples */
+bool dsp_decim_q15_init(dsp_decim_q15_t *p_decim, int16_t const *p_coeffs, int16_t *p_state,
+                        uint16_t num_taps, uint8_t factor);
+/* Returns the number of outputs, block / factor */
+uint16_t dsp_decim_q15(dsp_decim_q15_t *p_decim, int16_t const *p_in, int16_t *p_out, uint16_t block);
+
+bool dsp_rms_q15_init(dsp_rms_q15_t *p_rms, int16_t *p_history, uint16_t window);
+/* p_out: the RMS after each sample, NULL to only update the window */
+void dsp_rms_q15(dsp_rms_q15_t *p_rms, int16_t const *p_in, int16_t *p_out, uint16_t block);
+/* RMS of the current window, Q15 */
+int16_t dsp_rms_q15_get(dsp_rms_q15_t const *p_rms);
+
+#endif /* _DSP_FIXED_H */
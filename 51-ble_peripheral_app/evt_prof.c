@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "app_util_platform.h"
+#include "nrf.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "evt_prof.h"
+
+#define CYCLES_PER_US   (SystemCoreClock / 1000000)
+
+STATIC_ASSERT(EVT_PROF_END_PRIO > 3);   /* The application observer runs at 3 */
+
+static evt_prof_stats_t m_irq;
+static evt_prof_stats_t m_thread;
+static uint32_t m_start_cycles = 0;
+
+static void evt_start(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  m_start_cycles = DWT->CYCCNT;
+}
+
+static void evt_end(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  uint32_t us = (DWT->CYCCNT - m_start_cycles) / CYCLES_PER_US;
+  evt_prof_stats_t *p_stats = (__get_IPSR() != 0) ? &m_irq : &m_thread;
+
+  p_stats->count++;
+  p_stats->total_us += us;
+  if(us > p_stats->max_us)
+  {
+    p_stats->max_us = us;
+    p_stats->max_evt_id = p_ble_evt->header.evt_id;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_evt_prof_start, EVT_PROF_START_PRIO, evt_start, NULL);
+NRF_SDH_BLE_OBSERVER(m_evt_prof_end, EVT_PROF_END_PRIO, evt_end, NULL);
+
+ret_code_t evt_prof_init(void)
+{
+  memset(&m_irq, 0, sizeof(m_irq));
+  memset(&m_thread, 0, sizeof(m_thread));
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  return NRF_SUCCESS;
+}
+
+void evt_prof_stats_get(evt_prof_stats_t *p_irq, evt_prof_stats_t *p_thread)
+{
+  CRITICAL_REGION_ENTER();
+  *p_irq = m_irq;
+  *p_thread = m_thread;
+  CRITICAL_REGION_EXIT();
+}
+
+void evt_prof_log(void)
+{
+  evt_prof_stats_t irq;
+  evt_prof_stats_t thread;
+
+  evt_prof_stats_get(&irq, &thread);
+
+  NRF_LOG_INFO("BLE dispatch in interrupt: %u events, max %u us (evt 0x%02X), avg %u us",
+               irq.count, irq.max_us, irq.max_evt_id,
+               irq.count ? (uint32_t)(irq.total_us / irq.count) : 0);
+  NRF_LOG_INFO("BLE dispatch in thread: %u events, max %u us (evt 0x%02X), avg %u us",
+               thread.count, thread.max_us, thread.max_evt_id,
+               thread.count ? (uint32_t)(thread.total_us / thread.count) : 0);
+}
@@ -0,0 +1,33 @@
+#ifndef _EVT_PROF_H
+#define _EVT_PROF_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* BLE event dispatch profiler.
+ *
+ * Times the dispatch of each BLE event to all observers with the DWT cycle counter, from an
+ * observer at the first priority to one at the last. The times are kept apart for dispatches
+ * in interrupt context (NRF_SDH_DISPATCH_MODEL_INTERRUPT) and in thread mode (app_scheduler),
+ * so the worst case interrupt time of both dispatch models can be compared.
+ */
+
+#define EVT_PROF_START_PRIO   0
+#define EVT_PROF_END_PRIO     (NRF_SDH_BLE_OBSERVER_PRIO_LEVELS - 1)   /* After all the other observers */
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t max_us;
+  uint16_t max_evt_id;   /* Event of the worst case dispatch */
+  uint64_t total_us;
+} evt_prof_stats_t;
+
+ret_code_t evt_prof_init(void);
+
+void evt_prof_stats_get(evt_prof_stats_t *p_irq, evt_prof_stats_t *p_thread);
+
+void evt_prof_log(void);
+
+#endif /* _EVT_PROF_H */
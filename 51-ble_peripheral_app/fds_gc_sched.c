@@ -0,0 +1,257 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble_conn_state.h"
+#include "fds.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "fds_gc_sched.h"
+#include "radio_sched.h"
+
+APP_TIMER_DEF(m_check_timer);
+
+static fds_gc_sched_init_t m_config;
+static bool     m_initialized = false;
+static bool     m_running = false;
+static bool     m_external = false;   /* Collection started by another FDS user outstanding */
+static bool     m_job_queued = false;
+static uint32_t m_start_ticks = 0;
+static uint32_t m_freeable = 0;       /* Freeable words when the collection started */
+static uint16_t m_traffic = 0;        /* BLE data events in this check interval */
+static uint8_t  m_defer_count = 0;
+
+static fds_gc_sched_stats_t m_stats;
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static void run_begin(void)
+{
+  fds_stat_t stat = {0};
+
+  (void)fds_stat(&stat);
+
+  m_start_ticks = app_timer_cnt_get();
+  m_freeable = stat.freeable_words;
+}
+
+static void run_end(ret_code_t result)
+{
+  uint32_t duration_ms = ticks_to_ms(app_timer_cnt_diff_compute(app_timer_cnt_get(), m_start_ticks));
+
+  m_stats.runs++;
+  m_stats.words_freed += m_freeable;
+  m_stats.last_ms = duration_ms;
+  m_stats.max_ms = MAX(m_stats.max_ms, duration_ms);
+  m_stats.total_ms += duration_ms;
+
+  NRF_LOG_DEBUG("FDS garbage collection: %u words in %u ms, result %d", m_freeable, duration_ms, result);
+}
+
+static ret_code_t gc_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  /* A collection already queued reclaims the same space */
+  if(m_running || m_external)
+  {
+    return NRF_SUCCESS;
+  }
+
+  run_begin();
+
+  err_code = fds_gc();
+  if(err_code == NRF_SUCCESS)
+  {
+    m_running = true;
+    m_defer_count = 0;
+  }
+
+  return err_code;
+}
+
+static void gc_job(void *p_context)
+{
+  m_job_queued = false;
+
+  if(!m_running && !m_external && (gc_start() == NRF_SUCCESS))
+  {
+    m_stats.proactive++;
+  }
+}
+
+static void check_timeout_handler(void *p_context)
+{
+  fds_stat_t stat = {0};
+  uint16_t   traffic = m_traffic;
+  bool       urgent = false;
+  bool       dirty = false;
+
+  m_traffic = 0;
+
+  if(m_running || m_external || m_job_queued || (fds_stat(&stat) != NRF_SUCCESS))
+  {
+    return;
+  }
+
+  /* Nothing to reclaim when the free run is short: a collection would only cost an erase */
+  urgent = (stat.freeable_words > 0) && (stat.largest_contig < m_config.min_free_words);
+  dirty = (stat.freeable_words > 0) &&
+          ((stat.freeable_words * 100) >= (stat.words_used * m_config.dirty_pct));
+
+  if(!urgent && !dirty)
+  {
+    m_defer_count = 0;
+    return;
+  }
+
+  /* Wait for a quieter interval, or for the links to go */
+  if(!urgent && (ble_conn_state_conn_count() > 0) && (traffic > m_config.busy_events) &&
+     (m_defer_count < m_config.max_defer))
+  {
+    m_defer_count++;
+    m_stats.deferred++;
+    return;
+  }
+
+  if(radio_sched_job_put(gc_job, NULL) == NRF_SUCCESS)
+  {
+    m_job_queued = true;
+  }
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+  if(p_evt->id != FDS_EVT_GC)
+  {
+    return;
+  }
+
+  if(m_running)
+  {
+    m_running = false;
+    run_end(p_evt->result);
+
+    /* FDS runs the queued collections one after the other */
+    if(m_external)
+    {
+      run_begin();
+    }
+    return;
+  }
+
+  /* Started by another FDS user. Timed when it was reported through fds_gc_sched_storage_full() */
+  m_stats.external++;
+  if(m_external)
+  {
+    m_external = false;
+    run_end(p_evt->result);
+  }
+  else
+  {
+    m_stats.runs++;
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GATTS_EVT_WRITE:
+    case BLE_GATTS_EVT_HVC:
+    case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+      m_traffic = (m_traffic < UINT16_MAX) ? (m_traffic + 1) : m_traffic;
+      break;
+
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+      m_traffic = (uint16_t)MIN(UINT16_MAX, m_traffic + p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_fds_gc_sched_observer, FDS_GC_SCHED_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t fds_gc_sched_init(fds_gc_sched_init_t const *p_init)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if((p_init->dirty_pct == 0) || (p_init->dirty_pct > 100) || (p_init->check_interval < APP_TIMER_MIN_TIMEOUT_TICKS))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  m_config = *p_init;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  err_code = fds_register(fds_evt_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = app_timer_create(&m_check_timer, APP_TIMER_MODE_REPEATED, check_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  m_initialized = true;
+
+  return app_timer_start(m_check_timer, m_config.check_interval, NULL);
+}
+
+ret_code_t fds_gc_sched_space_needed(void)
+{
+  if(!m_initialized)
+  {
+    return fds_gc();
+  }
+
+  m_stats.stalls++;
+
+  return gc_start();
+}
+
+void fds_gc_sched_storage_full(void)
+{
+  if(!m_initialized)
+  {
+    return;
+  }
+
+  m_stats.stalls++;
+
+  if(!m_external)
+  {
+    m_external = true;
+    if(!m_running)
+    {
+      run_begin();
+    }
+  }
+}
+
+bool fds_gc_sched_is_running(void)
+{
+  return m_running || m_external;
+}
+
+void fds_gc_sched_stats_get(fds_gc_sched_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void fds_gc_sched_stats_log(void)
+{
+  NRF_LOG_INFO("FDS GC: %u runs (%u proactive, %u by other users, %u deferred for traffic), %u writes stalled",
+               m_stats.runs, m_stats.proactive, m_stats.external, m_stats.deferred, m_stats.stalls);
+  NRF_LOG_INFO("FDS GC: %u words freed, last %u ms, max %u ms, total %u ms",
+               m_stats.words_freed, m_stats.last_ms, m_stats.max_ms, m_stats.total_ms);
+}
@@ -0,0 +1,69 @@
+#ifndef _FDS_GC_SCHED_H
+#define _FDS_GC_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* FDS garbage collection scheduler.
+ *
+ * FDS only reclaims the space of deleted and updated records in fds_gc(). Instead of waiting
+ * for a write to fail, the scheduler checks fds_stat() every check_interval and collects once
+ * the freeable words reach dirty_pct of the used words, or the largest free run gets below
+ * min_free_words. The collection starts right after a radio event (radio_sched).
+ *
+ * BLE data traffic (GATT writes, notifications and indications) is counted per check interval.
+ * Above busy_events a wanted collection is deferred, up to max_defer checks; a low free run
+ * is never deferred.
+ *
+ * FDS users whose write fails with FDS_ERR_NO_SPACE_IN_FLASH call fds_gc_sched_space_needed()
+ * instead of fds_gc(), which counts the stall and collects at once. They continue on
+ * FDS_EVT_GC as before.
+ *
+ * Collections started by other FDS users are counted as well. Peer Manager collects itself in
+ * pm_handler_flash_clean() on PM_EVT_STORAGE_FULL; reporting that event with
+ * fds_gc_sched_storage_full() times the collection and holds the scheduler off until it is done.
+ */
+
+#define FDS_GC_SCHED_BLE_OBSERVER_PRIO  2
+
+typedef struct
+{
+  uint8_t  dirty_pct;         /* Freeable words, % of the used words */
+  uint16_t min_free_words;    /* Largest free run below this: collect now */
+  uint32_t check_interval;    /* app_timer ticks */
+  uint16_t busy_events;       /* BLE data events per check interval that make the link busy */
+  uint8_t  max_defer;         /* Checks a collection may be deferred by traffic */
+} fds_gc_sched_init_t;
+
+typedef struct
+{
+  uint32_t runs;              /* Collections, all causes */
+  uint32_t proactive;         /* Started by the dirty ratio or low free space */
+  uint32_t external;          /* Started by other FDS users, e.g. Peer Manager */
+  uint32_t stalls;            /* Writes that failed for lack of space */
+  uint32_t deferred;          /* Checks that deferred a collection for traffic */
+  uint32_t words_freed;       /* Freeable words at the start of the collections */
+  uint32_t last_ms;
+  uint32_t max_ms;
+  uint32_t total_ms;
+} fds_gc_sched_stats_t;
+
+/* Call before fds_init() (pm_init()), it registers an FDS user */
+ret_code_t fds_gc_sched_init(fds_gc_sched_init_t const *p_init);
+
+/* A write failed with FDS_ERR_NO_SPACE_IN_FLASH. Collects now, unless a collection runs */
+ret_code_t fds_gc_sched_space_needed(void);
+
+/* Peer Manager ran out of flash (PM_EVT_STORAGE_FULL), pm_handler_flash_clean() collects */
+void fds_gc_sched_storage_full(void);
+
+/* True while any collection is outstanding, also one started by Peer Manager */
+bool fds_gc_sched_is_running(void);
+
+void fds_gc_sched_stats_get(fds_gc_sched_stats_t *p_stats);
+
+void fds_gc_sched_stats_log(void);
+
+#endif /* _FDS_GC_SCHED_H */
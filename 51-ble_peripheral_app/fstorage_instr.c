@@ -0,0 +1,314 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+#include "nrf_log.h"
+#include "nrf_sdh_soc.h"
+
+#include "fstorage_instr.h"
+
+#define SOC_OBSERVER_PRIO   0
+#define PENDING_MAX         (NRF_FSTORAGE_SD_QUEUE_SIZE + 1)
+
+typedef struct
+{
+  uint32_t ticks;
+  uint8_t  op;
+} pending_op_t;
+
+static uint16_t const m_bin_ms[FSTORAGE_INSTR_HIST_BINS - 1] = { 5, 10, 20, 50, 100, 200, 500 };
+
+static nrf_fstorage_evt_handler_t m_user_handlers[FSTORAGE_INSTR_INSTANCES_MAX];
+static uint8_t      m_instance_count = 0;
+
+/* Operations in flight, oldest first */
+static pending_op_t m_pending[PENDING_MAX];
+static uint8_t      m_pending_head = 0;
+static uint8_t      m_pending_count = 0;
+static uint8_t      m_denials = 0;          /* Of the oldest operation */
+
+static fstorage_instr_stats_t m_stats;
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static void op_submitted(uint8_t op)
+{
+  pending_op_t *p_op = NULL;
+
+  CRITICAL_REGION_ENTER();
+  if(m_pending_count < PENDING_MAX)
+  {
+    p_op = &m_pending[(m_pending_head + m_pending_count) % PENDING_MAX];
+    p_op->ticks = app_timer_cnt_get();
+    p_op->op = op;
+    m_pending_count++;
+    m_stats.depth_max = MAX(m_stats.depth_max, m_pending_count);
+  }
+  m_stats.ops[op]++;
+  CRITICAL_REGION_EXIT();
+}
+
+static void op_completed(nrf_fstorage_evt_t const *p_evt)
+{
+  pending_op_t op;
+  uint32_t     ms = 0;
+  uint8_t      bin = 0;
+
+  if(p_evt->result != NRF_SUCCESS)
+  {
+    m_stats.failed++;
+  }
+
+  CRITICAL_REGION_ENTER();
+  if(m_pending_count == 0)
+  {
+    /* Submitted before attaching */
+    CRITICAL_REGION_EXIT();
+    return;
+  }
+  op = m_pending[m_pending_head];
+  m_pending_head = (m_pending_head + 1) % PENDING_MAX;
+  m_pending_count--;
+  CRITICAL_REGION_EXIT();
+
+  ms = ticks_to_ms(app_timer_cnt_diff_compute(app_timer_cnt_get(), op.ticks));
+  while((bin < ARRAY_SIZE(m_bin_ms)) && (ms > m_bin_ms[bin]))
+  {
+    bin++;
+  }
+
+  if(m_stats.hist[op.op][bin] < UINT16_MAX)
+  {
+    m_stats.hist[op.op][bin]++;
+  }
+  m_stats.max_ms[op.op] = MAX(m_stats.max_ms[op.op], ms);
+  m_stats.retries_max = MAX(m_stats.retries_max, m_denials);
+  m_denials = 0;
+}
+
+/* One forwarding handler per instance, the events do not tell the instance */
+static void evt_forward(uint8_t idx, nrf_fstorage_evt_t *p_evt)
+{
+  if((p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT) || (p_evt->id == NRF_FSTORAGE_EVT_ERASE_RESULT))
+  {
+    op_completed(p_evt);
+  }
+
+  if(m_user_handlers[idx] != NULL)
+  {
+    m_user_handlers[idx](p_evt);
+  }
+}
+
+static void evt_handler_0(nrf_fstorage_evt_t *p_evt) { evt_forward(0, p_evt); }
+static void evt_handler_1(nrf_fstorage_evt_t *p_evt) { evt_forward(1, p_evt); }
+static void evt_handler_2(nrf_fstorage_evt_t *p_evt) { evt_forward(2, p_evt); }
+static void evt_handler_3(nrf_fstorage_evt_t *p_evt) { evt_forward(3, p_evt); }
+
+static nrf_fstorage_evt_handler_t const m_forward_handlers[FSTORAGE_INSTR_INSTANCES_MAX] =
+{
+  evt_handler_0, evt_handler_1, evt_handler_2, evt_handler_3,
+};
+
+static ret_code_t api_init(nrf_fstorage_t *p_fs, void *p_param)
+{
+  return nrf_fstorage_sd.init(p_fs, p_param);
+}
+
+static ret_code_t api_uninit(nrf_fstorage_t *p_fs, void *p_param)
+{
+  return nrf_fstorage_sd.uninit(p_fs, p_param);
+}
+
+static ret_code_t api_read(nrf_fstorage_t const *p_fs, uint32_t src, void *p_dest, uint32_t len)
+{
+  return nrf_fstorage_sd.read(p_fs, src, p_dest, len);
+}
+
+static ret_code_t api_write(nrf_fstorage_t const *p_fs, uint32_t dest, void const *p_src, uint32_t len, void *p_param)
+{
+  ret_code_t err_code = nrf_fstorage_sd.write(p_fs, dest, p_src, len, p_param);
+
+  if(err_code == NRF_SUCCESS)
+  {
+    m_stats.words += len / sizeof(uint32_t);
+    op_submitted(FSTORAGE_INSTR_OP_WRITE);
+  }
+  else if(err_code == NRF_ERROR_NO_MEM)
+  {
+    m_stats.queue_full++;
+  }
+
+  return err_code;
+}
+
+static ret_code_t api_erase(nrf_fstorage_t const *p_fs, uint32_t page_addr, uint32_t len, void *p_param)
+{
+  ret_code_t err_code = nrf_fstorage_sd.erase(p_fs, page_addr, len, p_param);
+
+  if(err_code == NRF_SUCCESS)
+  {
+    op_submitted(FSTORAGE_INSTR_OP_ERASE);
+  }
+  else if(err_code == NRF_ERROR_NO_MEM)
+  {
+    m_stats.queue_full++;
+  }
+
+  return err_code;
+}
+
+static uint8_t const *api_rmap(nrf_fstorage_t const *p_fs, uint32_t addr)
+{
+  return nrf_fstorage_sd.rmap(p_fs, addr);
+}
+
+static uint8_t *api_wmap(nrf_fstorage_t const *p_fs, uint32_t addr)
+{
+  return nrf_fstorage_sd.wmap(p_fs, addr);
+}
+
+static bool api_is_busy(nrf_fstorage_t const *p_fs)
+{
+  return nrf_fstorage_sd.is_busy(p_fs);
+}
+
+static nrf_fstorage_api_t const m_api =
+{
+  .init    = api_init,
+  .uninit  = api_uninit,
+  .read    = api_read,
+  .write   = api_write,
+  .erase   = api_erase,
+  .rmap    = api_rmap,
+  .wmap    = api_wmap,
+  .is_busy = api_is_busy,
+};
+
+/* Flash operation results of the SoftDevice, also seen by nrf_fstorage_sd. It is the only
+ * user of sd_flash_write() and sd_flash_page_erase()
+ */
+static void soc_evt_handler(uint32_t evt_id, void *p_context)
+{
+  switch(evt_id)
+  {
+    case NRF_EVT_FLASH_OPERATION_SUCCESS:
+      m_stats.chunks++;
+      break;
+
+    case NRF_EVT_FLASH_OPERATION_ERROR:
+      m_stats.denials++;
+      if(m_denials < UINT8_MAX)
+      {
+        m_denials++;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_SOC_OBSERVER(m_fstorage_instr_soc_observer, SOC_OBSERVER_PRIO, soc_evt_handler, NULL);
+
+ret_code_t fstorage_instr_attach(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  for(uint32_t i = 0; i < NRF_FSTORAGE_INSTANCE_CNT; i++)
+  {
+    nrf_fstorage_t *p_fs = NRF_FSTORAGE_INSTANCE_GET(i);
+
+    /* Not initialized, or not on the SoftDevice backend */
+    if(p_fs->p_api != &nrf_fstorage_sd)
+    {
+      continue;
+    }
+
+    if(m_instance_count == FSTORAGE_INSTR_INSTANCES_MAX)
+    {
+      err_code = NRF_ERROR_NO_MEM;
+      break;
+    }
+
+    CRITICAL_REGION_ENTER();
+    m_user_handlers[m_instance_count] = p_fs->evt_handler;
+    p_fs->evt_handler = m_forward_handlers[m_instance_count];
+    p_fs->p_api = &m_api;
+    CRITICAL_REGION_EXIT();
+
+    m_instance_count++;
+  }
+
+  NRF_LOG_INFO("Flash instrumentation on %d fstorage instances", m_instance_count);
+
+  return err_code;
+}
+
+void fstorage_instr_stats_get(fstorage_instr_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+uint16_t fstorage_instr_encode(uint8_t *p_buf, uint16_t len)
+{
+  uint16_t pos = 0;
+
+  if(len < FSTORAGE_INSTR_RECORD_SIZE)
+  {
+    return 0;
+  }
+
+  p_buf[pos++] = FSTORAGE_INSTR_RECORD_VERSION;
+  p_buf[pos++] = m_stats.depth_max;
+  p_buf[pos++] = m_stats.retries_max;
+  p_buf[pos++] = NRF_FSTORAGE_SD_QUEUE_SIZE;
+  pos += uint32_encode(m_stats.ops[FSTORAGE_INSTR_OP_WRITE], &p_buf[pos]);
+  pos += uint32_encode(m_stats.ops[FSTORAGE_INSTR_OP_ERASE], &p_buf[pos]);
+  pos += uint32_encode(m_stats.words, &p_buf[pos]);
+  pos += uint32_encode(m_stats.chunks, &p_buf[pos]);
+  pos += uint32_encode(m_stats.denials, &p_buf[pos]);
+  pos += uint32_encode(m_stats.failed, &p_buf[pos]);
+  pos += uint32_encode(m_stats.queue_full, &p_buf[pos]);
+  for(uint8_t op = 0; op < FSTORAGE_INSTR_OP_COUNT; op++)
+  {
+    pos += uint32_encode(m_stats.max_ms[op], &p_buf[pos]);
+  }
+  for(uint8_t op = 0; op < FSTORAGE_INSTR_OP_COUNT; op++)
+  {
+    for(uint8_t i = 0; i < FSTORAGE_INSTR_HIST_BINS; i++)
+    {
+      pos += uint16_encode(m_stats.hist[op][i], &p_buf[pos]);
+    }
+  }
+
+  return pos;
+}
+
+void fstorage_instr_stats_log(void)
+{
+  uint16_t const *p_write = m_stats.hist[FSTORAGE_INSTR_OP_WRITE];
+  uint16_t const *p_erase = m_stats.hist[FSTORAGE_INSTR_OP_ERASE];
+
+  NRF_LOG_INFO("Flash: %u writes (%u words), %u erases, queue max %d of %d, %u rejected",
+               m_stats.ops[FSTORAGE_INSTR_OP_WRITE], m_stats.words, m_stats.ops[FSTORAGE_INSTR_OP_ERASE],
+               m_stats.depth_max, NRF_FSTORAGE_SD_QUEUE_SIZE, m_stats.queue_full);
+  NRF_LOG_INFO("Flash: %u chunks, %u timeslot denials (max %d per op of %d), %u failed",
+               m_stats.chunks, m_stats.denials, m_stats.retries_max, NRF_FSTORAGE_SD_MAX_RETRIES, m_stats.failed);
+  NRF_LOG_INFO("Flash write ms <=5/10/20/50: %u %u %u %u, max %u ms",
+               p_write[0], p_write[1], p_write[2], p_write[3], m_stats.max_ms[FSTORAGE_INSTR_OP_WRITE]);
+  NRF_LOG_INFO("Flash write ms <=100/200/500/more: %u %u %u %u",
+               p_write[4], p_write[5], p_write[6], p_write[7]);
+  NRF_LOG_INFO("Flash erase ms <=5/10/20/50: %u %u %u %u, max %u ms",
+               p_erase[0], p_erase[1], p_erase[2], p_erase[3], m_stats.max_ms[FSTORAGE_INSTR_OP_ERASE]);
+  NRF_LOG_INFO("Flash erase ms <=100/200/500/more: %u %u %u %u",
+               p_erase[4], p_erase[5], p_erase[6], p_erase[7]);
+}
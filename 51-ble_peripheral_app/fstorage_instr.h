@@ -0,0 +1,66 @@
+#ifndef _FSTORAGE_INSTR_H
+#define _FSTORAGE_INSTR_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Instrumentation of the nrf_fstorage_sd operations.
+ *
+ * fstorage_instr_attach() puts a forwarding API and a forwarding event handler in front of every
+ * fstorage instance (FDS, the black box, the time series...), so the operations of all of them
+ * are measured without changes to their code:
+ * - queue depth (operations submitted and not completed) and its maximum, and the operations
+ *   rejected because the NRF_FSTORAGE_SD_QUEUE_SIZE queue was full
+ * - latency from submission to completion, in a histogram per operation type
+ * - SoftDevice flash operations: completed chunks (NRF_FSTORAGE_SD_MAX_WRITE_SIZE) and timeslot
+ *   denials (NRF_EVT_FLASH_OPERATION_ERROR, each one retried by fstorage), also the most denials
+ *   of a single operation and the operations that ran out of NRF_FSTORAGE_SD_MAX_RETRIES
+ *
+ * Operations are completed in submission order by nrf_fstorage_sd, which lets the completions be
+ * matched to the submission times.
+ */
+
+#define FSTORAGE_INSTR_INSTANCES_MAX  4
+#define FSTORAGE_INSTR_HIST_BINS      8   /* Up to 5, 10, 20, 50, 100, 200, 500 ms, above */
+
+/* Encoded record version and size, see fstorage_instr_encode() */
+#define FSTORAGE_INSTR_RECORD_VERSION 1
+#define FSTORAGE_INSTR_RECORD_SIZE    (4 + (7 * 4) + (2 * 4) + (2 * 2 * FSTORAGE_INSTR_HIST_BINS))
+
+typedef enum
+{
+  FSTORAGE_INSTR_OP_WRITE,
+  FSTORAGE_INSTR_OP_ERASE,
+  FSTORAGE_INSTR_OP_COUNT,
+} fstorage_instr_op_t;
+
+typedef struct
+{
+  uint32_t ops[FSTORAGE_INSTR_OP_COUNT];
+  uint32_t words;           /* Words written */
+  uint32_t chunks;          /* SoftDevice flash operations completed */
+  uint32_t denials;         /* SoftDevice flash operations not scheduled in time, retried */
+  uint32_t failed;          /* Operations completed with an error (retries exhausted) */
+  uint32_t queue_full;      /* Operations rejected, NRF_FSTORAGE_SD_QUEUE_SIZE reached */
+  uint8_t  depth_max;
+  uint8_t  retries_max;     /* Most denials of one operation */
+  uint32_t max_ms[FSTORAGE_INSTR_OP_COUNT];
+  uint16_t hist[FSTORAGE_INSTR_OP_COUNT][FSTORAGE_INSTR_HIST_BINS];
+} fstorage_instr_stats_t;
+
+/* Call once all the fstorage instances are initialized */
+ret_code_t fstorage_instr_attach(void);
+
+void fstorage_instr_stats_get(fstorage_instr_stats_t *p_stats);
+
+/* Stats as a little endian record for the diagnostics service:
+ * version, depth max, retries max, queue size, writes, erases, words, chunks, denials,
+ * failed, queue full (u32), write and erase max ms (u32), write and erase histograms (u16).
+ * Returns the record size, 0 if len is too small.
+ */
+uint16_t fstorage_instr_encode(uint8_t *p_buf, uint16_t len);
+
+void fstorage_instr_stats_log(void);
+
+#endif /* _FSTORAGE_INSTR_H */
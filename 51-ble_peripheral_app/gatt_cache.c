@@ -0,0 +1,215 @@
+#include <string.h>
+
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_util.h"
+#include "ble_gatts.h"
+#include "crc16.h"
+#include "fds.h"
+#include "nrf_log.h"
+#include "peer_manager.h"
+
+#include "fds_gc_sched.h"
+#include "gatt_cache.h"
+
+typedef struct
+{
+  uint16_t crc;
+  uint16_t attr_count;
+} db_fingerprint_t;
+
+/* FDS keeps a pointer to the record data until the write completes */
+static db_fingerprint_t m_fingerprint;
+static bool m_store_pending = false;
+static bool m_fds_ready = false;
+static bool m_check_pending = false;   /* gatt_cache_check() called before FDS was up */
+
+static void db_fingerprint_compute(db_fingerprint_t *p_fp)
+{
+  uint16_t crc = 0xFFFF;
+
+  p_fp->attr_count = 0;
+
+  for(uint16_t handle = BLE_GATT_HANDLE_START; handle != 0; handle++)
+  {
+    ble_uuid_t          uuid = {0};
+    ble_gatts_attr_md_t md = {0};
+    uint8_t             uuid_raw[16];
+    uint8_t             uuid_len = 0;
+
+    if(sd_ble_gatts_attr_get(handle, &uuid, &md) != NRF_SUCCESS)
+    {
+      /* End of the table */
+      break;
+    }
+
+    crc = crc16_compute((uint8_t const *)&handle, sizeof(handle), &crc);
+
+    if(sd_ble_uuid_encode(&uuid, &uuid_len, uuid_raw) == NRF_SUCCESS)
+    {
+      crc = crc16_compute(uuid_raw, uuid_len, &crc);
+    }
+
+    crc = crc16_compute((uint8_t const *)&md.read_perm, sizeof(md.read_perm), &crc);
+    crc = crc16_compute((uint8_t const *)&md.write_perm, sizeof(md.write_perm), &crc);
+
+    /* Characteristic properties and value handles are in the declarations */
+    if((uuid.type == BLE_UUID_TYPE_BLE) && (uuid.uuid == BLE_UUID_CHARACTERISTIC))
+    {
+      uint8_t            decl[19];   /* Properties, value handle, 128 bit UUID */
+      ble_gatts_value_t  value = { .len = sizeof(decl), .offset = 0, .p_value = decl };
+
+      if(sd_ble_gatts_value_get(BLE_CONN_HANDLE_INVALID, handle, &value) == NRF_SUCCESS)
+      {
+        crc = crc16_compute(decl, MIN(value.len, sizeof(decl)), &crc);
+      }
+    }
+
+    p_fp->attr_count++;
+  }
+
+  p_fp->crc = crc;
+}
+
+static ret_code_t fingerprint_store(fds_record_desc_t *p_desc)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  fds_record_t record =
+  {
+    .file_id = GATT_CACHE_FDS_FILE_ID,
+    .key = GATT_CACHE_FDS_RECORD_KEY,
+    .data = { .p_data = &m_fingerprint, .length_words = BYTES_TO_WORDS(sizeof(m_fingerprint)) },
+  };
+
+  if(p_desc != NULL)
+  {
+    err_code = fds_record_update(p_desc, &record);
+  }
+  else
+  {
+    err_code = fds_record_write(NULL, &record);
+  }
+
+  if(err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+  {
+    /* Written again when the garbage collection is done */
+    m_store_pending = true;
+    return fds_gc_sched_space_needed();
+  }
+
+  return err_code;
+}
+
+static void db_check(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  fds_record_desc_t desc = {0};
+  fds_find_token_t  token = {0};
+  fds_flash_record_t flash_record = {0};
+  db_fingerprint_t  stored = {0};
+  bool              found = false;
+
+  db_fingerprint_compute(&m_fingerprint);
+
+  if(fds_record_find(GATT_CACHE_FDS_FILE_ID, GATT_CACHE_FDS_RECORD_KEY, &desc, &token) == NRF_SUCCESS)
+  {
+    err_code = fds_record_open(&desc, &flash_record);
+    APP_ERROR_CHECK(err_code);
+
+    memcpy(&stored, flash_record.p_data, sizeof(stored));
+    found = true;
+
+    err_code = fds_record_close(&desc);
+    APP_ERROR_CHECK(err_code);
+  }
+
+  if(found && (stored.crc == m_fingerprint.crc) && (stored.attr_count == m_fingerprint.attr_count))
+  {
+    NRF_LOG_INFO("GATT db unchanged (0x%04X, %d attributes)", m_fingerprint.crc, m_fingerprint.attr_count);
+    return;
+  }
+
+  /* Bonds made before the fingerprint was stored may have cached another table as well */
+  if(found || (pm_peer_count() > 0))
+  {
+    NRF_LOG_INFO("GATT db changed (0x%04X, %d attributes), sending Service Changed to bonded peers",
+                 m_fingerprint.crc, m_fingerprint.attr_count);
+    pm_local_database_has_changed();
+  }
+
+  err_code = fingerprint_store(found ? &desc : NULL);
+  APP_ERROR_CHECK(err_code);
+}
+
+static void db_check_evt_handler(void *p_event_data, uint16_t event_size)
+{
+  db_check();
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  switch(p_evt->id)
+  {
+    case FDS_EVT_INIT:
+      /* Usually sent from inside pm_init(), before Peer Manager has loaded the peers: the
+       * check waits for gatt_cache_check()
+       */
+      m_fds_ready = (p_evt->result == NRF_SUCCESS);
+      if(m_fds_ready && m_check_pending)
+      {
+        /* FDS came up late (format or repair). The Peer Manager storage handler runs after
+         * this one and loads the peers, check from the main loop
+         */
+        m_check_pending = false;
+        err_code = app_sched_event_put(NULL, 0, db_check_evt_handler);
+        APP_ERROR_CHECK(err_code);
+      }
+      break;
+    case FDS_EVT_GC:
+      if(m_store_pending)
+      {
+        fds_record_desc_t desc = {0};
+        fds_find_token_t  token = {0};
+        bool found = (fds_record_find(GATT_CACHE_FDS_FILE_ID, GATT_CACHE_FDS_RECORD_KEY, &desc, &token) == NRF_SUCCESS);
+
+        m_store_pending = false;
+        err_code = fingerprint_store(found ? &desc : NULL);
+        APP_ERROR_CHECK(err_code);
+      }
+      break;
+    case FDS_EVT_WRITE:
+    case FDS_EVT_UPDATE:
+      if(p_evt->write.file_id == GATT_CACHE_FDS_FILE_ID)
+      {
+        NRF_LOG_INFO("GATT db fingerprint stored, result %d", p_evt->result);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+ret_code_t gatt_cache_init(void)
+{
+  return fds_register(fds_evt_handler);
+}
+
+void gatt_cache_check(void)
+{
+  if(!m_fds_ready)
+  {
+    m_check_pending = true;
+    return;
+  }
+
+  db_check();
+}
+
+uint16_t gatt_cache_fingerprint_get(void)
+{
+  return m_fingerprint.crc;
+}
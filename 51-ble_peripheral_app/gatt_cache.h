@@ -0,0 +1,34 @@
+#ifndef _GATT_CACHE_H
+#define _GATT_CACHE_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Keeps bonded centrals' GATT caches valid across firmware updates.
+ *
+ * The CCCDs of bonded peers are stored and restored by the Peer Manager, so a bonded central
+ * that trusts its cache does not have to rediscover or re-subscribe. That is only safe while
+ * the attribute table stays the same. A fingerprint of the table (handles, types, permissions
+ * and characteristic declarations) is stored in FDS. When it differs at boot, the Peer Manager
+ * is told the local database changed, and bonded peers get a Service Changed indication.
+ *
+ * S140 v7 has no Database Hash characteristic (BLE 5.1 robust caching), the fingerprint is
+ * only used locally.
+ */
+
+#define GATT_CACHE_FDS_FILE_ID      0x1000
+#define GATT_CACHE_FDS_RECORD_KEY   0x0001
+
+/* Call before pm_init(), registers the FDS user */
+ret_code_t gatt_cache_init(void);
+
+/* Call after pm_init() and pm_register(): the peers must be loaded to tell them about a changed
+ * table. Checks now, or once FDS is initialized if it is not yet
+ */
+void gatt_cache_check(void);
+
+/* Fingerprint of the current attribute table. Valid after the check */
+uint16_t gatt_cache_fingerprint_get(void);
+
+#endif /* _GATT_CACHE_H */
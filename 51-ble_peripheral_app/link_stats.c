@@ -0,0 +1,354 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble_conn_state.h"
+#include "ble_hci.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "link_stats.h"
+
+typedef struct
+{
+  link_stats_t stats;
+  int32_t      rssi_sum;
+  uint32_t     rssi_samples;
+  uint32_t     connected_ticks;
+  uint32_t     last_ticks;      /* Connection events accounted up to here */
+  uint32_t     events_rem;      /* Remainder of the event estimate, in 0.25 ms units */
+} link_entry_t;
+
+APP_TIMER_DEF(m_sample_timer);
+
+static link_entry_t m_links[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+static uint16_t     m_disc[LINK_STATS_DISC_COUNT];
+static bool         m_initialized = false;
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+/* Entry of a connected link, NULL otherwise */
+static link_entry_t *link_get(uint16_t conn_handle)
+{
+  uint16_t idx = ble_conn_state_conn_idx(conn_handle);
+
+  if((idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) || (m_links[idx].stats.conn_handle != conn_handle))
+  {
+    return NULL;
+  }
+
+  return &m_links[idx];
+}
+
+static void hist_add(uint16_t *p_hist, int8_t rssi)
+{
+  int16_t bin = 0;
+
+  if(rssi >= LINK_STATS_RSSI_BIN_LOW)
+  {
+    bin = 1 + ((rssi - LINK_STATS_RSSI_BIN_LOW) / LINK_STATS_RSSI_BIN_WIDTH);
+  }
+  bin = MIN(bin, LINK_STATS_RSSI_BINS - 1);
+
+  if(p_hist[bin] < UINT16_MAX)
+  {
+    p_hist[bin]++;
+  }
+}
+
+/* Connection events since the last call, one per interval */
+static void events_account(link_entry_t *p_link)
+{
+  uint32_t now = app_timer_cnt_get();
+  uint32_t elapsed = p_link->events_rem + (ticks_to_ms(app_timer_cnt_diff_compute(now, p_link->last_ticks)) * 4);
+  uint32_t interval = (uint32_t)p_link->stats.conn_interval * 5;  /* 0.25 ms units */
+
+  p_link->last_ticks = now;
+
+  if(interval == 0)
+  {
+    return;
+  }
+
+  p_link->stats.conn_events += elapsed / interval;
+  p_link->events_rem = elapsed % interval;
+}
+
+static void link_sample(link_entry_t *p_link)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  int8_t     rssi = 0;
+  uint8_t    ch_index = 0;
+  ble_opt_t  opt;
+
+  events_account(p_link);
+
+  err_code = sd_ble_gap_rssi_get(p_link->stats.conn_handle, &rssi, &ch_index);
+  if(err_code == NRF_ERROR_INVALID_STATE)
+  {
+    /* Sampling not started yet. No RSSI events from this one, tx_power_ctrl sets its own */
+    (void)sd_ble_gap_rssi_start(p_link->stats.conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
+    return;
+  }
+  if(err_code != NRF_SUCCESS)
+  {
+    return;
+  }
+
+  p_link->stats.rssi_last = rssi;
+  p_link->rssi_sum += rssi;
+  p_link->rssi_samples++;
+  p_link->stats.rssi_avg = (int8_t)(p_link->rssi_sum / (int32_t)p_link->rssi_samples);
+  hist_add(p_link->stats.rssi_hist, rssi);
+
+  memset(&opt, 0, sizeof(opt));
+  opt.gap_opt.ch_map.conn_handle = p_link->stats.conn_handle;
+  if(sd_ble_opt_get(BLE_GAP_OPT_CH_MAP, &opt) == NRF_SUCCESS)
+  {
+    memcpy(p_link->stats.ch_map, opt.gap_opt.ch_map.ch_map, sizeof(p_link->stats.ch_map));
+  }
+}
+
+static void sample_timeout_handler(void *p_context)
+{
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    if(m_links[i].stats.conn_handle != BLE_CONN_HANDLE_INVALID)
+    {
+      link_sample(&m_links[i]);
+    }
+  }
+}
+
+static link_stats_disc_t disc_category(uint8_t reason)
+{
+  switch(reason)
+  {
+    case BLE_HCI_CONNECTION_TIMEOUT:
+      return LINK_STATS_DISC_SUPERVISION_TIMEOUT;
+    case BLE_HCI_STATUS_CODE_LMP_RESPONSE_TIMEOUT:
+      return LINK_STATS_DISC_LL_RESPONSE_TIMEOUT;
+    case BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE:
+      return LINK_STATS_DISC_MIC_FAILURE;
+    case BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION:
+    case BLE_HCI_REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES:
+    case BLE_HCI_REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF:
+      return LINK_STATS_DISC_REMOTE;
+    case BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION:
+      return LINK_STATS_DISC_LOCAL;
+    default:
+      return LINK_STATS_DISC_OTHER;
+  }
+}
+
+/* The summary prints the bins in two lines of four */
+STATIC_ASSERT(LINK_STATS_RSSI_BINS == 8);
+
+static void link_summary_log(link_entry_t const *p_link)
+{
+  link_stats_t const *p_stats = &p_link->stats;
+
+  NRF_LOG_INFO("Link 0x%04X: RSSI %d dBm (avg %d dBm), %u conn events, %u tx, %u rx",
+               p_stats->conn_handle, p_stats->rssi_last, p_stats->rssi_avg,
+               p_stats->conn_events, p_stats->tx_packets, p_stats->rx_packets);
+  NRF_LOG_INFO("Link 0x%04X: RSSI bins low %u %u %u %u", p_stats->conn_handle,
+               p_stats->rssi_hist[0], p_stats->rssi_hist[1], p_stats->rssi_hist[2], p_stats->rssi_hist[3]);
+  NRF_LOG_INFO("Link 0x%04X: RSSI bins high %u %u %u %u", p_stats->conn_handle,
+               p_stats->rssi_hist[4], p_stats->rssi_hist[5], p_stats->rssi_hist[6], p_stats->rssi_hist[7]);
+  NRF_LOG_INFO("Link 0x%04X: channel map %02X%08X, interval %u x 1.25 ms", p_stats->conn_handle,
+               p_stats->ch_map[4], uint32_decode(p_stats->ch_map), p_stats->conn_interval);
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  uint16_t      conn_handle = p_ble_evt->evt.common_evt.conn_handle;
+  uint16_t      idx = ble_conn_state_conn_idx(conn_handle);
+  link_entry_t  *p_link = NULL;
+
+  if(!m_initialized)
+  {
+    return;
+  }
+
+  if(p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+  {
+    if(idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT)
+    {
+      return;
+    }
+
+    p_link = &m_links[idx];
+    memset(p_link, 0, sizeof(link_entry_t));
+    p_link->stats.conn_handle = conn_handle;
+    p_link->stats.conn_interval = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+    p_link->stats.tx_phy = BLE_GAP_PHY_1MBPS;
+    p_link->stats.rx_phy = BLE_GAP_PHY_1MBPS;
+    p_link->connected_ticks = app_timer_cnt_get();
+    p_link->last_ticks = p_link->connected_ticks;
+    return;
+  }
+
+  p_link = link_get(conn_handle);
+  if(p_link == NULL)
+  {
+    return;
+  }
+
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_DISCONNECTED:
+    {
+      uint8_t reason = p_ble_evt->evt.gap_evt.params.disconnected.reason;
+      link_stats_disc_t category = disc_category(reason);
+
+      events_account(p_link);
+      if(m_disc[category] < UINT16_MAX)
+      {
+        m_disc[category]++;
+      }
+
+      NRF_LOG_INFO("Link 0x%04X: closed after %u s, reason 0x%02X", conn_handle,
+                   ticks_to_ms(app_timer_cnt_diff_compute(app_timer_cnt_get(), p_link->connected_ticks)) / 1000,
+                   reason);
+      link_summary_log(p_link);
+
+      p_link->stats.conn_handle = BLE_CONN_HANDLE_INVALID;
+    } break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+      /* Events so far at the old interval */
+      events_account(p_link);
+      p_link->stats.conn_interval = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+      break;
+
+    case BLE_GAP_EVT_PHY_UPDATE:
+      if(p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+      {
+        p_link->stats.tx_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+        p_link->stats.rx_phy = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+      }
+      break;
+
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+      p_link->stats.tx_packets += p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+      break;
+
+    case BLE_GATTS_EVT_HVC:
+      p_link->stats.tx_packets++;
+      break;
+
+    case BLE_GATTS_EVT_WRITE:
+      p_link->stats.rx_packets++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_link_stats_observer, LINK_STATS_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t link_stats_init(uint32_t sample_interval)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    m_links[i].stats.conn_handle = BLE_CONN_HANDLE_INVALID;
+  }
+  memset(m_disc, 0, sizeof(m_disc));
+
+  err_code = app_timer_create(&m_sample_timer, APP_TIMER_MODE_REPEATED, sample_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = app_timer_start(m_sample_timer, sample_interval, NULL);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  m_initialized = true;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t link_stats_get(uint16_t conn_handle, link_stats_t *p_stats)
+{
+  link_entry_t *p_link = link_get(conn_handle);
+
+  if(p_link == NULL)
+  {
+    return NRF_ERROR_NOT_FOUND;
+  }
+
+  events_account(p_link);
+  *p_stats = p_link->stats;
+
+  return NRF_SUCCESS;
+}
+
+uint16_t link_stats_disc_count_get(link_stats_disc_t category)
+{
+  if(category >= LINK_STATS_DISC_COUNT)
+  {
+    return 0;
+  }
+
+  return m_disc[category];
+}
+
+uint16_t link_stats_encode(uint16_t conn_handle, uint8_t *p_buf, uint16_t len)
+{
+  link_stats_t stats;
+  uint16_t     pos = 0;
+
+  if((len < LINK_STATS_RECORD_SIZE) || (link_stats_get(conn_handle, &stats) != NRF_SUCCESS))
+  {
+    return 0;
+  }
+
+  p_buf[pos++] = LINK_STATS_RECORD_VERSION;
+  p_buf[pos++] = (uint8_t)stats.rssi_last;
+  p_buf[pos++] = (uint8_t)stats.rssi_avg;
+  for(uint8_t i = 0; i < LINK_STATS_RSSI_BINS; i++)
+  {
+    pos += uint16_encode(stats.rssi_hist[i], &p_buf[pos]);
+  }
+  pos += uint32_encode(stats.conn_events, &p_buf[pos]);
+  pos += uint32_encode(stats.tx_packets, &p_buf[pos]);
+  pos += uint32_encode(stats.rx_packets, &p_buf[pos]);
+  memcpy(&p_buf[pos], stats.ch_map, sizeof(stats.ch_map));
+  pos += sizeof(stats.ch_map);
+  pos += uint16_encode(stats.conn_interval, &p_buf[pos]);
+  p_buf[pos++] = stats.tx_phy;
+  p_buf[pos++] = stats.rx_phy;
+  for(uint8_t i = 0; i < LINK_STATS_DISC_COUNT; i++)
+  {
+    pos += uint16_encode(m_disc[i], &p_buf[pos]);
+  }
+
+  return pos;
+}
+
+void link_stats_log(void)
+{
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    if(m_links[i].stats.conn_handle != BLE_CONN_HANDLE_INVALID)
+    {
+      events_account(&m_links[i]);
+      link_summary_log(&m_links[i]);
+    }
+  }
+
+  NRF_LOG_INFO("Disconnections: %u supervision timeout, %u LL timeout, %u MIC failure, %u remote, %u local, %u other",
+               m_disc[LINK_STATS_DISC_SUPERVISION_TIMEOUT], m_disc[LINK_STATS_DISC_LL_RESPONSE_TIMEOUT],
+               m_disc[LINK_STATS_DISC_MIC_FAILURE], m_disc[LINK_STATS_DISC_REMOTE],
+               m_disc[LINK_STATS_DISC_LOCAL], m_disc[LINK_STATS_DISC_OTHER]);
+}
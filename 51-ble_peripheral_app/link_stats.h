@@ -0,0 +1,76 @@
+#ifndef _LINK_STATS_H
+#define _LINK_STATS_H
+
+#include <stdint.h>
+
+#include "ble_gap.h"
+#include "sdk_errors.h"
+
+/* Link quality statistics per connection.
+ *
+ * RSSI is sampled every sample_interval on each link and counted in a histogram of 10 dB bins.
+ * Connection events are estimated from the connection time and interval. Packets sent
+ * (notifications, indications) and received (writes) are counted from the GATT events.
+ * Disconnection reasons of all links are counted by category, supervision timeouts separately.
+ *
+ * S140 does not report CRC errors or link layer retransmissions to the application. The
+ * closest signals are the RSSI histogram, the channel map of the central and the
+ * supervision timeout / MIC failure counts.
+ */
+
+#define LINK_STATS_RSSI_BINS      8
+#define LINK_STATS_RSSI_BIN_LOW   -95   /* Upper edge of the lowest bin */
+#define LINK_STATS_RSSI_BIN_WIDTH 10
+
+#define LINK_STATS_BLE_OBSERVER_PRIO  2
+
+/* Encoded record version and size, see link_stats_encode() */
+#define LINK_STATS_RECORD_VERSION 1
+#define LINK_STATS_RECORD_SIZE    (1 + 2 + (2 * LINK_STATS_RSSI_BINS) + 12 + 5 + 4 + (2 * LINK_STATS_DISC_COUNT))
+
+typedef enum
+{
+  LINK_STATS_DISC_SUPERVISION_TIMEOUT,
+  LINK_STATS_DISC_LL_RESPONSE_TIMEOUT,
+  LINK_STATS_DISC_MIC_FAILURE,
+  LINK_STATS_DISC_REMOTE,
+  LINK_STATS_DISC_LOCAL,
+  LINK_STATS_DISC_OTHER,
+  LINK_STATS_DISC_COUNT
+} link_stats_disc_t;
+
+typedef struct
+{
+  uint16_t conn_handle;
+  int8_t   rssi_last;
+  int8_t   rssi_avg;
+  uint16_t rssi_hist[LINK_STATS_RSSI_BINS];     /* Saturating counts, lowest bin first */
+  uint32_t conn_events;                         /* Estimated */
+  uint32_t tx_packets;
+  uint32_t rx_packets;
+  uint8_t  ch_map[5];                           /* Data channels in use, 37 bits. 0 if unknown */
+  uint16_t conn_interval;                       /* 1.25 ms units */
+  uint8_t  tx_phy;
+  uint8_t  rx_phy;
+} link_stats_t;
+
+/* sample_interval: RSSI sampling interval in app_timer ticks */
+ret_code_t link_stats_init(uint32_t sample_interval);
+
+/* NRF_ERROR_NOT_FOUND if the handle is not a connected link */
+ret_code_t link_stats_get(uint16_t conn_handle, link_stats_t *p_stats);
+
+/* Disconnections per link_stats_disc_t category */
+uint16_t link_stats_disc_count_get(link_stats_disc_t category);
+
+/* Little endian record of a link and the disconnection counts:
+ * version (1), rssi_last (1), rssi_avg (1), rssi_hist (2 x bins), conn_events (4), tx_packets (4),
+ * rx_packets (4), ch_map (5), conn_interval (2), tx_phy (1), rx_phy (1), disc counts (2 x count).
+ * Returns the encoded length, 0 if the link is unknown or the buffer too small.
+ */
+uint16_t link_stats_encode(uint16_t conn_handle, uint8_t *p_buf, uint16_t len);
+
+/* Summary of all connected links and the disconnection counts */
+void link_stats_log(void);
+
+#endif /* _LINK_STATS_H */
@@ -0,0 +1,224 @@
+#include <string.h>
+
+#include "lz_pack.h"
+
+#define WINDOW_MASK   (LZ_PACK_WINDOW - 1)
+
+static uint32_t hash3(uint8_t const *p)
+{
+  uint32_t key = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+
+  return (key * 2654435761u) >> (32 - LZ_PACK_HASH_BITS);
+}
+
+/* Byte at stream position at: in the history before pos, in p_in (starting at pos) from pos on */
+static uint8_t stream_byte(lz_pack_t const *p_lz, uint8_t const *p_in, uint32_t at)
+{
+  return (at < p_lz->pos) ? p_lz->history[at & WINDOW_MASK] : p_in[at - p_lz->pos];
+}
+
+/* Move the first count input bytes to the history, with their hashes */
+static void history_push(lz_pack_t *p_lz, uint8_t const *p_in, size_t avail, size_t count)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    if((i + LZ_PACK_MATCH_MIN) <= avail)
+    {
+      p_lz->hash[hash3(&p_in[i])] = (uint16_t)(p_lz->pos + i);
+    }
+    p_lz->history[(p_lz->pos + i) & WINDOW_MASK] = p_in[i];
+  }
+
+  p_lz->pos += count;
+}
+
+void lz_pack_reset(lz_pack_t *p_lz)
+{
+  memset(p_lz, 0, sizeof(*p_lz));
+}
+
+size_t lz_pack(lz_pack_t *p_lz, uint8_t const *p_in, size_t in_len, size_t *p_consumed,
+               uint8_t *p_out, size_t out_cap)
+{
+  size_t  in = 0;
+  size_t  out = 0;
+  size_t  flag_at = 0;
+  uint8_t flag_bit = 8;   /* No flag byte yet */
+
+  while(in < in_len)
+  {
+    size_t   avail = in_len - in;
+    size_t   length = 0;
+    uint32_t dist = 0;
+
+    /* A new flag byte and a match at most */
+    if((out_cap - out) < ((flag_bit == 8) ? 3u : 2u))
+    {
+      break;
+    }
+
+    if(avail >= LZ_PACK_MATCH_MIN)
+    {
+      uint16_t cand = p_lz->hash[hash3(&p_in[in])];
+
+      dist = (uint16_t)((uint16_t)p_lz->pos - cand);
+      if((dist != 0) && (dist <= LZ_PACK_WINDOW) && (dist <= p_lz->pos))
+      {
+        size_t max = (avail < LZ_PACK_MATCH_MAX) ? avail : LZ_PACK_MATCH_MAX;
+
+        /* The match may run into the bytes it copies: a run of dist-byte patterns */
+        while((length < max) && (stream_byte(p_lz, &p_in[in], p_lz->pos - dist + length) == p_in[in + length]))
+        {
+          length++;
+        }
+      }
+    }
+
+    if(flag_bit == 8)
+    {
+      flag_at = out++;
+      p_out[flag_at] = 0;
+      flag_bit = 0;
+    }
+
+    if(length >= LZ_PACK_MATCH_MIN)
+    {
+      p_out[flag_at] |= (uint8_t)(1u << flag_bit);
+      p_out[out++] = (uint8_t)(dist - 1);
+      p_out[out++] = (uint8_t)(length - LZ_PACK_MATCH_MIN);
+    }
+    else
+    {
+      length = 1;
+      p_out[out++] = p_in[in];
+    }
+
+    flag_bit++;
+    history_push(p_lz, &p_in[in], avail, length);
+    in += length;
+  }
+
+  *p_consumed = in;
+
+  return out;
+}
+
+void lz_unpack_reset(lz_unpack_t *p_lz)
+{
+  memset(p_lz, 0, sizeof(*p_lz));
+}
+
+size_t lz_unpack(lz_unpack_t *p_lz, uint8_t const *p_in, size_t in_len, uint8_t *p_out, size_t out_cap,
+                 bool *p_ok)
+{
+  size_t in = 0;
+  size_t out = 0;
+
+  *p_ok = false;
+
+  while(in < in_len)
+  {
+    uint8_t flags = p_in[in++];
+
+    for(uint8_t bit = 0; (bit < 8) && (in < in_len); bit++)
+    {
+      if(flags & (1u << bit))
+      {
+        uint32_t dist;
+        uint32_t length;
+
+        if((in_len - in) < 2)
+        {
+          return out;
+        }
+
+        dist = (uint32_t)p_in[in++] + 1;
+        length = (uint32_t)p_in[in++] + LZ_PACK_MATCH_MIN;
+
+        if((dist > p_lz->pos) || (length > (out_cap - out)))
+        {
+          return out;
+        }
+
+        for(uint32_t i = 0; i < length; i++)
+        {
+          uint8_t byte = p_lz->history[(p_lz->pos - dist) & WINDOW_MASK];
+
+          p_lz->history[p_lz->pos++ & WINDOW_MASK] = byte;
+          p_out[out++] = byte;
+        }
+      }
+      else
+      {
+        if(out == out_cap)
+        {
+          return out;
+        }
+
+        p_lz->history[p_lz->pos++ & WINDOW_MASK] = p_in[in];
+        p_out[out++] = p_in[in++];
+      }
+    }
+  }
+
+  *p_ok = true;
+
+  return out;
+}
+
+size_t lz_unpack_stored(lz_unpack_t *p_lz, uint8_t const *p_in, size_t in_len, uint8_t *p_out, size_t out_cap,
+                        bool *p_ok)
+{
+  size_t len = (in_len < out_cap) ? in_len : out_cap;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    p_lz->history[p_lz->pos++ & WINDOW_MASK] = p_in[i];
+    p_out[i] = p_in[i];
+  }
+
+  *p_ok = (len == in_len);
+
+  return len;
+}
+
+bool lz_delta_reset(lz_delta_t *p_delta, uint8_t channels)
+{
+  if((channels == 0) || (channels > LZ_DELTA_CHANNELS_MAX))
+  {
+    return false;
+  }
+
+  memset(p_delta, 0, sizeof(*p_delta));
+  p_delta->channels = channels;
+
+  return true;
+}
+
+void lz_delta_encode(lz_delta_t *p_delta, int16_t *p_values, size_t count)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    int16_t value = p_values[i];
+    int16_t delta = (int16_t)(value - p_delta->prev[p_delta->channel]);
+
+    /* Zig-zag: small magnitudes of either sign get small codes */
+    p_values[i] = (int16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+    p_delta->prev[p_delta->channel] = value;
+    p_delta->channel = (p_delta->channel + 1) % p_delta->channels;
+  }
+}
+
+void lz_delta_decode(lz_delta_t *p_delta, int16_t *p_values, size_t count)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    uint16_t code = (uint16_t)p_values[i];
+    int16_t  delta = (int16_t)((code >> 1) ^ (uint16_t)-(int16_t)(code & 1));
+    int16_t  value = (int16_t)(p_delta->prev[p_delta->channel] + delta);
+
+    p_values[i] = value;
+    p_delta->prev[p_delta->channel] = value;
+    p_delta->channel = (p_delta->channel + 1) % p_delta->channels;
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef _LZ_PACK_H
+#define _LZ_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Streaming LZ77 (LZSS) compression for notification payloads and flash records, in about
+ * 400 bytes of state.
+ *
+ * Block format: a flag byte, then up to 8 tokens, LSB first; again until the block ends.
+ * Flag bit 0: a literal byte. Flag bit 1: a match of two bytes, distance - 1 and length - 3:
+ * distance 1 to 256 back in the stream, length 3 to 258. At worst a block is 1/8 larger than
+ * its input. A block carries no length, the container (notification, record header) does.
+ *
+ * A block that does not shrink (size >= *p_consumed) can be replaced by the consumed input as
+ * it is, a stored block: the window holds those bytes either way, the next blocks still refer
+ * to them. The decoder takes it through lz_unpack_stored(). Framed streams (the black box
+ * download, tools/lz_unpack.py) put a u16 little endian length in front of each block, with
+ * LZ_PACK_FRAME_STORED set for a stored block, so incompressible data costs only the lengths.
+ *
+ * The window spans blocks: each block can refer to the bytes of the blocks before it, so the
+ * decoder has to see all blocks in order since the last reset. Reset both sides for blocks
+ * that must decode on their own, e.g. one flash record each.
+ *
+ * Matches are found through a hash of the next 3 bytes, one candidate each: fast and small,
+ * for repeated structure (record headers, erased flash, repeated values), not for best ratio.
+ *
+ * The delta filter turns a stream of int16 values (interleaved channels) into zig-zag deltas
+ * per channel before compression. A slowly changing signal becomes runs of small values
+ * that the LZ stage packs well. No firmware path uses it: the time series store has its own
+ * delta codec (ts_codec) and the black box holds log records. It is there for sample captures
+ * packed on a host, tools/lz_unpack.py --delta undoes it.
+ *
+ * No SDK dependencies, the compressor and decompressor can be built and exercised on a host.
+ */
+
+#define LZ_PACK_WINDOW        256
+#define LZ_PACK_HASH_BITS     6
+#define LZ_PACK_MATCH_MIN     3
+#define LZ_PACK_MATCH_MAX     258
+
+#define LZ_PACK_BOUND(len)    ((len) + (((len) + 7) / 8))   /* Block size at worst */
+#define LZ_PACK_FRAME_STORED  0x8000                          /* Framed block length flag */
+
+#define LZ_DELTA_CHANNELS_MAX 8
+
+typedef struct
+{
+  uint8_t  history[LZ_PACK_WINDOW];
+  uint16_t hash[1 << LZ_PACK_HASH_BITS];  /* Stream position of the last 3 bytes with the hash */
+  uint32_t pos;                           /* Bytes since the reset */
+} lz_pack_t;
+
+typedef struct
+{
+  uint8_t  history[LZ_PACK_WINDOW];
+  uint32_t pos;
+} lz_unpack_t;
+
+typedef struct
+{
+  int16_t prev[LZ_DELTA_CHANNELS_MAX];
+  uint8_t channels;
+  uint8_t channel;        /* Of the next value */
+} lz_delta_t;
+
+void lz_pack_reset(lz_pack_t *p_lz);
+
+/* Compress in_len bytes into one block. Stops early when the next token might not fit in
+ * out_cap, *p_consumed tells how far it got. Returns the block size
+ */
+size_t lz_pack(lz_pack_t *p_lz, uint8_t const *p_in, size_t in_len, size_t *p_consumed,
+               uint8_t *p_out, size_t out_cap);
+
+void lz_unpack_reset(lz_unpack_t *p_lz);
+
+/* Decompress one block. Returns the decompressed size, or false in *p_ok on a corrupt block or
+ * an output buffer too small
+ */
+size_t lz_unpack(lz_unpack_t *p_lz, uint8_t const *p_in, size_t in_len, uint8_t *p_out, size_t out_cap,
+                 bool *p_ok);
+
+/* Take a stored block: the bytes as they are, into the window. Same returns as lz_unpack() */
+size_t lz_unpack_stored(lz_unpack_t *p_lz, uint8_t const *p_in, size_t in_len, uint8_t *p_out, size_t out_cap,
+                        bool *p_ok);
+
+bool lz_delta_reset(lz_delta_t *p_delta, uint8_t channels);
+
+/* In place, count values */
+void lz_delta_encode(lz_delta_t *p_delta, int16_t *p_values, size_t count);
+
+void lz_delta_decode(lz_delta_t *p_delta, int16_t *p_values, size_t count);
+
+#endif /* _LZ_PACK_H */
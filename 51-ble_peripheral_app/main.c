@@ -6,8 +6,10 @@
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
 #include "nrf_delay.h"
+#include "hardfault.h"
 
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "bsp_btn_ble.h"
 #include "nrf_pwr_mgmt.h"
 
@@ -23,11 +25,46 @@
 #include "ble_advertising.h"
 
 #include "ble_conn_params.h"
+#include "ble_conn_state.h"
+
+#include "peer_manager.h"
+#include "peer_manager_handler.h"
+#include "nrf_ble_lesc.h"
+
+#include "adv_payload.h"
+#include "adv_sched.h"
+#include "gatt_cache.h"
+#include "evt_prof.h"
+#include "radio_sched.h"
+#include "tx_power_ctrl.h"
+#include "link_stats.h"
+#include "diag_service.h"
+#include "blackbox.h"
+#include "blackbox_service.h"
+#include "ts_flash_fs.h"
+#include "ts_store.h"
+#include "fstorage_instr.h"
+#include "saadc_sampler.h"
+#include "sample_source.h"
+#include "sim_source.h"
+#include "dsp_fixed.h"
+#include "window_agg.h"
+#include "sensor_service.h"
+#include "scanner.h"
+#include "config_store.h"
+#include "fds_gc_sched.h"
+#include "telemetry_adv.h"
 
 #define APP_BLE_CONN_CFG_TAG      1
 #define APP_BLE_OBSERVER_PRIO     3
 
 #define DEVICE_NAME               "NRF52_BLE_APP"
+#define DEVICE_SHORT_NAME         "NRF52_BLE"   /* Name in the advertising packet. Full name is in the scan response */
+#define DEVICE_APPEARANCE         BLE_APPEARANCE_GENERIC_CYCLING
+
+#define APP_COMPANY_ID            0x0059        /* Nordic company manufacturing id */
+#define APP_ADV_TX_POWER          0             /* Advertising TX power in dBm, also the highest link level */
+#define APP_VENDOR_DATA_SIZE      4
 
 #define MIN_CONN_INTERVAL         MSEC_TO_UNITS(100, UNIT_1_25_MS)
 #define MAX_CONN_INTERNAL         MSEC_TO_UNITS(200, UNIT_1_25_MS)
@@ -35,23 +72,447 @@
 #define CONN_SUPERVISION_TIMEOUT  MSEC_TO_UNITS(2000, UNIT_10_MS)
 
 #define APP_ADV_INTERVAL          300
-#define APP_ADV_DURATION          0   /* Continous Advertising */
+#define APP_ADV_DURATION          MSEC_TO_UNITS(30000, UNIT_10_MS)    /* Fast stage, then slow */
+#define APP_ADV_SLOW_INTERVAL     MSEC_TO_UNITS(1000, UNIT_0_625_MS)
+#define APP_ADV_SLOW_DURATION     MSEC_TO_UNITS(180000, UNIT_10_MS)   /* Slow stage, then very slow */
+#define APP_ADV_IDLE_INTERVAL     MSEC_TO_UNITS(2500, UNIT_0_625_MS)
+#define APP_ADV_IDLE_DURATION     0   /* Until connected or kicked */
+#define APP_ADV_EVENT_CHARGE_NC     10000   /* Approx. radio charge of a legacy adv event on 3 channels at 0 dBm */
+#define APP_ADV_LR_EVENT_CHARGE_NC  40000   /* Coded PHY packets are about 4 times longer */
+#define APP_ADV_REPORT_INTERVAL   APP_TIMER_TICKS(600000)  /* Adv schedule stats log, 10 minutes */
+#define APP_ADV_DIRECTED_INTERVAL MSEC_TO_UNITS(50, UNIT_0_625_MS)    /* Low duty directed, after the 1.28 s high duty burst */
+#define APP_ADV_DIRECTED_DURATION MSEC_TO_UNITS(5000, UNIT_10_MS)
+
+/* Link TX power follows the RSSI. -70 dBm leaves ~25 dB above the 1M PHY sensitivity */
+#define APP_LINK_TARGET_RSSI      -70
+#define APP_LINK_CODED_GAIN_DB    8     /* Coded PHY S8 receives ~8 dB lower */
+#define APP_LINK_HYSTERESIS_DB    6
+
+#define APP_LINK_STATS_SAMPLE_INTERVAL  APP_TIMER_TICKS(1000)
+#define APP_ADV_UPDATE_INTERVAL   APP_TIMER_TICKS((APP_ADV_INTERVAL * 625) / 1000)  /* Live adv data updates, once per adv interval */
 
 #define FIRST_CONN_PARAMS_UPDATE_DELAY    APP_TIMER_TICKS(5000)
 #define NEXT_CONN_PARAMS_UPDATE_DELAY     APP_TIMER_TICKS(30000)
 #define MAX_CONN_PARAMS_UPDATE_COUNT      3
 
+#define SEC_PARAM_BOND            1   /* Bonding, keys are stored in flash through FDS */
+#define SEC_PARAM_MITM            0   /* No display or keyboard */
+#define SEC_PARAM_LESC            1   /* LE Secure Connections */
+#define SEC_PARAM_KEYPRESS        0
+#define SEC_PARAM_IO_CAPABILITIES BLE_GAP_IO_CAPS_NONE
+#define SEC_PARAM_OOB             0
+#define SEC_PARAM_MIN_KEY_SIZE    7
+#define SEC_PARAM_MAX_KEY_SIZE    16
+
+#define APP_RECONNECT_PEERS_MAX   8   /* Bonded peers with tracked reconnection latency */
+
 #define CHECK_BLE_ADV_ADDR_TIME_INTERVAL  APP_TIMER_TICKS(9000)  /* 9 seconds */   
 
-NRF_BLE_QWR_DEF(m_qwr);   /* Use NRF_BLE_QWRS_DEF if multiple connections are used */
+#define APP_LONG_RANGE_ENABLED      0   /* 1: Start with connectable advertising on Coded PHY (long push on SW1 toggles) */
+
+#define APP_TELEMETRY_ADV_ENABLED   0   /* 1: Broadcast telemetry in extended advertising instead of connectable advertising */
+#define APP_TELEMETRY_ADV_INTERVAL  MSEC_TO_UNITS(100, UNIT_0_625_MS)
+#define TELEMETRY_FRAME_INTERVAL_MS 1000   /* Default, tunable in the settings */
+
+/* Scan gateway: APP_SCANNER_ENABLED in sdk_config.h, the scanner's buffers are only built with it */
+#define APP_SCAN_INTERVAL           MSEC_TO_UNITS(100, UNIT_0_625_MS)
+#define APP_SCAN_WINDOW             MSEC_TO_UNITS(100, UNIT_0_625_MS)   /* Continuous, in the time the links leave */
+#define APP_SCAN_FLUSH_INTERVAL     APP_TIMER_TICKS(250)
+#define APP_SCAN_MAX_AGE_MS         60000
+#define APP_SCAN_PRIORITY_ONLY      0   /* 1: Forward only the bonded peers, filtered by the SoftDevice allowlist */
+/* Field-tunable settings are written once they stop changing for this long */
+#define APP_CONFIG_FLUSH_DELAY      APP_TIMER_TICKS(5000)
+
+/* FDS garbage collection: at 25% dirty, or when less than 1 kB is left in one run. Deferred
+ * for up to 5 minutes while the links carry more than 20 data packets per check
+ */
+#define APP_FDS_GC_DIRTY_PCT        25
+#define APP_FDS_GC_MIN_FREE_WORDS   256
+#define APP_FDS_GC_CHECK_INTERVAL   APP_TIMER_TICKS(10000)
+#define APP_FDS_GC_BUSY_EVENTS      20
+#define APP_FDS_GC_MAX_DEFER        30
+
+/* Persistent settings. Values are the FDS record keys, never reuse one for another meaning */
+enum
+{
+  APP_CFG_DEVICE_NAME = 0x0001,     /* GAP Device Name. The advertised names are compiled in */
+  APP_CFG_CONN_INTERVAL_MIN,        /* 1.25 ms units */
+  APP_CFG_CONN_INTERVAL_MAX,
+  APP_CFG_TELEMETRY_INTERVAL_MS,
+  APP_CFG_LINK_TARGET_RSSI,         /* dBm */
+};
+
+#define APP_CFG_WRITE_NOW           0x0000   /* Not a setting: written alone, flushes the changed settings */
+
+#define APP_SCAN_FILTER_COMPANY_ID  0   /* Forward only tags with this manufacturer data company id. 0: all */
+
+/* SoftDevice events (NRF_SDH_DISPATCH_MODEL_APPSH) and app_timer timeouts
+ * (APP_TIMER_CONFIG_USE_SCHEDULER) are dispatched from app_scheduler, so all the application
+ * handlers run in thread mode and do not preempt each other. Each SoftDevice interrupt queues
+ * one poll event, which then drains all pending SoftDevice events. The queue only has to cover
+ * the interrupts and timeouts between two main loop passes. Check the high-water mark in the
+ * stats log before changing it.
+ */
+#define SCHED_MAX_EVENT_DATA_SIZE   APP_TIMER_SCHED_EVENT_DATA_SIZE
+#define SCHED_QUEUE_SIZE            16
+
+#define APP_STATS_REPORT_INTERVAL   APP_TIMER_TICKS(60000)
+
+/* Heavy jobs wait for the end of a radio event, at most this long when the radio is idle */
+#define APP_RADIO_JOB_MAX_DELAY     APP_TIMER_TICKS(500)
+
+/* Black box: NRF_LOG messages from this severity up are kept in flash. Pending records are
+ * written at the flush threshold, or after this long
+ */
+#define APP_BLACKBOX_LOG_SEVERITY   NRF_LOG_SEVERITY_INFO
+#define APP_BLACKBOX_FLUSH_INTERVAL APP_TIMER_TICKS(30000)
+#define APP_HVN_TX_QUEUE_SIZE       6   /* Notifications queued per link, for the black box download */
+
+/* Die temperature history, one reading per telemetry frame. About 2 bytes a reading:
+ * 16 pages hold 9 hours at 1 s
+ */
+#define APP_TS_STORE_PAGES          16
+
+/* Analog sampling: VDD and AIN0 (P0.02) at 1 kHz, the CPU wakes every 100 sets (10 times/s) */
+#define APP_SAMPLING_ENABLED        0
+#define APP_SAMPLING_RATE_HZ        1000
+#define APP_SAMPLING_FRAMES         100
+#define APP_SAMPLING_SIMULATED      0   /* 1: sensorsim waveforms instead of the SAADC, same rate and buffers */
+
+/* Cycle counts of the fixed point filter kernels, logged once at startup */
+#define APP_DSP_BENCH_ENABLED       0
+#define APP_DSP_BENCH_BLOCK         128
+#define APP_DSP_BENCH_TAPS          32
+
+/* Sensor service: AIN0 in windows, summaries and threshold events instead of raw samples */
+#define APP_SENSOR_CHANNEL          1
+
+/* Per-link state. Indexed with ble_conn_state_conn_idx() so that all the link tables stay compact */
+typedef struct
+{
+  uint16_t conn_handle;
+  uint16_t att_mtu;
+  uint8_t  tx_phy;
+  uint8_t  rx_phy;
+  uint32_t connected_ticks;   /* app_timer counter at connection, for the setup latencies */
+  pm_peer_id_t peer_id;       /* PM_PEER_ID_INVALID until the peer is known to be bonded */
+  bool     notified;          /* First notification sent */
+} link_state_t;
+
+/* Latency statistics */
+typedef struct
+{
+  uint32_t count;
+  uint32_t total_ms;
+  uint32_t max_ms;
+} latency_stats_t;
+
+/* Disconnection to reconnection latency of a bonded peer */
+typedef struct
+{
+  pm_peer_id_t  peer_id;
+  bool          disconnected;
+  uint32_t      disconnected_ticks;
+  latency_stats_t latency;
+} peer_reconnect_t;
+
+NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT);   /* One queued writes instance per link */
 NRF_BLE_GATT_DEF(m_gatt);
 BLE_ADVERTISING_DEF(m_advertising);
 
 APP_TIMER_DEF(m_check_ble_id); /* To check BLE address periodically for non-resolvable private addr */
+APP_TIMER_DEF(m_telemetry_timer); /* To publish telemetry frames */
+APP_TIMER_DEF(m_stats_timer); /* To log the event dispatch stats */
+
+/* Step 8.0: Advertising and scan response payloads, encoded at compile time */
+typedef struct
+{
+  ADV_AD_STRUCT(flags, 1);
+  ADV_AD_STRUCT(appearance, 2);
+  ADV_AD_STRUCT(tx_power, 1);
+  ADV_AD_STRUCT(manuf_data, 2 + APP_VENDOR_DATA_SIZE);  /* Company id followed by the vendor data */
+  ADV_AD_STRUCT(short_name, sizeof(DEVICE_SHORT_NAME) - 1);
+} app_adv_data_t;
+
+typedef struct
+{
+  ADV_AD_STRUCT(full_name, sizeof(DEVICE_NAME) - 1);
+  ADV_AD_STRUCT(conn_int, 4);
+} app_sr_data_t;
+
+ADV_PAYLOAD_CHECK(app_adv_data_t, BLE_GAP_ADV_SET_DATA_SIZE_MAX);
+ADV_PAYLOAD_CHECK(app_sr_data_t, BLE_GAP_ADV_SET_DATA_SIZE_MAX);
+
+/* Offset of the vendor data (after the company id) for runtime patching */
+#define APP_VENDOR_DATA_OFFSET    (ADV_AD_DATA_OFFSET(app_adv_data_t, manuf_data) + 2)
+
+static const app_adv_data_t m_adv_data =
+{
+  .flags      = ADV_AD(app_adv_data_t, flags, BLE_GAP_AD_TYPE_FLAGS, { BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE }),
+  .appearance = ADV_AD(app_adv_data_t, appearance, BLE_GAP_AD_TYPE_APPEARANCE,
+                       { LSB_16(DEVICE_APPEARANCE), MSB_16(DEVICE_APPEARANCE) }),
+  /* Transmitter is set to the same level in init_advertising() */
+  .tx_power   = ADV_AD(app_adv_data_t, tx_power, BLE_GAP_AD_TYPE_TX_POWER_LEVEL, { (uint8_t)APP_ADV_TX_POWER }),
+  .manuf_data = ADV_AD(app_adv_data_t, manuf_data, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA,
+                       { LSB_16(APP_COMPANY_ID), MSB_16(APP_COMPANY_ID), 0x12, 0x34, 0x56, 0x78 }),
+  .short_name = ADV_AD(app_adv_data_t, short_name, BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME, DEVICE_SHORT_NAME),
+};
+
+/* Long range mode uses extended connectable advertising, which has no scan response but
+ * takes a larger payload. The full name moves into the advertising data.
+ */
+typedef struct
+{
+  ADV_AD_STRUCT(flags, 1);
+  ADV_AD_STRUCT(appearance, 2);
+  ADV_AD_STRUCT(tx_power, 1);
+  ADV_AD_STRUCT(manuf_data, 2 + APP_VENDOR_DATA_SIZE);
+  ADV_AD_STRUCT(full_name, sizeof(DEVICE_NAME) - 1);
+} app_lr_adv_data_t;
+
+ADV_PAYLOAD_CHECK(app_lr_adv_data_t, BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_CONNECTABLE_MAX_SUPPORTED);
+
+#define APP_LR_VENDOR_DATA_OFFSET (ADV_AD_DATA_OFFSET(app_lr_adv_data_t, manuf_data) + 2)
+
+static const app_lr_adv_data_t m_lr_adv_data =
+{
+  .flags      = ADV_AD(app_lr_adv_data_t, flags, BLE_GAP_AD_TYPE_FLAGS, { BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE }),
+  .appearance = ADV_AD(app_lr_adv_data_t, appearance, BLE_GAP_AD_TYPE_APPEARANCE,
+                       { LSB_16(DEVICE_APPEARANCE), MSB_16(DEVICE_APPEARANCE) }),
+  .tx_power   = ADV_AD(app_lr_adv_data_t, tx_power, BLE_GAP_AD_TYPE_TX_POWER_LEVEL, { (uint8_t)APP_ADV_TX_POWER }),
+  .manuf_data = ADV_AD(app_lr_adv_data_t, manuf_data, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA,
+                       { LSB_16(APP_COMPANY_ID), MSB_16(APP_COMPANY_ID), 0x12, 0x34, 0x56, 0x78 }),
+  .full_name  = ADV_AD(app_lr_adv_data_t, full_name, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, DEVICE_NAME),
+};
+
+static const app_sr_data_t m_sr_data =
+{
+  .full_name  = ADV_AD(app_sr_data_t, full_name, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, DEVICE_NAME),
+  .conn_int   = ADV_AD(app_sr_data_t, conn_int, BLE_GAP_AD_TYPE_SLAVE_CONNECTION_INTERVAL_RANGE,
+                       { LSB_16(MIN_CONN_INTERVAL), MSB_16(MIN_CONN_INTERVAL),
+                         LSB_16(MAX_CONN_INTERNAL), MSB_16(MAX_CONN_INTERNAL) }),
+};
+
+/* Step 8.5: Advertising schedule. The allowlist stage advertises openly until a peer is bonded */
+static const adv_sched_stage_t m_adv_stages[] =
+{
+  { .interval = APP_ADV_INTERVAL,      .duration = APP_ADV_DURATION,      .allowlist = false },
+  { .interval = APP_ADV_SLOW_INTERVAL, .duration = APP_ADV_SLOW_DURATION, .allowlist = false },
+  { .interval = APP_ADV_IDLE_INTERVAL, .duration = APP_ADV_IDLE_DURATION, .allowlist = true  },
+};
+
+static link_state_t m_links[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+static bool m_long_range = APP_LONG_RANGE_ENABLED;
+
+/* Connection to encrypted link */
+static latency_stats_t m_reencrypt_latency;     /* Bonded peers, stored LTK */
+static latency_stats_t m_pairing_latency;       /* New peers, full LESC pairing */
+
+/* Connection to first notification */
+static latency_stats_t m_notify_cached_latency;    /* Bonded peers, CCCDs restored from flash */
+static latency_stats_t m_notify_uncached_latency;  /* Other peers, discovery and subscription first */
+
+static peer_reconnect_t m_peer_reconnect[APP_RECONNECT_PEERS_MAX];
+static uint8_t          m_peer_reconnect_next = 0;   /* Entry reused when the table is full */
+
+static uint32_t m_ts_time_base = 0;   /* Time series seconds at boot, continues the stored series */
+
+static nrf_saadc_input_t const m_sampling_inputs[] = { NRF_SAADC_INPUT_VDD, NRF_SAADC_INPUT_AIN0 };
+static int16_t m_sampling_means[ARRAY_SIZE(m_sampling_inputs)];   /* Of the last buffer */
+static window_agg_summary_t m_last_summary;                       /* Latest window, for the telemetry frame */
+
+static sample_source_t const m_saadc_source =
+{
+  .p_name        = "saadc",
+  .channel_count = ARRAY_SIZE(m_sampling_inputs),
+  .start         = saadc_sampler_start,
+  .stop          = saadc_sampler_stop,
+};
+
+/* Simulated inputs, in SAADC counts: VDD around 3.0 V and a 0 to 3.6 V triangle on AIN0 */
+static sensorsim_cfg_t const m_sim_cfgs[ARRAY_SIZE(m_sampling_inputs)] =
+{
+  { .min = 3300, .max = 3530, .incr = 1,  .start_at_max = false },
+  { .min = 0,    .max = 4095, .incr = 41, .start_at_max = false },
+};
 
-static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
+/* 1 s tumbling windows at 1 kHz, events below 0.3 V and above 3.1 V (12 bit, 3.6 V full scale).
+ * The central changes it through the sensor service
+ */
+static window_agg_config_t m_window_config =
+{
+  .pane_len   = 1000,
+  .panes      = 1,
+  .outputs    = WINDOW_AGG_OUT_SUMMARY | WINDOW_AGG_OUT_EVENTS,
+  .hist_min   = 0,
+  .hist_max   = 4095,
+  .high       = 3500,
+  .low        = 350,
+  .hysteresis = 100,
+};
+static window_agg_t m_window_agg;
 
 static void check_ble_id_timeout_handler(void *p_context);
+static void telemetry_timeout_handler(void *p_context);
+static void stats_timeout_handler(void *p_context);
+static void init_telemetry_adv(void);
+static void init_config(void);
+static void init_fds_gc_sched(void);
+static void init_sample_source(void);
+static bool window_config_handler(window_agg_config_t const *p_config);
+static bool scan_filter_handler(uint8_t const *p_data, uint16_t len);
+static bool settings_handler(uint8_t const *p_data, uint16_t len);
+static uint32_t ts_time_get(void);
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+/* Add a sample, returns the latency in ms */
+static uint32_t latency_stats_add(latency_stats_t *p_stats, uint32_t ticks)
+{
+  uint32_t latency_ms = ticks_to_ms(ticks);
+
+  p_stats->count++;
+  p_stats->total_ms += latency_ms;
+  p_stats->max_ms = MAX(p_stats->max_ms, latency_ms);
+
+  return latency_ms;
+}
+
+/* Get the link state entry of a connection. NULL if the handle does not belong to a link */
+static link_state_t *link_get(uint16_t conn_handle)
+{
+  uint16_t idx = ble_conn_state_conn_idx(conn_handle);
+
+  if(idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT)
+  {
+    return NULL;
+  }
+
+  return &m_links[idx];
+}
+
+/* Advertising can run when the set is not used by the broadcast and a peripheral link slot is free */
+static bool advertising_allowed(void)
+{
+  return !telemetry_adv_is_running() &&
+         (ble_conn_state_peripheral_conn_count() < NRF_SDH_BLE_PERIPHERAL_LINK_COUNT);
+}
+
+/* Restart advertising as long as there are free peripheral link slots */
+static void advertising_restart_if_free(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(adv_sched_is_running() || !advertising_allowed())
+  {
+    return;
+  }
+
+  err_code = adv_sched_start();
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Back to fast advertising, on button press or when there is data pending for a central */
+static void advertising_kick(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!advertising_allowed())
+  {
+    return;
+  }
+
+  err_code = adv_sched_kick();
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Reconnection entry of a peer. Takes a free or the oldest entry when 'create' is set */
+static peer_reconnect_t *peer_reconnect_get(pm_peer_id_t peer_id, bool create)
+{
+  peer_reconnect_t *p_entry = NULL;
+
+  for(uint32_t i = 0; i < APP_RECONNECT_PEERS_MAX; i++)
+  {
+    if(m_peer_reconnect[i].peer_id == peer_id)
+    {
+      return &m_peer_reconnect[i];
+    }
+
+    if((p_entry == NULL) && (m_peer_reconnect[i].peer_id == PM_PEER_ID_INVALID))
+    {
+      p_entry = &m_peer_reconnect[i];
+    }
+  }
+
+  if(!create)
+  {
+    return NULL;
+  }
+
+  if(p_entry == NULL)
+  {
+    p_entry = &m_peer_reconnect[m_peer_reconnect_next];
+    m_peer_reconnect_next = (m_peer_reconnect_next + 1) % APP_RECONNECT_PEERS_MAX;
+  }
+
+  memset(p_entry, 0, sizeof(*p_entry));
+  p_entry->peer_id = peer_id;
+
+  return p_entry;
+}
+
+/* A bonded peer dropped off. Directed advertising at its identity address so it comes back
+ * right away, then the normal advertising stages.
+ */
+static void advertising_reconnect(pm_peer_id_t peer_id)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  pm_peer_data_bonding_t bonding;
+  peer_reconnect_t *p_entry = peer_reconnect_get(peer_id, true);
+
+  p_entry->disconnected = true;
+  p_entry->disconnected_ticks = app_timer_cnt_get();
+
+  if(!advertising_allowed())
+  {
+    return;
+  }
+
+  err_code = pm_peer_data_bonding_load(peer_id, &bonding);
+  if(err_code != NRF_SUCCESS)
+  {
+    /* Bond deleted meanwhile */
+    advertising_restart_if_free();
+    return;
+  }
+
+  err_code = adv_sched_reconnect(&bonding.peer_ble_id.id_addr_info);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* A bonded peer is back, log how long it took */
+static void reconnect_latency_log(link_state_t const *p_link)
+{
+  peer_reconnect_t *p_entry = peer_reconnect_get(p_link->peer_id, false);
+  uint32_t latency_ms = 0;
+
+  if((p_entry == NULL) || !p_entry->disconnected)
+  {
+    return;
+  }
+
+  p_entry->disconnected = false;
+  latency_ms = latency_stats_add(&p_entry->latency,
+                                 app_timer_cnt_diff_compute(p_link->connected_ticks, p_entry->disconnected_ticks));
+
+  NRF_LOG_INFO("Peer %d: reconnected in %u ms (avg %u ms, max %u ms over %u)", p_link->peer_id,
+               latency_ms, p_entry->latency.total_ms / p_entry->latency.count,
+               p_entry->latency.max_ms, p_entry->latency.count);
+}
 
 /* Step 10.1: Connection parameter event handler */
 static void on_conn_params_evt(ble_conn_params_evt_t *p_evt)
@@ -60,7 +521,7 @@ static void on_conn_params_evt(ble_conn_params_evt_t *p_evt)
 
   if(p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
   {
-    err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+    err_code = sd_ble_gap_disconnect(p_evt->conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
     APP_ERROR_CHECK(err_code);
   }
 
@@ -76,7 +537,9 @@ static void conn_params_error_handler(uint32_t nrf_error)
   APP_ERROR_HANDLER(nrf_error);
 }
 
-/* Step 10: setting connection params */
+/* Step 10: setting connection params. After init_peer_manager(): the stored intervals are in the
+ * PPCP by then (config_apply()), the module negotiates with what it reads here
+ */
 static void init_conn_params(void)
 {
   ret_code_t err_code = NRF_SUCCESS;
@@ -114,7 +577,29 @@ static void init_services(void)
 
   qwr_init.error_handler = nrf_qwr_error_handler;
 
-  err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init);
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    err_code = nrf_ble_qwr_init(&m_qwr[i], &qwr_init);
+    APP_ERROR_CHECK(err_code);
+  }
+
+  /* Link quality stats, readable over the diagnostics service */
+  err_code = link_stats_init(APP_LINK_STATS_SAMPLE_INTERVAL);
+  APP_ERROR_CHECK(err_code);
+
+  /* The central loads the scan gateway's tag filter and tunes the settings here */
+  diag_service_init_t diag_init = {0};
+
+  diag_init.scan_filter_handler = APP_SCANNER_ENABLED ? scan_filter_handler : NULL;
+  diag_init.settings_handler = settings_handler;
+
+  err_code = diag_service_init(&diag_init);
+  APP_ERROR_CHECK(err_code);
+
+  err_code = blackbox_service_init(&m_gatt);
+  APP_ERROR_CHECK(err_code);
+
+  err_code = sensor_service_init(&m_gatt, &m_window_config, window_config_handler);
   APP_ERROR_CHECK(err_code);
 }
 
@@ -127,9 +612,39 @@ static void on_adv_event(ble_adv_evt_t ble_adv_evt)
   {
     case BLE_ADV_EVT_FAST:
       NRF_LOG_INFO("Fast advertising...");
+      adv_payload_suspend(false);
       err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
       APP_ERROR_CHECK(err_code);
     break;
+    case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
+    case BLE_ADV_EVT_DIRECTED:
+      NRF_LOG_INFO("Directed advertising...");
+      /* The reconnect prelude carries no payload, beacon updates wait for the first undirected stage */
+      adv_payload_suspend(true);
+      err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_DIRECTED);
+      APP_ERROR_CHECK(err_code);
+    break;
+    case BLE_ADV_EVT_FAST_WHITELIST:
+      NRF_LOG_INFO("Advertising to bonded peers...");
+      adv_payload_suspend(false);
+      err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_WHITELIST);
+      APP_ERROR_CHECK(err_code);
+    break;
+    case BLE_ADV_EVT_WHITELIST_REQUEST:
+    {
+      ble_gap_addr_t addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+      ble_gap_irk_t  irks[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+      uint32_t       addr_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+      uint32_t       irk_cnt  = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+
+      /* Bonded peers. While nothing is bonded the empty allowlist makes ble_advertising advertise openly */
+      err_code = pm_whitelist_get(addrs, &addr_cnt, irks, &irk_cnt);
+      APP_ERROR_CHECK(err_code);
+
+      err_code = ble_advertising_whitelist_reply(&m_advertising, addrs, addr_cnt, irks, irk_cnt);
+      APP_ERROR_CHECK(err_code);
+    }
+    break;
     case BLE_ADV_EVT_IDLE:
       NRF_LOG_INFO("Advertising event Idle...");
       err_code = bsp_indication_set(BSP_INDICATE_IDLE);
@@ -138,6 +653,57 @@ static void on_adv_event(ble_adv_evt_t ble_adv_evt)
     default:
     break;
    }
+
+  /* Moves on to the next stage when the current one times out */
+  adv_sched_on_adv_evt(ble_adv_evt);
+}
+
+/* Step 8.2: Advertising modes. Long range advertises connectable on Coded PHY through extended advertising */
+static void advertising_modes_config_get(bool long_range, ble_adv_modes_config_t *p_config)
+{
+  memset(p_config, 0, sizeof(*p_config));
+
+  p_config->ble_adv_fast_enabled = true;
+  p_config->ble_adv_fast_interval = APP_ADV_INTERVAL;
+  p_config->ble_adv_fast_timeout = APP_ADV_DURATION;
+  p_config->ble_adv_on_disconnect_disabled = true; /* Restarted from ble_event_handler when a link slot becomes free */
+
+  if(long_range)
+  {
+    p_config->ble_adv_extended_enabled = true;
+    p_config->ble_adv_primary_phy = BLE_GAP_PHY_CODED;
+    p_config->ble_adv_secondary_phy = BLE_GAP_PHY_CODED;
+  }
+  else
+  {
+    p_config->ble_adv_primary_phy = BLE_GAP_PHY_1MBPS;
+  }
+}
+
+/* Step 8.3: Install the payloads matching the advertising mode */
+static void advertising_payload_install(bool long_range)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(long_range)
+  {
+    err_code = adv_payload_init(&m_advertising, (uint8_t const *)&m_lr_adv_data, sizeof(m_lr_adv_data), NULL, 0);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = adv_payload_beacon_init(APP_LR_VENDOR_DATA_OFFSET, APP_VENDOR_DATA_SIZE, APP_ADV_UPDATE_INTERVAL);
+    APP_ERROR_CHECK(err_code);
+  }
+  else
+  {
+    err_code = adv_payload_init(&m_advertising,
+                                (uint8_t const *)&m_adv_data, sizeof(m_adv_data),
+                                (uint8_t const *)&m_sr_data, sizeof(m_sr_data));
+    APP_ERROR_CHECK(err_code);
+
+    /* Vendor data is updated live while advertising */
+    err_code = adv_payload_beacon_init(APP_VENDOR_DATA_OFFSET, APP_VENDOR_DATA_SIZE, APP_ADV_UPDATE_INTERVAL);
+    APP_ERROR_CHECK(err_code);
+  }
 }
 
 /* Step 8: Init Advertising */
@@ -145,76 +711,92 @@ static void init_advertising(void)
 {
   ret_code_t err_code = NRF_SUCCESS;
 
+  /* advdata and srdata are left empty. The payloads are the precompiled ones installed below */
   ble_advertising_init_t init = {0};
-  int8_t tx_power_lvl = 0;
 
-  ble_advdata_service_data_t service_data = {0};
-  uint8_t bat_lvl = 90;
+  /* Advertising params */
+  advertising_modes_config_get(m_long_range, &init.config);
+
+  init.evt_handler = on_adv_event;
+
+  err_code = ble_advertising_init(&m_advertising, &init);
+  APP_ERROR_CHECK(err_code);
 
-  ble_advdata_conn_int_t  conn_int_range = {0};
+  ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
 
-  uint8_t vendor_adv_data[4] = {0x12, 0x34, 0x56, 0x78};
-  ble_advdata_manuf_data_t manu_specific_data = {0};
+  advertising_payload_install(m_long_range);
 
-  /* Device Name */
-  init.advdata.name_type =  BLE_ADVDATA_FULL_NAME;
-  /* Device Appearance */
-  init.advdata.include_appearance = true; /* We are including appearance and be default it will set to unknown unless we set to a type when setting GAP param */
-  /* Flags */
-  init.advdata.flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-  /* TX power level */
-  init.advdata.p_tx_power_level = &tx_power_lvl; /* This only adds the power level in the adv packet. Not setting the transmitter */
+  /* Match the TX power field of the payloads. The set is shared with the telemetry broadcast */
+  err_code = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_ADV, m_advertising.adv_handle, APP_ADV_TX_POWER);
+  APP_ERROR_CHECK(err_code);
 
-#if 0   /* To save space in the adv packet use as required */
-  /* list of uuids */ /* This is only to inform a central about available services */
-  ble_uuid_t m_adv_uuids[] = {
-                                {BLE_UUID_HEALTH_THERMOMETER_SERVICE, BLE_UUID_TYPE_BLE},
-                                {BLE_UUID_BATTERY_SERVICE, BLE_UUID_TYPE_BLE}
-                              };
-  init.advdata.uuids_complete.p_uuids = m_adv_uuids;
-  init.advdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids)/sizeof(m_adv_uuids[0]);
+  adv_sched_init_t sched_init = {0};
 
+  sched_init.p_advertising = &m_advertising;
+  sched_init.p_base_config = &init.config;
+  sched_init.p_stages = m_adv_stages;
+  sched_init.stage_count = ARRAY_SIZE(m_adv_stages);
+  sched_init.event_charge_nc = m_long_range ? APP_ADV_LR_EVENT_CHARGE_NC : APP_ADV_EVENT_CHARGE_NC;
+  sched_init.report_interval = APP_ADV_REPORT_INTERVAL;
+  sched_init.directed_interval = APP_ADV_DIRECTED_INTERVAL;
+  sched_init.directed_duration = APP_ADV_DIRECTED_DURATION;
 
+  err_code = adv_sched_init(&sched_init);
+  APP_ERROR_CHECK(err_code);
+}
 
-  /* Service data /* /* This is not registering with GATT for connection event data transfer */
+/* Step 8.4: Switch between long range (Coded PHY) and legacy advertising at runtime */
+static void advertising_long_range_set(bool long_range)
+{
+  ret_code_t err_code = NRF_SUCCESS;
 
-  service_data.service_uuid = BLE_UUID_BATTERY_SERVICE;
-  service_data.data.p_data = &bat_lvl;
-  service_data.data.size  = sizeof(bat_lvl);
+  ble_adv_modes_config_t config;
 
-  init.advdata.p_service_data_array = &service_data;
-  init.advdata.service_data_count = 1;
+  if(long_range == m_long_range)
+  {
+    return;
+  }
 
+  err_code = adv_sched_stop();
+  APP_ERROR_CHECK(err_code);
 
-    /* connection interval range */
-  conn_int_range.min_conn_interval = MIN_CONN_INTERVAL;
-  conn_int_range.max_conn_interval = MAX_CONN_INTERNAL;
-  init.advdata.p_slave_conn_int = &conn_int_range;
-#endif
+  m_long_range = long_range;
 
-  /* Vendor (manufacturer) specific data */
-  manu_specific_data.company_identifier = 0x0059; /* Thid is nordic company manufacturing id */
-  manu_specific_data.data.p_data = vendor_adv_data;
-  manu_specific_data.data.size = sizeof(vendor_adv_data)/(sizeof(vendor_adv_data[0]));
-  init.advdata.p_manuf_specific_data = &manu_specific_data;
-  
-  /* Advertising params */
-  init.config.ble_adv_fast_enabled = true;
-  init.config.ble_adv_fast_interval = APP_ADV_INTERVAL;
-  init.config.ble_adv_fast_timeout = APP_ADV_DURATION;
+  advertising_modes_config_get(m_long_range, &config);
+  ble_advertising_modes_config_set(&m_advertising, &config);
+  adv_sched_base_config_set(&config, m_long_range ? APP_ADV_LR_EVENT_CHARGE_NC : APP_ADV_EVENT_CHARGE_NC);
+  advertising_payload_install(m_long_range);
 
-  init.evt_handler = on_adv_event;
+  if(!telemetry_adv_is_running())
+  {
+    init_telemetry_adv();
+  }
 
-  err_code = ble_advertising_init(&m_advertising, &init);
-  APP_ERROR_CHECK(err_code);
+  NRF_LOG_INFO("Long range advertising %s", m_long_range ? "on (Coded PHY)" : "off (1M PHY)");
 
-  ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
+  advertising_restart_if_free();
+}
+
+/* Step 7.1: GATT event handler */
+static void gatt_evt_handler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *p_evt)
+{
+  link_state_t *p_link = NULL;
+
+  if(p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED)
+  {
+    p_link = link_get(p_evt->conn_handle);
+    if(p_link != NULL)
+    {
+      p_link->att_mtu = p_evt->params.att_mtu_effective;
+    }
+    NRF_LOG_INFO("Link 0x%04X: ATT MTU %d", p_evt->conn_handle, p_evt->params.att_mtu_effective);
+  }
 }
 
 /* Step 7: Init GATT */
 static void init_gatt(void)
 {
-  ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
+  ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
   APP_ERROR_CHECK(err_code);
 }
 
@@ -233,7 +815,7 @@ static void init_gap_params(void)
   APP_ERROR_CHECK(err_code);
 
   /* Set device appearance */
-  err_code = sd_ble_gap_appearance_set(BLE_APPEARANCE_GENERIC_CYCLING);
+  err_code = sd_ble_gap_appearance_set(DEVICE_APPEARANCE);
   APP_ERROR_CHECK(err_code);
 
   gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
@@ -245,40 +827,125 @@ static void init_gap_params(void)
   APP_ERROR_CHECK(err_code);
 }
 
+/* Step 5.2: Time from connection to the first notification. Bonded peers get their CCCDs
+ * back from flash and a central trusting its GATT cache skips discovery and subscription.
+ */
+static void notify_latency_log(link_state_t *p_link)
+{
+  bool cached = (p_link->peer_id != PM_PEER_ID_INVALID);
+  latency_stats_t *p_stats = cached ? &m_notify_cached_latency : &m_notify_uncached_latency;
+  uint32_t latency_ms = 0;
+
+  p_link->notified = true;
+  latency_ms = latency_stats_add(p_stats, app_timer_cnt_diff_compute(app_timer_cnt_get(), p_link->connected_ticks));
+
+  NRF_LOG_INFO("Link 0x%04X: first notification %u ms after connect, %s (avg %u ms, max %u ms over %u)",
+               p_link->conn_handle, latency_ms, cached ? "bonded" : "not bonded",
+               p_stats->total_ms / p_stats->count, p_stats->max_ms, p_stats->count);
+}
+
 /* Step 5.1: BLE Event handler */
 static void ble_event_handler(ble_evt_t const *p_ble_evt, void *p_context)
 {
   ret_code_t err_code = NRF_SUCCESS;
+  uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+  link_state_t *p_link = link_get(conn_handle);
 
   switch(p_ble_evt->header.evt_id) {
     
     case BLE_GAP_EVT_DISCONNECTED:
-      NRF_LOG_INFO("Device disconnected");
+      NRF_LOG_INFO("Device 0x%04X disconnected, reason 0x%02X. Links: %d", conn_handle,
+                   p_ble_evt->evt.gap_evt.params.disconnected.reason,
+                   ble_conn_state_peripheral_conn_count());
+
+      if(ble_conn_state_peripheral_conn_count() == 0)
+      {
+        err_code = bsp_indication_set(BSP_INDICATE_IDLE);
+        APP_ERROR_CHECK(err_code);
+      }
+
+      if((p_link != NULL) && (p_link->peer_id != PM_PEER_ID_INVALID) &&
+         (p_ble_evt->evt.gap_evt.params.disconnected.reason != BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION))
+      {
+        advertising_reconnect(p_link->peer_id);
+      }
+      else
+      {
+        advertising_restart_if_free();
+      }
+
+      if(p_link != NULL)
+      {
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+        p_link->peer_id = PM_PEER_ID_INVALID;
+      }
       break;
     case BLE_GAP_EVT_CONNECTED:
-      NRF_LOG_INFO("Device Connected");
+      NRF_LOG_INFO("Device 0x%04X Connected. Links: %d", conn_handle,
+                   ble_conn_state_peripheral_conn_count());
       
-      err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
-      APP_ERROR_CHECK(err_code);
+      /* The SoftDevice stops advertising when a connection is established, adv_sched tracks that */
 
-      m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-      err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+      err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
       APP_ERROR_CHECK(err_code);
 
-
+      if(p_link != NULL)
+      {
+        p_link->conn_handle = conn_handle;
+        p_link->att_mtu = BLE_GATT_ATT_MTU_DEFAULT;
+        /* Connections from extended advertising start on its secondary PHY */
+        p_link->tx_phy = m_long_range ? BLE_GAP_PHY_CODED : BLE_GAP_PHY_1MBPS;
+        p_link->rx_phy = p_link->tx_phy;
+        p_link->connected_ticks = app_timer_cnt_get();
+        p_link->peer_id = PM_PEER_ID_INVALID;
+        p_link->notified = false;
+        NRF_LOG_INFO("Link 0x%04X: PHY 0x%02X", conn_handle, p_link->tx_phy);
+        tx_power_ctrl_phy_set(conn_handle, p_link->rx_phy);
+
+        err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr[ble_conn_state_conn_idx(conn_handle)], conn_handle);
+        APP_ERROR_CHECK(err_code);
+      }
+
+      /* Bonded peers re-encrypt with the stored LTK, new peers start pairing */
+      pm_handler_secure_on_connection(p_ble_evt);
+
+      advertising_restart_if_free();
+      break;
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+      if((p_link != NULL) && !p_link->notified)
+      {
+        notify_latency_log(p_link);
+      }
+      break;
+    case BLE_GAP_EVT_PHY_UPDATE:
+      if(p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS && p_link != NULL)
+      {
+        p_link->tx_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+        p_link->rx_phy = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+      }
+      NRF_LOG_INFO("Link 0x%04X: PHY tx 0x%02X rx 0x%02X", conn_handle,
+                   p_ble_evt->evt.gap_evt.params.phy_update.tx_phy,
+                   p_ble_evt->evt.gap_evt.params.phy_update.rx_phy);
       break;
     case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
       NRF_LOG_INFO("Phy update request");
 
+      /* Stay on Coded PHY in long range mode, otherwise let the SoftDevice pick */
       ble_gap_phys_t const phys = 
       {
-        .rx_phys = BLE_GAP_PHY_AUTO,
-        .tx_phys = BLE_GAP_PHY_AUTO,
+        .rx_phys = m_long_range ? BLE_GAP_PHY_CODED : BLE_GAP_PHY_AUTO,
+        .tx_phys = m_long_range ? BLE_GAP_PHY_CODED : BLE_GAP_PHY_AUTO,
       };
 
       err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);   
       APP_ERROR_CHECK(err_code);
 
+      /* Coded PHY is forced in long range mode, any other choice is reported by the PHY update */
+      if(m_long_range)
+      {
+        tx_power_ctrl_phy_set(p_ble_evt->evt.gap_evt.conn_handle, BLE_GAP_PHY_CODED);
+      }
+
      break;
     default:
      break;
@@ -297,16 +964,36 @@ static void init_ble_stack(void)
   err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
   APP_ERROR_CHECK(err_code);
 
+  /* Deeper notification queue, several packets per connection event */
+  ble_cfg_t ble_cfg = {0};
+  ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+  ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = APP_HVN_TX_QUEUE_SIZE;
+  err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+  APP_ERROR_CHECK(err_code);
+
   err_code = nrf_sdh_ble_enable(&ram_start);
   APP_ERROR_CHECK(err_code);
 
+  ble_conn_state_init();
+
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    m_links[i].peer_id = PM_PEER_ID_INVALID;
+  }
+
   NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_event_handler, NULL);
 }
 
 /* Step 4.1: Initialize Power Managment */
 static void idle_state_handler(void)
 {
-  if( NRF_LOG_PROCESS() == false ) {
+  /* LESC DH key computations requested by the SoftDevice */
+  ret_code_t err_code = nrf_ble_lesc_request_handler();
+  APP_ERROR_CHECK(err_code);
+
+  /* Logs are drained between radio events. Sleep through the next one */
+  if( radio_sched_radio_active() || (NRF_LOG_PROCESS() == false) ) {
     nrf_pwr_mgmt_run();
   }
 }
@@ -318,10 +1005,32 @@ static void init_power_management(void)
   APP_ERROR_CHECK(err_code);
 }
 
-/* Step 3: Initialize LEDs */
+/* Step 3.1: Button events */
+static void bsp_event_handler(bsp_event_t event)
+{
+  switch(event)
+  {
+    case BSP_EVENT_KEY_0:   /* Short push on SW1 */
+      advertising_kick();
+      break;
+    case BSP_EVENT_KEY_1:   /* Long push on SW1 */
+      advertising_long_range_set(!m_long_range);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Step 3: Initialize LEDs and buttons */
 static void init_leds(void)
 {
-  ret_code_t err_code = bsp_init(BSP_INIT_LEDS, NULL);
+  ret_code_t err_code = bsp_init(BSP_INIT_LEDS | BSP_INIT_BUTTONS, bsp_event_handler);
+  APP_ERROR_CHECK(err_code);
+
+  err_code = bsp_event_to_button_action_assign(0, BSP_BUTTON_ACTION_PUSH, BSP_EVENT_KEY_0);
+  APP_ERROR_CHECK(err_code);
+
+  err_code = bsp_event_to_button_action_assign(0, BSP_BUTTON_ACTION_LONG_PUSH, BSP_EVENT_KEY_1);
   APP_ERROR_CHECK(err_code);
 }
 
@@ -334,6 +1043,20 @@ static void timer_init(void)
   /* Step 12.4: create timer for ble_id reading */
   err_code = app_timer_create(&m_check_ble_id, APP_TIMER_MODE_REPEATED, check_ble_id_timeout_handler);
   APP_ERROR_CHECK(err_code);
+
+  /* Step 13.1: create timer for telemetry frames */
+  err_code = app_timer_create(&m_telemetry_timer, APP_TIMER_MODE_REPEATED, telemetry_timeout_handler);
+  APP_ERROR_CHECK(err_code);
+
+  /* Step 15.1: create timer for the event dispatch stats */
+  err_code = app_timer_create(&m_stats_timer, APP_TIMER_MODE_REPEATED, stats_timeout_handler);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 2.1: Initialize the scheduler, before the SoftDevice starts queueing events */
+static void scheduler_init(void)
+{
+  APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
 }
 
 /* Step 1: Initialize the logger */
@@ -350,8 +1073,8 @@ static void start_advertisments(void)
 {
   ret_code_t  ret_code = NRF_SUCCESS;
 
-  /* make sure to use the same mode of advertisement used in advertisement init */
-  ret_code = ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+  /* Fast, slow and very slow stages, see m_adv_stages */
+  ret_code = adv_sched_start();
   APP_ERROR_CHECK(ret_code);
 }
 
@@ -433,26 +1156,878 @@ static void check_ble_id_timeout_handler(void *p_context)
   }
 }
 
-
-/**@brief Function for application main entry.
+/* Step 13.1: Build a telemetry frame and hand it to the broadcaster, or to the
+ * vendor data of the connectable advertising when not broadcasting. Frame layout, little
+ * endian (the broadcaster adds its own sequence number in front):
+ *   die temperature (int16, 0.25 degC), mean of the latest window (int16), links (uint8),
+ *   last buffer means of the sampling inputs (int16 each), latest window summary as in the
+ *   sensor service (SENSOR_SUMMARY_SIZE)
+ * The legacy advertising vendor data carries the first APP_VENDOR_DATA_SIZE bytes: the
+ * temperature and the window mean.
  */
-int main(void)
+static void telemetry_frame_build(void *p_context)
 {
-  ret_code_t ret_code = NRF_SUCCESS;
+  ret_code_t err_code = NRF_SUCCESS;
 
-  log_init();
+  uint8_t  frame[5 + sizeof(m_sampling_means) + SENSOR_SUMMARY_SIZE];
+  uint16_t len = 0;
+
+  int32_t temp = 0;
+
+  STATIC_ASSERT(sizeof(frame) <= TELEMETRY_ADV_FRAME_MAX);
+  STATIC_ASSERT(APP_VENDOR_DATA_SIZE <= sizeof(frame));
+
+  /* Die temperature history, 0.25 degC units */
+  if(sd_temp_get(&temp) == NRF_SUCCESS)
+  {
+    (void)ts_store_append(ts_time_get(), temp);
+  }
+
+  len += uint16_encode((uint16_t)(int16_t)temp, &frame[len]);
+  len += uint16_encode((uint16_t)m_last_summary.mean, &frame[len]);
+  frame[len++] = (uint8_t)ble_conn_state_peripheral_conn_count();
+
+  for(uint8_t ch = 0; ch < ARRAY_SIZE(m_sampling_means); ch++)
+  {
+    len += uint16_encode((uint16_t)m_sampling_means[ch], &frame[len]);
+  }
+
+  len += sensor_service_summary_encode(&m_last_summary, &frame[len]);
+
+  if(telemetry_adv_is_running())
+  {
+    err_code = telemetry_adv_frame_set(frame, len);
+  }
+  else
+  {
+    err_code = adv_payload_beacon_set(frame);
+  }
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 13.1: Frames are built right after a radio event */
+static void telemetry_timeout_handler(void *p_context)
+{
+  ret_code_t err_code = radio_sched_job_put(telemetry_frame_build, NULL);
+  if(err_code == NRF_ERROR_NO_MEM)
+  {
+    /* Queue full under load, the next frame catches up */
+    NRF_LOG_DEBUG("Telemetry frame skipped");
+    err_code = NRF_SUCCESS;
+  }
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 13.1: (Re)start the frame timer at the configured interval */
+static void telemetry_timer_restart(void)
+{
+  ret_code_t err_code = app_timer_stop(m_telemetry_timer);
+  APP_ERROR_CHECK(err_code);
+
+  uint32_t interval = APP_TIMER_TICKS(config_store_int_get(APP_CFG_TELEMETRY_INTERVAL_MS));
+
+  err_code = app_timer_start(m_telemetry_timer, MAX(interval, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 13: Init connectionless telemetry broadcast */
+static void init_telemetry_adv(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  telemetry_adv_init_t init = {0};
+
+  init.p_adv_handle = &m_advertising.adv_handle;  /* S140 has a single advertising set */
+  init.company_id = APP_COMPANY_ID;
+  init.interval = APP_TELEMETRY_ADV_INTERVAL;
+  if(m_long_range)
+  {
+    init.primary_phy = BLE_GAP_PHY_CODED;
+    init.secondary_phy = BLE_GAP_PHY_CODED;
+  }
+  else
+  {
+    init.primary_phy = BLE_GAP_PHY_1MBPS;
+    init.secondary_phy = BLE_GAP_PHY_2MBPS;       /* Shortest airtime for large frames */
+  }
+
+  err_code = telemetry_adv_init(&init);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 13.2: Start telemetry broadcast. Replaces connectable advertising */
+static void start_telemetry_broadcast(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  /* The broadcast takes over the advertising set */
+  adv_payload_suspend(true);
+
+  err_code = telemetry_adv_start();
+  APP_ERROR_CHECK(err_code);
+
+  NRF_LOG_INFO("Telemetry broadcast started...");
+}
+
+/* Step 14.3: The bonded peers are the scanner's priority peers */
+static void scanner_priority_update(pm_peer_id_t const *p_peer_ids, uint32_t peer_cnt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gap_addr_t         addrs[SCANNER_PRIORITY_MAX];
+  uint8_t                addr_cnt = 0;
+  pm_peer_data_bonding_t bonding;
+
+  for(uint32_t i = 0; (i < peer_cnt) && (addr_cnt < SCANNER_PRIORITY_MAX); i++)
+  {
+    if(pm_peer_data_bonding_load(p_peer_ids[i], &bonding) == NRF_SUCCESS)
+    {
+      addrs[addr_cnt++] = bonding.peer_ble_id.id_addr_info;
+    }
+  }
+
+  err_code = scanner_priority_set(addrs, addr_cnt);
+  APP_ERROR_CHECK(err_code);
+
+  if(APP_SCAN_PRIORITY_ONLY && (addr_cnt > 0))
+  {
+    err_code = scanner_mode_set(SCANNER_MODE_PRIORITY);
+    APP_ERROR_CHECK(err_code);
+  }
+}
+
+/* Step 14.2: Bonded peers for the allowlist, and their IRKs for address resolution. They are also
+ * the scanner's priority peers. The identity list can not be changed while the advertising set or
+ * scanning is in use, stop them first.
+ */
+static void peer_list_update(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  pm_peer_id_t peer_ids[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  uint32_t     peer_cnt = 0;
+  pm_peer_id_t peer_id = pm_next_peer_id_get(PM_PEER_ID_INVALID);
+
+  while((peer_id != PM_PEER_ID_INVALID) && (peer_cnt < BLE_GAP_WHITELIST_ADDR_MAX_COUNT))
+  {
+    peer_ids[peer_cnt++] = peer_id;
+    peer_id = pm_next_peer_id_get(peer_id);
+  }
+
+  /* Neither list can be changed while scanning, the scanner is restarted once both are set */
+  bool scanning = scanner_is_running();
+  if(scanning)
+  {
+    err_code = scanner_stop();
+    APP_ERROR_CHECK(err_code);
+  }
+
+  err_code = pm_whitelist_set(peer_ids, peer_cnt);
+  APP_ERROR_CHECK(err_code);
+
+  if(APP_SCANNER_ENABLED)
+  {
+    scanner_priority_update(peer_ids, peer_cnt);
+  }
+
+  if(telemetry_adv_is_running())
+  {
+    /* Broadcast owns the advertising set, identities are set on the next boot */
+    NRF_LOG_INFO("Bonded peers: %d (identities not updated)", peer_cnt);
+  }
+  else
+  {
+    err_code = pm_device_identities_list_set(peer_ids, peer_cnt);
+    if(err_code != NRF_ERROR_NOT_SUPPORTED)
+    {
+      APP_ERROR_CHECK(err_code);
+    }
+
+    NRF_LOG_INFO("Bonded peers: %d", peer_cnt);
+  }
+
+  if(scanning)
+  {
+    err_code = scanner_start();
+    APP_ERROR_CHECK(err_code);
+  }
+}
+
+static void sec_latency_log(uint16_t conn_handle, pm_conn_sec_procedure_t procedure)
+{
+  link_state_t    *p_link = link_get(conn_handle);
+  latency_stats_t *p_stats = NULL;
+  uint32_t        latency_ms = 0;
+
+  if(p_link == NULL)
+  {
+    return;
+  }
+
+  p_stats = (procedure == PM_CONN_SEC_PROCEDURE_ENCRYPTION) ? &m_reencrypt_latency : &m_pairing_latency;
+  latency_ms = latency_stats_add(p_stats, app_timer_cnt_diff_compute(app_timer_cnt_get(), p_link->connected_ticks));
+
+  NRF_LOG_INFO("Link 0x%04X: %s in %u ms (avg %u ms, max %u ms over %u)", conn_handle,
+               (procedure == PM_CONN_SEC_PROCEDURE_ENCRYPTION) ? "re-encrypted" : "paired",
+               latency_ms, p_stats->total_ms / p_stats->count, p_stats->max_ms, p_stats->count);
+}
+
+/* Step 14.1: Peer Manager event handler */
+static void pm_evt_handler(pm_evt_t const *p_evt)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  link_state_t *p_link = NULL;
+
+  pm_handler_on_pm_evt(p_evt);
+  pm_handler_disconnect_on_sec_failure(p_evt);
+  pm_handler_flash_clean(p_evt);
+
+  switch(p_evt->evt_id)
+  {
+    case PM_EVT_BONDED_PEER_CONNECTED:
+      p_link = link_get(p_evt->conn_handle);
+      if(p_link != NULL)
+      {
+        p_link->peer_id = p_evt->peer_id;
+        reconnect_latency_log(p_link);
+      }
+      break;
+    case PM_EVT_CONN_SEC_SUCCEEDED:
+      sec_latency_log(p_evt->conn_handle, p_evt->params.conn_sec_succeeded.procedure);
+
+      /* New bond, reconnections are directed from now on */
+      p_link = link_get(p_evt->conn_handle);
+      if((p_link != NULL) && (p_evt->params.conn_sec_succeeded.procedure != PM_CONN_SEC_PROCEDURE_PAIRING))
+      {
+        p_link->peer_id = p_evt->peer_id;
+      }
+      break;
+    case PM_EVT_PEER_DATA_UPDATE_SUCCEEDED:
+      if((p_evt->params.peer_data_update_succeeded.data_id == PM_PEER_DATA_ID_BONDING) &&
+         p_evt->params.peer_data_update_succeeded.flash_changed)
+      {
+        /* New or updated bond */
+        err_code = adv_sched_stop();
+        APP_ERROR_CHECK(err_code);
+
+        peer_list_update();
+        advertising_restart_if_free();
+      }
+      break;
+    case PM_EVT_STORAGE_FULL:
+      /* pm_handler_flash_clean() started a collection */
+      fds_gc_sched_storage_full();
+      break;
+    default:
+      break;
+  }
+}
+
+/* Step 14: Init Peer Manager. Bonds are stored in flash through FDS */
+static void init_peer_manager(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gap_sec_params_t sec_param = {0};
+
+  /* Space of updated and deleted records is reclaimed ahead of time */
+  init_fds_gc_sched();
+
+  /* Checks the GATT db against the one bonded peers have cached, see below */
+  err_code = gatt_cache_init();
+  APP_ERROR_CHECK(err_code);
+
+  /* Settings are loaded from FDS as well */
+  init_config();
+
+  err_code = pm_init();
+  APP_ERROR_CHECK(err_code);
+
+  sec_param.bond = SEC_PARAM_BOND;
+  sec_param.mitm = SEC_PARAM_MITM;
+  sec_param.lesc = SEC_PARAM_LESC;
+  sec_param.keypress = SEC_PARAM_KEYPRESS;
+  sec_param.io_caps = SEC_PARAM_IO_CAPABILITIES;
+  sec_param.oob = SEC_PARAM_OOB;
+  sec_param.min_key_size = SEC_PARAM_MIN_KEY_SIZE;
+  sec_param.max_key_size = SEC_PARAM_MAX_KEY_SIZE;
+  sec_param.kdist_own.enc = 1;
+  sec_param.kdist_own.id = 1;
+  sec_param.kdist_peer.enc = 1;
+  sec_param.kdist_peer.id = 1;
+
+  err_code = pm_sec_params_set(&sec_param);
+  APP_ERROR_CHECK(err_code);
+
+  err_code = pm_register(pm_evt_handler);
+  APP_ERROR_CHECK(err_code);
+
+  /* Peer Manager is up and has loaded the bonds: a changed GATT db reaches them */
+  gatt_cache_check();
+
+  for(uint32_t i = 0; i < APP_RECONNECT_PEERS_MAX; i++)
+  {
+    m_peer_reconnect[i].peer_id = PM_PEER_ID_INVALID;
+  }
+}
+
+/* Step 15: Periodic stats. Worst case BLE event dispatch time, scheduler queue high-water mark,
+ * radio aligned jobs, TX power control, link quality, the black box, the time series, the FDS
+ * garbage collection, the flash operations and the analog sampling
+ */
+static void stats_timeout_handler(void *p_context)
+{
+  uint16_t sched_max = app_sched_queue_utilization_get();
+
+  evt_prof_log();
+  radio_sched_stats_log();
+  tx_power_ctrl_stats_log();
+  link_stats_log();
+  blackbox_stats_log();
+  ts_store_stats_log();
+  fds_gc_sched_stats_log();
+  fstorage_instr_stats_log();
+
+  if(sample_source_is_running())
+  {
+    sample_source_stats_log();
+    sensor_service_stats_log();
+    if(saadc_sampler_is_running())
+    {
+      saadc_sampler_stats_log();
+    }
+    NRF_LOG_INFO("Sampling means: VDD %d, AIN0 %d (12 bit, 3.6 V full scale)",
+                 m_sampling_means[0], m_sampling_means[1]);
+  }
+
+  if(scanner_is_running())
+  {
+    scanner_stats_log();
+  }
+
+  NRF_LOG_INFO("Scheduler queue high-water mark: %d of %d", sched_max, SCHED_QUEUE_SIZE);
+  if(sched_max > ((SCHED_QUEUE_SIZE * 3) / 4))
+  {
+    NRF_LOG_WARNING("Scheduler queue close to full, increase SCHED_QUEUE_SIZE");
+  }
+}
+
+/* Step 16: Radio notification, to run heavy jobs between radio events.
+ * Must be configured before advertising is started
+ */
+static void init_radio_sched(void)
+{
+  ret_code_t err_code = radio_sched_init(APP_RADIO_JOB_MAX_DELAY);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 17: Per-link TX power from the RSSI of the central */
+static void init_tx_power_ctrl(void)
+{
+  tx_power_ctrl_init_t init = {0};
+
+  init.max_dbm = APP_ADV_TX_POWER;
+  init.target_rssi_dbm = (int8_t)config_store_int_get(APP_CFG_LINK_TARGET_RSSI);
+  init.coded_gain_db = APP_LINK_CODED_GAIN_DB;
+  init.hysteresis_db = APP_LINK_HYSTERESIS_DB;
+
+  ret_code_t err_code = tx_power_ctrl_init(&init);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 18.1: Forward a batch of new advertisers to the host, one line each:
+ * address type and address, payload hash, count, average/max RSSI
+ */
+static void scanner_batch_handler(scan_entry_t const *p_entries, uint16_t count)
+{
+  for(uint16_t i = 0; i < count; i++)
+  {
+    NRF_LOG_INFO("ADV %06X%08X %08X n%u %d/%d",
+                 ((uint32_t)p_entries[i].addr_type << 16) | uint16_decode(&p_entries[i].addr[4]),
+                 uint32_decode(&p_entries[i].addr[0]), p_entries[i].payload_hash, p_entries[i].count,
+                 scan_table_rssi_avg(&p_entries[i]), p_entries[i].rssi_max);
+  }
+}
+
+/* Step 18: Scan gateway */
+static void init_scanner(void)
+{
+  scanner_init_t init = {0};
+
+  init.interval = APP_SCAN_INTERVAL;
+  init.window = APP_SCAN_WINDOW;
+  init.flush_interval = APP_SCAN_FLUSH_INTERVAL;
+  init.max_age_ms = APP_SCAN_MAX_AGE_MS;
+  init.batch_handler = scanner_batch_handler;
+
+  ret_code_t err_code = scanner_init(&init);
+  APP_ERROR_CHECK(err_code);
+
+  if(APP_SCAN_FILTER_COMPANY_ID != 0)
+  {
+    scanner_filter_company_add(APP_SCAN_FILTER_COMPANY_ID);
+  }
+}
+
+/* Step 18.2: Tag addresses and company ids written to the diagnostics service */
+static bool scan_filter_handler(uint8_t const *p_data, uint16_t len)
+{
+  ret_code_t err_code = scanner_filter_load(p_data, len);
+
+  if(err_code != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Scan filter write rejected, error 0x%X", err_code);
+    return false;
+  }
+
+  scanner_stats_log();
+
+  return true;
+}
+
+/* Step 19.1: Settings and their defaults */
+static const config_item_t m_config_items[] =
+{
+  { .key = APP_CFG_DEVICE_NAME,           .type = CONFIG_TYPE_STR, .p_def_str = DEVICE_NAME },
+  { .key = APP_CFG_CONN_INTERVAL_MIN,     .type = CONFIG_TYPE_U16, .def_int = MIN_CONN_INTERVAL },
+  { .key = APP_CFG_CONN_INTERVAL_MAX,     .type = CONFIG_TYPE_U16, .def_int = MAX_CONN_INTERNAL },
+  { .key = APP_CFG_TELEMETRY_INTERVAL_MS, .type = CONFIG_TYPE_U32, .def_int = TELEMETRY_FRAME_INTERVAL_MS },
+  { .key = APP_CFG_LINK_TARGET_RSSI,      .type = CONFIG_TYPE_I8,  .def_int = APP_LINK_TARGET_RSSI },
+};
+
+/* Step 19.2: Apply the settings that were set up with the defaults, once loaded and after each write */
+static void config_apply(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gap_conn_params_t   gap_conn_params = {0};
+  ble_gap_conn_sec_mode_t sec_mode = {0};
+  char const              *p_name = config_store_str_get(APP_CFG_DEVICE_NAME);
+
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&sec_mode);
+
+  err_code = sd_ble_gap_device_name_set(&sec_mode, (const uint8_t *)p_name, strlen(p_name));
+  APP_ERROR_CHECK(err_code);
+
+  gap_conn_params.min_conn_interval = (uint16_t)config_store_int_get(APP_CFG_CONN_INTERVAL_MIN);
+  gap_conn_params.max_conn_interval = (uint16_t)config_store_int_get(APP_CFG_CONN_INTERVAL_MAX);
+  gap_conn_params.slave_latency = SLAVE_LATENCY;
+  gap_conn_params.conn_sup_timeout = CONN_SUPERVISION_TIMEOUT;
+
+  err_code = sd_ble_gap_ppcp_set(&gap_conn_params);
+  if(err_code == NRF_ERROR_INVALID_PARAM)
+  {
+    NRF_LOG_WARNING("Stored connection intervals rejected, keeping the defaults");
+  }
+  else
+  {
+    APP_ERROR_CHECK(err_code);
+  }
+
+  telemetry_timer_restart();
+}
+
+/* Step 19.3: Settings written by the central: { key (u16), value }. The value of the integer
+ * settings is an int32, little endian, that of the string settings the characters without the
+ * terminator. They apply right away and go to flash APP_CONFIG_FLUSH_DELAY after the last
+ * change, or on { APP_CFG_WRITE_NOW }. The connection parameter negotiation picks the new
+ * intervals up on the next reset.
+ */
+static bool setting_check(uint16_t key, int32_t value)
+{
+  int32_t min = (key == APP_CFG_CONN_INTERVAL_MIN) ? value : config_store_int_get(APP_CFG_CONN_INTERVAL_MIN);
+  int32_t max = (key == APP_CFG_CONN_INTERVAL_MAX) ? value : config_store_int_get(APP_CFG_CONN_INTERVAL_MAX);
+
+  /* Intervals the SoftDevice would reject for the PPCP are not stored */
+  return (min >= BLE_GAP_CP_MIN_CONN_INTVL_MIN) && (max <= BLE_GAP_CP_MAX_CONN_INTVL_MAX) && (min <= max);
+}
+
+static bool settings_handler(uint8_t const *p_data, uint16_t len)
+{
+  ret_code_t          err_code = NRF_SUCCESS;
+  uint16_t            key = 0;
+  char                str[CONFIG_STORE_STR_MAX + 1];
+  config_item_t const *p_item = NULL;
+
+  STATIC_ASSERT(DIAG_SETTINGS_MAX_LEN == (2 + CONFIG_STORE_STR_MAX));
+
+  if(len < 2)
+  {
+    return false;
+  }
+
+  key = uint16_decode(p_data);
+
+  if((key == APP_CFG_WRITE_NOW) && (len == 2))
+  {
+    err_code = config_store_flush();
+    APP_ERROR_CHECK(err_code);
+    return true;
+  }
+
+  for(uint8_t i = 0; i < ARRAY_SIZE(m_config_items); i++)
+  {
+    if(m_config_items[i].key == key)
+    {
+      p_item = &m_config_items[i];
+    }
+  }
+
+  if(p_item == NULL)
+  {
+    NRF_LOG_WARNING("Setting 0x%04X unknown", key);
+    return false;
+  }
+
+  if((p_item->type == CONFIG_TYPE_STR) && (len > 2) && ((len - 2) <= CONFIG_STORE_STR_MAX))
+  {
+    memcpy(str, &p_data[2], len - 2);
+    str[len - 2] = '\0';
+    err_code = config_store_str_set(key, str);
+  }
+  else if((p_item->type != CONFIG_TYPE_STR) && (len == 6))
+  {
+    int32_t value = (int32_t)uint32_decode(&p_data[2]);
+
+    err_code = setting_check(key, value) ? config_store_int_set(key, value) : NRF_ERROR_INVALID_PARAM;
+  }
+  else
+  {
+    err_code = NRF_ERROR_INVALID_LENGTH;
+  }
+
+  if(err_code != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Setting 0x%04X rejected, error 0x%X", key, err_code);
+    return false;
+  }
+
+  config_apply();
+
+  return true;
+}
+
+/* Step 19.4: Config store events */
+static void config_evt_handler(config_store_evt_t evt)
+{
+  switch(evt)
+  {
+    case CONFIG_STORE_EVT_LOADED:
+      config_apply();
+      break;
+    case CONFIG_STORE_EVT_FLUSHED:
+      NRF_LOG_INFO("Settings written to flash");
+      config_store_stats_log();
+      break;
+    default:
+      break;
+  }
+}
+
+/* Step 19: Persistent settings, served from RAM. Call before pm_init() */
+static void init_config(void)
+{
+  ret_code_t err_code = config_store_init(m_config_items, ARRAY_SIZE(m_config_items),
+                                          APP_CONFIG_FLUSH_DELAY, config_evt_handler);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 20.1: Errors and faults end up in the black box before the reset */
+void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
+{
+  __disable_irq();
+  blackbox_fault_record(id, pc, info);
+  NRF_LOG_FINAL_FLUSH();
+
+  NRF_BREAKPOINT_COND;
+#ifndef DEBUG
+  NVIC_SystemReset();
+#else
+  app_error_save_and_stop(id, pc, info);
+#endif
+}
+
+void HardFault_process(HardFault_stack_t *p_stack)
+{
+  /* No stack frame when the fault came from a stack overflow */
+  blackbox_fault_record(BLACKBOX_FAULT_ID_HARDFAULT, (p_stack != NULL) ? p_stack->pc : 0,
+                        (p_stack != NULL) ? p_stack->lr : 0);
+  NVIC_SystemReset();
+}
+
+/* Step 20: Black box log. Needs the SoftDevice and the radio scheduler */
+static void init_blackbox(void)
+{
+  ret_code_t err_code = blackbox_init(APP_BLACKBOX_LOG_SEVERITY, APP_BLACKBOX_FLUSH_INTERVAL);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 21.1: Time series time, seconds since the first point ever stored. Called at least
+ * once per RTC wrap (512 s)
+ */
+static uint32_t ts_time_get(void)
+{
+  static uint32_t last_ticks = 0;
+  static uint64_t elapsed_ticks = 0;
+
+  uint32_t now = app_timer_cnt_get();
+
+  elapsed_ticks += app_timer_cnt_diff_compute(now, last_ticks);
+  last_ticks = now;
+
+  return m_ts_time_base + (uint32_t)((elapsed_ticks * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+/* Step 21: Time series store, in the flash below the black box */
+static void init_ts_store(void)
+{
+  ts_store_init_t init = {0};
+
+  init.p_flash = ts_flash_fs_get();
+  init.end_addr = blackbox_flash_start_get();
+  init.pages = APP_TS_STORE_PAGES;
+
+  ret_code_t err_code = ts_store_init(&init);
+  APP_ERROR_CHECK(err_code);
+
+  /* Uptime does not survive resets: go on after the stored points */
+  m_ts_time_base = ts_store_last_time_get() + 1;
+}
+
+/* Step 22: FDS garbage collection in quiet times. Call before pm_init() */
+static void init_fds_gc_sched(void)
+{
+  fds_gc_sched_init_t init = {0};
+
+  init.dirty_pct = APP_FDS_GC_DIRTY_PCT;
+  init.min_free_words = APP_FDS_GC_MIN_FREE_WORDS;
+  init.check_interval = APP_FDS_GC_CHECK_INTERVAL;
+  init.busy_events = APP_FDS_GC_BUSY_EVENTS;
+  init.max_defer = APP_FDS_GC_MAX_DEFER;
+
+  ret_code_t err_code = fds_gc_sched_init(&init);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 23: Flash operation stats of all the fstorage users. Call after the last one is set up */
+static void init_fstorage_instr(void)
+{
+  ret_code_t err_code = fstorage_instr_attach();
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 24.1: Full sample buffer, in thread mode. Mean per channel, and the sensor channel into
+ * the windows
+ */
+static void sampling_buffer_handler(int16_t const *p_samples, uint16_t frames, uint8_t channel_count)
+{
+  for(uint8_t ch = 0; ch < channel_count; ch++)
+  {
+    int32_t sum = 0;
+
+    for(uint16_t i = 0; i < frames; i++)
+    {
+      sum += p_samples[(i * channel_count) + ch];
+    }
+
+    m_sampling_means[ch] = (int16_t)(sum / frames);
+  }
+
+  if(APP_SENSOR_CHANNEL < channel_count)
+  {
+    window_agg_put(&m_window_agg, &p_samples[APP_SENSOR_CHANNEL], frames, channel_count);
+    sensor_service_samples_account(frames);
+  }
+}
+
+/* Step 24: Analog sampling, TIMER1 -> PPI -> SAADC, EasyDMA double buffering. The buffers go
+ * through the sample source layer, see Step 25
+ */
+static void init_sampling(void)
+{
+  saadc_sampler_init_t init = {0};
+
+  init.p_inputs = m_sampling_inputs;
+  init.channel_count = ARRAY_SIZE(m_sampling_inputs);
+  init.rate_hz = APP_SAMPLING_RATE_HZ;
+  init.frames = APP_SAMPLING_FRAMES;
+  init.handler = sample_source_put;
+
+  ret_code_t err_code = saadc_sampler_init(&init);
+  APP_ERROR_CHECK(err_code);
+
+  init_sample_source();
+}
+
+/* Step 25: Sample source for the processing. The SAADC, or the sensorsim waveforms for runs
+ * without analog inputs
+ */
+static void init_sample_source(void)
+{
+  sample_source_init_t init = {0};
+  sim_source_init_t    sim_init = {0};
+
+  sim_init.p_cfgs = m_sim_cfgs;
+  sim_init.channel_count = ARRAY_SIZE(m_sim_cfgs);
+  sim_init.noise = 8;
+  sim_init.seed = 1;
+
+  init.p_source = APP_SAMPLING_SIMULATED ? sim_source_init(&sim_init) : &m_saadc_source;
+  init.sink = sampling_buffer_handler;
+  init.rate_hz = APP_SAMPLING_RATE_HZ;
+  init.frames = APP_SAMPLING_FRAMES;
+
+  ret_code_t err_code = sample_source_select(&init);
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Step 26: Cycles per block of the DSP kernels on the AIN0 sensorsim waveform, with the DWT cycle
+ * counter started by evt_prof_init()
+ */
+static void dsp_bench_log(char const *p_name, uint32_t cycles)
+{
+  NRF_LOG_INFO("DSP %s: %u cycles per %u samples, %u per sample",
+               p_name, cycles, APP_DSP_BENCH_BLOCK, cycles / APP_DSP_BENCH_BLOCK);
+}
+
+static void dsp_bench(void)
+{
+  /* Low pass, fc = 0.1 fs Butterworth, Q14 (post shift 1) */
+  static int16_t const biquad_coeffs[5] = { 1106, 2210, 1106, 18727, -6763 };
+
+  static int16_t  in[APP_DSP_BENCH_BLOCK];
+  static int16_t  out[APP_DSP_BENCH_BLOCK];
+  static int16_t  fir_coeffs[APP_DSP_BENCH_TAPS];
+  static int16_t  fir_state[APP_DSP_BENCH_TAPS - 1 + APP_DSP_BENCH_BLOCK];
+  static int32_t  in31[APP_DSP_BENCH_BLOCK];
+  static int32_t  fir31_coeffs[APP_DSP_BENCH_TAPS];
+  static int32_t  fir31_state[APP_DSP_BENCH_TAPS - 1 + APP_DSP_BENCH_BLOCK];
+  static int32_t  biquad_state[2];
+  static int16_t  rms_history[64];
+
+  sensorsim_state_t     sim_state;
+  dsp_fir_q15_t         fir;
+  dsp_fir_q31_t         fir31;
+  dsp_biquad_q15_t      biquad;
+  dsp_decim_q15_t       decim;
+  dsp_rms_q15_t         rms;
+  uint32_t              start;
+
+  sensorsim_init(&sim_state, &m_sim_cfgs[1]);
+  for(uint16_t i = 0; i < APP_DSP_BENCH_BLOCK; i++)
+  {
+    in[i] = (int16_t)sensorsim_measure(&sim_state, &m_sim_cfgs[1]);
+    in31[i] = in[i] * 65536;
+  }
+
+  for(uint16_t i = 0; i < APP_DSP_BENCH_TAPS; i++)
+  {
+    fir_coeffs[i] = INT16_MAX / APP_DSP_BENCH_TAPS;   /* Moving average */
+    fir31_coeffs[i] = INT32_MAX / APP_DSP_BENCH_TAPS;
+  }
+
+  (void)dsp_fir_q15_init(&fir, fir_coeffs, fir_state, APP_DSP_BENCH_TAPS);
+  start = DWT->CYCCNT;
+  dsp_fir_q15(&fir, in, out, APP_DSP_BENCH_BLOCK);
+  dsp_bench_log("FIR Q15 32 taps", DWT->CYCCNT - start);
+
+  (void)dsp_fir_q31_init(&fir31, fir31_coeffs, fir31_state, APP_DSP_BENCH_TAPS);
+  start = DWT->CYCCNT;
+  dsp_fir_q31(&fir31, in31, in31, APP_DSP_BENCH_BLOCK);
+  dsp_bench_log("FIR Q31 32 taps", DWT->CYCCNT - start);
+
+  (void)dsp_decim_q15_init(&decim, fir_coeffs, fir_state, APP_DSP_BENCH_TAPS, 4);
+  start = DWT->CYCCNT;
+  (void)dsp_decim_q15(&decim, in, out, APP_DSP_BENCH_BLOCK);
+  dsp_bench_log("Decimate Q15 by 4", DWT->CYCCNT - start);
+
+  (void)dsp_biquad_q15_init(&biquad, biquad_coeffs, biquad_state, 1, 1);
+  start = DWT->CYCCNT;
+  dsp_biquad_q15(&biquad, in, out, APP_DSP_BENCH_BLOCK);
+  dsp_bench_log("Biquad Q15", DWT->CYCCNT - start);
+
+  (void)dsp_rms_q15_init(&rms, rms_history, ARRAY_SIZE(rms_history));
+  start = DWT->CYCCNT;
+  dsp_rms_q15(&rms, in, out, APP_DSP_BENCH_BLOCK);
+  dsp_bench_log("Moving RMS Q15 64", DWT->CYCCNT - start);
+}
+
+/* Step 27: Windowed aggregation of the sensor channel, summaries and events to the sensor
+ * service. The latest summary also goes into the telemetry frame (Step 13.1)
+ */
+static void window_summary_handler(window_agg_summary_t const *p_summary, void *p_context)
+{
+  m_last_summary = *p_summary;
+  sensor_service_summary_send(p_summary);
+}
+
+static void window_event_handler(window_agg_event_t const *p_event, void *p_context)
+{
+  sensor_service_event_send(p_event);
+}
+
+static void init_window_agg(void)
+{
+  bool ok = window_agg_init(&m_window_agg, &m_window_config, window_summary_handler, window_event_handler, NULL);
+  APP_ERROR_CHECK_BOOL(ok);
+}
+
+/* Step 27.1: Window configuration written by the central, starts the windows over */
+static bool window_config_handler(window_agg_config_t const *p_config)
+{
+  if(!window_agg_init(&m_window_agg, p_config, window_summary_handler, window_event_handler, NULL))
+  {
+    return false;
+  }
+
+  m_window_config = *p_config;
+
+  return true;
+}
+
+
+/**@brief Function for application main entry.
+ */
+int main(void)
+{
+  ret_code_t ret_code = NRF_SUCCESS;
+
+  log_init();
   timer_init();
+  scheduler_init();
   init_leds();
 
   init_power_management();
   
+  ret_code = evt_prof_init();
+  APP_ERROR_CHECK(ret_code);
+
   /* Init Soft device and parameters */
   init_ble_stack();
   init_gap_params();
   init_gatt();
   init_advertising();
+  init_telemetry_adv();
   init_services();
+  init_peer_manager();
   init_conn_params();
+  init_radio_sched();
+  init_blackbox();
+  init_ts_store();
+  init_fstorage_instr();
+  init_tx_power_ctrl();
+  if(APP_SCANNER_ENABLED)
+  {
+    init_scanner();
+  }
+  init_sampling();
+
+  if(APP_DSP_BENCH_ENABLED)
+  {
+    dsp_bench();
+  }
+
+  init_window_agg();
 
   NRF_LOG_INFO("BLE Base Application started...");
 
@@ -460,7 +2035,33 @@ int main(void)
   set_random_static_addr();
   //set_non_resolvable_pvt_addr();
 
-  start_advertisments();
+  peer_list_update();
+
+  if(APP_TELEMETRY_ADV_ENABLED)
+  {
+    start_telemetry_broadcast();
+  }
+  else
+  {
+    start_advertisments();
+  }
+
+  if(APP_SCANNER_ENABLED)
+  {
+    ret_code = scanner_start();
+    APP_ERROR_CHECK(ret_code);
+  }
+
+  if(APP_SAMPLING_ENABLED)
+  {
+    ret_code = sample_source_start();
+    APP_ERROR_CHECK(ret_code);
+  }
+
+  telemetry_timer_restart();
+
+  ret_code = app_timer_start(m_stats_timer, APP_STATS_REPORT_INTERVAL, NULL);
+  APP_ERROR_CHECK(ret_code);
 
   /* check device addr */
   get_device_adv_addr();
@@ -470,6 +2071,8 @@ int main(void)
   // Enter main loop.
   for (;;)
   {
+    /* Runs all queued events (SoftDevice event polls) in one go, then sleeps */
+    app_sched_execute();
     idle_state_handler();
   }
 }
@@ -0,0 +1,221 @@
+#include <string.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+#include "nrf_nvic.h"
+#include "nrf_soc.h"
+
+#include "radio_sched.h"
+
+/* Warning 800 us before a radio event: enough for a producer to finish a short step */
+#define RADIO_SCHED_DISTANCE    NRF_RADIO_NOTIFICATION_DISTANCE_800US
+
+typedef struct
+{
+  radio_sched_job_t job;
+  void              *p_context;
+} job_entry_t;
+
+APP_TIMER_DEF(m_fallback_timer);
+
+static job_entry_t m_jobs[RADIO_SCHED_QUEUE_SIZE];
+static uint8_t     m_job_head = 0;   /* Next job to run */
+static uint8_t     m_job_count = 0;
+
+static radio_sched_warn_handler_t m_warn_handlers[RADIO_SCHED_WARN_HANDLERS];
+static uint8_t                    m_warn_count = 0;
+
+static volatile bool m_radio_active = false;
+static volatile bool m_drain_queued = false;
+static bool          m_fallback_running = false;
+static uint32_t      m_max_delay = 0;
+
+static radio_sched_stats_t m_stats;
+
+static bool job_pop(job_entry_t *p_entry)
+{
+  bool found = false;
+
+  CRITICAL_REGION_ENTER();
+  if(m_job_count > 0)
+  {
+    *p_entry = m_jobs[m_job_head];
+    m_job_head = (m_job_head + 1) % RADIO_SCHED_QUEUE_SIZE;
+    m_job_count--;
+    found = true;
+  }
+  CRITICAL_REGION_EXIT();
+
+  return found;
+}
+
+/* Run the queued jobs. Stops at the next radio event unless forced */
+static void drain(bool force)
+{
+  job_entry_t entry;
+
+  while(force || !m_radio_active)
+  {
+    if(!job_pop(&entry))
+    {
+      break;
+    }
+
+    entry.job(entry.p_context);
+
+    if(force)
+    {
+      m_stats.timed_out++;
+    }
+    else
+    {
+      m_stats.aligned++;
+    }
+  }
+
+  if(m_job_count > 0)
+  {
+    m_stats.deferred++;
+  }
+  else if(m_fallback_running)
+  {
+    (void)app_timer_stop(m_fallback_timer);
+    m_fallback_running = false;
+  }
+}
+
+static void drain_evt_handler(void *p_event_data, uint16_t event_size)
+{
+  m_drain_queued = false;
+  drain(false);
+}
+
+static void fallback_timeout_handler(void *p_context)
+{
+  m_fallback_running = false;
+  drain(true);
+}
+
+/* Radio notification, toggles with every ACTIVE and INACTIVE signal */
+void SWI1_EGU1_IRQHandler(void)
+{
+  m_radio_active = !m_radio_active;
+
+  if(m_radio_active)
+  {
+    for(uint8_t i = 0; i < m_warn_count; i++)
+    {
+      m_warn_handlers[i]();
+    }
+  }
+  else if((m_job_count > 0) && !m_drain_queued)
+  {
+    if(app_sched_event_put(NULL, 0, drain_evt_handler) == NRF_SUCCESS)
+    {
+      m_drain_queued = true;
+    }
+  }
+}
+
+ret_code_t radio_sched_init(uint32_t max_delay)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_max_delay = MAX(max_delay, APP_TIMER_MIN_TIMEOUT_TICKS);
+
+  err_code = app_timer_create(&m_fallback_timer, APP_TIMER_MODE_SINGLE_SHOT, fallback_timeout_handler);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = sd_nvic_ClearPendingIRQ(SWI1_EGU1_IRQn);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = sd_nvic_SetPriority(SWI1_EGU1_IRQn, RADIO_SCHED_IRQ_PRIORITY);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = sd_nvic_EnableIRQ(SWI1_EGU1_IRQn);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  return sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH, RADIO_SCHED_DISTANCE);
+}
+
+ret_code_t radio_sched_job_put(radio_sched_job_t job, void *p_context)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(job == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  CRITICAL_REGION_ENTER();
+  if(m_job_count < RADIO_SCHED_QUEUE_SIZE)
+  {
+    uint8_t idx = (m_job_head + m_job_count) % RADIO_SCHED_QUEUE_SIZE;
+
+    m_jobs[idx].job = job;
+    m_jobs[idx].p_context = p_context;
+    m_job_count++;
+  }
+  else
+  {
+    m_stats.dropped++;
+    err_code = NRF_ERROR_NO_MEM;
+  }
+  CRITICAL_REGION_EXIT();
+
+  if((err_code == NRF_SUCCESS) && !m_fallback_running)
+  {
+    err_code = app_timer_start(m_fallback_timer, m_max_delay, NULL);
+    m_fallback_running = (err_code == NRF_SUCCESS);
+  }
+
+  return err_code;
+}
+
+ret_code_t radio_sched_warn_register(radio_sched_warn_handler_t handler)
+{
+  if(handler == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(m_warn_count >= RADIO_SCHED_WARN_HANDLERS)
+  {
+    return NRF_ERROR_NO_MEM;
+  }
+
+  m_warn_handlers[m_warn_count++] = handler;
+
+  return NRF_SUCCESS;
+}
+
+bool radio_sched_radio_active(void)
+{
+  return m_radio_active;
+}
+
+void radio_sched_stats_get(radio_sched_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void radio_sched_stats_log(void)
+{
+  NRF_LOG_INFO("Radio aligned jobs: %u aligned, %u timed out, %u deferred drains, %u dropped",
+               m_stats.aligned, m_stats.timed_out, m_stats.deferred, m_stats.dropped);
+}
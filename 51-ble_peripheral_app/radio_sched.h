@@ -0,0 +1,56 @@
+#ifndef _RADIO_SCHED_H
+#define _RADIO_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Radio notification aligned job queue.
+ *
+ * The SoftDevice radio notification signals the application shortly before each radio event
+ * (ACTIVE) and right after it (INACTIVE). Heavy jobs (flash writes, sensor reads, large
+ * computations) are queued here and run from app_scheduler right after a radio event ends, so
+ * they get the whole gap up to the next one. Draining stops when the next radio event is
+ * signalled, the remaining jobs wait for the next gap.
+ *
+ * Producers can register a warning handler, called from the radio notification interrupt when
+ * a radio event is about to start. Keep these handlers short.
+ *
+ * Without radio activity (not advertising, no links) the jobs run after max_delay anyway.
+ */
+
+#define RADIO_SCHED_QUEUE_SIZE      8
+#define RADIO_SCHED_WARN_HANDLERS   4
+#define RADIO_SCHED_IRQ_PRIORITY    APP_IRQ_PRIORITY_LOW
+
+typedef void (*radio_sched_job_t)(void *p_context);
+
+typedef void (*radio_sched_warn_handler_t)(void);
+
+typedef struct
+{
+  uint32_t aligned;     /* Jobs run right after a radio event */
+  uint32_t timed_out;   /* Jobs run after max_delay without a radio event */
+  uint32_t deferred;    /* Drains cut short by the next radio event */
+  uint32_t dropped;     /* Jobs rejected on a full queue */
+} radio_sched_stats_t;
+
+/* Call with the SoftDevice enabled, before any radio activity is started.
+ * max_delay: longest time a job waits for a radio gap, in app_timer ticks.
+ */
+ret_code_t radio_sched_init(uint32_t max_delay);
+
+/* NRF_ERROR_NO_MEM when the queue is full */
+ret_code_t radio_sched_job_put(radio_sched_job_t job, void *p_context);
+
+ret_code_t radio_sched_warn_register(radio_sched_warn_handler_t handler);
+
+/* True from the warning before a radio event until it ends */
+bool radio_sched_radio_active(void);
+
+void radio_sched_stats_get(radio_sched_stats_t *p_stats);
+
+void radio_sched_stats_log(void);
+
+#endif /* _RADIO_SCHED_H */
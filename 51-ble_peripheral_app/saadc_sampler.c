@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+#include "nrfx_ppi.h"
+#include "nrfx_saadc.h"
+#include "nrfx_timer.h"
+
+#include "saadc_sampler.h"
+
+#define TIMER_FREQ_HZ       1000000
+#define CONVERSION_US       12        /* Acquisition (10 us) and conversion (2 us) per channel */
+
+static nrfx_timer_t const m_timer = NRFX_TIMER_INSTANCE(1);
+static nrf_ppi_channel_t  m_ppi_channel;
+
+static nrf_saadc_value_t  m_buffers[2][SAADC_SAMPLER_BUFFER_SIZE];
+static uint16_t           m_buffer_len = 0;     /* Samples per buffer */
+static uint8_t            m_queued = 0;         /* Buffers given to the SAADC */
+static bool               m_running = false;
+
+static saadc_sampler_init_t  m_config;
+static saadc_sampler_stats_t m_stats;
+
+static uint32_t ticks_to_us(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static void buffer_give(nrf_saadc_value_t *p_buffer)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  CRITICAL_REGION_ENTER();
+  err_code = nrfx_saadc_buffer_convert(p_buffer, m_buffer_len);
+  if(err_code == NRFX_SUCCESS)
+  {
+    m_queued++;
+  }
+  CRITICAL_REGION_EXIT();
+
+  APP_ERROR_CHECK(err_code);
+}
+
+/* Thread mode: the full buffer goes to the handler, then back to the SAADC */
+static void buffer_evt_handler(void *p_event_data, uint16_t event_size)
+{
+  nrf_saadc_value_t *p_buffer = *(nrf_saadc_value_t **)p_event_data;
+  uint32_t          start = app_timer_cnt_get();
+
+  m_config.handler(p_buffer, m_config.frames, m_config.channel_count);
+
+  m_stats.buffers++;
+  m_stats.handler_max_us = MAX(m_stats.handler_max_us,
+                               ticks_to_us(app_timer_cnt_diff_compute(app_timer_cnt_get(), start)));
+
+  if(m_running)
+  {
+    buffer_give(p_buffer);
+  }
+}
+
+static void saadc_evt_handler(nrfx_saadc_evt_t const *p_evt)
+{
+  nrf_saadc_value_t *p_buffer = NULL;
+
+  if(p_evt->type != NRFX_SAADC_EVT_DONE)
+  {
+    return;
+  }
+
+  p_buffer = p_evt->data.done.p_buffer;
+  if(m_queued > 0)
+  {
+    m_queued--;
+  }
+
+  if(m_queued == 0)
+  {
+    /* The SAADC has no buffer left, sampling pauses until the handler returns one */
+    m_stats.overruns++;
+  }
+
+  if(app_sched_event_put(&p_buffer, sizeof(p_buffer), buffer_evt_handler) != NRF_SUCCESS)
+  {
+    /* Scheduler queue full: the samples are dropped, the buffer goes straight back */
+    m_stats.overruns++;
+    if(nrfx_saadc_buffer_convert(p_buffer, m_buffer_len) == NRFX_SUCCESS)
+    {
+      m_queued++;
+    }
+  }
+}
+
+static void timer_evt_handler(nrf_timer_event_t event_type, void *p_context)
+{
+  /* Compare events only go to PPI, the interrupt is off */
+}
+
+ret_code_t saadc_sampler_init(saadc_sampler_init_t const *p_init)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  nrfx_saadc_config_t saadc_config = NRFX_SAADC_DEFAULT_CONFIG;
+  nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+
+  if((p_init->p_inputs == NULL) || (p_init->handler == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((p_init->channel_count == 0) || (p_init->channel_count > SAADC_SAMPLER_CHANNELS_MAX) ||
+     (p_init->rate_hz == 0) || (p_init->rate_hz > SAADC_SAMPLER_RATE_MAX) || (p_init->frames == 0) ||
+     ((p_init->frames * p_init->channel_count) > SAADC_SAMPLER_BUFFER_SIZE) ||
+     ((p_init->channel_count * CONVERSION_US * p_init->rate_hz) > TIMER_FREQ_HZ))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  m_config = *p_init;
+  m_buffer_len = p_init->frames * p_init->channel_count;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  err_code = nrfx_saadc_init(&saadc_config, saadc_evt_handler);
+  if(err_code != NRFX_SUCCESS)
+  {
+    return err_code;
+  }
+
+  /* More than one channel enabled: scan mode, one SAMPLE converts them all */
+  for(uint8_t i = 0; i < p_init->channel_count; i++)
+  {
+    nrf_saadc_channel_config_t channel_config = NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(p_init->p_inputs[i]);
+
+    err_code = nrfx_saadc_channel_init(i, &channel_config);
+    if(err_code != NRFX_SUCCESS)
+    {
+      return err_code;
+    }
+  }
+
+  timer_config.frequency = NRF_TIMER_FREQ_1MHz;
+  timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+
+  err_code = nrfx_timer_init(&m_timer, &timer_config, timer_evt_handler);
+  if(err_code != NRFX_SUCCESS)
+  {
+    return err_code;
+  }
+
+  /* Compare clears the timer: one SAMPLE per period */
+  nrfx_timer_extended_compare(&m_timer, NRF_TIMER_CC_CHANNEL0, TIMER_FREQ_HZ / p_init->rate_hz,
+                              NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
+
+  err_code = nrfx_ppi_channel_alloc(&m_ppi_channel);
+  if(err_code != NRFX_SUCCESS)
+  {
+    return err_code;
+  }
+
+  return nrfx_ppi_channel_assign(m_ppi_channel,
+                                 nrfx_timer_compare_event_address_get(&m_timer, NRF_TIMER_CC_CHANNEL0),
+                                 nrfx_saadc_sample_task_get());
+}
+
+ret_code_t saadc_sampler_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(m_running)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  m_running = true;
+
+  /* Primary and secondary buffer, the driver switches between them on END */
+  buffer_give(m_buffers[0]);
+  buffer_give(m_buffers[1]);
+
+  err_code = nrfx_ppi_channel_enable(m_ppi_channel);
+  if(err_code != NRFX_SUCCESS)
+  {
+    return err_code;
+  }
+
+  nrfx_timer_enable(&m_timer);
+
+  NRF_LOG_INFO("Sampling %d channels at %u Hz, %d sets per buffer",
+               m_config.channel_count, TIMER_FREQ_HZ / (TIMER_FREQ_HZ / m_config.rate_hz), m_config.frames);
+
+  return NRF_SUCCESS;
+}
+
+void saadc_sampler_stop(void)
+{
+  if(!m_running)
+  {
+    return;
+  }
+
+  m_running = false;
+
+  nrfx_timer_disable(&m_timer);
+  (void)nrfx_ppi_channel_disable(m_ppi_channel);
+  nrfx_saadc_abort();
+  m_queued = 0;
+}
+
+bool saadc_sampler_is_running(void)
+{
+  return m_running;
+}
+
+void saadc_sampler_stats_get(saadc_sampler_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void saadc_sampler_stats_log(void)
+{
+  NRF_LOG_INFO("Sampling: %u buffers, %u overruns, slowest buffer handler %u us",
+               m_stats.buffers, m_stats.overruns, m_stats.handler_max_us);
+}
@@ -0,0 +1,58 @@
+#ifndef _SAADC_SAMPLER_H
+#define _SAADC_SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf_saadc.h"
+#include "sdk_errors.h"
+
+/* Fixed rate SAADC sampling without the CPU.
+ *
+ * TIMER1 compare events trigger the SAADC SAMPLE task through a PPI channel, so the sample
+ * instants follow the 16 MHz clock and not the interrupt latency. In scan mode one SAMPLE
+ * converts all the configured inputs. EasyDMA writes the results into two buffers in turn:
+ * the CPU wakes once per full buffer, and the buffer is handed to the handler from
+ * app_scheduler (thread mode) while the SAADC fills the other one.
+ *
+ * A buffer goes back to the SAADC when the handler returns. If the handler is still busy when
+ * the other buffer is full, sampling pauses until it returns; the pause is counted as an
+ * overrun. The handler has frames / rate_hz to process a buffer.
+ */
+
+#define SAADC_SAMPLER_CHANNELS_MAX  8
+#define SAADC_SAMPLER_BUFFER_SIZE   512   /* Samples per buffer, all channels */
+#define SAADC_SAMPLER_RATE_MAX      20000 /* Sample sets per second */
+
+/* Interleaved samples: frame 0 channel 0, frame 0 channel 1, ... 12 bit, single ended */
+typedef void (*saadc_sampler_handler_t)(int16_t const *p_samples, uint16_t frames, uint8_t channel_count);
+
+typedef struct
+{
+  nrf_saadc_input_t const *p_inputs;  /* Analog input of each channel */
+  uint8_t                 channel_count;
+  uint32_t                rate_hz;    /* Sample sets per second */
+  uint16_t                frames;     /* Sample sets per buffer, frames * channel_count <= SAADC_SAMPLER_BUFFER_SIZE */
+  saadc_sampler_handler_t handler;
+} saadc_sampler_init_t;
+
+typedef struct
+{
+  uint32_t buffers;       /* Buffers handed to the handler */
+  uint32_t overruns;      /* Sampling paused, no free buffer */
+  uint32_t handler_max_us;
+} saadc_sampler_stats_t;
+
+ret_code_t saadc_sampler_init(saadc_sampler_init_t const *p_init);
+
+ret_code_t saadc_sampler_start(void);
+
+void saadc_sampler_stop(void);
+
+bool saadc_sampler_is_running(void);
+
+void saadc_sampler_stats_get(saadc_sampler_stats_t *p_stats);
+
+void saadc_sampler_stats_log(void);
+
+#endif /* _SAADC_SAMPLER_H */
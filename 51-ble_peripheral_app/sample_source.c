@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "nrf_log.h"
+
+#include "sample_source.h"
+
+APP_TIMER_DEF(m_pace_timer);
+
+static sample_source_init_t m_config;
+static bool                 m_timer_created = false;
+static bool                 m_running = false;
+static int16_t              m_buffer[SAMPLE_SOURCE_BUFFER_SIZE];
+
+static sample_source_stats_t m_stats;
+
+static void pace_timeout_handler(void *p_context)
+{
+  uint16_t frames = m_config.p_source->fill(m_buffer, m_config.frames);
+
+  if(frames == 0)
+  {
+    NRF_LOG_INFO("Sample source %s ended", m_config.p_source->p_name);
+    sample_source_stop();
+    return;
+  }
+
+  sample_source_put(m_buffer, frames, m_config.p_source->channel_count);
+}
+
+ret_code_t sample_source_select(sample_source_init_t const *p_init)
+{
+  ret_code_t            err_code = NRF_SUCCESS;
+  sample_source_t const *p_source = p_init->p_source;
+
+  if(m_running)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  if((p_source == NULL) || (p_init->sink == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if((p_source->channel_count == 0) || ((p_source->fill == NULL) && (p_source->start == NULL)))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if((p_source->fill != NULL) &&
+     ((p_init->rate_hz == 0) || (p_init->frames == 0) ||
+      ((p_init->frames * p_source->channel_count) > SAMPLE_SOURCE_BUFFER_SIZE) ||
+      (APP_TIMER_TICKS((p_init->frames * 1000) / p_init->rate_hz) < APP_TIMER_MIN_TIMEOUT_TICKS)))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if(!m_timer_created)
+  {
+    err_code = app_timer_create(&m_pace_timer, APP_TIMER_MODE_REPEATED, pace_timeout_handler);
+    if(err_code != NRF_SUCCESS)
+    {
+      return err_code;
+    }
+    m_timer_created = true;
+  }
+
+  m_config = *p_init;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sample_source_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(m_config.p_source == NULL)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  if(m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  if(m_config.p_source->fill != NULL)
+  {
+    /* One buffer per period */
+    err_code = app_timer_start(m_pace_timer, APP_TIMER_TICKS((m_config.frames * 1000) / m_config.rate_hz), NULL);
+  }
+  else
+  {
+    err_code = m_config.p_source->start();
+  }
+
+  if(err_code == NRF_SUCCESS)
+  {
+    m_running = true;
+    NRF_LOG_INFO("Sample source %s started, %d channels", m_config.p_source->p_name, m_config.p_source->channel_count);
+  }
+
+  return err_code;
+}
+
+void sample_source_stop(void)
+{
+  if(!m_running)
+  {
+    return;
+  }
+
+  m_running = false;
+
+  if(m_config.p_source->fill != NULL)
+  {
+    (void)app_timer_stop(m_pace_timer);
+  }
+  else if(m_config.p_source->stop != NULL)
+  {
+    m_config.p_source->stop();
+  }
+}
+
+bool sample_source_is_running(void)
+{
+  return m_running;
+}
+
+void sample_source_put(int16_t const *p_samples, uint16_t frames, uint8_t channel_count)
+{
+  if(!m_running)
+  {
+    return;
+  }
+
+  m_stats.buffers++;
+  m_stats.frames += frames;
+
+  m_config.sink(p_samples, frames, channel_count);
+}
+
+void sample_source_stats_get(sample_source_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void sample_source_stats_log(void)
+{
+  NRF_LOG_INFO("Sample source %s: %u buffers, %u sample sets",
+               (m_config.p_source != NULL) ? m_config.p_source->p_name : "none", m_stats.buffers, m_stats.frames);
+}
@@ -0,0 +1,67 @@
+#ifndef _SAMPLE_SOURCE_H
+#define _SAMPLE_SOURCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Pluggable source of sample buffers for the processing pipeline.
+ *
+ * The pipeline only sees the sink: buffers of interleaved int16 sample sets (frame 0 channel 0,
+ * frame 0 channel 1, ...), in thread mode. Two kinds of sources feed it:
+ * - Hardware sources (saadc_sampler, a TWI sensor driver) run on their own and hand each
+ *   buffer to sample_source_put(). They provide start and stop.
+ * - Synthetic sources (sim_source, trace_source) provide fill(): the frames of the next buffer.
+ *   They are paced by an app_timer at rate_hz, frames per buffer.
+ *
+ * fill() is plain C, so the same sources and the pipeline behind the sink can be driven on a
+ * host by calling fill() in a loop, or through the pace timer on a simulated clock as
+ * tests/test_pipeline.c does with a trace.
+ */
+
+#define SAMPLE_SOURCE_BUFFER_SIZE   512   /* Samples per buffer of the synthetic sources */
+
+typedef void (*sample_sink_t)(int16_t const *p_samples, uint16_t frames, uint8_t channel_count);
+
+typedef struct
+{
+  char const *p_name;
+  uint8_t    channel_count;
+  ret_code_t (*start)(void);      /* Hardware sources */
+  void       (*stop)(void);
+  uint16_t   (*fill)(int16_t *p_samples, uint16_t frames);  /* Synthetic sources. Returns the frames
+                                                             * written, 0 when the source has ended */
+} sample_source_t;
+
+typedef struct
+{
+  sample_source_t const *p_source;
+  sample_sink_t         sink;
+  uint32_t              rate_hz;  /* Synthetic sources: sample sets per second */
+  uint16_t              frames;   /* Synthetic sources: sample sets per buffer */
+} sample_source_init_t;
+
+typedef struct
+{
+  uint32_t buffers;
+  uint32_t frames;
+} sample_source_stats_t;
+
+/* Select the source. Only while stopped */
+ret_code_t sample_source_select(sample_source_init_t const *p_init);
+
+ret_code_t sample_source_start(void);
+
+void sample_source_stop(void);
+
+bool sample_source_is_running(void);
+
+/* Hardware sources: a full buffer, in thread mode */
+void sample_source_put(int16_t const *p_samples, uint16_t frames, uint8_t channel_count);
+
+void sample_source_stats_get(sample_source_stats_t *p_stats);
+
+void sample_source_stats_log(void);
+
+#endif /* _SAMPLE_SOURCE_H */
@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "scan_table.h"
+
+#define FNV_OFFSET_BASIS  2166136261u
+#define FNV_PRIME         16777619u
+
+static uint32_t fnv1a(uint32_t hash, uint8_t const *p_data, uint16_t len)
+{
+  for(uint16_t i = 0; i < len; i++)
+  {
+    hash ^= p_data[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/* Home slot of an advertiser. Only the address is hashed, a payload change updates the entry in place */
+static uint16_t slot_home(scan_table_t const *p_table, uint8_t const *p_addr, uint8_t addr_type)
+{
+  uint32_t hash = fnv1a(FNV_OFFSET_BASIS, p_addr, SCAN_TABLE_ADDR_LEN);
+
+  hash ^= addr_type;
+
+  /* Final avalanche, low bits index the table */
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6Bu;
+  hash ^= hash >> 13;
+
+  return (uint16_t)(hash & (p_table->size - 1));
+}
+
+static bool entry_matches(scan_entry_t const *p_entry, uint8_t const *p_addr, uint8_t addr_type)
+{
+  return (p_entry->addr_type == addr_type) &&
+         (memcmp(p_entry->addr, p_addr, SCAN_TABLE_ADDR_LEN) == 0);
+}
+
+/* Start the aggregate over for a new or changed advertisement */
+static void entry_set(scan_entry_t *p_entry, uint32_t payload_hash, int8_t rssi, uint32_t now)
+{
+  p_entry->flags = SCAN_TABLE_FLAG_USED | SCAN_TABLE_FLAG_DIRTY;
+  p_entry->payload_hash = payload_hash;
+  p_entry->rssi_sum = rssi;
+  p_entry->count = 1;
+  p_entry->rssi_last = rssi;
+  p_entry->rssi_max = rssi;
+  p_entry->first_seen = now;
+  p_entry->last_seen = now;
+}
+
+bool scan_table_init(scan_table_t *p_table, scan_entry_t *p_entries, uint16_t size)
+{
+  if((p_table == NULL) || (p_entries == NULL) || (size == 0) || ((size & (size - 1)) != 0))
+  {
+    return false;
+  }
+
+  memset(p_table, 0, sizeof(scan_table_t));
+  memset(p_entries, 0, size * sizeof(scan_entry_t));
+
+  p_table->p_entries = p_entries;
+  p_table->size = size;
+
+  return true;
+}
+
+uint32_t scan_table_payload_hash(uint8_t const *p_data, uint16_t len)
+{
+  return fnv1a(FNV_OFFSET_BASIS, p_data, len);
+}
+
+scan_table_result_t scan_table_put(scan_table_t *p_table, uint8_t const *p_addr, uint8_t addr_type,
+                                   uint32_t payload_hash, int8_t rssi, uint32_t now)
+{
+  uint16_t     mask = p_table->size - 1;
+  uint16_t     slot = slot_home(p_table, p_addr, addr_type);
+  scan_entry_t *p_entry = NULL;
+
+  for(uint16_t probe = 0; probe < p_table->size; probe++)
+  {
+    p_entry = &p_table->p_entries[slot];
+
+    if(!(p_entry->flags & SCAN_TABLE_FLAG_USED))
+    {
+      break;
+    }
+
+    if(entry_matches(p_entry, p_addr, addr_type))
+    {
+      if(p_entry->payload_hash != payload_hash)
+      {
+        /* Rolling payloads (counters, rotating beacons) replace the previous one */
+        entry_set(p_entry, payload_hash, rssi, now);
+
+        p_table->stats.replaced++;
+        return SCAN_TABLE_REPLACED;
+      }
+
+      if(p_entry->count == UINT16_MAX)
+      {
+        /* Keep the average, give the recent samples more weight */
+        p_entry->count /= 2;
+        p_entry->rssi_sum /= 2;
+      }
+
+      p_entry->count++;
+      p_entry->rssi_sum += rssi;
+      p_entry->rssi_last = rssi;
+      if(rssi > p_entry->rssi_max)
+      {
+        p_entry->rssi_max = rssi;
+      }
+      p_entry->last_seen = now;
+
+      p_table->stats.duplicates++;
+      return SCAN_TABLE_DUPLICATE;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  if(p_table->used >= ((p_table->size / 4) * 3))
+  {
+    p_table->stats.dropped++;
+    return SCAN_TABLE_FULL;
+  }
+
+  /* p_entry is the free slot ending the probe sequence */
+  memcpy(p_entry->addr, p_addr, SCAN_TABLE_ADDR_LEN);
+  p_entry->addr_type = addr_type;
+  entry_set(p_entry, payload_hash, rssi, now);
+
+  p_table->used++;
+  p_table->stats.inserted++;
+
+  return SCAN_TABLE_NEW;
+}
+
+uint16_t scan_table_dirty_get(scan_table_t *p_table, scan_entry_t *p_out, uint16_t max)
+{
+  uint16_t     copied = 0;
+  scan_entry_t *p_entry = NULL;
+
+  for(uint16_t i = 0; (i < p_table->size) && (copied < max); i++)
+  {
+    p_entry = &p_table->p_entries[p_table->cursor];
+    p_table->cursor = (p_table->cursor + 1) & (p_table->size - 1);
+
+    if(p_entry->flags & SCAN_TABLE_FLAG_DIRTY)
+    {
+      p_entry->flags &= (uint8_t)~SCAN_TABLE_FLAG_DIRTY;
+      p_out[copied++] = *p_entry;
+    }
+  }
+
+  return copied;
+}
+
+/* Backward shift deletion: pull the following entries of the probe run into the hole */
+static void slot_delete(scan_table_t *p_table, uint16_t hole)
+{
+  uint16_t     mask = p_table->size - 1;
+  uint16_t     next = (hole + 1) & mask;
+  uint16_t     home = 0;
+  scan_entry_t *p_next = NULL;
+
+  for(;;)
+  {
+    p_next = &p_table->p_entries[next];
+
+    if(!(p_next->flags & SCAN_TABLE_FLAG_USED))
+    {
+      break;
+    }
+
+    home = slot_home(p_table, p_next->addr, p_next->addr_type);
+
+    /* Move it if its home is not in (hole, next], cyclically */
+    if(((next - home) & mask) >= ((next - hole) & mask))
+    {
+      p_table->p_entries[hole] = *p_next;
+      hole = next;
+    }
+
+    next = (next + 1) & mask;
+  }
+
+  memset(&p_table->p_entries[hole], 0, sizeof(scan_entry_t));
+  p_table->used--;
+}
+
+uint16_t scan_table_expire(scan_table_t *p_table, uint32_t now, uint32_t max_age)
+{
+  uint16_t     removed = 0;
+  uint16_t     i = 0;
+  scan_entry_t *p_entry = NULL;
+
+  while(i < p_table->size)
+  {
+    p_entry = &p_table->p_entries[i];
+
+    if((p_entry->flags & SCAN_TABLE_FLAG_USED) && ((uint32_t)(now - p_entry->last_seen) > max_age))
+    {
+      slot_delete(p_table, i);
+      removed++;
+      /* Another entry may have shifted into this slot */
+      continue;
+    }
+
+    i++;
+  }
+
+  p_table->stats.expired += removed;
+
+  return removed;
+}
+
+int8_t scan_table_rssi_avg(scan_entry_t const *p_entry)
+{
+  if(p_entry->count == 0)
+  {
+    return 0;
+  }
+
+  return (int8_t)(p_entry->rssi_sum / (int32_t)p_entry->count);
+}
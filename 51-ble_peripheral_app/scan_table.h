@@ -0,0 +1,81 @@
+#ifndef _SCAN_TABLE_H
+#define _SCAN_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Deduplicating advertisement table.
+ *
+ * Fixed size, open addressing with linear probing. Entries are keyed by the advertiser address
+ * and keep a hash of its last advertising payload: a repeated advertisement only updates the
+ * RSSI aggregate of its entry, a changed payload replaces the entry contents and a new address
+ * creates an entry. Both leave the entry dirty.
+ * Dirty entries are collected in batches for the host, stale ones are expired with backward
+ * shift deletion so no tombstones build up.
+ *
+ * No SDK dependencies, the table can be built and exercised on a host.
+ */
+
+#define SCAN_TABLE_ADDR_LEN     6
+
+/* Entry flags */
+#define SCAN_TABLE_FLAG_USED    0x01
+#define SCAN_TABLE_FLAG_DIRTY   0x02    /* Not forwarded to the host yet */
+
+typedef struct
+{
+  uint8_t  addr[SCAN_TABLE_ADDR_LEN];
+  uint8_t  addr_type;
+  uint8_t  flags;
+  uint32_t payload_hash;
+  int32_t  rssi_sum;
+  uint16_t count;         /* Advertisements seen. Halved with rssi_sum before it saturates */
+  int8_t   rssi_last;
+  int8_t   rssi_max;
+  uint32_t first_seen;    /* Caller's time, ms */
+  uint32_t last_seen;
+} scan_entry_t;
+
+typedef struct
+{
+  uint32_t inserted;
+  uint32_t duplicates;
+  uint32_t replaced;      /* Payload changed */
+  uint32_t dropped;       /* Table at the load limit */
+  uint32_t expired;
+} scan_table_stats_t;
+
+typedef struct
+{
+  scan_entry_t       *p_entries;
+  uint16_t           size;        /* Power of two */
+  uint16_t           used;
+  uint16_t           cursor;      /* Dirty scan position, batches resume here */
+  scan_table_stats_t stats;
+} scan_table_t;
+
+typedef enum
+{
+  SCAN_TABLE_NEW,
+  SCAN_TABLE_DUPLICATE,
+  SCAN_TABLE_REPLACED,
+  SCAN_TABLE_FULL,
+} scan_table_result_t;
+
+/* size must be a power of two. Inserts are refused above 3/4 load to keep the probes short */
+bool scan_table_init(scan_table_t *p_table, scan_entry_t *p_entries, uint16_t size);
+
+uint32_t scan_table_payload_hash(uint8_t const *p_data, uint16_t len);
+
+scan_table_result_t scan_table_put(scan_table_t *p_table, uint8_t const *p_addr, uint8_t addr_type,
+                                   uint32_t payload_hash, int8_t rssi, uint32_t now);
+
+/* Copy up to max dirty entries and clear their dirty flag. Returns the number copied */
+uint16_t scan_table_dirty_get(scan_table_t *p_table, scan_entry_t *p_out, uint16_t max);
+
+/* Remove the entries not seen for max_age. Returns the number removed */
+uint16_t scan_table_expire(scan_table_t *p_table, uint32_t now, uint32_t max_age);
+
+int8_t scan_table_rssi_avg(scan_entry_t const *p_entry);
+
+#endif /* _SCAN_TABLE_H */
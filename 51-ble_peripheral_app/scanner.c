@@ -0,0 +1,469 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+#include "peer_manager.h"
+#include "sdk_config.h"
+
+#include "bloom.h"
+#include "scanner.h"
+
+/* Bloom filter keys, the prefix keeps addresses and company ids apart */
+#define FILTER_KEY_ADDR     'A'
+#define FILTER_KEY_COMPANY  'C'
+#define FILTER_KEY_CLEAR    'X'   /* Only in scanner_filter_load() */
+
+APP_TIMER_DEF(m_flush_timer);
+
+/* Without the scan gateway the API stays linkable for the runtime checks of the caller,
+ * but the table and filter buffers are not built
+ */
+#if APP_SCANNER_ENABLED
+#define TABLE_ENTRIES   SCANNER_TABLE_SIZE
+#define FILTER_WORDS    (SCANNER_FILTER_BITS / 32)
+#else
+#define TABLE_ENTRIES   1
+#define FILTER_WORDS    1
+#endif
+
+static scan_entry_t m_entries[TABLE_ENTRIES];
+static scan_table_t m_table;
+static scan_entry_t m_batch[SCANNER_BATCH_MAX];
+
+/* Reports land here, the SoftDevice pauses scanning until the buffer is handed back */
+static uint8_t   m_scan_buffer[BLE_GAP_SCAN_BUFFER_EXTENDED_MIN];
+static ble_data_t m_scan_data = { m_scan_buffer, sizeof(m_scan_buffer) };
+
+static ble_gap_scan_params_t   m_scan_params;
+static scanner_batch_handler_t m_batch_handler = NULL;
+static uint32_t m_flush_interval = 0;
+static uint32_t m_flush_interval_ms = 0;
+static uint32_t m_max_age_ms = 0;
+static uint32_t m_now_ms = 0;          /* Advanced by the flush timer */
+static uint32_t m_reports = 0;
+static bool     m_running = false;
+
+static uint32_t       m_filter_bits[FILTER_WORDS];
+static bloom_t        m_filter;
+static ble_gap_addr_t m_priority[SCANNER_PRIORITY_MAX];
+static uint8_t        m_priority_count = 0;
+static scanner_mode_t m_mode = SCANNER_MODE_ALL;
+static uint32_t       m_rejected = 0;
+static uint32_t       m_priority_hits = 0;
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static void flush_timeout_handler(void *p_context)
+{
+  uint16_t count = 0;
+
+  m_now_ms += m_flush_interval_ms;
+
+  count = scan_table_dirty_get(&m_table, m_batch, SCANNER_BATCH_MAX);
+  if((count > 0) && (m_batch_handler != NULL))
+  {
+    m_batch_handler(m_batch, count);
+  }
+
+  (void)scan_table_expire(&m_table, m_now_ms, m_max_age_ms);
+}
+
+static bool addr_find(ble_gap_addr_t const *p_addrs, uint32_t count, ble_gap_addr_t const *p_addr)
+{
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if((p_addrs[i].addr_type == p_addr->addr_type) &&
+       (memcmp(p_addrs[i].addr, p_addr->addr, BLE_GAP_ADDR_LEN) == 0))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Company id of the first manufacturer specific data, false if there is none */
+static bool company_id_find(uint8_t const *p_data, uint16_t len, uint16_t *p_company_id)
+{
+  uint16_t pos = 0;
+
+  while((pos + 1) < len)
+  {
+    uint8_t ad_len = p_data[pos];
+
+    if((ad_len == 0) || ((pos + 1 + ad_len) > len))
+    {
+      break;
+    }
+
+    if((p_data[pos + 1] == BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA) && (ad_len >= 3))
+    {
+      *p_company_id = uint16_decode(&p_data[pos + 2]);
+      return true;
+    }
+
+    pos += 1 + ad_len;
+  }
+
+  return false;
+}
+
+static bool filter_pass(ble_gap_evt_adv_report_t const *p_report)
+{
+  uint8_t  key[1 + BLE_GAP_ADDR_LEN];
+  uint16_t company_id = 0;
+
+  if(addr_find(m_priority, m_priority_count, &p_report->peer_addr))
+  {
+    m_priority_hits++;
+    return true;
+  }
+
+  if(m_filter.key_count == 0)
+  {
+    return true;
+  }
+
+  key[0] = FILTER_KEY_ADDR;
+  memcpy(&key[1], p_report->peer_addr.addr, BLE_GAP_ADDR_LEN);
+  if(bloom_check(&m_filter, key, sizeof(key)))
+  {
+    return true;
+  }
+
+  if(company_id_find(p_report->data.p_data, p_report->data.len, &company_id))
+  {
+    key[0] = FILTER_KEY_COMPANY;
+    (void)uint16_encode(company_id, &key[1]);
+    if(bloom_check(&m_filter, key, 3))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void on_adv_report(ble_gap_evt_adv_report_t const *p_report)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  m_reports++;
+
+  if(filter_pass(p_report))
+  {
+    /* Fragments of chained extended advertising hash separately, they are still deduplicated */
+    (void)scan_table_put(&m_table, p_report->peer_addr.addr, p_report->peer_addr.addr_type,
+                         scan_table_payload_hash(p_report->data.p_data, p_report->data.len),
+                         p_report->rssi, m_now_ms);
+  }
+  else
+  {
+    m_rejected++;
+  }
+
+  if(m_running)
+  {
+    err_code = sd_ble_gap_scan_start(NULL, &m_scan_data);
+    if(err_code != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Scanning not resumed, error 0x%X", err_code);
+      m_running = false;
+    }
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_ADV_REPORT:
+      on_adv_report(&p_ble_evt->evt.gap_evt.params.adv_report);
+      break;
+
+    case BLE_GAP_EVT_TIMEOUT:
+      if(p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN)
+      {
+        m_running = false;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_scanner_observer, SCANNER_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t scanner_init(scanner_init_t const *p_init)
+{
+  if(p_init == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(!APP_SCANNER_ENABLED)
+  {
+    return NRF_ERROR_NOT_SUPPORTED;
+  }
+
+  if((p_init->window == 0) || (p_init->window > p_init->interval))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  (void)scan_table_init(&m_table, m_entries, SCANNER_TABLE_SIZE);
+  (void)bloom_init(&m_filter, m_filter_bits, SCANNER_FILTER_BITS, SCANNER_FILTER_HASHES);
+
+  memset(&m_scan_params, 0, sizeof(m_scan_params));
+  m_scan_params.extended = 1;
+  m_scan_params.active = 0;
+  m_scan_params.interval = p_init->interval;
+  m_scan_params.window = p_init->window;
+  m_scan_params.timeout = BLE_GAP_SCAN_TIMEOUT_UNLIMITED;
+  m_scan_params.scan_phys = BLE_GAP_PHY_1MBPS;
+  m_scan_params.filter_policy = BLE_GAP_SCAN_FP_ACCEPT_ALL;
+
+  m_batch_handler = p_init->batch_handler;
+  m_flush_interval = p_init->flush_interval;
+  m_flush_interval_ms = ticks_to_ms(p_init->flush_interval);
+  m_max_age_ms = p_init->max_age_ms;
+  m_now_ms = 0;
+
+  return app_timer_create(&m_flush_timer, APP_TIMER_MODE_REPEATED, flush_timeout_handler);
+}
+
+/* SoftDevice allowlist: bonded peers (as Peer Manager set it) and the priority peers not among them */
+static ret_code_t allowlist_apply(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gap_addr_t       addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  ble_gap_addr_t const *p_addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  ble_gap_irk_t        irks[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  uint32_t             addr_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+  uint32_t             irk_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+
+  err_code = pm_whitelist_get(addrs, &addr_cnt, irks, &irk_cnt);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  for(uint8_t i = 0; i < m_priority_count; i++)
+  {
+    if(addr_find(addrs, addr_cnt, &m_priority[i]))
+    {
+      continue;
+    }
+
+    if(addr_cnt >= BLE_GAP_WHITELIST_ADDR_MAX_COUNT)
+    {
+      NRF_LOG_WARNING("Allowlist full, %d priority peers left out", m_priority_count - i);
+      break;
+    }
+    addrs[addr_cnt++] = m_priority[i];
+  }
+
+  for(uint32_t i = 0; i < addr_cnt; i++)
+  {
+    p_addrs[i] = &addrs[i];
+  }
+
+  return sd_ble_gap_whitelist_set(p_addrs, addr_cnt);
+}
+
+ret_code_t scanner_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!APP_SCANNER_ENABLED)
+  {
+    return NRF_ERROR_NOT_SUPPORTED;
+  }
+
+  if(m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  if(m_mode == SCANNER_MODE_PRIORITY)
+  {
+    err_code = allowlist_apply();
+    if(err_code != NRF_SUCCESS)
+    {
+      return err_code;
+    }
+  }
+
+  m_scan_params.filter_policy = (m_mode == SCANNER_MODE_PRIORITY) ? BLE_GAP_SCAN_FP_WHITELIST
+                                                                  : BLE_GAP_SCAN_FP_ACCEPT_ALL;
+
+  err_code = sd_ble_gap_scan_start(&m_scan_params, &m_scan_data);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  m_running = true;
+
+  return app_timer_start(m_flush_timer, m_flush_interval, NULL);
+}
+
+ret_code_t scanner_stop(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  m_running = false;
+
+  err_code = sd_ble_gap_scan_stop();
+  if((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE))
+  {
+    return err_code;
+  }
+
+  return app_timer_stop(m_flush_timer);
+}
+
+bool scanner_is_running(void)
+{
+  return m_running;
+}
+
+static uint8_t filter_record_len(uint8_t type)
+{
+  switch(type)
+  {
+    case FILTER_KEY_ADDR:
+      return 1 + BLE_GAP_ADDR_LEN;
+
+    case FILTER_KEY_COMPANY:
+      return 3;
+
+    case FILTER_KEY_CLEAR:
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+ret_code_t scanner_mode_set(scanner_mode_t mode)
+{
+  if((mode == SCANNER_MODE_PRIORITY) && (m_priority_count == 0))
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  m_mode = mode;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t scanner_priority_set(ble_gap_addr_t const *p_addrs, uint8_t count)
+{
+  if((count > 0) && (p_addrs == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(count > SCANNER_PRIORITY_MAX)
+  {
+    return NRF_ERROR_NO_MEM;
+  }
+
+  memcpy(m_priority, p_addrs, count * sizeof(ble_gap_addr_t));
+  m_priority_count = count;
+
+  /* Without priority peers the SoftDevice allowlist would pass nothing */
+  if(m_priority_count == 0)
+  {
+    m_mode = SCANNER_MODE_ALL;
+  }
+
+  return NRF_SUCCESS;
+}
+
+void scanner_filter_addr_add(uint8_t const *p_addr)
+{
+  uint8_t key[1 + BLE_GAP_ADDR_LEN];
+
+  key[0] = FILTER_KEY_ADDR;
+  memcpy(&key[1], p_addr, BLE_GAP_ADDR_LEN);
+  bloom_add(&m_filter, key, sizeof(key));
+}
+
+void scanner_filter_company_add(uint16_t company_id)
+{
+  uint8_t key[3];
+
+  key[0] = FILTER_KEY_COMPANY;
+  (void)uint16_encode(company_id, &key[1]);
+  bloom_add(&m_filter, key, sizeof(key));
+}
+
+void scanner_filter_clear(void)
+{
+  bloom_clear(&m_filter);
+}
+
+ret_code_t scanner_filter_load(uint8_t const *p_data, uint16_t len)
+{
+  uint16_t pos = 0;
+
+  if(!APP_SCANNER_ENABLED)
+  {
+    return NRF_ERROR_NOT_SUPPORTED;
+  }
+
+  /* Check all the records first, a bad write leaves the filter as it was */
+  while(pos < len)
+  {
+    uint8_t record_len = filter_record_len(p_data[pos]);
+
+    if(record_len == 0)
+    {
+      return NRF_ERROR_INVALID_DATA;
+    }
+    pos += record_len;
+  }
+
+  if(pos != len)
+  {
+    return NRF_ERROR_INVALID_LENGTH;
+  }
+
+  /* Address and company id records are the filter keys as they are */
+  for(pos = 0; pos < len; pos += filter_record_len(p_data[pos]))
+  {
+    if(p_data[pos] == FILTER_KEY_CLEAR)
+    {
+      bloom_clear(&m_filter);
+    }
+    else
+    {
+      bloom_add(&m_filter, &p_data[pos], filter_record_len(p_data[pos]));
+    }
+  }
+
+  return NRF_SUCCESS;
+}
+
+void scanner_stats_log(void)
+{
+  NRF_LOG_INFO("Scanner: %u reports, %u advertisers (%u new, %u changed, %u expired, %u dropped)",
+               m_reports, m_table.used, m_table.stats.inserted, m_table.stats.replaced,
+               m_table.stats.expired, m_table.stats.dropped);
+  NRF_LOG_INFO("Scan filter: %u rejected, %u priority, %u keys (~%u ppm false positives)",
+               m_rejected, m_priority_hits, m_filter.key_count, bloom_fp_ppm(&m_filter));
+}
@@ -0,0 +1,85 @@
+#ifndef _SCANNER_H
+#define _SCANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_gap.h"
+#include "sdk_errors.h"
+#include "scan_table.h"
+
+/* Scan gateway.
+ *
+ * Passive scanning (legacy and extended advertising on 1M PHY) next to the peripheral role.
+ * Each advertising report goes through the deduplicating scan table, and every flush_interval
+ * the new entries are handed to the batch handler (up to SCANNER_BATCH_MAX at a time, the
+ * rest follows in the next batches). Entries not seen for max_age are expired.
+ *
+ * Reports are filtered in two tiers before they reach the table:
+ * - Priority peers (a few addresses). In SCANNER_MODE_PRIORITY the SoftDevice allowlist is
+ *   used, so only they wake the CPU. The SoftDevice has one allowlist for scanning and
+ *   advertising: it is set to the bonded peers plus the priority peers, so priority peers can
+ *   also connect while advertising uses the allowlist.
+ * - In SCANNER_MODE_ALL, other reports pass when their address or manufacturer data company
+ *   id is in a Bloom filter (thousands of tags, ~0.1% false positives at 4096 keys).
+ *   An empty filter passes everything. The filter is in RAM only, load it again after a reset.
+ *
+ * Only built with APP_SCANNER_ENABLED (sdk_config.h), otherwise scanner_init() and
+ * scanner_start() return NRF_ERROR_NOT_SUPPORTED.
+ */
+
+#define SCANNER_TABLE_SIZE          512   /* Up to 384 advertisers (3/4 load) */
+#define SCANNER_BATCH_MAX           16
+#define SCANNER_BLE_OBSERVER_PRIO   1
+
+#define SCANNER_FILTER_BITS         65536 /* 8 kB */
+#define SCANNER_FILTER_HASHES       6
+#define SCANNER_PRIORITY_MAX        BLE_GAP_WHITELIST_ADDR_MAX_COUNT
+
+typedef enum
+{
+  SCANNER_MODE_ALL,       /* Priority peers and the Bloom filter matches */
+  SCANNER_MODE_PRIORITY,  /* Priority peers only, filtered by the SoftDevice */
+} scanner_mode_t;
+
+typedef void (*scanner_batch_handler_t)(scan_entry_t const *p_entries, uint16_t count);
+
+typedef struct
+{
+  uint16_t                interval;        /* Scan interval in 0.625 ms units */
+  uint16_t                window;          /* Scan window in 0.625 ms units */
+  uint32_t                flush_interval;  /* app_timer ticks */
+  uint32_t                max_age_ms;      /* Entries not seen this long are expired */
+  scanner_batch_handler_t batch_handler;
+} scanner_init_t;
+
+ret_code_t scanner_init(scanner_init_t const *p_init);
+
+ret_code_t scanner_start(void);
+
+ret_code_t scanner_stop(void);
+
+bool scanner_is_running(void);
+
+/* Takes effect on the next scanner_start() */
+ret_code_t scanner_mode_set(scanner_mode_t mode);
+
+/* Takes effect on the next scanner_start(). No priority peers falls back to SCANNER_MODE_ALL */
+ret_code_t scanner_priority_set(ble_gap_addr_t const *p_addrs, uint8_t count);
+
+void scanner_filter_addr_add(uint8_t const *p_addr);
+
+void scanner_filter_company_add(uint16_t company_id);
+
+/* Empty filter: all reports pass */
+void scanner_filter_clear(void);
+
+/* Filter keys in a row, as a central writes them: { 'A', address (6, little endian) },
+ * { 'C', company id (u16) }, or { 'X' } to clear the filter. Nothing is added when a record is
+ * unknown (NRF_ERROR_INVALID_DATA) or cut short (NRF_ERROR_INVALID_LENGTH).
+ */
+ret_code_t scanner_filter_load(uint8_t const *p_data, uint16_t len);
+
+void scanner_stats_log(void);
+
+#endif /* _SCANNER_H */
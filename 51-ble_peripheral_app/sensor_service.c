@@ -0,0 +1,354 @@
+#include <string.h>
+
+#include "app_util.h"
+#include "ble_srv_common.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "diag_service.h"
+#include "sensor_service.h"
+
+/* Airtime of one notification on the 1M PHY, 8 us a byte: preamble 1, access address 4,
+ * LL header 2, L2CAP header 4, ATT header 3, MIC 4, CRC 3
+ */
+#define PDU_OVERHEAD_BYTES  21
+#define PDU_US_PER_BYTE     8
+
+static nrf_ble_gatt_t const            *mp_gatt = NULL;
+static sensor_service_config_handler_t m_config_handler = NULL;
+static uint16_t                        m_service_handle = BLE_GATT_HANDLE_INVALID;
+static ble_gatts_char_handles_t        m_config_handles;
+static ble_gatts_char_handles_t        m_summary_handles;
+static ble_gatts_char_handles_t        m_event_handles;
+static uint8_t                         m_uuid_type = BLE_UUID_TYPE_UNKNOWN;
+
+static uint16_t                        m_conn_handle = BLE_CONN_HANDLE_INVALID;   /* Subscribed link */
+
+static sensor_service_stats_t m_stats;
+
+static uint32_t pdu_airtime_us(uint16_t len)
+{
+  return (PDU_OVERHEAD_BYTES + len) * PDU_US_PER_BYTE;
+}
+
+static uint16_t config_encode(window_agg_config_t const *p_config, uint8_t *p_data)
+{
+  uint16_t len = 0;
+
+  len += uint16_encode(p_config->pane_len, &p_data[len]);
+  p_data[len++] = p_config->panes;
+  p_data[len++] = p_config->outputs;
+  len += uint16_encode((uint16_t)p_config->hist_min, &p_data[len]);
+  len += uint16_encode((uint16_t)p_config->hist_max, &p_data[len]);
+  len += uint16_encode((uint16_t)p_config->high, &p_data[len]);
+  len += uint16_encode((uint16_t)p_config->low, &p_data[len]);
+  len += uint16_encode(p_config->hysteresis, &p_data[len]);
+
+  return len;
+}
+
+static void config_decode(uint8_t const *p_data, window_agg_config_t *p_config)
+{
+  p_config->pane_len = uint16_decode(&p_data[0]);
+  p_config->panes = p_data[2];
+  p_config->outputs = p_data[3];
+  p_config->hist_min = (int16_t)uint16_decode(&p_data[4]);
+  p_config->hist_max = (int16_t)uint16_decode(&p_data[6]);
+  p_config->high = (int16_t)uint16_decode(&p_data[8]);
+  p_config->low = (int16_t)uint16_decode(&p_data[10]);
+  p_config->hysteresis = uint16_decode(&p_data[12]);
+}
+
+static bool notify(uint16_t handle, uint8_t const *p_data, uint16_t len)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gatts_hvx_params_t hvx = {0};
+
+  if(m_conn_handle == BLE_CONN_HANDLE_INVALID)
+  {
+    return false;
+  }
+
+  hvx.handle = handle;
+  hvx.type = BLE_GATT_HVX_NOTIFICATION;
+  hvx.p_len = &len;
+  hvx.p_data = p_data;
+
+  err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx);
+  if(err_code != NRF_SUCCESS)
+  {
+    /* No buffer, or notifications just disabled: a summary is superseded by the next anyway */
+    m_stats.dropped++;
+    return false;
+  }
+
+  m_stats.bytes += len;
+  m_stats.airtime_us += pdu_airtime_us(len);
+
+  return true;
+}
+
+static void on_config_write(uint16_t conn_handle, ble_gatts_evt_write_t const *p_write)
+{
+  ret_code_t          err_code = NRF_SUCCESS;
+  window_agg_config_t config = {0};
+
+  ble_gatts_rw_authorize_reply_params_t reply = {0};
+
+  reply.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+
+  if((p_write->op != BLE_GATTS_OP_WRITE_REQ) || (p_write->offset != 0) || (p_write->len != SENSOR_CONFIG_SIZE))
+  {
+    reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+  }
+  else
+  {
+    config_decode(p_write->data, &config);
+
+    if(window_agg_config_check(&config) && m_config_handler(&config))
+    {
+      reply.params.write.gatt_status = BLE_GATT_STATUS_SUCCESS;
+      reply.params.write.update = 1;
+      reply.params.write.len = p_write->len;
+      reply.params.write.p_data = p_write->data;
+      NRF_LOG_INFO("Link 0x%04X: sensor window %u x %u samples, outputs 0x%X",
+                   conn_handle, config.panes, config.pane_len, config.outputs);
+    }
+    else
+    {
+      reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED;
+    }
+  }
+
+  err_code = sd_ble_gatts_rw_authorize_reply(conn_handle, &reply);
+  if(err_code != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Link 0x%04X: sensor config write not answered, error 0x%X", conn_handle, err_code);
+  }
+}
+
+static void on_write(uint16_t conn_handle, ble_gatts_evt_write_t const *p_write)
+{
+  if(((p_write->handle != m_summary_handles.cccd_handle) && (p_write->handle != m_event_handles.cccd_handle)) ||
+     (p_write->len != 2))
+  {
+    return;
+  }
+
+  if(ble_srv_is_notification_enabled(p_write->data))
+  {
+    m_conn_handle = conn_handle;
+  }
+  else if(conn_handle == m_conn_handle)
+  {
+    /* Both off before the link stops receiving */
+    uint16_t other = (p_write->handle == m_summary_handles.cccd_handle) ? m_event_handles.cccd_handle
+                                                                         : m_summary_handles.cccd_handle;
+    uint8_t           cccd[2] = {0};
+    ble_gatts_value_t value = {0};
+
+    value.len = sizeof(cccd);
+    value.p_value = cccd;
+    if((sd_ble_gatts_value_get(conn_handle, other, &value) != NRF_SUCCESS) ||
+       !ble_srv_is_notification_enabled(cccd))
+    {
+      m_conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  ble_gatts_evt_rw_authorize_request_t const *p_auth = NULL;
+
+  if(m_service_handle == BLE_GATT_HANDLE_INVALID)
+  {
+    return;
+  }
+
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+      p_auth = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+      if((p_auth->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE) &&
+         (p_auth->request.write.handle == m_config_handles.value_handle))
+      {
+        on_config_write(p_ble_evt->evt.gatts_evt.conn_handle, &p_auth->request.write);
+      }
+      break;
+
+    case BLE_GATTS_EVT_WRITE:
+      on_write(p_ble_evt->evt.gatts_evt.conn_handle, &p_ble_evt->evt.gatts_evt.params.write);
+      break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      if(p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+      {
+        m_conn_handle = BLE_CONN_HANDLE_INVALID;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_sensor_service_observer, SENSOR_SERVICE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t sensor_service_init(nrf_ble_gatt_t const *p_gatt, window_agg_config_t const *p_config,
+                               sensor_service_config_handler_t config_handler)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint8_t    config[SENSOR_CONFIG_SIZE];
+
+  ble_uuid128_t         base_uuid = { DIAG_SERVICE_UUID_BASE };
+  ble_uuid_t            service_uuid = {0};
+  ble_add_char_params_t char_params = {0};
+
+  if((p_config == NULL) || (config_handler == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  mp_gatt = p_gatt;
+  m_config_handler = config_handler;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  /* Same base as the diagnostics service, the SoftDevice returns its type */
+  err_code = sd_ble_uuid_vs_add(&base_uuid, &m_uuid_type);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  service_uuid.type = m_uuid_type;
+  service_uuid.uuid = SENSOR_SERVICE_UUID;
+
+  err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &m_service_handle);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  char_params.uuid = SENSOR_CONFIG_CHAR_UUID;
+  char_params.uuid_type = m_uuid_type;
+  char_params.max_len = SENSOR_CONFIG_SIZE;
+  char_params.init_len = config_encode(p_config, config);
+  char_params.p_init_value = config;
+  char_params.is_defered_write = true;
+  char_params.char_props.read = 1;
+  char_params.char_props.write = 1;
+  char_params.read_access = SEC_JUST_WORKS;
+  char_params.write_access = SEC_JUST_WORKS;
+
+  err_code = characteristic_add(m_service_handle, &char_params, &m_config_handles);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid = SENSOR_SUMMARY_CHAR_UUID;
+  char_params.uuid_type = m_uuid_type;
+  char_params.max_len = SENSOR_SUMMARY_SIZE;
+  char_params.init_len = 0;
+  char_params.is_var_len = true;
+  char_params.char_props.notify = 1;
+  char_params.cccd_write_access = SEC_JUST_WORKS;
+
+  err_code = characteristic_add(m_service_handle, &char_params, &m_summary_handles);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  char_params.uuid = SENSOR_EVENT_CHAR_UUID;
+  char_params.max_len = SENSOR_EVENT_SIZE;
+
+  return characteristic_add(m_service_handle, &char_params, &m_event_handles);
+}
+
+bool sensor_service_is_subscribed(void)
+{
+  return m_conn_handle != BLE_CONN_HANDLE_INVALID;
+}
+
+uint16_t sensor_service_summary_encode(window_agg_summary_t const *p_summary, uint8_t *p_data)
+{
+  uint16_t len = 0;
+
+  len += uint16_encode(p_summary->seq, &p_data[len]);
+  len += uint16_encode(p_summary->count, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->min, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->max, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->mean, &p_data[len]);
+  len += uint32_encode(p_summary->variance, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->p50, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->p90, &p_data[len]);
+  len += uint16_encode((uint16_t)p_summary->p99, &p_data[len]);
+
+  return len;
+}
+
+void sensor_service_summary_send(window_agg_summary_t const *p_summary)
+{
+  uint8_t  data[SENSOR_SUMMARY_SIZE];
+  uint16_t len = sensor_service_summary_encode(p_summary, data);
+
+  if(notify(m_summary_handles.value_handle, data, len))
+  {
+    m_stats.summaries++;
+  }
+}
+
+void sensor_service_event_send(window_agg_event_t const *p_event)
+{
+  uint8_t  data[SENSOR_EVENT_SIZE];
+  uint16_t len = 0;
+
+  len += uint32_encode(p_event->sample, &data[len]);
+  len += uint16_encode((uint16_t)p_event->value, &data[len]);
+  data[len++] = (uint8_t)p_event->level;
+
+  if(notify(m_event_handles.value_handle, data, len))
+  {
+    m_stats.events++;
+  }
+}
+
+void sensor_service_samples_account(uint16_t count)
+{
+  uint16_t chunk;
+
+  if(m_conn_handle == BLE_CONN_HANDLE_INVALID)
+  {
+    return;
+  }
+
+  /* Raw streaming: 2 bytes a sample, packed into notifications of ATT MTU - 3 bytes */
+  chunk = nrf_ble_gatt_eff_mtu_get(mp_gatt, m_conn_handle) - 3;
+  m_stats.samples += count;
+  m_stats.raw_airtime_us += ((uint64_t)count * 2 * PDU_US_PER_BYTE) +
+                            ((uint64_t)CEIL_DIV((uint32_t)count * 2, chunk) * PDU_OVERHEAD_BYTES * PDU_US_PER_BYTE);
+}
+
+void sensor_service_stats_get(sensor_service_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void sensor_service_stats_log(void)
+{
+  uint32_t saved_pct = 0;
+
+  if(m_stats.raw_airtime_us > m_stats.airtime_us)
+  {
+    saved_pct = (uint32_t)(((m_stats.raw_airtime_us - m_stats.airtime_us) * 100) / m_stats.raw_airtime_us);
+  }
+
+  NRF_LOG_INFO("Sensor service: %u samples -> %u summaries, %u events, %u bytes, %u dropped",
+               m_stats.samples, m_stats.summaries, m_stats.events, m_stats.bytes, m_stats.dropped);
+  NRF_LOG_INFO("Sensor airtime: %u ms sent, %u ms raw streaming, %u%% saved",
+               (uint32_t)(m_stats.airtime_us / 1000), (uint32_t)(m_stats.raw_airtime_us / 1000), saved_pct);
+}
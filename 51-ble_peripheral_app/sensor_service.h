@@ -0,0 +1,69 @@
+#ifndef _SENSOR_SERVICE_H
+#define _SENSOR_SERVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf_ble_gatt.h"
+#include "sdk_errors.h"
+#include "window_agg.h"
+
+/* Sensor GATT service, on the diagnostics UUID base. Sends window summaries and threshold
+ * events instead of raw samples.
+ *
+ * Config characteristic (read, write): the window_agg_config_t, little endian:
+ * pane_len (u16), panes (u8), outputs (u8), hist_min, hist_max, high, low (i16), hysteresis (u16).
+ * A write is checked and applied at once, a bad configuration is refused with
+ * BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH or ..._WRITE_NOT_PERMITTED.
+ * Summary characteristic (notify): seq, count (u16), min, max, mean (i16), variance (u32),
+ * p50, p90, p99 (i16). 20 bytes, fits the default ATT MTU.
+ * Event characteristic (notify): sample index (u32), value (i16), level (u8).
+ *
+ * Notifications go to the last link that enabled them. Needs an encrypted link.
+ */
+
+#define SENSOR_SERVICE_UUID             0x0020
+#define SENSOR_CONFIG_CHAR_UUID         0x0021
+#define SENSOR_SUMMARY_CHAR_UUID        0x0022
+#define SENSOR_EVENT_CHAR_UUID          0x0023
+
+#define SENSOR_CONFIG_SIZE              14
+#define SENSOR_SUMMARY_SIZE             20
+#define SENSOR_EVENT_SIZE               7
+
+#define SENSOR_SERVICE_BLE_OBSERVER_PRIO  2
+
+/* Called on a config write. Returns false to refuse it */
+typedef bool (*sensor_service_config_handler_t)(window_agg_config_t const *p_config);
+
+typedef struct
+{
+  uint32_t samples;         /* Aggregated while a link was subscribed */
+  uint32_t summaries;
+  uint32_t events;
+  uint32_t bytes;           /* Notification payload sent */
+  uint32_t dropped;         /* No SoftDevice buffer */
+  uint64_t airtime_us;      /* Estimated, of the notifications sent */
+  uint64_t raw_airtime_us;  /* Estimated, had the samples been streamed. 32 bits wrap in an hour */
+} sensor_service_stats_t;
+
+ret_code_t sensor_service_init(nrf_ble_gatt_t const *p_gatt, window_agg_config_t const *p_config,
+                               sensor_service_config_handler_t config_handler);
+
+bool sensor_service_is_subscribed(void);
+
+/* The summary characteristic value, SENSOR_SUMMARY_SIZE bytes. Also used by the telemetry frame */
+uint16_t sensor_service_summary_encode(window_agg_summary_t const *p_summary, uint8_t *p_data);
+
+void sensor_service_summary_send(window_agg_summary_t const *p_summary);
+
+void sensor_service_event_send(window_agg_event_t const *p_event);
+
+/* Samples aggregated, counted against the raw stream they replace */
+void sensor_service_samples_account(uint16_t count);
+
+void sensor_service_stats_get(sensor_service_stats_t *p_stats);
+
+void sensor_service_stats_log(void);
+
+#endif /* _SENSOR_SERVICE_H */
@@ -0,0 +1,81 @@
+#include <stddef.h>
+
+#include "sim_source.h"
+
+static sensorsim_cfg_t const *mp_cfgs;
+static sensorsim_state_t     m_states[SIM_SOURCE_CHANNELS_MAX];
+static uint16_t              m_noise;
+static uint32_t              m_rand;
+
+static uint16_t sim_fill(int16_t *p_samples, uint16_t frames);
+
+static sample_source_t m_source =
+{
+  .p_name = "sim",
+  .fill   = sim_fill,
+};
+
+/* xorshift32 */
+static uint32_t rand_next(void)
+{
+  m_rand ^= m_rand << 13;
+  m_rand ^= m_rand >> 17;
+  m_rand ^= m_rand << 5;
+
+  return m_rand;
+}
+
+static int16_t sample_clamp(int32_t value)
+{
+  if(value > INT16_MAX)
+  {
+    return INT16_MAX;
+  }
+  if(value < INT16_MIN)
+  {
+    return INT16_MIN;
+  }
+
+  return (int16_t)value;
+}
+
+static uint16_t sim_fill(int16_t *p_samples, uint16_t frames)
+{
+  for(uint16_t frame = 0; frame < frames; frame++)
+  {
+    for(uint8_t ch = 0; ch < m_source.channel_count; ch++)
+    {
+      int32_t value = (int32_t)sensorsim_measure(&m_states[ch], &mp_cfgs[ch]);
+
+      if(m_noise != 0)
+      {
+        value += (int32_t)(rand_next() % (2u * m_noise + 1)) - m_noise;
+      }
+
+      *p_samples++ = sample_clamp(value);
+    }
+  }
+
+  return frames;
+}
+
+sample_source_t const *sim_source_init(sim_source_init_t const *p_init)
+{
+  if((p_init->p_cfgs == NULL) || (p_init->channel_count == 0) ||
+     (p_init->channel_count > SIM_SOURCE_CHANNELS_MAX))
+  {
+    return NULL;
+  }
+
+  mp_cfgs = p_init->p_cfgs;
+  m_noise = p_init->noise;
+  m_rand = (p_init->seed != 0) ? p_init->seed : 1;    /* xorshift sticks at 0 */
+  m_source.channel_count = p_init->channel_count;
+
+  for(uint8_t ch = 0; ch < p_init->channel_count; ch++)
+  {
+    sensorsim_init(&m_states[ch], &mp_cfgs[ch]);
+  }
+
+  return &m_source;
+}
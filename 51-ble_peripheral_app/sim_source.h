@@ -0,0 +1,27 @@
+#ifndef _SIM_SOURCE_H
+#define _SIM_SOURCE_H
+
+#include <stdint.h>
+
+#include "sample_source.h"
+#include "sensorsim.h"
+
+/* Synthetic sample source from the SDK sensorsim: per channel a triangle wave between min and
+ * max, stepping by incr per sample set, plus optional pseudo random noise. The noise generator
+ * is seeded at init, so a run is reproducible.
+ */
+
+#define SIM_SOURCE_CHANNELS_MAX  4
+
+typedef struct
+{
+  sensorsim_cfg_t const *p_cfgs;      /* One per channel, values in the int16 range */
+  uint8_t               channel_count;
+  uint16_t              noise;        /* Peak noise added to each sample, 0: none */
+  uint32_t              seed;
+} sim_source_init_t;
+
+/* Returns the source for sample_source_select(), NULL on a bad configuration */
+sample_source_t const *sim_source_init(sim_source_init_t const *p_init);
+
+#endif /* _SIM_SOURCE_H */
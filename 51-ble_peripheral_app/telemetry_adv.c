@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "app_util.h"
+#include "ble.h"
+
+#include "telemetry_adv.h"
+
+#define FRAME_HEADER_SIZE   5   /* AD length, AD type, company id, sequence number */
+
+/* While advertising, the SoftDevice only accepts new data in a different buffer than
+ * the one in use, so the frames alternate between two buffers.
+ */
+static uint8_t m_frame_buf[2][BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];
+static uint8_t m_buf_idx = 0;
+
+static ble_gap_adv_data_t   m_adv_data;
+static ble_gap_adv_params_t m_adv_params;
+
+static uint8_t  *mp_adv_handle = NULL;
+static uint16_t m_company_id;
+static uint8_t  m_seq = 0;
+static bool     m_running = false;
+
+/* Encodes with the current sequence number, the caller moves it on once the frame is accepted */
+static uint16_t frame_encode(uint8_t *p_buf, uint8_t const *p_frame, uint16_t len)
+{
+  p_buf[0] = (uint8_t)(len + FRAME_HEADER_SIZE - 1);
+  p_buf[1] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+  p_buf[2] = LSB_16(m_company_id);
+  p_buf[3] = MSB_16(m_company_id);
+  p_buf[4] = m_seq;
+
+  if(len > 0)
+  {
+    memcpy(&p_buf[FRAME_HEADER_SIZE], p_frame, len);
+  }
+
+  return len + FRAME_HEADER_SIZE;
+}
+
+ret_code_t telemetry_adv_init(telemetry_adv_init_t const *p_init)
+{
+  if((p_init == NULL) || (p_init->p_adv_handle == NULL))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(m_running)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  mp_adv_handle = p_init->p_adv_handle;
+  m_company_id = p_init->company_id;
+
+  memset(&m_adv_params, 0, sizeof(m_adv_params));
+  m_adv_params.properties.type = BLE_GAP_ADV_TYPE_EXTENDED_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;
+  m_adv_params.p_peer_addr = NULL;
+  m_adv_params.filter_policy = BLE_GAP_ADV_FP_ANY;
+  m_adv_params.interval = p_init->interval;
+  m_adv_params.duration = 0;   /* Until stopped */
+  m_adv_params.primary_phy = p_init->primary_phy;
+  m_adv_params.secondary_phy = p_init->secondary_phy;
+
+  /* Start with an empty frame so the set can be started before the first reading */
+  m_buf_idx = 0;
+  memset(&m_adv_data, 0, sizeof(m_adv_data));
+  m_adv_data.adv_data.p_data = m_frame_buf[m_buf_idx];
+  m_adv_data.adv_data.len = frame_encode(m_frame_buf[m_buf_idx], NULL, 0);
+  m_seq++;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t telemetry_adv_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(mp_adv_handle == NULL)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  if(m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  err_code = sd_ble_gap_adv_set_configure(mp_adv_handle, &m_adv_data, &m_adv_params);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  err_code = sd_ble_gap_adv_start(*mp_adv_handle, BLE_CONN_CFG_TAG_DEFAULT);
+  if(err_code == NRF_SUCCESS)
+  {
+    m_running = true;
+  }
+
+  return err_code;
+}
+
+ret_code_t telemetry_adv_stop(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if(!m_running)
+  {
+    return NRF_SUCCESS;
+  }
+
+  err_code = sd_ble_gap_adv_stop(*mp_adv_handle);
+  if((err_code == NRF_SUCCESS) || (err_code == NRF_ERROR_INVALID_STATE))
+  {
+    m_running = false;
+    err_code = NRF_SUCCESS;
+  }
+
+  return err_code;
+}
+
+ret_code_t telemetry_adv_frame_set(uint8_t const *p_frame, uint16_t len)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  ble_gap_adv_data_t adv_data = {0};
+  uint8_t next = m_buf_idx ^ 1;
+
+  if((p_frame == NULL) && (len > 0))
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(len > TELEMETRY_ADV_FRAME_MAX)
+  {
+    return NRF_ERROR_DATA_SIZE;
+  }
+
+  adv_data.adv_data.p_data = m_frame_buf[next];
+  adv_data.adv_data.len = frame_encode(m_frame_buf[next], p_frame, len);
+
+  if(m_running)
+  {
+    /* Data only update, params must be NULL while advertising */
+    err_code = sd_ble_gap_adv_set_configure(mp_adv_handle, &adv_data, NULL);
+    if(err_code != NRF_SUCCESS)
+    {
+      return err_code;
+    }
+  }
+
+  /* A frame the SoftDevice refused leaves no gap in the sequence */
+  m_adv_data = adv_data;
+  m_buf_idx = next;
+  m_seq++;
+
+  return NRF_SUCCESS;
+}
+
+bool telemetry_adv_is_running(void)
+{
+  return m_running;
+}
@@ -0,0 +1,47 @@
+#ifndef _TELEMETRY_ADV_H
+#define _TELEMETRY_ADV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+#include "ble_gap.h"
+
+/* Connectionless telemetry broadcast.
+ *
+ * Frames are sent as manufacturer specific data in non-connectable, non-scannable extended
+ * advertising, so the payload goes on the secondary channels and can be up to 255 bytes.
+ * Each frame is prefixed with a sequence number so receivers can detect missed frames.
+ *
+ * S140 has a single advertising set, so the broadcast shares the set created by
+ * ble_advertising and can only run while connectable advertising is stopped.
+ */
+
+/* Extended advertising data minus AD header (2), company id (2) and sequence number (1) */
+#define TELEMETRY_ADV_FRAME_MAX   (BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED - 5)
+
+typedef struct
+{
+  uint8_t  *p_adv_handle;   /* Advertising set handle, shared with ble_advertising */
+  uint16_t company_id;
+  uint32_t interval;        /* Advertising interval in 0.625 ms units */
+  uint8_t  primary_phy;     /* BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_CODED */
+  uint8_t  secondary_phy;   /* BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS or BLE_GAP_PHY_CODED */
+} telemetry_adv_init_t;
+
+/* Can be called again while stopped to change the interval or PHYs */
+ret_code_t telemetry_adv_init(telemetry_adv_init_t const *p_init);
+
+/* Start broadcasting the last frame set. Connectable advertising must be stopped */
+ret_code_t telemetry_adv_start(void);
+
+ret_code_t telemetry_adv_stop(void);
+
+/* Set the next telemetry frame. Can be called while broadcasting, the frame goes out
+ * in the next advertising event without stopping the broadcast.
+ */
+ret_code_t telemetry_adv_frame_set(uint8_t const *p_frame, uint16_t len);
+
+bool telemetry_adv_is_running(void);
+
+#endif /* _TELEMETRY_ADV_H */
@@ -0,0 +1,105 @@
+#include <stddef.h>
+
+#include "app_timer.h"
+
+#define TIMERS_MAX  8
+
+static app_timer_t *mp_timers[TIMERS_MAX];
+static uint8_t     m_timer_count = 0;
+static uint64_t    m_now = 0;
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+  app_timer_t *p_timer = *p_timer_id;
+
+  if(timeout_handler == NULL)
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if(m_timer_count >= TIMERS_MAX)
+  {
+    return NRF_ERROR_NO_MEM;
+  }
+
+  p_timer->handler = timeout_handler;
+  p_timer->mode = mode;
+  p_timer->running = false;
+  mp_timers[m_timer_count++] = p_timer;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+  if((timer_id->handler == NULL) || (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  timer_id->p_context = p_context;
+  timer_id->period = timeout_ticks;
+  timer_id->expires = m_now + timeout_ticks;
+  timer_id->running = true;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+  timer_id->running = false;
+
+  return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+  /* 24 bit RTC counter */
+  return (uint32_t)(m_now & 0x00FFFFFF);
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+  return (ticks_to - ticks_from) & 0x00FFFFFF;
+}
+
+void app_timer_stub_advance(uint32_t ticks)
+{
+  uint64_t end = m_now + ticks;
+
+  for(;;)
+  {
+    app_timer_t *p_next = NULL;
+
+    for(uint8_t i = 0; i < m_timer_count; i++)
+    {
+      app_timer_t *p_timer = mp_timers[i];
+
+      if(p_timer->running && (p_timer->expires <= end) &&
+         ((p_next == NULL) || (p_timer->expires < p_next->expires)))
+      {
+        p_next = p_timer;
+      }
+    }
+
+    if(p_next == NULL)
+    {
+      break;
+    }
+
+    m_now = p_next->expires;
+    if(p_next->mode == APP_TIMER_MODE_REPEATED)
+    {
+      p_next->expires += p_next->period;
+    }
+    else
+    {
+      p_next->running = false;
+    }
+
+    p_next->handler(p_next->p_context);
+  }
+
+  m_now = end;
+}
@@ -0,0 +1,56 @@
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Host stand-in for app_timer on a simulated RTC: nothing fires on its own, the test moves the
+ * clock with app_timer_stub_advance() and the timers that expire run in order, from the caller.
+ */
+
+#define APP_TIMER_CLOCK_FREQ            32768
+#define APP_TIMER_CONFIG_RTC_FREQUENCY  0
+#define APP_TIMER_MIN_TIMEOUT_TICKS     5
+#define APP_TIMER_TICKS(MS)             ((uint32_t)((((uint64_t)(MS) * APP_TIMER_CLOCK_FREQ) + 500) / 1000))
+
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+
+typedef enum
+{
+  APP_TIMER_MODE_SINGLE_SHOT,
+  APP_TIMER_MODE_REPEATED,
+} app_timer_mode_t;
+
+typedef struct
+{
+  app_timer_timeout_handler_t handler;
+  app_timer_mode_t            mode;
+  void                        *p_context;
+  uint64_t                    expires;
+  uint32_t                    period;
+  bool                        running;
+} app_timer_t;
+
+typedef app_timer_t *app_timer_id_t;
+
+#define APP_TIMER_DEF(timer_id)                       \
+  static app_timer_t timer_id##_data;                 \
+  static app_timer_id_t const timer_id = &timer_id##_data
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler);
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context);
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+
+uint32_t app_timer_cnt_get(void);
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+/* Move the clock ticks forward, running the handlers of the timers that expire on the way */
+void app_timer_stub_advance(uint32_t ticks);
+
+#endif /* APP_TIMER_H__ */
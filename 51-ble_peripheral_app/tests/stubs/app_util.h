@@ -0,0 +1,13 @@
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+
+/* Host stand-in for the app_util.h helpers the modules use */
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define ARRAY_SIZE(arr)     (sizeof(arr) / sizeof((arr)[0]))
+#define STATIC_ASSERT(expr) _Static_assert(expr, #expr)
+
+#endif /* APP_UTIL_H__ */
@@ -0,0 +1,44 @@
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+/* Host stand-in: the Cortex-M4 SIMD intrinsics dsp_fixed.c uses, in plain C after their
+ * definitions in the Armv7-M Architecture Reference Manual. Built with __ARM_FEATURE_DSP
+ * defined, the test covers the SIMD code path of the kernels.
+ */
+
+/* Bottom half of val1, top half of val2 << val3 */
+static inline uint32_t __PKHBT(uint32_t val1, uint32_t val2, uint32_t val3)
+{
+  return (val1 & 0x0000FFFFu) | ((val2 << val3) & 0xFFFF0000u);
+}
+
+/* val3 + bottom * bottom + top * top, signed halfwords, 64 bit accumulate */
+static inline uint64_t __SMLALD(uint32_t val1, uint32_t val2, uint64_t val3)
+{
+  int64_t acc = (int64_t)val3;
+
+  acc += (int32_t)(int16_t)val1 * (int16_t)val2;
+  acc += (int32_t)(int16_t)(val1 >> 16) * (int16_t)(val2 >> 16);
+
+  return (uint64_t)acc;
+}
+
+/* bottom * bottom - top * top, signed halfwords */
+static inline uint32_t __SMUSD(uint32_t val1, uint32_t val2)
+{
+  return (uint32_t)(((int32_t)(int16_t)val1 * (int16_t)val2) -
+                    ((int32_t)(int16_t)(val1 >> 16) * (int16_t)(val2 >> 16)));
+}
+
+/* Signed saturation to sat bits */
+static inline int32_t __SSAT(int32_t val, uint32_t sat)
+{
+  int32_t max = (int32_t)((1u << (sat - 1)) - 1);
+  int32_t min = -max - 1;
+
+  return (val > max) ? max : ((val < min) ? min : val);
+}
+
+#endif /* __CMSIS_COMPILER_H */
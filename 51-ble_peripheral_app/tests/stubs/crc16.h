@@ -0,0 +1,10 @@
+#ifndef CRC16_H__
+#define CRC16_H__
+
+#include <stdint.h>
+
+/* Host stand-in, same CRC-16-CCITT as the SDK crc16.c (implemented in crc16.c here) */
+
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size, uint16_t const *p_crc);
+
+#endif /* CRC16_H__ */
@@ -0,0 +1,16 @@
+#ifndef NRF_LOG_H_
+#define NRF_LOG_H_
+
+/* Host stand-in: the module logs are not printed, the arguments are still evaluated */
+
+static inline void nrf_log_discard(char const *p_fmt, ...)
+{
+  (void)p_fmt;
+}
+
+#define NRF_LOG_ERROR(...)    nrf_log_discard(__VA_ARGS__)
+#define NRF_LOG_WARNING(...)  nrf_log_discard(__VA_ARGS__)
+#define NRF_LOG_INFO(...)     nrf_log_discard(__VA_ARGS__)
+#define NRF_LOG_DEBUG(...)    nrf_log_discard(__VA_ARGS__)
+
+#endif /* NRF_LOG_H_ */
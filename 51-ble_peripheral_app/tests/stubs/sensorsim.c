@@ -0,0 +1,37 @@
+#include "sensorsim.h"
+
+void sensorsim_init(sensorsim_state_t *p_state, sensorsim_cfg_t const *p_cfg)
+{
+  p_state->current_val = p_cfg->start_at_max ? p_cfg->max : p_cfg->min;
+  p_state->is_increasing = !p_cfg->start_at_max;
+}
+
+uint32_t sensorsim_measure(sensorsim_state_t *p_state, sensorsim_cfg_t const *p_cfg)
+{
+  if(p_state->is_increasing)
+  {
+    if((p_cfg->max - p_state->current_val) <= p_cfg->incr)
+    {
+      p_state->current_val = p_cfg->max;
+      p_state->is_increasing = false;
+    }
+    else
+    {
+      p_state->current_val += p_cfg->incr;
+    }
+  }
+  else
+  {
+    if((p_state->current_val - p_cfg->min) <= p_cfg->incr)
+    {
+      p_state->current_val = p_cfg->min;
+      p_state->is_increasing = true;
+    }
+    else
+    {
+      p_state->current_val -= p_cfg->incr;
+    }
+  }
+
+  return p_state->current_val;
+}
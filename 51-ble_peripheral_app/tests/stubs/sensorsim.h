@@ -0,0 +1,27 @@
+#ifndef SENSORSIM_H__
+#define SENSORSIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host stand-in, the same triangle wave as the SDK sensorsim.c (implemented in sensorsim.c here) */
+
+typedef struct
+{
+  uint32_t min;
+  uint32_t max;
+  uint32_t incr;
+  bool     start_at_max;
+} sensorsim_cfg_t;
+
+typedef struct
+{
+  uint32_t current_val;
+  bool     is_increasing;
+} sensorsim_state_t;
+
+void sensorsim_init(sensorsim_state_t *p_state, sensorsim_cfg_t const *p_cfg);
+
+uint32_t sensorsim_measure(sensorsim_state_t *p_state, sensorsim_cfg_t const *p_cfg);
+
+#endif /* SENSORSIM_H__ */
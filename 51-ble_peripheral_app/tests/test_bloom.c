@@ -0,0 +1,131 @@
+/* bloom: false positive rate and lookup cost at the scanner's sizing.
+ *
+ * 4096 tag addresses go into a 64 kbit filter with 6 hashes (SCANNER_FILTER_BITS/HASHES),
+ * keyed like the scanner does. One million other addresses measure the false positive rate
+ * against the bloom_fp_ppm() estimate (theory: ~0.094%). The per report cost is the one of a
+ * rejected report, which looks up both its address and its company id.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bloom.h"
+#include "test_util.h"
+
+#define FILTER_BITS     65536
+#define FILTER_HASHES   6
+#define TAGS            4096
+#define PROBES          1000000
+
+static uint32_t m_bits[FILTER_BITS / 32];
+static uint32_t m_rng = 1;
+
+static uint32_t rng_next(void)
+{
+  /* xorshift32 */
+  m_rng ^= m_rng << 13;
+  m_rng ^= m_rng >> 17;
+  m_rng ^= m_rng << 5;
+
+  return m_rng;
+}
+
+/* Scanner key: 'A' and the 6 byte address */
+static void addr_key(uint32_t seed, uint8_t *p_key)
+{
+  uint32_t lo = seed * 2654435761u;
+  uint32_t hi = (seed ^ 0x5BD1E995u) * 40503u;
+
+  p_key[0] = 'A';
+  memcpy(&p_key[1], &lo, 4);
+  memcpy(&p_key[5], &hi, 2);
+}
+
+static void test_basic(void)
+{
+  bloom_t bloom;
+  uint8_t key[7];
+
+  CHECK(!bloom_init(&bloom, m_bits, 1000, FILTER_HASHES));
+  CHECK(!bloom_init(&bloom, m_bits, 16, FILTER_HASHES));
+  CHECK(bloom_init(&bloom, m_bits, FILTER_BITS, FILTER_HASHES));
+  CHECK(bloom_fp_ppm(&bloom) == 0);
+
+  addr_key(1, key);
+  CHECK(!bloom_check(&bloom, key, sizeof(key)));
+  bloom_add(&bloom, key, sizeof(key));
+  CHECK(bloom_check(&bloom, key, sizeof(key)));
+  CHECK(bloom.key_count == 1);
+
+  bloom_clear(&bloom);
+  CHECK(bloom.key_count == 0);
+  CHECK(!bloom_check(&bloom, key, sizeof(key)));
+}
+
+static void test_fp_rate(void)
+{
+  bloom_t         bloom;
+  uint8_t         key[7];
+  uint8_t         company[3] = { 'C', 0, 0 };
+  uint32_t        false_pos = 0;
+  uint32_t        estimate_ppm = 0;
+  uint32_t        measured_ppm = 0;
+  struct timespec start;
+  struct timespec end;
+  double          elapsed_ns = 0;
+
+  CHECK(bloom_init(&bloom, m_bits, FILTER_BITS, FILTER_HASHES));
+
+  for(uint32_t i = 0; i < TAGS; i++)
+  {
+    addr_key(i, key);
+    bloom_add(&bloom, key, sizeof(key));
+  }
+
+  /* No false negatives */
+  for(uint32_t i = 0; i < TAGS; i++)
+  {
+    addr_key(i, key);
+    CHECK(bloom_check(&bloom, key, sizeof(key)));
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for(uint32_t i = 0; i < PROBES; i++)
+  {
+    uint32_t seed = TAGS + (rng_next() & 0x7FFFFFFF);
+
+    addr_key(seed, key);
+    company[1] = (uint8_t)seed;
+    company[2] = (uint8_t)(seed >> 8);
+
+    /* A report passes on either key, company ids are not in this filter */
+    if(bloom_check(&bloom, key, sizeof(key)) || bloom_check(&bloom, company, sizeof(company)))
+    {
+      false_pos++;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed_ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+
+  /* Two lookups per report */
+  estimate_ppm = bloom_fp_ppm(&bloom);
+  measured_ppm = (uint32_t)(((uint64_t)false_pos * 1000000) / (2 * (uint64_t)PROBES));
+
+  CHECK(measured_ppm < 2000);
+  CHECK((measured_ppm * 2 >= estimate_ppm) && (measured_ppm <= estimate_ppm * 2));
+
+  printf("fp: %u keys in %u bits, %u hashes\n", TAGS, FILTER_BITS, FILTER_HASHES);
+  printf("fp: %u ppm measured per lookup, %u ppm estimated by bloom_fp_ppm()\n",
+         measured_ppm, estimate_ppm);
+  printf("fp: %.1f ns per rejected report (2 lookups) on the host\n", elapsed_ns / PROBES);
+}
+
+int main(void)
+{
+  test_basic();
+  test_fp_rate();
+
+  return test_result("bloom");
+}
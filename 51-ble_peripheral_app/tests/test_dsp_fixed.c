@@ -0,0 +1,336 @@
+/* dsp_fixed: bit exactness of the kernels against naive references.
+ *
+ * Each kernel filters a noise stream with full scale extremes, cut into blocks of varying
+ * size, and must match a direct evaluation of its definition sample for sample. The Makefile
+ * builds this twice: plain C, and with __ARM_FEATURE_DSP and the emulated SIMD intrinsics of
+ * stubs/cmsis_compiler.h, so both code paths of the Cortex-M4 kernels are covered.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "app_util.h"
+#include "dsp_fixed.h"
+#include "test_util.h"
+
+#define SAMPLES     4000
+#define BLOCK_MAX   64
+#define TAPS        13
+#define DECIM       4
+#define RMS_WINDOW  64
+#define STAGES      2
+
+static int16_t m_in[SAMPLES];
+static int16_t m_out[SAMPLES];
+static int16_t m_ref[SAMPLES];
+static int32_t m_in31[SAMPLES];
+static int32_t m_out31[SAMPLES];
+static int32_t m_ref31[SAMPLES];
+
+static uint32_t m_rng = 3;
+
+static uint32_t rng_next(void)
+{
+  /* xorshift32 */
+  m_rng ^= m_rng << 13;
+  m_rng ^= m_rng >> 17;
+  m_rng ^= m_rng << 5;
+
+  return m_rng;
+}
+
+/* Block sizes cycle through odd and even lengths, multiples of DECIM for the decimator */
+static uint16_t block_len(uint32_t pos, uint16_t multiple)
+{
+  static uint16_t const lens[] = { 1, 7, 64, 2, 33, 16, 5, 48 };
+  uint16_t len = lens[(pos / 7) % ARRAY_SIZE(lens)];
+
+  len = ((len + multiple - 1) / multiple) * multiple;
+
+  return (uint16_t)MIN(len, SAMPLES - pos);
+}
+
+static int16_t sat16(int64_t value)
+{
+  return (value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : (int16_t)value);
+}
+
+static int32_t sat32(int64_t value)
+{
+  return (value > INT32_MAX) ? INT32_MAX : ((value < INT32_MIN) ? INT32_MIN : (int32_t)value);
+}
+
+static uint32_t mismatches16(void)
+{
+  uint32_t count = 0;
+
+  for(uint32_t i = 0; i < SAMPLES; i++)
+  {
+    count += (m_out[i] != m_ref[i]);
+  }
+
+  return count;
+}
+
+/* Coefficients are in time reversed order: h[TAPS - 1] weighs the newest sample */
+static void fir_q15_ref(int16_t const *p_h, uint16_t taps)
+{
+  for(int32_t n = 0; n < SAMPLES; n++)
+  {
+    int64_t acc = 0;
+
+    for(int32_t k = 0; k < taps; k++)
+    {
+      int32_t idx = n - (taps - 1) + k;
+
+      acc += (idx >= 0) ? ((int32_t)p_h[k] * m_in[idx]) : 0;
+    }
+
+    m_ref[n] = sat16(acc >> 15);
+  }
+}
+
+static void test_fir_q15(void)
+{
+  static int16_t h[TAPS];
+  static int16_t state[TAPS - 1 + BLOCK_MAX];
+  dsp_fir_q15_t  fir;
+
+  for(uint16_t k = 0; k < TAPS; k++)
+  {
+    h[k] = (int16_t)rng_next();
+  }
+  /* Full scale products, the saturation path */
+  h[0] = h[1] = h[2] = h[3] = INT16_MIN;
+
+  CHECK(!dsp_fir_q15_init(&fir, h, state, 0));
+  CHECK(dsp_fir_q15_init(&fir, h, state, TAPS));
+  for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, 1))
+  {
+    dsp_fir_q15(&fir, &m_in[pos], &m_out[pos], block_len(pos, 1));
+  }
+
+  fir_q15_ref(h, TAPS);
+  CHECK(mismatches16() == 0);
+
+  /* Decimation: every DECIM-th output of the same filter */
+  {
+    static int16_t  decim_state[TAPS - 1 + BLOCK_MAX];
+    dsp_decim_q15_t decim;
+    uint32_t        outputs = 0;
+    uint32_t        count = 0;
+
+    CHECK(!dsp_decim_q15_init(&decim, h, decim_state, TAPS, 0));
+    CHECK(dsp_decim_q15_init(&decim, h, decim_state, TAPS, DECIM));
+    for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, DECIM))
+    {
+      outputs += dsp_decim_q15(&decim, &m_in[pos], &m_out[outputs], block_len(pos, DECIM));
+    }
+
+    CHECK(outputs == (SAMPLES / DECIM));
+    for(uint32_t i = 0; i < outputs; i++)
+    {
+      count += (m_out[i] != m_ref[(i * DECIM) + DECIM - 1]);
+    }
+    CHECK(count == 0);
+  }
+}
+
+static void test_biquad_q15(void)
+{
+  /* {b0, b1, b2, a1, a2} per stage in Q14 (post_shift 1): low pass and band pass */
+  static int16_t const coeffs[STAGES * 5] =
+  {
+    4000, 8000, 4000, 25000, -12000,
+    3000, -6000, 3000, 20000, -9000,
+  };
+  int32_t          state[STAGES * 2];
+  dsp_biquad_q15_t iir;
+
+  CHECK(!dsp_biquad_q15_init(&iir, coeffs, state, STAGES, 4));
+  CHECK(dsp_biquad_q15_init(&iir, coeffs, state, STAGES, 1));
+  for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, 1))
+  {
+    dsp_biquad_q15(&iir, &m_in[pos], &m_out[pos], block_len(pos, 1));
+  }
+
+  memcpy(m_ref, m_in, sizeof(m_ref));
+  for(uint8_t stage = 0; stage < STAGES; stage++)
+  {
+    int16_t const *c = &coeffs[stage * 5];
+    int16_t       x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+
+    for(uint32_t n = 0; n < SAMPLES; n++)
+    {
+      int16_t x0 = m_ref[n];
+      int64_t acc = ((int64_t)c[0] * x0) + ((int64_t)c[1] * x1) + ((int64_t)c[2] * x2) +
+                    ((int64_t)c[3] * y1) + ((int64_t)c[4] * y2);
+
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = sat16(acc >> 14);
+      m_ref[n] = y1;
+    }
+  }
+
+  CHECK(mismatches16() == 0);
+}
+
+static void test_rms_q15(void)
+{
+  int16_t       history[RMS_WINDOW];
+  dsp_rms_q15_t rms;
+
+  CHECK(!dsp_rms_q15_init(&rms, history, 48));
+  CHECK(dsp_rms_q15_init(&rms, history, RMS_WINDOW));
+  for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, 1))
+  {
+    dsp_rms_q15(&rms, &m_in[pos], &m_out[pos], block_len(pos, 1));
+  }
+
+  for(int32_t n = 0; n < SAMPLES; n++)
+  {
+    uint64_t sum_sq = 0;
+    uint32_t mean_sq = 0;
+    uint32_t root = 0;
+
+    for(int32_t k = n - (RMS_WINDOW - 1); k <= n; k++)
+    {
+      sum_sq += (k >= 0) ? (uint64_t)((int32_t)m_in[k] * m_in[k]) : 0;
+    }
+
+    /* Floor of the square root, by search */
+    mean_sq = (uint32_t)(sum_sq / RMS_WINDOW);
+    while(((uint64_t)(root + 1) * (root + 1)) <= mean_sq)
+    {
+      root++;
+    }
+    m_ref[n] = (int16_t)MIN(root, INT16_MAX);
+  }
+
+  CHECK(mismatches16() == 0);
+  CHECK(dsp_rms_q15_get(&rms) == m_ref[SAMPLES - 1]);
+}
+
+static void test_fir_q31(void)
+{
+  static int32_t h[TAPS];
+  static int32_t state[TAPS - 1 + BLOCK_MAX];
+  dsp_fir_q31_t  fir;
+  uint32_t       count = 0;
+
+  /* Input scaled down by 4 bits, log2(TAPS) rounded up, as the header asks */
+  for(uint16_t k = 0; k < TAPS; k++)
+  {
+    h[k] = (int32_t)rng_next();
+  }
+  for(uint32_t i = 0; i < SAMPLES; i++)
+  {
+    m_in31[i] = (int32_t)rng_next() >> 4;
+  }
+
+  CHECK(dsp_fir_q31_init(&fir, h, state, TAPS));
+  for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, 1))
+  {
+    dsp_fir_q31(&fir, &m_in31[pos], &m_out31[pos], block_len(pos, 1));
+  }
+
+  for(int32_t n = 0; n < SAMPLES; n++)
+  {
+    int64_t acc = 0;
+
+    for(int32_t k = 0; k < TAPS; k++)
+    {
+      int32_t idx = n - (TAPS - 1) + k;
+
+      acc += (idx >= 0) ? ((int64_t)h[k] * m_in31[idx]) : 0;
+    }
+    m_ref31[n] = sat32(acc >> 31);
+    count += (m_out31[n] != m_ref31[n]);
+  }
+
+  CHECK(count == 0);
+}
+
+static void test_biquad_q31(void)
+{
+  /* The Q15 cascade, coefficients widened to Q30. The input is scaled down 2 more bits, so
+   * that the 5 products stay within the 64 bit accumulator at the low pass gain
+   */
+  static int32_t const coeffs[STAGES * 5] =
+  {
+    4000 * 65536, 8000 * 65536, 4000 * 65536, 25000 * 65536, -12000 * 65536,
+    3000 * 65536, -6000 * 65536, 3000 * 65536, 20000 * 65536, -9000 * 65536,
+  };
+  int32_t          state[STAGES * 4];
+  dsp_biquad_q31_t iir;
+  uint32_t         count = 0;
+
+  for(uint32_t i = 0; i < SAMPLES; i++)
+  {
+    m_in31[i] >>= 2;
+  }
+
+  CHECK(dsp_biquad_q31_init(&iir, coeffs, state, STAGES, 1));
+  for(uint32_t pos = 0; pos < SAMPLES; pos += block_len(pos, 1))
+  {
+    dsp_biquad_q31(&iir, &m_in31[pos], &m_out31[pos], block_len(pos, 1));
+  }
+
+  memcpy(m_ref31, m_in31, sizeof(m_ref31));
+  for(uint8_t stage = 0; stage < STAGES; stage++)
+  {
+    int32_t const *c = &coeffs[stage * 5];
+    int32_t       x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+
+    for(uint32_t n = 0; n < SAMPLES; n++)
+    {
+      int32_t x0 = m_ref31[n];
+      int64_t acc = ((int64_t)c[0] * x0) + ((int64_t)c[1] * x1) + ((int64_t)c[2] * x2) +
+                    ((int64_t)c[3] * y1) + ((int64_t)c[4] * y2);
+
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = sat32(acc >> 30);
+      m_ref31[n] = y1;
+    }
+  }
+
+  for(uint32_t n = 0; n < SAMPLES; n++)
+  {
+    count += (m_out31[n] != m_ref31[n]);
+  }
+
+  CHECK(count == 0);
+}
+
+int main(void)
+{
+  for(uint32_t i = 0; i < SAMPLES; i++)
+  {
+    m_in[i] = (int16_t)rng_next();
+  }
+  /* Runs of full scale samples */
+  for(uint32_t i = 100; i < 120; i++)
+  {
+    m_in[i] = INT16_MIN;
+    m_in[i + 200] = INT16_MAX;
+  }
+
+  test_fir_q15();
+  test_biquad_q15();
+  test_rms_q15();
+  test_fir_q31();
+  test_biquad_q31();
+
+  printf("%u samples per kernel, %s\n", SAMPLES,
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+         "SIMD intrinsics"
+#else
+         "plain C"
+#endif
+         );
+
+  return test_result("dsp_fixed");
+}
@@ -0,0 +1,297 @@
+/* lz_pack: round trip, compression ratio, throughput and RAM footprint.
+ *
+ * Each corpus is packed the way the black box download does it: 512 byte reads, blocks of at
+ * most 242 bytes (ATT MTU 247, minus the notification header and the u16 block length), one
+ * window over the whole stream. Corpora: black box pages of log records, erased flash, two
+ * channels of sensor samples raw and through the delta filter, and random bytes, the worst case.
+ * The raw samples do not compress, the noise is in every low byte; the delta filter is what
+ * makes them repeat. Blocks that do not shrink go out stored, as the download sends them.
+ *
+ * With a directory argument the black box and random streams are also written there, framed as
+ * sent (lz_blackbox.bin, lz_random.bin) and raw (.raw), for the cross-check with
+ * tools/lz_unpack.py.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "app_util.h"
+#include "lz_pack.h"
+#include "test_util.h"
+
+#define CORPUS_SIZE     32768
+#define READ_SIZE       512
+#define BLOCK_CAP       242
+#define PAGE_SIZE       4096
+#define REPEATS         20
+
+typedef struct
+{
+  char const *p_name;
+  double     ratio_min;     /* Input over framed output, at least. Just below the measured ratio */
+} corpus_t;
+
+static uint8_t  m_corpus[CORPUS_SIZE];
+static int16_t  m_values[CORPUS_SIZE / 2];
+static uint8_t  m_framed[CORPUS_SIZE * 2];
+static uint8_t  m_unpacked[CORPUS_SIZE];
+static size_t   m_framed_len = 0;
+static uint32_t m_stored = 0;         /* Stored blocks of the last pack() */
+static uint32_t m_rng = 1;
+
+static uint32_t rng_next(void)
+{
+  /* xorshift32 */
+  m_rng ^= m_rng << 13;
+  m_rng ^= m_rng >> 17;
+  m_rng ^= m_rng << 5;
+
+  return m_rng;
+}
+
+static double elapsed_s(struct timespec const *p_start, struct timespec const *p_end)
+{
+  return (double)(p_end->tv_sec - p_start->tv_sec) + ((double)(p_end->tv_nsec - p_start->tv_nsec) / 1e9);
+}
+
+static void word_put(uint8_t *p_dest, uint32_t value)
+{
+  memcpy(p_dest, &value, sizeof(value));
+}
+
+/* Pages of { magic, sequence } and NRF_LOG records, an erased tail on each */
+static void blackbox_pages(void)
+{
+  static uint32_t const formats[] = { 0x000312A0, 0x000312D8, 0x00031310, 0x00031344 };
+  uint16_t seq = 0;
+  uint32_t uptime = 1000;
+
+  memset(m_corpus, 0xFF, CORPUS_SIZE);
+
+  for(uint32_t page = 0; page < (CORPUS_SIZE / PAGE_SIZE); page++)
+  {
+    uint8_t  *p_page = &m_corpus[page * PAGE_SIZE];
+    uint32_t used = 8 + ((rng_next() % 3) * 1024) + 2048;   /* Filled 50 to 100 % */
+    uint32_t pos = 8;
+
+    word_put(&p_page[0], 0x31584242);
+    word_put(&p_page[4], page);
+
+    while((pos + 28) <= MIN(used, PAGE_SIZE))
+    {
+      uint32_t fmt = rng_next() % ARRAY_SIZE(formats);
+      uint32_t nargs = 1 + fmt;
+
+      /* { words, type, sequence } { uptime } { fmt } { module, severity, nargs } args */
+      word_put(&p_page[pos], (4 + nargs) | (0x01 << 8) | ((uint32_t)seq++ << 16));
+      word_put(&p_page[pos + 4], uptime += (rng_next() % 200));
+      word_put(&p_page[pos + 8], formats[fmt]);
+      word_put(&p_page[pos + 12], (7 << 16) | (3 << 8) | nargs);
+      for(uint32_t arg = 0; arg < nargs; arg++)
+      {
+        word_put(&p_page[pos + 16 + (arg * 4)], (arg == 0) ? (rng_next() % 3) : (uint32_t)(-50 - (int32_t)(rng_next() % 30)));
+      }
+      pos += (4 + nargs) * 4;
+    }
+  }
+}
+
+/* VDD near 3300 counts and a noisy triangle, interleaved int16 */
+static void samples(void)
+{
+  int32_t tri = 0;
+  int32_t dir = 41;
+
+  for(uint32_t i = 0; i < ARRAY_SIZE(m_values); i += 2)
+  {
+    m_values[i] = 3300 + (int16_t)((i / 2) % 230);
+
+    tri += dir;
+    if((tri > 4095) || (tri < 0))
+    {
+      dir = -dir;
+      tri += 2 * dir;
+    }
+    m_values[i + 1] = (int16_t)(tri + (int32_t)(rng_next() % 17) - 8);
+  }
+
+  memcpy(m_corpus, m_values, sizeof(m_values));
+}
+
+/* Pack the corpus into u16 length framed blocks, stored when they do not shrink */
+static size_t pack(void)
+{
+  lz_pack_t lz;
+  size_t    in = 0;
+
+  m_framed_len = 0;
+  m_stored = 0;
+  lz_pack_reset(&lz);
+
+  while(in < CORPUS_SIZE)
+  {
+    size_t   consumed = 0;
+    uint16_t frame_len = 0;
+    size_t   len = lz_pack(&lz, &m_corpus[in], MIN(READ_SIZE, CORPUS_SIZE - in), &consumed,
+                           &m_framed[m_framed_len + 2], BLOCK_CAP);
+
+    CHECK((len <= BLOCK_CAP) && (len <= LZ_PACK_BOUND(consumed)) && (consumed > 0));
+    if(consumed == 0)
+    {
+      break;
+    }
+
+    if(len >= consumed)
+    {
+      memcpy(&m_framed[m_framed_len + 2], &m_corpus[in], consumed);
+      len = consumed;
+      frame_len = (uint16_t)(len | LZ_PACK_FRAME_STORED);
+      m_stored++;
+    }
+    else
+    {
+      frame_len = (uint16_t)len;
+    }
+
+    m_framed[m_framed_len] = (uint8_t)frame_len;
+    m_framed[m_framed_len + 1] = (uint8_t)(frame_len >> 8);
+    m_framed_len += 2 + len;
+    in += consumed;
+  }
+
+  return m_framed_len;
+}
+
+static size_t unpack(bool *p_ok)
+{
+  lz_unpack_t lz;
+  size_t      pos = 0;
+  size_t      out = 0;
+
+  *p_ok = true;
+  lz_unpack_reset(&lz);
+
+  while(*p_ok && ((pos + 2) <= m_framed_len))
+  {
+    uint16_t frame_len = (uint16_t)(m_framed[pos] | (m_framed[pos + 1] << 8));
+    size_t   len = frame_len & ~LZ_PACK_FRAME_STORED;
+
+    if(frame_len & LZ_PACK_FRAME_STORED)
+    {
+      out += lz_unpack_stored(&lz, &m_framed[pos + 2], len, &m_unpacked[out], CORPUS_SIZE - out, p_ok);
+    }
+    else
+    {
+      out += lz_unpack(&lz, &m_framed[pos + 2], len, &m_unpacked[out], CORPUS_SIZE - out, p_ok);
+    }
+    pos += 2 + len;
+  }
+
+  return out;
+}
+
+static void run(corpus_t const *p_corpus)
+{
+  struct timespec start;
+  struct timespec end;
+  double          pack_s = 0;
+  double          unpack_s = 0;
+  size_t          packed = 0;
+  size_t          unpacked = 0;
+  bool            ok = false;
+  double          ratio = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(uint32_t i = 0; i < REPEATS; i++)
+  {
+    packed = pack();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pack_s = elapsed_s(&start, &end) / REPEATS;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(uint32_t i = 0; i < REPEATS; i++)
+  {
+    unpacked = unpack(&ok);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  unpack_s = elapsed_s(&start, &end) / REPEATS;
+
+  CHECK(ok);
+  CHECK(unpacked == CORPUS_SIZE);
+  CHECK(memcmp(m_unpacked, m_corpus, CORPUS_SIZE) == 0);
+
+  /* Framed size, as it goes over the air */
+  ratio = (double)CORPUS_SIZE / (double)packed;
+  CHECK(ratio >= p_corpus->ratio_min);
+
+  printf("%-16s %6u -> %6u bytes, ratio %5.2f, %3u stored, pack %6.1f MB/s, unpack %6.1f MB/s on the host\n",
+         p_corpus->p_name, CORPUS_SIZE, (unsigned int)packed, ratio, m_stored,
+         (CORPUS_SIZE / pack_s) / 1e6, (CORPUS_SIZE / unpack_s) / 1e6);
+}
+
+static bool file_write(char const *p_dir, char const *p_name, uint8_t const *p_data, size_t len)
+{
+  char path[256];
+  FILE *p_file = NULL;
+  bool ok = false;
+
+  snprintf(path, sizeof(path), "%s/%s", p_dir, p_name);
+  p_file = fopen(path, "wb");
+  if(p_file == NULL)
+  {
+    return false;
+  }
+
+  ok = (fwrite(p_data, 1, len, p_file) == len);
+
+  return (fclose(p_file) == 0) && ok;
+}
+
+int main(int argc, char **argv)
+{
+  /* Incompressible data goes out stored, it only grows by the block lengths */
+  static corpus_t const blackbox = { "black box pages", 1.6 };
+  static corpus_t const erased   = { "erased flash", 50.0 };
+  static corpus_t const raw      = { "samples", 0.98 };
+  static corpus_t const delta    = { "samples, delta", 1.4 };
+  static corpus_t const noise    = { "random", 0.98 };
+  lz_delta_t            filter;
+
+  blackbox_pages();
+  run(&blackbox);
+  if(argc > 1)
+  {
+    CHECK(file_write(argv[1], "lz_blackbox.bin", m_framed, m_framed_len));
+    CHECK(file_write(argv[1], "lz_blackbox.raw", m_corpus, CORPUS_SIZE));
+  }
+
+  memset(m_corpus, 0xFF, CORPUS_SIZE);
+  run(&erased);
+
+  samples();
+  run(&raw);
+
+  CHECK(lz_delta_reset(&filter, 2));
+  lz_delta_encode(&filter, m_values, ARRAY_SIZE(m_values));
+  memcpy(m_corpus, m_values, sizeof(m_values));
+  run(&delta);
+
+  for(uint32_t i = 0; i < CORPUS_SIZE; i++)
+  {
+    m_corpus[i] = (uint8_t)rng_next();
+  }
+  run(&noise);
+  CHECK(m_stored == ((m_framed_len - CORPUS_SIZE) / 2));   /* Every block */
+  if(argc > 1)
+  {
+    CHECK(file_write(argv[1], "lz_random.bin", m_framed, m_framed_len));
+    CHECK(file_write(argv[1], "lz_random.raw", m_corpus, CORPUS_SIZE));
+  }
+
+  printf("RAM: lz_pack_t %u bytes, lz_unpack_t %u bytes, lz_delta_t %u bytes\n",
+         (unsigned int)sizeof(lz_pack_t), (unsigned int)sizeof(lz_unpack_t), (unsigned int)sizeof(lz_delta_t));
+  CHECK(sizeof(lz_pack_t) <= 400);
+
+  return test_result("lz_pack");
+}
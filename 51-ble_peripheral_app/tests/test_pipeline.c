@@ -0,0 +1,544 @@
+/* Sample pipeline: a recorded trace through sample_source, a Q15 FIR and window_agg.
+ *
+ * The trace (traces/steps.csv) has the firmware's channel layout (VDD, AIN0) at 1 kHz. AIN0
+ * steps between three levels every 2 s, with a +-300 count ripple at half the sample rate on
+ * top. A 4 tap boxcar FIR, as the sink would run it, cancels the ripple; 1 s tumbling windows
+ * and the 350 / 3500 levels of the firmware then see clean steps. The pace timer runs on the
+ * simulated RTC of the app_timer stub.
+ *
+ * Checked: the trace file against the trace it was generated from, in CSV and binary, the
+ * source ends with the trace, the summaries against a naive filter and statistics, the
+ * threshold events of the three steps only, and the same output for another buffer size. The
+ * sensorsim waveforms of the firmware's simulated sampling (sim_source) go through the same
+ * pipeline. Each stage's throughput on the host is printed for both sources.
+ *
+ * With a trace file argument, that trace is run instead and its summaries printed. Trace files:
+ * - CSV: one sample set per line, the channels separated by commas. Lines not starting with a
+ *   number (comments, column names) are skipped.
+ * - Binary (.bin): interleaved int16 sample sets, little endian, in the firmware's layout.
+ * The sensor channel is AIN0, the second column, or the only one. Run from the tests directory,
+ * as make does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "dsp_fixed.h"
+#include "sample_source.h"
+#include "sim_source.h"
+#include "test_util.h"
+#include "trace_source.h"
+#include "window_agg.h"
+
+#define RATE_HZ         1000
+#define CHANNELS        2
+#define SENSOR_CHANNEL  1
+#define STEP_FRAMES     2000
+#define TRACE_FRAMES    (3 * STEP_FRAMES)
+#define RIPPLE          300
+#define WINDOW_LEN      1000
+#define WINDOWS         (TRACE_FRAMES / WINDOW_LEN)
+#define FIR_TAPS        4
+#define EVENTS_MAX      64
+
+#define TRACE_FILE          "traces/steps.csv"
+#define TRACE_FRAMES_MAX    100000
+#define TRACE_CHANNELS_MAX  SIM_SOURCE_CHANNELS_MAX
+#define BENCH_FRAMES        100
+#define BENCH_REPEATS       50
+
+typedef enum
+{
+  STAGE_SOURCE,
+  STAGE_DSP,
+  STAGE_WINDOW,
+  STAGE_COUNT,
+} stage_t;
+
+static int16_t const m_levels[] = { 1000, 3800, 200 };
+
+static int16_t  m_recorded[TRACE_FRAMES * CHANNELS];
+static int16_t  m_trace[TRACE_FRAMES_MAX * TRACE_CHANNELS_MAX];
+static uint32_t m_trace_frames = 0;
+static uint8_t  m_trace_channels = 0;
+static uint8_t  m_sensor_channel = SENSOR_CHANNEL;
+
+/* The firmware's simulated inputs (main.c): VDD around 3.0 V and a 0 to 3.6 V triangle on AIN0 */
+static sensorsim_cfg_t const m_sim_cfgs[CHANNELS] =
+{
+  { .min = 3300, .max = 3530, .incr = 1,  .start_at_max = false },
+  { .min = 0,    .max = 4095, .incr = 41, .start_at_max = false },
+};
+
+/* Boxcar, 0.25 per tap */
+static int16_t const m_fir_coeffs[FIR_TAPS] = { 8192, 8192, 8192, 8192 };
+static int16_t       m_fir_state[FIR_TAPS - 1 + (SAMPLE_SOURCE_BUFFER_SIZE / CHANNELS)];
+static dsp_fir_q15_t m_fir;
+
+static window_agg_config_t const m_window_config =
+{
+  .pane_len   = WINDOW_LEN,
+  .panes      = 1,
+  .outputs    = WINDOW_AGG_OUT_SUMMARY | WINDOW_AGG_OUT_EVENTS,
+  .hist_min   = 0,
+  .hist_max   = 4095,
+  .high       = 3500,
+  .low        = 350,
+  .hysteresis = 100,
+};
+static window_agg_t m_window_agg;
+
+static window_agg_summary_t m_summaries[WINDOWS + 1];
+static uint16_t             m_summary_count = 0;
+static window_agg_event_t   m_events[EVENTS_MAX];
+static uint16_t             m_event_count = 0;
+
+/* What traces/steps.csv was generated from */
+static void trace_record(void)
+{
+  for(uint32_t i = 0; i < TRACE_FRAMES; i++)
+  {
+    m_recorded[i * CHANNELS] = 3400;
+    m_recorded[(i * CHANNELS) + SENSOR_CHANNEL] = m_levels[i / STEP_FRAMES] + ((i & 1) ? RIPPLE : -RIPPLE);
+  }
+}
+
+static bool trace_csv_read(FILE *p_file)
+{
+  char     line[128];
+  uint32_t len = 0;
+
+  while(fgets(line, sizeof(line), p_file) != NULL)
+  {
+    char    *p_pos = line;
+    uint8_t channels = 0;
+
+    if((line[0] != '-') && ((line[0] < '0') || (line[0] > '9')))
+    {
+      continue;
+    }
+
+    while(true)
+    {
+      char *p_end = NULL;
+      long value = strtol(p_pos, &p_end, 10);
+
+      if((p_end == p_pos) || (value < INT16_MIN) || (value > INT16_MAX) ||
+         (channels >= TRACE_CHANNELS_MAX) || (len >= ARRAY_SIZE(m_trace)))
+      {
+        return false;
+      }
+
+      m_trace[len++] = (int16_t)value;
+      channels++;
+
+      if(*p_end != ',')
+      {
+        break;
+      }
+      p_pos = p_end + 1;
+    }
+
+    if(m_trace_channels == 0)
+    {
+      m_trace_channels = channels;
+    }
+    else if(channels != m_trace_channels)
+    {
+      return false;
+    }
+    m_trace_frames++;
+  }
+
+  return (m_trace_frames > 0);
+}
+
+static bool trace_bin_read(FILE *p_file)
+{
+  uint8_t  bytes[2];
+  uint32_t len = 0;
+
+  while(fread(bytes, 1, sizeof(bytes), p_file) == sizeof(bytes))
+  {
+    if(len >= (TRACE_FRAMES_MAX * CHANNELS))
+    {
+      return false;
+    }
+    m_trace[len++] = (int16_t)(bytes[0] | (bytes[1] << 8));
+  }
+
+  m_trace_channels = CHANNELS;
+  m_trace_frames = len / CHANNELS;
+
+  return (m_trace_frames > 0) && ((len % CHANNELS) == 0) && feof(p_file);
+}
+
+/* Into m_trace, CSV or binary by the file name */
+static bool trace_load(char const *p_path)
+{
+  FILE   *p_file = fopen(p_path, "rb");
+  size_t len = strlen(p_path);
+  bool   ok = false;
+
+  if(p_file == NULL)
+  {
+    printf("%s: can not open\n", p_path);
+    return false;
+  }
+
+  m_trace_frames = 0;
+  m_trace_channels = 0;
+
+  ok = ((len > 4) && (strcmp(&p_path[len - 4], ".bin") == 0)) ? trace_bin_read(p_file) : trace_csv_read(p_file);
+  (void)fclose(p_file);
+
+  m_sensor_channel = (m_trace_channels > 1) ? SENSOR_CHANNEL : 0;
+
+  return ok;
+}
+
+static double elapsed_s(struct timespec const *p_start, struct timespec const *p_end)
+{
+  return (double)(p_end->tv_sec - p_start->tv_sec) + ((double)(p_end->tv_nsec - p_start->tv_nsec) / 1e9);
+}
+
+static void summary_handler(window_agg_summary_t const *p_summary, void *p_context)
+{
+  if(m_summary_count < ARRAY_SIZE(m_summaries))
+  {
+    m_summaries[m_summary_count] = *p_summary;
+  }
+  m_summary_count++;
+}
+
+static void event_handler(window_agg_event_t const *p_event, void *p_context)
+{
+  if(m_event_count < ARRAY_SIZE(m_events))
+  {
+    m_events[m_event_count] = *p_event;
+  }
+  m_event_count++;
+}
+
+/* The sink: one channel out of the interleaved buffer, filtered, into the windows */
+static void pipeline_sink(int16_t const *p_samples, uint16_t frames, uint8_t channel_count)
+{
+  int16_t channel[SAMPLE_SOURCE_BUFFER_SIZE];
+  int16_t filtered[SAMPLE_SOURCE_BUFFER_SIZE];
+
+  for(uint16_t i = 0; i < frames; i++)
+  {
+    channel[i] = p_samples[(i * channel_count) + m_sensor_channel];
+  }
+
+  dsp_fir_q15(&m_fir, channel, filtered, frames);
+  window_agg_put(&m_window_agg, filtered, frames, 1);
+}
+
+static void pipeline_reset(void)
+{
+  m_summary_count = 0;
+  m_event_count = 0;
+  CHECK(dsp_fir_q15_init(&m_fir, m_fir_coeffs, m_fir_state, FIR_TAPS));
+  CHECK(window_agg_init(&m_window_agg, &m_window_config, summary_handler, event_handler, NULL));
+}
+
+static sample_source_t const *trace_select(void)
+{
+  trace_source_init_t trace_init = {0};
+
+  trace_init.p_samples = m_trace;
+  trace_init.frame_count = m_trace_frames;
+  trace_init.channel_count = m_trace_channels;
+  trace_init.loop = false;
+
+  return trace_source_init(&trace_init);
+}
+
+static sample_source_t const *sim_select(void)
+{
+  sim_source_init_t sim_init = {0};
+
+  sim_init.p_cfgs = m_sim_cfgs;
+  sim_init.channel_count = ARRAY_SIZE(m_sim_cfgs);
+  sim_init.noise = 8;
+  sim_init.seed = 1;
+
+  return sim_source_init(&sim_init);
+}
+
+/* frame_count sample sets through the pace timer. A source that ends must stop itself with the
+ * next buffer, the others are stopped
+ */
+static void pipeline_run(sample_source_t const *p_source, uint16_t frames, uint32_t frame_count, bool ends)
+{
+  sample_source_init_t  init = {0};
+  sample_source_stats_t stats = {0};
+  uint32_t              buffers = (frame_count + frames - 1) / frames;
+
+  init.p_source = p_source;
+  init.sink = pipeline_sink;
+  init.rate_hz = RATE_HZ;
+  init.frames = frames;
+
+  pipeline_reset();
+
+  CHECK(init.p_source != NULL);
+  CHECK(sample_source_select(&init) == NRF_SUCCESS);
+  CHECK(sample_source_start() == NRF_SUCCESS);
+
+  app_timer_stub_advance(APP_TIMER_TICKS((frames * 1000) / RATE_HZ) * buffers);
+  if(ends)
+  {
+    app_timer_stub_advance(APP_TIMER_TICKS((frames * 1000) / RATE_HZ));
+    CHECK(!sample_source_is_running());
+  }
+  sample_source_stop();
+
+  sample_source_stats_get(&stats);
+  CHECK(stats.frames == frame_count);
+  CHECK(stats.buffers == buffers);
+}
+
+/* Each stage on its own clock, over the whole run BENCH_REPEATS times */
+static void pipeline_bench(sample_source_t const *p_source, uint32_t frame_count)
+{
+  static int16_t  buffer[SAMPLE_SOURCE_BUFFER_SIZE];
+  int16_t         channel[BENCH_FRAMES];
+  int16_t         filtered[BENCH_FRAMES];
+  double          stage_s[STAGE_COUNT] = {0};
+  struct timespec times[STAGE_COUNT + 1];
+
+  STATIC_ASSERT((BENCH_FRAMES * TRACE_CHANNELS_MAX) <= SAMPLE_SOURCE_BUFFER_SIZE);
+
+  for(uint32_t repeat = 0; repeat < BENCH_REPEATS; repeat++)
+  {
+    uint32_t done = 0;
+
+    trace_source_rewind();
+    pipeline_reset();
+
+    while(done < frame_count)
+    {
+      uint16_t frames = 0;
+
+      clock_gettime(CLOCK_MONOTONIC, &times[STAGE_SOURCE]);
+      frames = p_source->fill(buffer, (uint16_t)MIN(BENCH_FRAMES, frame_count - done));
+      clock_gettime(CLOCK_MONOTONIC, &times[STAGE_DSP]);
+      if(frames == 0)
+      {
+        break;
+      }
+
+      for(uint16_t i = 0; i < frames; i++)
+      {
+        channel[i] = buffer[(i * p_source->channel_count) + m_sensor_channel];
+      }
+      dsp_fir_q15(&m_fir, channel, filtered, frames);
+      clock_gettime(CLOCK_MONOTONIC, &times[STAGE_WINDOW]);
+
+      window_agg_put(&m_window_agg, filtered, frames, 1);
+      clock_gettime(CLOCK_MONOTONIC, &times[STAGE_COUNT]);
+
+      for(uint8_t stage = 0; stage < STAGE_COUNT; stage++)
+      {
+        stage_s[stage] += elapsed_s(&times[stage], &times[stage + 1]);
+      }
+      done += frames;
+    }
+  }
+
+  /* Sample sets per second: all channels from the source, the sensor channel after it */
+  printf("%-6s source %7.1f, DSP %7.1f, window_agg %7.1f M sample sets/s on the host\n", p_source->p_name,
+         ((double)frame_count * BENCH_REPEATS / stage_s[STAGE_SOURCE]) / 1e6,
+         ((double)frame_count * BENCH_REPEATS / stage_s[STAGE_DSP]) / 1e6,
+         ((double)frame_count * BENCH_REPEATS / stage_s[STAGE_WINDOW]) / 1e6);
+}
+
+/* Naive filter and statistics, straight from the definitions */
+static void test_summaries(void)
+{
+  int32_t filtered[TRACE_FRAMES];
+
+  for(int32_t i = 0; i < TRACE_FRAMES; i++)
+  {
+    int32_t sum = 0;
+
+    for(int32_t k = 0; k < FIR_TAPS; k++)
+    {
+      sum += ((i - k) >= 0) ? m_recorded[((i - k) * CHANNELS) + SENSOR_CHANNEL] : 0;
+    }
+    filtered[i] = sum / FIR_TAPS;
+  }
+
+  CHECK(m_summary_count == WINDOWS);
+
+  for(uint16_t w = 0; (w < WINDOWS) && (w < m_summary_count); w++)
+  {
+    window_agg_summary_t const *p_summary = &m_summaries[w];
+    int32_t const              *p_window = &filtered[w * WINDOW_LEN];
+    int32_t                    min = INT16_MAX;
+    int32_t                    max = INT16_MIN;
+    double                     mean = 0;
+    double                     variance = 0;
+
+    for(uint16_t i = 0; i < WINDOW_LEN; i++)
+    {
+      min = (p_window[i] < min) ? p_window[i] : min;
+      max = (p_window[i] > max) ? p_window[i] : max;
+      mean += p_window[i];
+    }
+    mean /= WINDOW_LEN;
+
+    for(uint16_t i = 0; i < WINDOW_LEN; i++)
+    {
+      variance += (p_window[i] - mean) * (p_window[i] - mean);
+    }
+    variance /= WINDOW_LEN;
+
+    CHECK(p_summary->seq == w);
+    CHECK(p_summary->count == WINDOW_LEN);
+    CHECK(p_summary->min == min);
+    CHECK(p_summary->max == max);
+    CHECK(p_summary->mean == (int16_t)mean);
+    CHECK(abs((int32_t)p_summary->variance - (int32_t)variance) <= 1);
+
+    /* The ripple is gone: all but the first three samples of a window sit on the level */
+    CHECK(abs(p_summary->p50 - m_levels[(w * WINDOW_LEN) / STEP_FRAMES]) <= (4096 / WINDOW_AGG_BINS));
+
+    printf("window %u: min %d, max %d, mean %d, variance %u, p50 %d\n", w, p_summary->min, p_summary->max,
+           p_summary->mean, (unsigned int)p_summary->variance, p_summary->p50);
+  }
+}
+
+/* One event per step. The raw ripple alone would cross the low level on every sample of the 200 step */
+static void test_events(void)
+{
+  static window_agg_event_t const expected[] =
+  {
+    { .sample = 0,                     .value = 175,  .level = WINDOW_AGG_LEVEL_LOW },   /* FIR state filling */
+    { .sample = 1,                     .value = 500,  .level = WINDOW_AGG_LEVEL_NORMAL },
+    { .sample = STEP_FRAMES + 3,       .value = 3800, .level = WINDOW_AGG_LEVEL_HIGH },
+    { .sample = 2 * STEP_FRAMES,       .value = 2900, .level = WINDOW_AGG_LEVEL_NORMAL },
+    { .sample = (2 * STEP_FRAMES) + 3, .value = 200,  .level = WINDOW_AGG_LEVEL_LOW },
+  };
+
+  CHECK(m_event_count == ARRAY_SIZE(expected));
+
+  for(uint16_t i = 0; (i < ARRAY_SIZE(expected)) && (i < m_event_count); i++)
+  {
+    CHECK(m_events[i].sample == expected[i].sample);
+    CHECK(m_events[i].value == expected[i].value);
+    CHECK(m_events[i].level == expected[i].level);
+  }
+}
+
+/* The file trace and the binary form of it read back the recorded trace */
+static void test_trace_files(void)
+{
+  char path[] = "_build/steps.bin";
+  FILE *p_file = NULL;
+
+  CHECK(trace_load(TRACE_FILE));
+  CHECK((m_trace_frames == TRACE_FRAMES) && (m_trace_channels == CHANNELS));
+  CHECK(memcmp(m_trace, m_recorded, sizeof(m_recorded)) == 0);
+
+  p_file = fopen(path, "wb");
+  CHECK(p_file != NULL);
+  if(p_file != NULL)
+  {
+    for(uint32_t i = 0; i < ARRAY_SIZE(m_recorded); i++)
+    {
+      uint8_t bytes[2] = { (uint8_t)m_recorded[i], (uint8_t)((uint16_t)m_recorded[i] >> 8) };
+
+      CHECK(fwrite(bytes, 1, sizeof(bytes), p_file) == sizeof(bytes));
+    }
+    CHECK(fclose(p_file) == 0);
+  }
+
+  memset(m_trace, 0, sizeof(m_trace));
+  CHECK(trace_load(path));
+  CHECK((m_trace_frames == TRACE_FRAMES) && (m_trace_channels == CHANNELS));
+  CHECK(memcmp(m_trace, m_recorded, sizeof(m_recorded)) == 0);
+}
+
+/* The triangle on AIN0 sweeps the whole range in every window, 200 samples a period */
+static void test_sim(void)
+{
+  sample_source_t const *p_source = sim_select();
+
+  m_sensor_channel = SENSOR_CHANNEL;
+  pipeline_run(p_source, 100, TRACE_FRAMES, false);
+
+  CHECK(m_summary_count == WINDOWS);
+  for(uint16_t w = 0; (w < WINDOWS) && (w < m_summary_count); w++)
+  {
+    CHECK(m_summaries[w].min < 100);
+    CHECK(m_summaries[w].max > 4000);
+    CHECK(abs(m_summaries[w].mean - 2048) < 100);
+  }
+
+  pipeline_bench(p_source, TRACE_FRAMES);
+}
+
+/* A trace from the command line: its summaries and the stage throughput, nothing checked */
+static int trace_file_run(char const *p_path)
+{
+  if(!trace_load(p_path))
+  {
+    printf("%s: not a trace\n", p_path);
+    return 1;
+  }
+
+  printf("%s: %u sample sets, %u channels\n", p_path, (unsigned int)m_trace_frames, m_trace_channels);
+
+  pipeline_run(trace_select(), 100, m_trace_frames, true);
+  for(uint16_t w = 0; (w < m_summary_count) && (w < ARRAY_SIZE(m_summaries)); w++)
+  {
+    printf("window %u: min %d, max %d, mean %d, variance %u, p50 %d\n", w, m_summaries[w].min,
+           m_summaries[w].max, m_summaries[w].mean, (unsigned int)m_summaries[w].variance, m_summaries[w].p50);
+  }
+  printf("%u threshold events\n", m_event_count);
+
+  pipeline_bench(trace_select(), m_trace_frames);
+
+  return test_result("pipeline");
+}
+
+int main(int argc, char **argv)
+{
+  window_agg_summary_t summaries[WINDOWS];
+  window_agg_event_t   events[ARRAY_SIZE(m_events)];
+  uint16_t             event_count = 0;
+
+  if(argc > 1)
+  {
+    return trace_file_run(argv[1]);
+  }
+
+  trace_record();
+  test_trace_files();
+
+  pipeline_run(trace_select(), 100, TRACE_FRAMES, true);
+  test_summaries();
+  test_events();
+
+  /* State carries over between buffers: 96 frames, the trace cut elsewhere, same output */
+  memcpy(summaries, m_summaries, sizeof(summaries));
+  memcpy(events, m_events, sizeof(events));
+  event_count = m_event_count;
+
+  pipeline_run(trace_select(), 96, TRACE_FRAMES, true);
+  CHECK(m_summary_count == WINDOWS);
+  CHECK(memcmp(summaries, m_summaries, sizeof(summaries)) == 0);
+  CHECK(m_event_count == event_count);
+  CHECK(memcmp(events, m_events, sizeof(events)) == 0);
+
+  pipeline_bench(trace_select(), TRACE_FRAMES);
+  test_sim();
+
+  return test_result("pipeline");
+}
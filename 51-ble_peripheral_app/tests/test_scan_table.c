@@ -0,0 +1,184 @@
+/* scan_table: dedup behaviour and a replay of a busy scan.
+ *
+ * The replay feeds 1,500 advertisements per second for a minute from a population where half
+ * of the advertisers roll their payload on every advertisement (counters, rotating beacons)
+ * and a tenth change address every 15 s (resolvable private addresses).
+ * The table must hold one entry per advertiser, never drop, and the per report cost is printed.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "scan_table.h"
+#include "test_util.h"
+
+#define TABLE_SIZE        256
+#define ADVERTISERS       150
+#define REPLAY_RATE       1500      /* Advertisements per second */
+#define REPLAY_SECONDS    60
+#define BATCH_PERIOD_MS   100
+#define EXPIRE_PERIOD_MS  1000
+#define MAX_AGE_MS        5000
+
+static scan_entry_t m_entries[TABLE_SIZE];
+static scan_entry_t m_batch[32];
+
+static void addr_make(uint32_t id, uint8_t *p_addr)
+{
+  for(uint8_t i = 0; i < SCAN_TABLE_ADDR_LEN; i++)
+  {
+    p_addr[i] = (uint8_t)((id * 2654435761u) >> (i * 4));
+  }
+  p_addr[0] = (uint8_t)id;
+  p_addr[1] = (uint8_t)(id >> 8);
+}
+
+static void test_dedup(void)
+{
+  scan_table_t table;
+  uint8_t      addr[SCAN_TABLE_ADDR_LEN];
+  uint16_t     count = 0;
+
+  CHECK(scan_table_init(&table, m_entries, TABLE_SIZE));
+  CHECK(!scan_table_init(&table, m_entries, 100));
+
+  addr_make(1, addr);
+  CHECK(scan_table_put(&table, addr, 0, 0x1111, -60, 0) == SCAN_TABLE_NEW);
+  CHECK(scan_table_put(&table, addr, 0, 0x1111, -50, 10) == SCAN_TABLE_DUPLICATE);
+  CHECK(scan_table_put(&table, addr, 1, 0x1111, -50, 10) == SCAN_TABLE_NEW);
+  CHECK(table.used == 2);
+
+  count = scan_table_dirty_get(&table, m_batch, 32);
+  CHECK(count == 2);
+  CHECK(scan_table_dirty_get(&table, m_batch, 32) == 0);
+
+  /* A changed payload replaces the entry: same slot count, dirty again, aggregate restarted */
+  CHECK(scan_table_put(&table, addr, 0, 0x2222, -70, 20) == SCAN_TABLE_REPLACED);
+  CHECK(table.used == 2);
+  CHECK(table.stats.replaced == 1);
+  count = scan_table_dirty_get(&table, m_batch, 32);
+  CHECK(count == 1);
+  CHECK(m_batch[0].payload_hash == 0x2222);
+  CHECK(m_batch[0].count == 1);
+  CHECK(scan_table_rssi_avg(&m_batch[0]) == -70);
+  CHECK(m_batch[0].first_seen == 20);
+
+  /* The other address type is still there and expires first */
+  CHECK(scan_table_expire(&table, 21, 5) == 1);
+  CHECK(table.used == 1);
+  CHECK(scan_table_put(&table, addr, 0, 0x2222, -70, 21) == SCAN_TABLE_DUPLICATE);
+}
+
+static void test_full(void)
+{
+  scan_table_t table;
+  uint8_t      addr[SCAN_TABLE_ADDR_LEN];
+  uint32_t     id = 0;
+
+  CHECK(scan_table_init(&table, m_entries, 16));
+
+  for(id = 0; id < 12; id++)
+  {
+    addr_make(id, addr);
+    CHECK(scan_table_put(&table, addr, 0, id, -40, 0) == SCAN_TABLE_NEW);
+  }
+
+  addr_make(id, addr);
+  CHECK(scan_table_put(&table, addr, 0, id, -40, 0) == SCAN_TABLE_FULL);
+
+  /* Known advertisers are still updated at the load limit */
+  addr_make(3, addr);
+  CHECK(scan_table_put(&table, addr, 0, 99, -40, 1) == SCAN_TABLE_REPLACED);
+
+  /* Every remaining entry is still found after the deletions shifted the probe runs */
+  CHECK(scan_table_expire(&table, 10, 9) == 11);
+  CHECK(scan_table_put(&table, addr, 0, 99, -40, 11) == SCAN_TABLE_DUPLICATE);
+  CHECK(table.used == 1);
+}
+
+static void test_replay(void)
+{
+  scan_table_t    table;
+  uint8_t         addr[SCAN_TABLE_ADDR_LEN];
+  uint8_t         payload[31];
+  uint32_t        rolling[ADVERTISERS] = {0};
+  uint32_t        reports = REPLAY_RATE * REPLAY_SECONDS;
+  uint32_t        rng = 12345;
+  uint32_t        forwarded = 0;
+  uint16_t        peak = 0;
+  struct timespec start;
+  struct timespec end;
+  double          elapsed_ns = 0;
+
+  CHECK(scan_table_init(&table, m_entries, TABLE_SIZE));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for(uint32_t i = 0; i < reports; i++)
+  {
+    uint32_t now = (uint32_t)(((uint64_t)i * 1000) / REPLAY_RATE);
+    uint32_t adv = 0;
+    uint32_t id = 0;
+
+    rng = rng * 1664525u + 1013904223u;
+    adv = (rng >> 8) % ADVERTISERS;
+
+    /* A tenth of the population rotates its address every 15 s of replay */
+    id = adv;
+    if((adv % 10) == 0)
+    {
+      id += (now / 15000) * ADVERTISERS;
+    }
+    addr_make(id, addr);
+
+    memset(payload, (int)adv, sizeof(payload));
+    if((adv % 2) == 0)
+    {
+      /* Rolling counter in the payload */
+      memcpy(payload, &rolling[adv], sizeof(rolling[adv]));
+      rolling[adv]++;
+    }
+
+    CHECK(scan_table_put(&table, addr, 0, scan_table_payload_hash(payload, sizeof(payload)),
+                         (int8_t)(-40 - (int8_t)(rng & 0x1F)), now) != SCAN_TABLE_FULL);
+
+    if(table.used > peak)
+    {
+      peak = table.used;
+    }
+
+    if(((i * 1000) % (REPLAY_RATE * BATCH_PERIOD_MS)) == 0)
+    {
+      forwarded += scan_table_dirty_get(&table, m_batch, 32);
+    }
+
+    if(((i * 1000) % (REPLAY_RATE * EXPIRE_PERIOD_MS)) == 0)
+    {
+      (void)scan_table_expire(&table, now, MAX_AGE_MS);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed_ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+
+  /* Only the rotated addresses of the last period can add to the population */
+  CHECK(peak <= ADVERTISERS + (ADVERTISERS / 10));
+  CHECK(table.stats.dropped == 0);
+
+  printf("replay: %u reports at %u/s, %u advertisers, peak %u entries of %u\n",
+         reports, REPLAY_RATE, ADVERTISERS, peak, TABLE_SIZE);
+  printf("replay: %u new, %u changed, %u duplicates, %u expired, %u forwarded\n",
+         table.stats.inserted, table.stats.replaced, table.stats.duplicates,
+         table.stats.expired, forwarded);
+  printf("replay: %.0f ns per report on the host (incl. payload hash and batching)\n",
+         elapsed_ns / reports);
+}
+
+int main(void)
+{
+  test_dedup();
+  test_full();
+  test_replay();
+
+  return test_result("scan_table");
+}
@@ -0,0 +1,286 @@
+/* ts_store on the RAM flash backend: round trip, wrap, reboot and torn writes, and the cost.
+ *
+ * A day of a slow sensor (one point every 10 s, a few counts of noise) goes into 4 pages, the oldest drop out.
+ * Reported: compression against 8 byte raw points, the flash writes and host time per append,
+ * and the flash bytes read and host time of a one hour query at the end of the day.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "radio_sched.h"
+#include "test_util.h"
+#include "ts_flash_ram.h"
+#include "ts_store.h"
+
+#define PAGES           4
+#define REGION_START    0x000F0000
+#define REGION_SIZE     (PAGES * TS_STORE_PAGE_SIZE)
+#define POINT_PERIOD_S  10
+#define DAY_S           86400
+#define JOBS_MAX        RADIO_SCHED_QUEUE_SIZE
+
+static uint8_t m_flash[REGION_SIZE];
+
+/* radio_sched stand-in: jobs run when the test says the radio is idle */
+static radio_sched_job_t m_jobs[JOBS_MAX];
+static void              *m_job_contexts[JOBS_MAX];
+static uint8_t           m_job_count = 0;
+
+ret_code_t radio_sched_job_put(radio_sched_job_t job, void *p_context)
+{
+  if(m_job_count >= JOBS_MAX)
+  {
+    return NRF_ERROR_NO_MEM;
+  }
+
+  m_jobs[m_job_count] = job;
+  m_job_contexts[m_job_count] = p_context;
+  m_job_count++;
+
+  return NRF_SUCCESS;
+}
+
+/* One radio gap: the queued jobs run. False if there were none */
+static bool jobs_run(void)
+{
+  bool ran = (m_job_count > 0);
+
+  while(m_job_count > 0)
+  {
+    radio_sched_job_t job = m_jobs[0];
+    void              *p_context = m_job_contexts[0];
+
+    m_job_count--;
+    memmove(&m_jobs[0], &m_jobs[1], m_job_count * sizeof(m_jobs[0]));
+    memmove(&m_job_contexts[0], &m_job_contexts[1], m_job_count * sizeof(m_job_contexts[0]));
+    job(p_context);
+  }
+
+  return ran;
+}
+
+/* Radio gaps and flash completions until nothing is left to do */
+static void idle_run(void)
+{
+  bool busy = true;
+
+  while(busy)
+  {
+    busy = ts_flash_ram_process();
+    busy = jobs_run() || busy;
+  }
+}
+
+static int32_t value_at(uint32_t t)
+{
+  uint32_t noise = (t * 2654435761u) >> 29;   /* 0 - 7 */
+
+  return 2000 + (int32_t)lround(300.0 * sin((double)t / 3600.0)) + (int32_t)noise - 4;
+}
+
+static double elapsed_ns(struct timespec const *p_start)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (double)(end.tv_sec - p_start->tv_sec) * 1e9 + (double)(end.tv_nsec - p_start->tv_nsec);
+}
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t t_prev;
+  uint32_t errors;
+} query_check_t;
+
+static bool query_handler(uint32_t t, int32_t v, void *p_context)
+{
+  query_check_t *p_check = p_context;
+
+  if(((p_check->count > 0) && (t <= p_check->t_prev)) || (v != value_at(t)))
+  {
+    p_check->errors++;
+  }
+
+  p_check->t_prev = t;
+  p_check->count++;
+
+  return true;
+}
+
+static uint32_t query_count(uint32_t t_from, uint32_t t_to, uint32_t *p_errors)
+{
+  query_check_t check = {0};
+  uint32_t      found = ts_store_query(t_from, t_to, query_handler, &check);
+
+  CHECK(found == check.count);
+  *p_errors = check.errors;
+
+  return found;
+}
+
+static ts_flash_t const *store_init(void)
+{
+  ts_store_init_t init = {0};
+
+  init.p_flash = ts_flash_ram_init(m_flash, REGION_START, REGION_SIZE);
+  init.end_addr = REGION_START + REGION_SIZE;
+  init.pages = PAGES;
+
+  CHECK(ts_store_init(&init) == NRF_SUCCESS);
+
+  return init.p_flash;
+}
+
+static uint32_t append_run(uint32_t t, uint32_t points)
+{
+  for(uint32_t i = 0; i < points; i++)
+  {
+    t += POINT_PERIOD_S;
+    CHECK(ts_store_append(t, value_at(t)) == NRF_SUCCESS);
+    idle_run();
+  }
+
+  return t;
+}
+
+static void test_day(void)
+{
+  ts_store_init_t      init = {0};
+  ts_store_stats_t     stats;
+  ts_flash_ram_stats_t flash;
+  struct timespec      start;
+  double               append_ns = 0;
+  double               query_ns = 0;
+  uint32_t             t = 0;
+  uint32_t             errors = 0;
+  uint32_t             found = 0;
+  uint32_t             points = DAY_S / POINT_PERIOD_S;
+
+  /* Erased flash, and the invalid arguments first */
+  memset(m_flash, 0xFF, sizeof(m_flash));
+  init.p_flash = ts_flash_ram_init(m_flash, REGION_START, REGION_SIZE);
+  init.end_addr = REGION_START + REGION_SIZE + 1;
+  init.pages = PAGES;
+  CHECK(ts_store_init(&init) == NRF_ERROR_INVALID_PARAM);
+  init.p_flash = NULL;
+  init.end_addr = REGION_START + REGION_SIZE;
+  CHECK(ts_store_init(&init) == NRF_ERROR_INVALID_PARAM);
+
+  (void)store_init();
+  CHECK(ts_store_last_time_get() == 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  t = append_run(0, points);
+  append_ns = elapsed_ns(&start);
+
+  ts_store_stats_get(&stats);
+  ts_flash_ram_stats_get(&flash);
+
+  CHECK(stats.points == points);
+  CHECK(stats.dropped == 0);
+  CHECK(stats.write_errors == 0);
+  CHECK(ts_store_append(t - 1, 0) == NRF_ERROR_INVALID_PARAM);
+
+  printf("day: %u points in %u blocks, %u stored in %u slots, %u erases\n",
+         stats.points, stats.blocks, stats.stored_blocks, PAGES * (TS_STORE_PAGE_SIZE / TS_STORE_BLOCK_SIZE),
+         stats.erases);
+  printf("day: %.2f bytes per point, %.2f x smaller than 8 byte raw points\n",
+         (double)(stats.blocks * TS_STORE_BLOCK_SIZE) / stats.points,
+         (8.0 * stats.points) / (double)(stats.blocks * TS_STORE_BLOCK_SIZE));
+  printf("append: %.0f ns per point on the host, %.3f flash writes and %.4f erases per point\n",
+         append_ns / points, (double)flash.writes / points, (double)flash.erases / points);
+
+  /* The region holds less than the day, the oldest pages are gone */
+  found = query_count(0, UINT32_MAX, &errors);
+  CHECK(errors == 0);
+  CHECK(found > 0);
+  CHECK(found < points);
+
+  /* Last hour */
+  ts_flash_ram_stats_clear();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  found = query_count(t - 3600 + 1, t, &errors);
+  query_ns = elapsed_ns(&start);
+  ts_flash_ram_stats_get(&flash);
+
+  CHECK(errors == 0);
+  CHECK(found == 3600 / POINT_PERIOD_S);
+
+  printf("query: last hour, %u points in %.1f us on the host, %u flash reads of %u bytes\n",
+         found, query_ns / 1000, flash.reads, flash.read_bytes);
+}
+
+static void test_reboot(void)
+{
+  uint32_t t_before = ts_store_last_time_get();
+  uint32_t errors = 0;
+  uint32_t t = 0;
+  uint32_t found = 0;
+
+  /* The block being filled is lost, the written ones are found again */
+  ts_store_flush();
+  idle_run();
+  found = query_count(0, UINT32_MAX, &errors);
+
+  (void)store_init();
+  CHECK(ts_store_last_time_get() == t_before);
+  CHECK(query_count(0, UINT32_MAX, &errors) == found);
+  CHECK(errors == 0);
+
+  t = append_run(ts_store_last_time_get(), 100);
+  CHECK(query_count(t - 99 * POINT_PERIOD_S, t, &errors) == 100);
+  CHECK(errors == 0);
+}
+
+static void test_torn_write(void)
+{
+  ts_store_stats_t stats;
+  uint32_t         t = 0;
+  uint32_t         t_written = 0;
+  uint32_t         errors = 0;
+
+  /* Fill until a block write is started, then cut the power in the middle of it */
+  ts_store_flush();
+  idle_run();
+  t_written = ts_store_last_time_get();
+  t = t_written;
+
+  for(;;)
+  {
+    t += POINT_PERIOD_S;
+    CHECK(ts_store_append(t, value_at(t)) == NRF_SUCCESS);
+
+    if(jobs_run())
+    {
+      /* The write (or the erase before it) is started */
+      ts_flash_ram_power_cut();
+      break;
+    }
+  }
+
+  /* Back up: the torn block fails its CRC, the store goes on after the last good one */
+  (void)store_init();
+  CHECK(ts_store_last_time_get() >= t_written);
+  CHECK(ts_store_last_time_get() < t);
+
+  t = append_run(ts_store_last_time_get(), 2000);
+  ts_store_stats_get(&stats);
+  CHECK(stats.write_errors == 0);
+  CHECK(query_count(0, UINT32_MAX, &errors) > 0);
+  CHECK(errors == 0);
+  CHECK(query_count(t - 999 * POINT_PERIOD_S, t, &errors) == 1000);
+  CHECK(errors == 0);
+}
+
+int main(void)
+{
+  test_day();
+  test_reboot();
+  test_torn_write();
+
+  return test_result("ts_store");
+}
@@ -0,0 +1,32 @@
+#ifndef _TEST_UTIL_H
+#define _TEST_UTIL_H
+
+#include <stdio.h>
+
+/* Minimal checks for the host tests. Failures are reported and counted, the test goes on */
+
+static unsigned int m_test_failures = 0;
+
+#define CHECK(cond)                                                     \
+  do                                                                    \
+  {                                                                     \
+    if(!(cond))                                                         \
+    {                                                                   \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+      m_test_failures++;                                                \
+    }                                                                   \
+  } while(0)
+
+static inline int test_result(char const *p_name)
+{
+  if(m_test_failures > 0)
+  {
+    printf("%s: %u checks failed\n", p_name, m_test_failures);
+    return 1;
+  }
+
+  printf("%s: passed\n", p_name);
+  return 0;
+}
+
+#endif /* _TEST_UTIL_H */
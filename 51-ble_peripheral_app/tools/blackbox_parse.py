@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Print the records of a black box download (see blackbox.h).
+
+    blackbox_parse.py [--lz] dump.bin [firmware.elf]
+
+dump.bin is the data characteristic payload, concatenated. --lz: the download was started with
+BLACKBOX_CTRL_START_LZ, the payload is decompressed first (lz_unpack.py). With the ELF the
+NRF_LOG records are formatted (format strings and module names are read from it, pyelftools is
+needed), without it their raw words are printed.
+"""
+
+import re
+import struct
+import sys
+
+import lz_unpack
+
+PAGE_SIZE = 4096
+PAGE_MAGIC = 0x31584242
+
+REC_LOG = 0x01
+REC_HEXDUMP = 0x02
+REC_BOOT = 0x03
+REC_FAULT = 0x04
+REC_APP = 0x10
+
+SEVERITY = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+RESETREAS = [(0x1, "pin"), (0x2, "watchdog"), (0x4, "soft reset"), (0x8, "lockup"),
+             (0x10000, "system off (GPIO)"), (0x20000, "system off (LPCOMP)"),
+             (0x40000, "debug interface"), (0x80000, "system off (NFC)"), (0x100000, "VBUS")]
+
+FMT_SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[hlzjt]*([diouxXcsp%])")
+
+
+class Elf:
+    """Strings in flash and NRF_LOG module names"""
+
+    def __init__(self, path):
+        from elftools.elf.elffile import ELFFile
+
+        self._file = open(path, "rb")
+        self._elf = ELFFile(self._file)
+        self._sections = [s for s in self._elf.iter_sections() if s["sh_addr"] and s["sh_type"] == "SHT_PROGBITS"]
+        self._modules = self._load_modules()
+
+    def _read(self, addr, size):
+        for section in self._sections:
+            start = section["sh_addr"]
+            if start <= addr < start + section["sh_size"]:
+                return section.data()[addr - start:addr - start + size]
+        return None
+
+    def string(self, addr):
+        data = self._read(addr, 256)
+        if data is None:
+            return None
+        return data.split(b"\0", 1)[0].decode("ascii", "replace")
+
+    def _load_modules(self):
+        # The module const data entries are sorted by name, the module id is the index
+        section = self._elf.get_section_by_name(".log_const_data")
+        symtab = self._elf.get_section_by_name(".symtab")
+        modules = {}
+        if section is None or symtab is None:
+            return modules
+        start = section["sh_addr"]
+        for sym in symtab.iter_symbols():
+            value, size = sym["st_value"], sym["st_size"]
+            if size and start <= value < start + section["sh_size"]:
+                ptr = struct.unpack_from("<I", section.data(), value - start)[0]
+                modules[(value - start) // size] = self.string(ptr)
+        return modules
+
+    def module(self, module_id):
+        return self._modules.get(module_id, "module %d" % module_id)
+
+
+def format_log(elf, fmt_addr, args):
+    fmt = elf.string(fmt_addr) if elf else None
+    if fmt is None:
+        return "fmt 0x%06X args %s" % (fmt_addr, " ".join("0x%X" % a for a in args))
+
+    values = iter(args)
+
+    def conv(match):
+        spec = match.group(0)
+        kind = match.group(1)
+        if kind == "%":
+            return "%"
+        value = next(values, 0)
+        if kind == "s":
+            return elf.string(value) or "<0x%X>" % value
+        if kind == "c":
+            return chr(value & 0xFF)
+        if kind == "p":
+            return "0x%08X" % value
+        if kind in "di" and value & 0x80000000:
+            value -= 1 << 32
+        spec = re.sub(r"[hlzjt]+", "", spec).replace("u", "d").replace("i", "d")
+        return spec % value
+
+    return FMT_SPEC.sub(conv, fmt)
+
+
+def reset_reason(value):
+    names = [name for bit, name in RESETREAS if value & bit]
+    return ", ".join(names) if names else "power on"
+
+
+def record_text(elf, rec_type, words, payload):
+    if rec_type == REC_LOG and len(words) >= 2:
+        nargs = words[1] & 0xFF
+        severity = (words[1] >> 8) & 0xFF
+        module = elf.module(words[1] >> 16) if elf else "module %d" % (words[1] >> 16)
+        text = format_log(elf, words[0], words[2:2 + nargs])
+        return "<%s> %s: %s" % (SEVERITY.get(severity, "?"), module, text)
+    if rec_type == REC_HEXDUMP and len(words) >= 2:
+        module = elf.module(words[0] >> 16) if elf else "module %d" % (words[0] >> 16)
+        return "hexdump %s: %s" % (module, payload[8:8 + words[1]].hex(" "))
+    if rec_type == REC_BOOT and len(words) >= 3:
+        return "boot %d, reset: %s, %d words recovered from RAM" % (words[1], reset_reason(words[0]), words[2])
+    if rec_type == REC_FAULT and len(words) >= 3:
+        return "FAULT id 0x%X pc 0x%08X info 0x%X" % tuple(words[:3])
+    return "type 0x%02X: %s" % (rec_type, payload.hex(" "))
+
+
+def parse(data, elf):
+    for page_start in range(0, len(data) - PAGE_SIZE + 1, PAGE_SIZE):
+        magic, seq = struct.unpack_from("<II", data, page_start)
+        if magic != PAGE_MAGIC:
+            print("page at 0x%X: no header" % page_start)
+            continue
+        print("--- page %d" % seq)
+
+        off = page_start + 8
+        end = page_start + PAGE_SIZE
+        while off + 8 <= end:
+            header, uptime = struct.unpack_from("<II", data, off)
+            count = header & 0xFF
+            if count == 0xFF:
+                break
+            if count < 2 or off + count * 4 > end:
+                print("torn record, rest of the page skipped")
+                break
+            payload = data[off + 8:off + count * 4]
+            words = list(struct.unpack_from("<%dI" % (count - 2), payload))
+            rec_type = (header >> 8) & 0xFF
+            print("%10.3f #%05d %s" % (uptime / 1000.0, header >> 16, record_text(elf, rec_type, words, payload)))
+            off += count * 4
+
+
+def main():
+    args = sys.argv[1:]
+    compressed = "--lz" in args
+    if compressed:
+        args.remove("--lz")
+
+    if len(args) not in (1, 2):
+        print(__doc__)
+        return 1
+
+    with open(args[0], "rb") as f:
+        data = f.read()
+
+    if compressed:
+        data = lz_unpack.unpack_framed(data)
+
+    elf = Elf(args[1]) if len(args) == 2 else None
+    parse(data, elf)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Decompress lz_pack blocks (see lz_pack.h).
+
+    lz_unpack.py framed.bin out.bin [--delta CHANNELS]
+
+framed.bin is a sequence of blocks, each with a u16 little endian length in front, as sent by
+the black box download with BLACKBOX_CTRL_START_LZ. The top bit of the length marks a stored
+block, its bytes as they are. --delta undoes the lz_delta filter over interleaved int16
+channels.
+
+As a library: Unpacker().unpack(block), or Unpacker().stored(block) for a stored block, for each
+block in order, delta_decode() for the filter.
+"""
+
+import struct
+import sys
+
+WINDOW = 256
+MATCH_MIN = 3
+FRAME_STORED = 0x8000
+
+
+class Unpacker:
+    """Decoder state, the window spans blocks"""
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self._history = bytearray()
+
+    def unpack(self, block):
+        out = bytearray()
+        i = 0
+
+        while i < len(block):
+            flags = block[i]
+            i += 1
+            for bit in range(8):
+                if i >= len(block):
+                    break
+                if flags & (1 << bit):
+                    if i + 2 > len(block):
+                        raise ValueError("truncated match")
+                    dist = block[i] + 1
+                    length = block[i + 1] + MATCH_MIN
+                    i += 2
+                    if dist > len(self._history):
+                        raise ValueError("match before the start of the stream")
+                    for _ in range(length):
+                        self._history.append(self._history[-dist])
+                        out.append(self._history[-1])
+                else:
+                    self._history.append(block[i])
+                    out.append(block[i])
+                    i += 1
+            del self._history[:-WINDOW]
+
+        return bytes(out)
+
+    def stored(self, block):
+        self._history += block
+        del self._history[:-WINDOW]
+
+        return bytes(block)
+
+
+def frames(data):
+    """(block, stored) of a u16 length framed stream"""
+    i = 0
+    while i + 2 <= len(data):
+        (length,) = struct.unpack_from("<H", data, i)
+        stored = bool(length & FRAME_STORED)
+        length &= ~FRAME_STORED
+        i += 2
+        if i + length > len(data):
+            raise ValueError("truncated block at %d" % (i - 2))
+        yield data[i:i + length], stored
+        i += length
+
+
+def unpack_framed(data):
+    unpacker = Unpacker()
+    return b"".join(unpacker.stored(block) if stored else unpacker.unpack(block)
+                    for block, stored in frames(data))
+
+
+def delta_decode(data, channels):
+    """Zig-zag deltas per channel back to int16 values, as bytes"""
+    codes = struct.unpack("<%dH" % (len(data) // 2), data[:len(data) & ~1])
+    prev = [0] * channels
+    values = []
+
+    for i, code in enumerate(codes):
+        delta = (code >> 1) ^ -(code & 1)
+        value = (prev[i % channels] + delta + 0x8000) % 0x10000 - 0x8000
+        prev[i % channels] = value
+        values.append(value)
+
+    return struct.pack("<%dh" % len(values), *values)
+
+
+def main():
+    args = sys.argv[1:]
+    channels = 0
+
+    if "--delta" in args:
+        at = args.index("--delta")
+        channels = int(args[at + 1])
+        del args[at:at + 2]
+
+    if len(args) != 2:
+        print(__doc__)
+        return 1
+
+    with open(args[0], "rb") as f:
+        data = unpack_framed(f.read())
+
+    if channels:
+        data = delta_decode(data, channels)
+
+    with open(args[1], "wb") as f:
+        f.write(data)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
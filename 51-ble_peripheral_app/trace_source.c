@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include "trace_source.h"
+
+static trace_source_init_t m_trace;
+static uint32_t            m_pos = 0;
+
+static uint16_t trace_fill(int16_t *p_samples, uint16_t frames);
+
+static sample_source_t m_source =
+{
+  .p_name = "trace",
+  .fill   = trace_fill,
+};
+
+static uint16_t trace_fill(int16_t *p_samples, uint16_t frames)
+{
+  uint16_t written = 0;
+
+  while(written < frames)
+  {
+    uint32_t chunk;
+
+    if(m_pos == m_trace.frame_count)
+    {
+      if(!m_trace.loop)
+      {
+        break;
+      }
+      m_pos = 0;
+    }
+
+    chunk = m_trace.frame_count - m_pos;
+    if(chunk > (uint32_t)(frames - written))
+    {
+      chunk = frames - written;
+    }
+
+    memcpy(&p_samples[written * m_trace.channel_count], &m_trace.p_samples[m_pos * m_trace.channel_count],
+           chunk * m_trace.channel_count * sizeof(int16_t));
+    m_pos += chunk;
+    written += chunk;
+  }
+
+  return written;
+}
+
+sample_source_t const *trace_source_init(trace_source_init_t const *p_init)
+{
+  if((p_init->p_samples == NULL) || (p_init->frame_count == 0) || (p_init->channel_count == 0))
+  {
+    return NULL;
+  }
+
+  m_trace = *p_init;
+  m_pos = 0;
+  m_source.channel_count = p_init->channel_count;
+
+  return &m_source;
+}
+
+void trace_source_rewind(void)
+{
+  m_pos = 0;
+}
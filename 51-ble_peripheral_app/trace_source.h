@@ -0,0 +1,27 @@
+#ifndef _TRACE_SOURCE_H
+#define _TRACE_SOURCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sample_source.h"
+
+/* Sample source replaying a recorded trace: interleaved int16 sample sets in RAM or flash,
+ * e.g. a capture from the SAADC source converted to a C array. Replays once or in a loop.
+ */
+
+typedef struct
+{
+  int16_t const *p_samples;
+  uint32_t      frame_count;
+  uint8_t       channel_count;
+  bool          loop;
+} trace_source_init_t;
+
+/* Returns the source for sample_source_select(), NULL on a bad configuration */
+sample_source_t const *trace_source_init(trace_source_init_t const *p_init);
+
+/* Back to the first sample set */
+void trace_source_rewind(void);
+
+#endif /* _TRACE_SOURCE_H */
@@ -0,0 +1,125 @@
+#include "ts_codec.h"
+
+uint8_t ts_varint_put(uint8_t *p_buf, uint32_t value)
+{
+  uint8_t len = 0;
+
+  while(value >= 0x80)
+  {
+    p_buf[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  p_buf[len++] = (uint8_t)value;
+
+  return len;
+}
+
+uint8_t ts_varint_get(uint8_t const *p_buf, uint16_t len, uint32_t *p_value)
+{
+  uint32_t value = 0;
+
+  for(uint8_t i = 0; (i < 5) && (i < len); i++)
+  {
+    value |= (uint32_t)(p_buf[i] & 0x7F) << (7 * i);
+    if((p_buf[i] & 0x80) == 0)
+    {
+      *p_value = value;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+void ts_encoder_init(ts_encoder_t *p_enc, uint8_t *p_buf, uint16_t size, uint32_t t, int32_t v)
+{
+  p_enc->p_buf = p_buf;
+  p_enc->size = size;
+  p_enc->len = 0;
+  p_enc->count = 1;
+  p_enc->t_prev = t;
+  p_enc->dt_prev = 0;
+  p_enc->v_prev = v;
+}
+
+bool ts_encode(ts_encoder_t *p_enc, uint32_t t, int32_t v)
+{
+  uint8_t  point[TS_CODEC_POINT_MAX];
+  uint8_t  len = 0;
+  uint32_t dt = t - p_enc->t_prev;
+
+  /* Differences wrap in 32 bits, the decoder wraps the same way */
+  len = ts_varint_put(point, ts_zigzag_encode((int32_t)(dt - p_enc->dt_prev)));
+  len += ts_varint_put(&point[len], ts_zigzag_encode((int32_t)((uint32_t)v - (uint32_t)p_enc->v_prev)));
+
+  if((p_enc->len + len) > p_enc->size)
+  {
+    return false;
+  }
+
+  for(uint8_t i = 0; i < len; i++)
+  {
+    p_enc->p_buf[p_enc->len++] = point[i];
+  }
+
+  p_enc->count++;
+  p_enc->t_prev = t;
+  p_enc->dt_prev = dt;
+  p_enc->v_prev = v;
+
+  return true;
+}
+
+void ts_decoder_init(ts_decoder_t *p_dec, uint8_t const *p_buf, uint16_t len, uint16_t count,
+                     uint32_t t_first, int32_t v_first)
+{
+  p_dec->p_buf = p_buf;
+  p_dec->len = len;
+  p_dec->pos = 0;
+  p_dec->remaining = count;
+  p_dec->t_prev = t_first;
+  p_dec->dt_prev = 0;
+  p_dec->v_prev = v_first;
+  p_dec->first = true;
+}
+
+bool ts_decode(ts_decoder_t *p_dec, uint32_t *p_t, int32_t *p_v)
+{
+  uint32_t dod = 0;
+  uint32_t dv = 0;
+  uint8_t  used = 0;
+
+  if(p_dec->remaining == 0)
+  {
+    return false;
+  }
+
+  if(!p_dec->first)
+  {
+    used = ts_varint_get(&p_dec->p_buf[p_dec->pos], p_dec->len - p_dec->pos, &dod);
+    if(used == 0)
+    {
+      return false;
+    }
+    p_dec->pos += used;
+
+    used = ts_varint_get(&p_dec->p_buf[p_dec->pos], p_dec->len - p_dec->pos, &dv);
+    if(used == 0)
+    {
+      return false;
+    }
+    p_dec->pos += used;
+
+    p_dec->dt_prev += (uint32_t)ts_zigzag_decode(dod);
+    p_dec->t_prev += p_dec->dt_prev;
+    p_dec->v_prev = (int32_t)((uint32_t)p_dec->v_prev + (uint32_t)ts_zigzag_decode(dv));
+  }
+
+  p_dec->first = false;
+  p_dec->remaining--;
+
+  *p_t = p_dec->t_prev;
+  *p_v = p_dec->v_prev;
+
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef _TS_CODEC_H
+#define _TS_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Delta encoding of (time, value) points into a byte buffer.
+ *
+ * The first point of a block is kept by the caller (block header). Each following point is
+ * two zig-zag varints: the change of the time step (delta of delta, 0 for a regular sample
+ * rate) and the value delta. A slowly changing reading at a fixed rate takes 2 bytes instead
+ * of 8, 10 bytes at worst.
+ *
+ * No SDK dependencies, the codec can be built and exercised on a host.
+ */
+
+#define TS_CODEC_POINT_MAX  10    /* Encoded size of a point at worst */
+
+typedef struct
+{
+  uint8_t  *p_buf;
+  uint16_t size;
+  uint16_t len;           /* Bytes used */
+  uint16_t count;         /* Points, including the first */
+  uint32_t t_prev;
+  uint32_t dt_prev;
+  int32_t  v_prev;
+} ts_encoder_t;
+
+typedef struct
+{
+  uint8_t const *p_buf;
+  uint16_t      len;
+  uint16_t      pos;
+  uint16_t      remaining;  /* Points not returned yet */
+  bool          first;      /* Next point is the first one, from the header */
+  uint32_t      t_prev;
+  uint32_t      dt_prev;
+  int32_t       v_prev;
+} ts_decoder_t;
+
+static inline uint32_t ts_zigzag_encode(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t ts_zigzag_decode(uint32_t value)
+{
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/* Varint, 7 bits per byte, low bits first. Returns the bytes written (1 - 5) */
+uint8_t ts_varint_put(uint8_t *p_buf, uint32_t value);
+
+/* Returns the bytes read, 0 if the varint runs past len or is longer than 5 bytes */
+uint8_t ts_varint_get(uint8_t const *p_buf, uint16_t len, uint32_t *p_value);
+
+/* Start a block with its first point */
+void ts_encoder_init(ts_encoder_t *p_enc, uint8_t *p_buf, uint16_t size, uint32_t t, int32_t v);
+
+/* Append a point. False if it does not fit, the block is then unchanged */
+bool ts_encode(ts_encoder_t *p_enc, uint32_t t, int32_t v);
+
+/* count: points in the block, including the first (t_first, v_first) */
+void ts_decoder_init(ts_decoder_t *p_dec, uint8_t const *p_buf, uint16_t len, uint16_t count,
+                     uint32_t t_first, int32_t v_first);
+
+/* Next point, the first one included. False at the end or on corrupt data */
+bool ts_decode(ts_decoder_t *p_dec, uint32_t *p_t, int32_t *p_v);
+
+#endif /* _TS_CODEC_H */
@@ -0,0 +1,59 @@
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+
+#include "ts_flash_fs.h"
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_fs) =
+{
+  .evt_handler = fstorage_evt_handler,
+};
+
+static ts_flash_done_t m_done = NULL;
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt)
+{
+  if(m_done != NULL)
+  {
+    m_done(p_evt->result);
+  }
+}
+
+static ret_code_t fs_init(uint32_t start_addr, uint32_t end_addr, ts_flash_done_t done)
+{
+  m_fs.start_addr = start_addr;
+  m_fs.end_addr = end_addr;
+  m_done = done;
+
+  return nrf_fstorage_init(&m_fs, &nrf_fstorage_sd, NULL);
+}
+
+static ret_code_t fs_read(uint32_t addr, void *p_dest, uint32_t len)
+{
+  return nrf_fstorage_read(&m_fs, addr, p_dest, len);
+}
+
+static ret_code_t fs_write(uint32_t addr, void const *p_src, uint32_t len)
+{
+  return nrf_fstorage_write(&m_fs, addr, p_src, len, NULL);
+}
+
+static ret_code_t fs_erase(uint32_t page_addr)
+{
+  return nrf_fstorage_erase(&m_fs, page_addr, 1, NULL);
+}
+
+static const ts_flash_t m_flash =
+{
+  .p_name = "fstorage",
+  .init = fs_init,
+  .read = fs_read,
+  .write = fs_write,
+  .erase = fs_erase,
+};
+
+ts_flash_t const *ts_flash_fs_get(void)
+{
+  return &m_flash;
+}
@@ -0,0 +1,13 @@
+#ifndef _TS_FLASH_FS_H
+#define _TS_FLASH_FS_H
+
+#include "ts_store.h"
+
+/* Time series flash backend on nrf_fstorage_sd: internal flash, operations scheduled around
+ * the radio activity by the SoftDevice. Reads go straight to the memory mapped flash.
+ */
+
+/* Returns the backend for ts_store_init_t.p_flash */
+ts_flash_t const *ts_flash_fs_get(void);
+
+#endif /* _TS_FLASH_FS_H */
@@ -0,0 +1,190 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "ts_flash_ram.h"
+
+typedef enum
+{
+  OP_NONE,
+  OP_WRITE,
+  OP_ERASE,
+} op_t;
+
+static uint8_t         *mp_mem = NULL;
+static uint32_t        m_base = 0;
+static uint32_t        m_size = 0;
+static ts_flash_done_t m_done = NULL;
+
+/* One operation at a time, like the store issues them */
+static op_t            m_op = OP_NONE;
+static uint32_t        m_op_addr = 0;
+static uint8_t const   *mp_op_src = NULL;
+static uint32_t        m_op_len = 0;
+
+static ts_flash_ram_stats_t m_stats;
+
+static bool range_valid(uint32_t addr, uint32_t len)
+{
+  return (addr >= m_base) && (len <= m_size) && ((addr - m_base) <= (m_size - len));
+}
+
+static ret_code_t ram_init(uint32_t start_addr, uint32_t end_addr, ts_flash_done_t done)
+{
+  if((end_addr < start_addr) || !range_valid(start_addr, end_addr - start_addr))
+  {
+    return NRF_ERROR_INVALID_ADDR;
+  }
+
+  m_done = done;
+  m_op = OP_NONE;
+
+  return NRF_SUCCESS;
+}
+
+static ret_code_t ram_read(uint32_t addr, void *p_dest, uint32_t len)
+{
+  if(!range_valid(addr, len))
+  {
+    return NRF_ERROR_INVALID_ADDR;
+  }
+
+  memcpy(p_dest, &mp_mem[addr - m_base], len);
+  m_stats.reads++;
+  m_stats.read_bytes += len;
+
+  return NRF_SUCCESS;
+}
+
+static ret_code_t ram_write(uint32_t addr, void const *p_src, uint32_t len)
+{
+  if(!range_valid(addr, len) || ((addr % 4) != 0) || ((len % 4) != 0))
+  {
+    return NRF_ERROR_INVALID_ADDR;
+  }
+
+  if(m_op != OP_NONE)
+  {
+    return NRF_ERROR_BUSY;
+  }
+
+  /* The source must stay valid until completion, as for fstorage */
+  m_op = OP_WRITE;
+  m_op_addr = addr;
+  mp_op_src = p_src;
+  m_op_len = len;
+
+  return NRF_SUCCESS;
+}
+
+static ret_code_t ram_erase(uint32_t page_addr)
+{
+  if(!range_valid(page_addr, TS_STORE_PAGE_SIZE) || (((page_addr - m_base) % TS_STORE_PAGE_SIZE) != 0))
+  {
+    return NRF_ERROR_INVALID_ADDR;
+  }
+
+  if(m_op != OP_NONE)
+  {
+    return NRF_ERROR_BUSY;
+  }
+
+  m_op = OP_ERASE;
+  m_op_addr = page_addr;
+  m_op_len = TS_STORE_PAGE_SIZE;
+
+  return NRF_SUCCESS;
+}
+
+/* Carry out the first len bytes of the pending operation */
+static void op_apply(uint32_t len)
+{
+  uint8_t *p_dest = &mp_mem[m_op_addr - m_base];
+
+  if(m_op == OP_WRITE)
+  {
+    for(uint32_t i = 0; i < len; i++)
+    {
+      p_dest[i] &= mp_op_src[i];
+    }
+  }
+  else
+  {
+    memset(p_dest, 0xFF, len);
+  }
+}
+
+static const ts_flash_t m_flash =
+{
+  .p_name = "ram",
+  .init = ram_init,
+  .read = ram_read,
+  .write = ram_write,
+  .erase = ram_erase,
+};
+
+ts_flash_t const *ts_flash_ram_init(uint8_t *p_mem, uint32_t start_addr, uint32_t size)
+{
+  if(p_mem == NULL)
+  {
+    return NULL;
+  }
+
+  mp_mem = p_mem;
+  m_base = start_addr;
+  m_size = size;
+  m_op = OP_NONE;
+  memset(&m_stats, 0, sizeof(m_stats));
+
+  return &m_flash;
+}
+
+bool ts_flash_ram_process(void)
+{
+  op_t op = m_op;
+
+  if(op == OP_NONE)
+  {
+    return false;
+  }
+
+  op_apply(m_op_len);
+
+  if(op == OP_WRITE)
+  {
+    m_stats.writes++;
+    m_stats.write_bytes += m_op_len;
+  }
+  else
+  {
+    m_stats.erases++;
+  }
+
+  /* Free before the report, the handler may start the next operation */
+  m_op = OP_NONE;
+  if(m_done != NULL)
+  {
+    m_done(NRF_SUCCESS);
+  }
+
+  return true;
+}
+
+void ts_flash_ram_power_cut(void)
+{
+  if(m_op != OP_NONE)
+  {
+    op_apply(m_op_len / 2);
+  }
+
+  m_op = OP_NONE;
+}
+
+void ts_flash_ram_stats_get(ts_flash_ram_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void ts_flash_ram_stats_clear(void)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
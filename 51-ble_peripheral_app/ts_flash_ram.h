@@ -0,0 +1,41 @@
+#ifndef _TS_FLASH_RAM_H
+#define _TS_FLASH_RAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ts_store.h"
+
+/* Time series flash backend on a RAM buffer, to run ts_store on a host.
+ *
+ * Behaves like NOR flash: a write can only clear bits, an erase sets a page to 0xFF. Writes and
+ * erases are only started; ts_flash_ram_process() completes the pending one, so the caller
+ * plays the flash event loop and can cut the power in the middle of an operation. The
+ * operations are counted to report the flash cost of appends and queries.
+ *
+ * No SDK dependencies.
+ */
+
+typedef struct
+{
+  uint32_t reads;
+  uint32_t read_bytes;
+  uint32_t writes;
+  uint32_t write_bytes;
+  uint32_t erases;
+} ts_flash_ram_stats_t;
+
+/* p_mem backs the flash from start_addr on, size bytes. Contents are kept */
+ts_flash_t const *ts_flash_ram_init(uint8_t *p_mem, uint32_t start_addr, uint32_t size);
+
+/* Complete the pending write or erase and report it. False if none was pending */
+bool ts_flash_ram_process(void);
+
+/* Power loss: half of the pending operation is done and it is never reported */
+void ts_flash_ram_power_cut(void);
+
+void ts_flash_ram_stats_get(ts_flash_ram_stats_t *p_stats);
+
+void ts_flash_ram_stats_clear(void);
+
+#endif /* _TS_FLASH_RAM_H */
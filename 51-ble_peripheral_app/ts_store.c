@@ -0,0 +1,517 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "app_util.h"
+#include "crc16.h"
+#include "nrf_log.h"
+
+#include "radio_sched.h"
+#include "ts_codec.h"
+#include "ts_store.h"
+
+#define BLOCK_MAGIC       0x5354    /* "TS" */
+#define BLOCKS_PER_PAGE   (TS_STORE_PAGE_SIZE / TS_STORE_BLOCK_SIZE)
+#define PAYLOAD_SIZE      (TS_STORE_BLOCK_SIZE - sizeof(block_header_t))
+#define NO_BLOCK          0xFF
+
+typedef struct
+{
+  uint16_t magic;
+  uint16_t count;       /* Points, including the first */
+  uint32_t seq;         /* Block sequence number, one up per block */
+  uint32_t t_first;
+  uint32_t t_last;
+  int32_t  v_first;
+  uint16_t len;         /* Encoded payload bytes */
+  uint16_t crc;         /* CRC-16 of the header up to here and of the payload */
+} block_header_t;
+
+typedef struct
+{
+  block_header_t hdr;
+  uint8_t        payload[TS_STORE_BLOCK_SIZE - sizeof(block_header_t)];
+} block_t;
+
+STATIC_ASSERT(sizeof(block_t) == TS_STORE_BLOCK_SIZE);
+
+/* Sparse index: time range of the valid blocks of each page */
+typedef struct
+{
+  uint32_t t_first;
+  uint32_t t_last;
+  uint8_t  blocks;
+} page_index_t;
+
+typedef enum
+{
+  FLASH_IDLE,
+  FLASH_ERASE,
+  FLASH_WRITE,
+} flash_state_t;
+
+static ts_flash_t const *mp_flash = NULL;
+static uint32_t         m_start_addr = 0;
+
+static bool          m_initialized = false;
+static uint8_t       m_pages = 0;
+static uint16_t      m_slots = 0;
+static page_index_t  m_index[TS_STORE_PAGES_MAX];
+
+static uint16_t      m_slot_next = 0;       /* Slot the next block is written to */
+static bool          m_page_erased = false; /* The page of m_slot_next is erased */
+static uint32_t      m_seq_next = 0;
+static uint32_t      m_t_last = 0;
+static bool          m_empty = true;
+
+/* Double buffering: one block is filled while the other one is written */
+static block_t       m_blocks[2];
+static uint8_t       m_open = 0;
+static bool          m_open_used = false;   /* The open block has its first point */
+static bool          m_pending = false;     /* The other block waits for its write */
+static ts_encoder_t  m_encoder;
+static block_t       m_read_block;          /* Flash blocks are read here for the scan and queries */
+
+static flash_state_t m_state = FLASH_IDLE;
+static bool          m_job_queued = false;
+
+static ts_store_stats_t m_stats;
+static uint32_t         m_written_points = 0;
+
+static uint32_t slot_addr(uint16_t slot)
+{
+  return m_start_addr + (slot * TS_STORE_BLOCK_SIZE);
+}
+
+static uint16_t block_crc(block_t const *p_block)
+{
+  uint16_t crc = crc16_compute((uint8_t const *)&p_block->hdr, offsetof(block_header_t, crc), NULL);
+
+  return crc16_compute(p_block->payload, p_block->hdr.len, &crc);
+}
+
+static bool block_valid(block_t const *p_block)
+{
+  return (p_block->hdr.magic == BLOCK_MAGIC) && (p_block->hdr.count > 0) &&
+         (p_block->hdr.len <= PAYLOAD_SIZE) && (p_block->hdr.crc == block_crc(p_block));
+}
+
+/* Whole block into m_read_block. False if it can not be read */
+static bool block_read(uint16_t slot)
+{
+  return mp_flash->read(slot_addr(slot), &m_read_block, TS_STORE_BLOCK_SIZE) == NRF_SUCCESS;
+}
+
+static bool slot_blank(uint16_t slot)
+{
+  uint32_t const *p_words = (uint32_t const *)&m_read_block;
+
+  if(!block_read(slot))
+  {
+    return false;
+  }
+
+  for(uint32_t i = 0; i < (TS_STORE_BLOCK_SIZE / sizeof(uint32_t)); i++)
+  {
+    if(p_words[i] != 0xFFFFFFFF)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void index_add(block_header_t const *p_hdr, uint8_t page)
+{
+  page_index_t *p_page = &m_index[page];
+
+  p_page->t_first = (p_page->blocks == 0) ? p_hdr->t_first : MIN(p_page->t_first, p_hdr->t_first);
+  p_page->t_last = (p_page->blocks == 0) ? p_hdr->t_last : MAX(p_page->t_last, p_hdr->t_last);
+  p_page->blocks++;
+  m_stats.stored_blocks++;
+}
+
+static void write_job(void *p_context);
+
+static void write_queue(void)
+{
+  if(m_job_queued || !m_pending || (m_state != FLASH_IDLE))
+  {
+    return;
+  }
+
+  if(radio_sched_job_put(write_job, NULL) == NRF_SUCCESS)
+  {
+    m_job_queued = true;
+  }
+}
+
+/* Seal the open block and hand it to the writer */
+static void block_close(void)
+{
+  block_t *p_block = &m_blocks[m_open];
+
+  p_block->hdr.magic = BLOCK_MAGIC;
+  p_block->hdr.count = m_encoder.count;
+  p_block->hdr.seq = m_seq_next;
+  p_block->hdr.t_last = m_encoder.t_prev;
+  p_block->hdr.len = m_encoder.len;
+  p_block->hdr.crc = block_crc(p_block);
+
+  m_pending = true;
+  m_open ^= 1;
+  m_open_used = false;
+
+  write_queue();
+}
+
+static void write_start(void)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint8_t    page = m_slot_next / BLOCKS_PER_PAGE;
+
+  if(!m_page_erased)
+  {
+    /* Entering a page: the oldest data goes */
+    m_state = FLASH_ERASE;
+    err_code = mp_flash->erase(m_start_addr + (page * TS_STORE_PAGE_SIZE));
+  }
+  else
+  {
+    m_state = FLASH_WRITE;
+    err_code = mp_flash->write(slot_addr(m_slot_next), &m_blocks[m_open ^ 1], TS_STORE_BLOCK_SIZE);
+  }
+
+  if(err_code != NRF_SUCCESS)
+  {
+    /* Backend busy, tried again with the next point */
+    m_state = FLASH_IDLE;
+  }
+}
+
+static void write_job(void *p_context)
+{
+  m_job_queued = false;
+
+  if(m_pending && (m_state == FLASH_IDLE))
+  {
+    write_start();
+  }
+}
+
+static void flash_done(ret_code_t result)
+{
+  uint8_t page = m_slot_next / BLOCKS_PER_PAGE;
+
+  if(result != NRF_SUCCESS)
+  {
+    NRF_LOG_WARNING("Time series flash operation failed, result 0x%X", result);
+    m_stats.write_errors++;
+    if(m_state == FLASH_WRITE)
+    {
+      /* Slot may be partly written, the block goes to the next one */
+      m_slot_next = (m_slot_next + 1) % m_slots;
+      m_page_erased = ((m_slot_next % BLOCKS_PER_PAGE) != 0);
+    }
+    m_state = FLASH_IDLE;
+    return;
+  }
+
+  switch(m_state)
+  {
+    case FLASH_ERASE:
+      m_stats.erases++;
+      m_stats.stored_blocks -= m_index[page].blocks;
+      memset(&m_index[page], 0, sizeof(m_index[page]));
+      m_page_erased = true;
+      m_state = FLASH_IDLE;
+
+      /* The write waits for the next radio gap too, the erase took the current one */
+      write_queue();
+      break;
+
+    case FLASH_WRITE:
+      index_add(&m_blocks[m_open ^ 1].hdr, page);
+      m_stats.blocks++;
+      m_stats.encoded_bytes += m_blocks[m_open ^ 1].hdr.len;
+      m_written_points += m_blocks[m_open ^ 1].hdr.count;
+
+      m_seq_next++;
+      m_slot_next = (m_slot_next + 1) % m_slots;
+      m_page_erased = ((m_slot_next % BLOCKS_PER_PAGE) != 0);
+      m_pending = false;
+      m_state = FLASH_IDLE;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Newest valid block, the index, and where to write next */
+static void region_scan(void)
+{
+  block_header_t newest = {0};
+  bool           found = false;
+  uint16_t       newest_slot = 0;
+
+  memset(m_index, 0, sizeof(m_index));
+
+  for(uint16_t slot = 0; slot < m_slots; slot++)
+  {
+    if(!block_read(slot) || !block_valid(&m_read_block))
+    {
+      continue;
+    }
+
+    index_add(&m_read_block.hdr, slot / BLOCKS_PER_PAGE);
+
+    if(!found || (m_read_block.hdr.seq > newest.seq))
+    {
+      newest = m_read_block.hdr;
+      newest_slot = slot;
+      found = true;
+    }
+  }
+
+  if(!found)
+  {
+    m_slot_next = 0;
+    m_page_erased = false;
+    return;
+  }
+
+  m_seq_next = newest.seq + 1;
+  m_t_last = newest.t_last;
+  m_empty = false;
+
+  m_slot_next = (newest_slot + 1) % m_slots;
+  m_page_erased = ((m_slot_next % BLOCKS_PER_PAGE) != 0);
+
+  /* Rest of the page must be blank, or a torn write is in the way: go on in the next page */
+  for(uint16_t slot = m_slot_next; m_page_erased && ((slot % BLOCKS_PER_PAGE) != 0); slot++)
+  {
+    if(!slot_blank(slot))
+    {
+      m_slot_next = (((m_slot_next / BLOCKS_PER_PAGE) + 1) * BLOCKS_PER_PAGE) % m_slots;
+      m_page_erased = false;
+    }
+  }
+}
+
+ret_code_t ts_store_init(ts_store_init_t const *p_init)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+
+  if((p_init->p_flash == NULL) || (p_init->pages < 2) || (p_init->pages > TS_STORE_PAGES_MAX) || ((p_init->end_addr % TS_STORE_PAGE_SIZE) != 0))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_written_points = 0;
+  m_seq_next = 0;
+  m_t_last = 0;
+  m_empty = true;
+  m_open_used = false;
+  m_pending = false;
+  m_state = FLASH_IDLE;
+  m_job_queued = false;
+
+  m_pages = p_init->pages;
+  m_slots = m_pages * BLOCKS_PER_PAGE;
+
+  mp_flash = p_init->p_flash;
+  m_start_addr = p_init->end_addr - (m_pages * TS_STORE_PAGE_SIZE);
+
+  err_code = mp_flash->init(m_start_addr, p_init->end_addr, flash_done);
+  if(err_code != NRF_SUCCESS)
+  {
+    return err_code;
+  }
+
+  region_scan();
+  m_initialized = true;
+
+  NRF_LOG_INFO("Time series at 0x%X: %u blocks, next slot %u, last time %u",
+               m_start_addr, m_stats.stored_blocks, m_slot_next, m_t_last);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t ts_store_append(uint32_t t, int32_t v)
+{
+  if(!m_initialized)
+  {
+    return NRF_ERROR_INVALID_STATE;
+  }
+
+  if(!m_empty && (t < m_t_last))
+  {
+    m_stats.dropped++;
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  if(m_open_used && !ts_encode(&m_encoder, t, v))
+  {
+    if(m_pending)
+    {
+      /* Writes fall behind the sample rate */
+      m_stats.dropped++;
+      write_queue();
+      return NRF_ERROR_NO_MEM;
+    }
+
+    block_close();
+  }
+
+  if(!m_open_used)
+  {
+    block_t *p_block = &m_blocks[m_open];
+
+    p_block->hdr.t_first = t;
+    p_block->hdr.v_first = v;
+    ts_encoder_init(&m_encoder, p_block->payload, PAYLOAD_SIZE, t, v);
+    m_open_used = true;
+  }
+
+  m_t_last = t;
+  m_empty = false;
+  m_stats.points++;
+
+  /* Retry of a write the backend did not take */
+  write_queue();
+
+  return NRF_SUCCESS;
+}
+
+void ts_store_flush(void)
+{
+  if(m_open_used && !m_pending)
+  {
+    block_close();
+  }
+}
+
+/* Points of one block in the range. False when the handler stopped the query */
+static bool block_query(block_t const *p_block, uint16_t count, uint32_t t_from, uint32_t t_to,
+                        ts_store_query_handler_t handler, void *p_context, uint32_t *p_found)
+{
+  ts_decoder_t decoder;
+  uint32_t     t = 0;
+  int32_t      v = 0;
+
+  if((count == 0) || (p_block->hdr.t_first > t_to))
+  {
+    return true;
+  }
+
+  ts_decoder_init(&decoder, p_block->payload, PAYLOAD_SIZE, count, p_block->hdr.t_first, p_block->hdr.v_first);
+  while(ts_decode(&decoder, &t, &v) && (t <= t_to))
+  {
+    if(t < t_from)
+    {
+      continue;
+    }
+
+    (*p_found)++;
+    if(!handler(t, v, p_context))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint32_t ts_store_query(uint32_t t_from, uint32_t t_to, ts_store_query_handler_t handler, void *p_context)
+{
+  uint32_t found = 0;
+  block_t  *p_pending = &m_blocks[m_open ^ 1];
+
+  if(!m_initialized)
+  {
+    return 0;
+  }
+
+  /* Oldest first: the ring starts at the next slot to write */
+  for(uint16_t i = 0; i < m_slots; i++)
+  {
+    uint16_t           slot = (m_slot_next + i) % m_slots;
+    page_index_t const *p_page = &m_index[slot / BLOCKS_PER_PAGE];
+    block_t            *p_block = &m_read_block;
+
+    if((p_page->blocks == 0) || (p_page->t_last < t_from) || (p_page->t_first > t_to))
+    {
+      /* Skip the rest of the page */
+      i += (BLOCKS_PER_PAGE - 1) - (slot % BLOCKS_PER_PAGE);
+      continue;
+    }
+
+    /* The header first, the payload only for blocks in the range */
+    if(mp_flash->read(slot_addr(slot), &p_block->hdr, sizeof(block_header_t)) != NRF_SUCCESS)
+    {
+      continue;
+    }
+
+    if((p_block->hdr.magic != BLOCK_MAGIC) || (p_block->hdr.t_last < t_from) ||
+       (p_block->hdr.len > PAYLOAD_SIZE))
+    {
+      continue;
+    }
+
+    /* Written, but the completion is not handled yet: served from RAM below */
+    if(m_pending && (p_block->hdr.seq >= p_pending->hdr.seq))
+    {
+      continue;
+    }
+
+    if((mp_flash->read(slot_addr(slot) + sizeof(block_header_t), p_block->payload, p_block->hdr.len) != NRF_SUCCESS) ||
+       !block_valid(p_block))
+    {
+      continue;
+    }
+
+    if(!block_query(p_block, p_block->hdr.count, t_from, t_to, handler, p_context, &found))
+    {
+      return found;
+    }
+  }
+
+  if(m_pending && (p_pending->hdr.t_last >= t_from))
+  {
+    if(!block_query(p_pending, p_pending->hdr.count, t_from, t_to, handler, p_context, &found))
+    {
+      return found;
+    }
+  }
+
+  if(m_open_used)
+  {
+    (void)block_query(&m_blocks[m_open], m_encoder.count, t_from, t_to, handler, p_context, &found);
+  }
+
+  return found;
+}
+
+uint32_t ts_store_last_time_get(void)
+{
+  return m_t_last;
+}
+
+void ts_store_stats_get(ts_store_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void ts_store_stats_log(void)
+{
+  /* Compression against 8 byte raw points, x100 */
+  uint32_t ratio = (m_stats.blocks > 0) ?
+                   (uint32_t)(((uint64_t)m_written_points * 8 * 100) / (m_stats.blocks * TS_STORE_BLOCK_SIZE)) : 0;
+
+  NRF_LOG_INFO("Time series: %u points (%u dropped), %u blocks written, %u stored, %u erases",
+               m_stats.points, m_stats.dropped, m_stats.blocks, m_stats.stored_blocks, m_stats.erases);
+  NRF_LOG_INFO("Time series: %u.%02u x smaller than raw, %u write errors",
+               ratio / 100, ratio % 100, m_stats.write_errors);
+}
@@ -0,0 +1,87 @@
+#ifndef _TS_STORE_H
+#define _TS_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Append-only time-series store in internal flash.
+ *
+ * Points (time, value) are delta encoded (ts_codec) into a 256 byte block in RAM. A full block
+ * gets a header with its sequence number, time range, first point and a CRC, and is written to
+ * the next block slot with a single flash write, right after a radio event (radio_sched). The
+ * slots form a ring over the region: a page is erased just before its first block is written,
+ * which drops the oldest page, so all the pages see the same number of erase cycles. Erase and
+ * write are both started from radio_sched jobs.
+ *
+ * Flash is accessed through a ts_flash_t: ts_flash_fs (nrf_fstorage_sd) on the target,
+ * ts_flash_ram for host builds.
+ *
+ * Power loss costs the block being filled. A torn write fails the CRC and is skipped; the scan
+ * at init continues after the newest valid block. A RAM index of the time range per page lets
+ * queries skip pages, and the block headers let them skip blocks without decoding.
+ *
+ * Times must not decrease, also across resets: continue from ts_store_last_time_get().
+ */
+
+#define TS_STORE_PAGE_SIZE      4096
+#define TS_STORE_BLOCK_SIZE     256
+#define TS_STORE_PAGES_MAX      32
+
+/* Completion of a write or an erase, from the backend's event context */
+typedef void (*ts_flash_done_t)(ret_code_t result);
+
+/* Flash backend. Reads complete on return; write and erase are started and report done() */
+typedef struct
+{
+  char const *p_name;
+  ret_code_t (*init)(uint32_t start_addr, uint32_t end_addr, ts_flash_done_t done);
+  ret_code_t (*read)(uint32_t addr, void *p_dest, uint32_t len);
+  ret_code_t (*write)(uint32_t addr, void const *p_src, uint32_t len);
+  ret_code_t (*erase)(uint32_t page_addr);    /* One TS_STORE_PAGE_SIZE page */
+} ts_flash_t;
+
+/* Called for each point in the range, oldest first. Return false to stop */
+typedef bool (*ts_store_query_handler_t)(uint32_t t, int32_t v, void *p_context);
+
+typedef struct
+{
+  ts_flash_t const *p_flash;
+  uint32_t         end_addr;  /* Region end, page aligned. The region is right below it */
+  uint8_t          pages;     /* 2 - TS_STORE_PAGES_MAX */
+} ts_store_init_t;
+
+typedef struct
+{
+  uint32_t points;            /* Appended since init */
+  uint32_t dropped;           /* Block write still pending, or times out of order */
+  uint32_t blocks;            /* Blocks written */
+  uint32_t encoded_bytes;     /* Payload bytes of the written blocks */
+  uint32_t erases;
+  uint32_t write_errors;
+  uint32_t stored_blocks;     /* Valid blocks in flash */
+} ts_store_stats_t;
+
+/* Call with the backend ready (SoftDevice enabled for ts_flash_fs). Scans the region for the newest block */
+ret_code_t ts_store_init(ts_store_init_t const *p_init);
+
+/* NRF_ERROR_INVALID_PARAM: t lower than the last time. NRF_ERROR_NO_MEM: dropped, the
+ * previous block is still being written
+ */
+ret_code_t ts_store_append(uint32_t t, int32_t v);
+
+/* Close the block being filled, e.g. before a planned power down */
+void ts_store_flush(void);
+
+/* Points with t_from <= t <= t_to, from flash and from the blocks in RAM. Returns the count */
+uint32_t ts_store_query(uint32_t t_from, uint32_t t_to, ts_store_query_handler_t handler, void *p_context);
+
+/* Time of the newest point, 0 if the store is empty */
+uint32_t ts_store_last_time_get(void);
+
+void ts_store_stats_get(ts_store_stats_t *p_stats);
+
+void ts_store_stats_log(void);
+
+#endif /* _TS_STORE_H */
@@ -0,0 +1,254 @@
+#include <string.h>
+
+#include "app_util.h"
+#include "ble_conn_state.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "tx_power_ctrl.h"
+
+/* RSSI events on a 2 dB change, after 4 samples over the threshold */
+#define TX_POWER_CTRL_RSSI_THRESHOLD_DB   2
+#define TX_POWER_CTRL_RSSI_SKIP_COUNT     4
+
+/* RSSI filter in 1/8 dB, new samples weigh 1/4 */
+#define TX_POWER_CTRL_FILTER_SHIFT        2
+#define TX_POWER_CTRL_FILTER_SCALE        8
+
+typedef struct
+{
+  uint16_t conn_handle;
+  int16_t  rssi_filtered;   /* 1/8 dB, valid once sampled */
+  bool     sampled;
+  bool     coded;           /* Receiving on Coded PHY */
+  int8_t   level_dbm;
+} link_power_t;
+
+/* nRF52840 radio output levels, ascending */
+static const int8_t m_levels[] = { -40, -20, -16, -12, -8, -4, 0, 2, 3, 4, 5, 6, 7, 8 };
+
+static tx_power_ctrl_init_t m_config;
+static bool                 m_initialized = false;
+static link_power_t         m_links[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+static tx_power_ctrl_stats_t m_stats;
+
+static link_power_t *link_get(uint16_t conn_handle)
+{
+  uint16_t idx = ble_conn_state_conn_idx(conn_handle);
+
+  if(idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT)
+  {
+    return NULL;
+  }
+
+  return &m_links[idx];
+}
+
+static bool level_supported(int8_t level_dbm)
+{
+  for(uint8_t i = 0; i < ARRAY_SIZE(m_levels); i++)
+  {
+    if(m_levels[i] == level_dbm)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Lowest supported level at or above required_dbm, capped to the maximum */
+static int8_t level_for(int16_t required_dbm)
+{
+  for(uint8_t i = 0; i < ARRAY_SIZE(m_levels); i++)
+  {
+    if((m_levels[i] >= required_dbm) || (m_levels[i] >= m_config.max_dbm))
+    {
+      return MIN(m_levels[i], m_config.max_dbm);
+    }
+  }
+
+  return m_config.max_dbm;
+}
+
+static void level_set(link_power_t *p_link, int8_t level_dbm)
+{
+  ret_code_t err_code = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, p_link->conn_handle, level_dbm);
+
+  if(err_code != NRF_SUCCESS)
+  {
+    /* Link is going down */
+    NRF_LOG_WARNING("Link 0x%04X: TX power not set, error 0x%X", p_link->conn_handle, err_code);
+    return;
+  }
+
+  NRF_LOG_INFO("Link 0x%04X: TX power %d dBm -> %d dBm (RSSI %d dBm)", p_link->conn_handle,
+               p_link->level_dbm, level_dbm, p_link->rssi_filtered / TX_POWER_CTRL_FILTER_SCALE);
+
+  p_link->level_dbm = level_dbm;
+  m_stats.changes++;
+  m_stats.min_dbm = MIN(m_stats.min_dbm, level_dbm);
+}
+
+static void on_rssi(link_power_t *p_link, int8_t rssi)
+{
+  int16_t sample = rssi * TX_POWER_CTRL_FILTER_SCALE;
+  int16_t target = m_config.target_rssi_dbm - (p_link->coded ? m_config.coded_gain_db : 0);
+  int16_t required = 0;
+  int8_t  level = 0;
+
+  m_stats.samples++;
+
+  if(p_link->sampled)
+  {
+    p_link->rssi_filtered += (sample - p_link->rssi_filtered) / (1 << TX_POWER_CTRL_FILTER_SHIFT);
+  }
+  else
+  {
+    p_link->rssi_filtered = sample;
+    p_link->sampled = true;
+  }
+
+  /* The central hears us at rssi - (max - level): keep that at or above the target */
+  required = m_config.max_dbm - (p_link->rssi_filtered / TX_POWER_CTRL_FILTER_SCALE) + target;
+
+  level = level_for(required);
+  if(level > p_link->level_dbm)
+  {
+    level_set(p_link, level);
+    return;
+  }
+
+  level = level_for(required + m_config.hysteresis_db);
+  if(level < p_link->level_dbm)
+  {
+    level_set(p_link, level);
+  }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  ret_code_t err_code = NRF_SUCCESS;
+  uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+  link_power_t *p_link = NULL;
+
+  if(!m_initialized)
+  {
+    return;
+  }
+
+  p_link = link_get(conn_handle);
+  if(p_link == NULL)
+  {
+    return;
+  }
+
+  switch(p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      if(p_ble_evt->evt.gap_evt.params.connected.role != BLE_GAP_ROLE_PERIPH)
+      {
+        break;
+      }
+
+      memset(p_link, 0, sizeof(link_power_t));
+      p_link->conn_handle = conn_handle;
+      p_link->level_dbm = m_config.max_dbm;
+
+      err_code = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, conn_handle, m_config.max_dbm);
+      if(err_code == NRF_SUCCESS)
+      {
+        err_code = sd_ble_gap_rssi_start(conn_handle, TX_POWER_CTRL_RSSI_THRESHOLD_DB, TX_POWER_CTRL_RSSI_SKIP_COUNT);
+      }
+      if(err_code != NRF_SUCCESS)
+      {
+        NRF_LOG_WARNING("Link 0x%04X: TX power control not started, error 0x%X", conn_handle, err_code);
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+      }
+      break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+      break;
+
+    case BLE_GAP_EVT_PHY_UPDATE:
+      if(p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+      {
+        p_link->coded = (p_ble_evt->evt.gap_evt.params.phy_update.rx_phy == BLE_GAP_PHY_CODED);
+      }
+      break;
+
+    case BLE_GAP_EVT_RSSI_CHANGED:
+      if(p_link->conn_handle == conn_handle)
+      {
+        on_rssi(p_link, p_ble_evt->evt.gap_evt.params.rssi_changed.rssi);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(m_tx_power_ctrl_observer, TX_POWER_CTRL_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+ret_code_t tx_power_ctrl_init(tx_power_ctrl_init_t const *p_init)
+{
+  if(p_init == NULL)
+  {
+    return NRF_ERROR_NULL;
+  }
+
+  if(!level_supported(p_init->max_dbm))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  m_config = *p_init;
+
+  for(uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+  {
+    m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+  }
+
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_stats.min_dbm = m_config.max_dbm;
+  m_initialized = true;
+
+  return NRF_SUCCESS;
+}
+
+int8_t tx_power_ctrl_level_get(uint16_t conn_handle)
+{
+  link_power_t *p_link = link_get(conn_handle);
+
+  if((p_link == NULL) || (p_link->conn_handle != conn_handle))
+  {
+    return m_config.max_dbm;
+  }
+
+  return p_link->level_dbm;
+}
+
+void tx_power_ctrl_phy_set(uint16_t conn_handle, uint8_t rx_phy)
+{
+  link_power_t *p_link = link_get(conn_handle);
+
+  if((p_link == NULL) || (p_link->conn_handle != conn_handle))
+  {
+    return;
+  }
+
+  p_link->coded = (rx_phy == BLE_GAP_PHY_CODED);
+}
+
+void tx_power_ctrl_stats_get(tx_power_ctrl_stats_t *p_stats)
+{
+  *p_stats = m_stats;
+}
+
+void tx_power_ctrl_stats_log(void)
+{
+  NRF_LOG_INFO("TX power control: %u changes over %u RSSI samples, lowest %d dBm",
+               m_stats.changes, m_stats.samples, m_stats.min_dbm);
+}
@@ -0,0 +1,50 @@
+#ifndef _TX_POWER_CTRL_H
+#define _TX_POWER_CTRL_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+/* Per-link TX power control from the RSSI of the central.
+ *
+ * Each peripheral link samples RSSI (sd_ble_gap_rssi_start) and filters it. Assuming a symmetric
+ * path and a central transmitting at about our maximum level, the central hears us
+ * (max_dbm - level) dB below our RSSI reading. The lowest supported level that keeps it above
+ * the target is used: lowered once the margin exceeds the hysteresis, raised as soon as the
+ * margin drops. Links on Coded PHY use a lower target (better receiver sensitivity).
+ *
+ * Links start at max_dbm, the level the advertising uses.
+ */
+
+#define TX_POWER_CTRL_BLE_OBSERVER_PRIO   2   /* Before the application observer */
+
+typedef struct
+{
+  int8_t  max_dbm;            /* Highest level, also the starting level */
+  int8_t  target_rssi_dbm;    /* Wanted level at the central on 1M/2M PHY */
+  int8_t  coded_gain_db;      /* Target reduction on Coded PHY */
+  uint8_t hysteresis_db;      /* Extra margin needed before lowering */
+} tx_power_ctrl_init_t;
+
+typedef struct
+{
+  uint32_t changes;         /* Level changes on all links */
+  uint32_t samples;         /* RSSI samples on all links */
+  int8_t   min_dbm;         /* Lowest level used */
+} tx_power_ctrl_stats_t;
+
+ret_code_t tx_power_ctrl_init(tx_power_ctrl_init_t const *p_init);
+
+/* Current level of a link. max_dbm for unknown links */
+int8_t tx_power_ctrl_level_get(uint16_t conn_handle);
+
+/* PHY a link receives on, for the PHYs not reported by BLE_GAP_EVT_PHY_UPDATE: the one
+ * the connection was established on and the one answered to a PHY update request.
+ */
+void tx_power_ctrl_phy_set(uint16_t conn_handle, uint8_t rx_phy);
+
+void tx_power_ctrl_stats_get(tx_power_ctrl_stats_t *p_stats);
+
+void tx_power_ctrl_stats_log(void);
+
+#endif /* _TX_POWER_CTRL_H */
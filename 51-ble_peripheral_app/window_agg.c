@@ -0,0 +1,213 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "window_agg.h"
+
+static void pane_clear(window_agg_pane_t *p_pane)
+{
+  memset(p_pane, 0, sizeof(*p_pane));
+  p_pane->min = INT16_MAX;
+  p_pane->max = INT16_MIN;
+}
+
+static uint8_t bin_index(window_agg_t const *p_agg, int16_t value)
+{
+  int32_t offset = (int32_t)value - p_agg->config.hist_min;
+
+  if(offset < 0)
+  {
+    return 0;
+  }
+
+  offset /= p_agg->bin_width;
+
+  return (offset >= WINDOW_AGG_BINS) ? (WINDOW_AGG_BINS - 1) : (uint8_t)offset;
+}
+
+/* Value below which pct percent of the window lies */
+static int16_t percentile(window_agg_t const *p_agg, uint32_t const *p_hist, uint32_t count,
+                          uint8_t pct, int16_t min, int16_t max)
+{
+  uint32_t rank = ((count * pct) + 99) / 100;   /* 1 based */
+  uint32_t below = 0;
+  int32_t  value = max;
+
+  if(rank == 0)
+  {
+    rank = 1;
+  }
+
+  for(uint8_t bin = 0; bin < WINDOW_AGG_BINS; bin++)
+  {
+    if((below + p_hist[bin]) >= rank)
+    {
+      value = (int32_t)p_agg->config.hist_min + ((int32_t)bin * p_agg->bin_width) +
+              (int32_t)((((rank - below) * p_agg->bin_width) - 1) / p_hist[bin]);
+      break;
+    }
+    below += p_hist[bin];
+  }
+
+  /* The end bins also hold the samples outside the range */
+  if(value < min)
+  {
+    value = min;
+  }
+  if(value > max)
+  {
+    value = max;
+  }
+
+  return (int16_t)value;
+}
+
+static void window_close(window_agg_t *p_agg)
+{
+  window_agg_summary_t summary = {0};
+  uint32_t             hist[WINDOW_AGG_BINS] = {0};
+  int64_t              sum = 0;
+  int64_t              sum_sq = 0;
+  uint32_t             count = 0;
+  int16_t              min = INT16_MAX;
+  int16_t              max = INT16_MIN;
+
+  for(uint8_t i = 0; i < p_agg->panes_full; i++)
+  {
+    window_agg_pane_t const *p_pane = &p_agg->panes[i];
+
+    count += p_pane->count;
+    sum += p_pane->sum;
+    sum_sq += p_pane->sum_sq;
+    min = (p_pane->min < min) ? p_pane->min : min;
+    max = (p_pane->max > max) ? p_pane->max : max;
+
+    for(uint8_t bin = 0; bin < WINDOW_AGG_BINS; bin++)
+    {
+      hist[bin] += p_pane->hist[bin];
+    }
+  }
+
+  summary.seq = p_agg->seq++;
+  summary.count = (uint16_t)count;
+  summary.min = min;
+  summary.max = max;
+  summary.mean = (int16_t)(sum / (int64_t)count);
+  /* n * sum_sq - sum^2 stays below 2^59 with WINDOW_AGG_LEN_MAX */
+  summary.variance = (uint32_t)((((int64_t)count * sum_sq) - (sum * sum)) / ((int64_t)count * count));
+  summary.p50 = percentile(p_agg, hist, count, 50, min, max);
+  summary.p90 = percentile(p_agg, hist, count, 90, min, max);
+  summary.p99 = percentile(p_agg, hist, count, 99, min, max);
+
+  p_agg->summary_handler(&summary, p_agg->p_context);
+}
+
+static void level_update(window_agg_t *p_agg, int16_t value)
+{
+  window_agg_config_t const *p_config = &p_agg->config;
+  window_agg_level_t        level = p_agg->level;
+  window_agg_event_t        event = {0};
+
+  if(value > p_config->high)
+  {
+    level = WINDOW_AGG_LEVEL_HIGH;
+  }
+  else if(value < p_config->low)
+  {
+    level = WINDOW_AGG_LEVEL_LOW;
+  }
+  else if(((level == WINDOW_AGG_LEVEL_HIGH) && (value <= ((int32_t)p_config->high - p_config->hysteresis))) ||
+          ((level == WINDOW_AGG_LEVEL_LOW) && (value >= ((int32_t)p_config->low + p_config->hysteresis))))
+  {
+    level = WINDOW_AGG_LEVEL_NORMAL;
+  }
+
+  if(level == p_agg->level)
+  {
+    return;
+  }
+
+  p_agg->level = level;
+
+  event.sample = p_agg->samples;
+  event.value = value;
+  event.level = level;
+  p_agg->event_handler(&event, p_agg->p_context);
+}
+
+bool window_agg_config_check(window_agg_config_t const *p_config)
+{
+  return (p_config->pane_len != 0) &&
+         (p_config->panes != 0) && (p_config->panes <= WINDOW_AGG_PANES_MAX) &&
+         (((uint32_t)p_config->pane_len * p_config->panes) <= WINDOW_AGG_LEN_MAX) &&
+         (p_config->hist_max > p_config->hist_min) &&
+         (p_config->high > p_config->low) &&
+         (((int32_t)p_config->high - p_config->hysteresis) >= p_config->low);
+}
+
+bool window_agg_init(window_agg_t *p_agg, window_agg_config_t const *p_config,
+                     window_agg_summary_handler_t summary_handler, window_agg_event_handler_t event_handler,
+                     void *p_context)
+{
+  if((summary_handler == NULL) || (event_handler == NULL) || !window_agg_config_check(p_config))
+  {
+    return false;
+  }
+
+  p_agg->config = *p_config;
+  p_agg->summary_handler = summary_handler;
+  p_agg->event_handler = event_handler;
+  p_agg->p_context = p_context;
+  p_agg->pane = 0;
+  p_agg->panes_full = 0;
+  p_agg->seq = 0;
+  p_agg->samples = 0;
+  p_agg->level = WINDOW_AGG_LEVEL_NORMAL;
+  p_agg->bin_width = (uint16_t)((((int32_t)p_config->hist_max - p_config->hist_min) / WINDOW_AGG_BINS) + 1);
+
+  pane_clear(&p_agg->panes[0]);
+
+  return true;
+}
+
+void window_agg_put(window_agg_t *p_agg, int16_t const *p_samples, uint16_t count, uint8_t stride)
+{
+  window_agg_config_t const *p_config = &p_agg->config;
+
+  for(uint16_t i = 0; i < count; i++)
+  {
+    window_agg_pane_t *p_pane = &p_agg->panes[p_agg->pane];
+    int16_t           value = p_samples[i * stride];
+
+    p_pane->count++;
+    p_pane->sum += value;
+    p_pane->sum_sq += (int32_t)value * value;
+    p_pane->min = (value < p_pane->min) ? value : p_pane->min;
+    p_pane->max = (value > p_pane->max) ? value : p_pane->max;
+    p_pane->hist[bin_index(p_agg, value)]++;
+
+    if(p_config->outputs & WINDOW_AGG_OUT_EVENTS)
+    {
+      level_update(p_agg, value);
+    }
+    p_agg->samples++;
+
+    if(p_pane->count < p_config->pane_len)
+    {
+      continue;
+    }
+
+    /* Pane full: the window over the last panes panes closes, the oldest pane is reused */
+    if(p_agg->panes_full < p_config->panes)
+    {
+      p_agg->panes_full++;
+    }
+
+    if(p_config->outputs & WINDOW_AGG_OUT_SUMMARY)
+    {
+      window_close(p_agg);
+    }
+
+    p_agg->pane = (p_agg->pane + 1) % p_config->panes;
+    pane_clear(&p_agg->panes[p_agg->pane]);
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef _WINDOW_AGG_H
+#define _WINDOW_AGG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Windowed aggregation of a sample stream, so that only summaries and threshold crossings go
+ * over the air instead of every sample.
+ *
+ * The stream is cut into panes of pane_len samples. Each full pane closes a window over the
+ * last panes panes: one pane is a tumbling window, more panes slide the window by pane_len.
+ * A pane keeps count, min, max, sum, sum of squares and a histogram, so that a window is
+ * merged from its panes in fixed memory. Percentiles come from the merged histogram, with
+ * linear interpolation inside a bin: accurate to about (hist_max - hist_min) / WINDOW_AGG_BINS.
+ *
+ * Threshold events are per sample, with hysteresis: one event per level change.
+ *
+ * No SDK dependencies, the aggregation can be built and exercised on a host.
+ */
+
+#define WINDOW_AGG_PANES_MAX    8
+#define WINDOW_AGG_BINS         32
+#define WINDOW_AGG_LEN_MAX      16384   /* Samples per window, keeps the variance in 64 bits */
+
+#define WINDOW_AGG_OUT_SUMMARY  0x01
+#define WINDOW_AGG_OUT_EVENTS   0x02
+
+typedef struct
+{
+  uint16_t pane_len;      /* Samples between summaries */
+  uint8_t  panes;         /* Window of panes * pane_len samples. 1: tumbling */
+  uint8_t  outputs;       /* WINDOW_AGG_OUT_* */
+  int16_t  hist_min;      /* Percentile range, samples outside count in the end bins */
+  int16_t  hist_max;
+  int16_t  high;          /* Threshold levels */
+  int16_t  low;
+  uint16_t hysteresis;    /* Distance back inside a level before it is left */
+} window_agg_config_t;
+
+typedef struct
+{
+  uint16_t seq;           /* Window number, wraps */
+  uint16_t count;         /* Samples in the window, less than the full window while it fills */
+  int16_t  min;
+  int16_t  max;
+  int16_t  mean;
+  uint32_t variance;      /* Population variance, in sample units squared */
+  int16_t  p50;
+  int16_t  p90;
+  int16_t  p99;
+} window_agg_summary_t;
+
+typedef enum
+{
+  WINDOW_AGG_LEVEL_NORMAL,
+  WINDOW_AGG_LEVEL_HIGH,
+  WINDOW_AGG_LEVEL_LOW,
+} window_agg_level_t;
+
+typedef struct
+{
+  uint32_t           sample;    /* Index since the configuration */
+  int16_t            value;
+  window_agg_level_t level;     /* Level entered */
+} window_agg_event_t;
+
+typedef void (*window_agg_summary_handler_t)(window_agg_summary_t const *p_summary, void *p_context);
+typedef void (*window_agg_event_handler_t)(window_agg_event_t const *p_event, void *p_context);
+
+typedef struct
+{
+  uint16_t count;
+  int16_t  min;
+  int16_t  max;
+  int32_t  sum;
+  int64_t  sum_sq;
+  uint16_t hist[WINDOW_AGG_BINS];
+} window_agg_pane_t;
+
+typedef struct
+{
+  window_agg_config_t          config;
+  window_agg_summary_handler_t summary_handler;
+  window_agg_event_handler_t   event_handler;
+  void                         *p_context;
+  window_agg_pane_t            panes[WINDOW_AGG_PANES_MAX];
+  uint8_t                      pane;          /* Filling */
+  uint8_t                      panes_full;
+  uint16_t                     bin_width;
+  uint16_t                     seq;
+  uint32_t                     samples;
+  window_agg_level_t           level;
+} window_agg_t;
+
+bool window_agg_config_check(window_agg_config_t const *p_config);
+
+/* Starts over with empty windows. Returns false on a bad configuration */
+bool window_agg_init(window_agg_t *p_agg, window_agg_config_t const *p_config,
+                     window_agg_summary_handler_t summary_handler, window_agg_event_handler_t event_handler,
+                     void *p_context);
+
+/* count samples, stride apart: one channel of an interleaved buffer */
+void window_agg_put(window_agg_t *p_agg, int16_t const *p_samples, uint16_t count, uint8_t stride);
+
+#endif /* _WINDOW_AGG_H */